@@ -0,0 +1,243 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+
+// Times the protobuf paths every driver call and callback goes through -
+// serializing a message into a callback binary as pb_obj_to_binary does,
+// parsing one binary with deserialize<T> in utils.hpp, and parsing a list
+// of encoded binaries into a batch as batch_call.cpp does - on message
+// shapes taken from large clusters. The erlang side of the same paths,
+// and the whole batch path from erlang terms, is timed by
+// test/mesos_bench.erl.
+//
+// Each result is a line of csv on stdout, in the same columns as
+// mesos_bench:run/0 prints, so runs at two commits can be diffed or
+// loaded into a spreadsheet:
+//
+//   name,items,bytes,iterations,ns_per_item,allocs_per_item
+//
+// usage: pb_bench [min_seconds_per_case]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "erl_nif.h"
+#include "erlang_mesos.hpp"
+#include "mesos/mesos.pb.h"
+#include "utils.hpp"
+
+using namespace mesos;
+using namespace std;
+
+// every heap allocation the process makes, protobuf's included
+static atomic<unsigned long> allocations(0);
+
+void* operator new(size_t size)
+{
+  allocations++;
+  void* p = malloc(size > 0 ? size : 1);
+  if(p == NULL) { throw bad_alloc(); }
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+static double min_seconds = 0.5;
+
+static void add_scalar(Resource* resource, const string& name, double value)
+{
+  resource->set_name(name);
+  resource->set_type(Value::SCALAR);
+  resource->mutable_scalar()->set_value(value);
+  resource->set_role("*");
+}
+
+// an offer from a slave with many custom resources, one in ten a set of port ranges
+static Offer make_offer(int resources)
+{
+  Offer offer;
+  offer.mutable_id()->set_value("20150924-000000-16777343-5050-1234-O123456");
+  offer.mutable_framework_id()->set_value("20150924-000000-16777343-5050-1234-0000");
+  offer.mutable_slave_id()->set_value("20150924-000000-16777343-5050-1234-S42");
+  offer.set_hostname("slave-42.rack-7.example.com");
+
+  for(int i = 0; i < resources; i++)
+  {
+    Resource* resource = offer.add_resources();
+    if(i % 10 != 0)
+    {
+      add_scalar(resource, "resource-" + to_string(i), i * 1.5);
+      continue;
+    }
+
+    resource->set_name("ports");
+    resource->set_type(Value::RANGES);
+    resource->set_role("*");
+    for(int j = 0; j < 10; j++)
+    {
+      Value::Range* range = resource->mutable_ranges()->add_range();
+      range->set_begin(31000 + j * 100);
+      range->set_end(31000 + j * 100 + 49);
+    }
+  }
+
+  for(int i = 0; i < 5; i++)
+  {
+    Attribute* attribute = offer.add_attributes();
+    attribute->set_name("attribute-" + to_string(i));
+    attribute->set_type(Value::TEXT);
+    attribute->mutable_text()->set_value("value-" + to_string(i));
+  }
+  return offer;
+}
+
+static TaskInfo make_task_info(size_t dataSize)
+{
+  TaskInfo task;
+  task.set_name("task-with-data");
+  task.mutable_task_id()->set_value("task-0123456789");
+  task.mutable_slave_id()->set_value("20150924-000000-16777343-5050-1234-S42");
+  add_scalar(task.add_resources(), "cpus", 0.5);
+  add_scalar(task.add_resources(), "mem", 512);
+  task.mutable_command()->set_value("./run-task --with --some --arguments");
+  task.set_data(string(dataSize, 'd'));
+  return task;
+}
+
+static TaskStatus make_task_status()
+{
+  TaskStatus status;
+  status.mutable_task_id()->set_value("task-0123456789");
+  status.set_state(TASK_RUNNING);
+  status.mutable_slave_id()->set_value("20150924-000000-16777343-5050-1234-S42");
+  return status;
+}
+
+// runs op, which handles items items, with doubling iteration counts until it
+// takes at least min_seconds and prints the result
+template<typename Op>
+static void run(const string& name, size_t items, size_t bytes, Op op)
+{
+  typedef chrono::steady_clock Clock;
+
+  op();
+
+  for(unsigned long iterations = 1; ; iterations *= 2)
+  {
+    unsigned long allocated = allocations;
+    Clock::time_point start = Clock::now();
+    for(unsigned long i = 0; i < iterations; i++)
+    {
+      op();
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    allocated = allocations - allocated;
+
+    if(seconds >= min_seconds)
+    {
+      double total = static_cast<double>(iterations) * items;
+      printf("%s,%zu,%zu,%lu,%.1f,%.2f\n",
+             name.c_str(), items, bytes, iterations, seconds * 1e9 / total, allocated / total);
+      fflush(stdout);
+      return;
+    }
+  }
+}
+
+// pb_obj_to_binary without the erlang binary
+template<typename T>
+static void bench_serialize(const string& name, const T& obj)
+{
+  vector<unsigned char> buffer(obj.ByteSize());
+  run("serialize_" + name, 1, buffer.size(), [&]() {
+    buffer.resize(obj.ByteSize());
+    obj.SerializeWithCachedSizesToArray(&buffer[0]);
+  });
+}
+
+template<typename T>
+static void bench_deserialize(const string& name, const T& obj)
+{
+  string bytes = obj.SerializeAsString();
+  run("deserialize_" + name, 1, bytes.size(), [&]() {
+    T parsed;
+    deserialize<T>(parsed, (void*) bytes.data(), bytes.size());
+  });
+}
+
+// the batch launchTasks, requestResources and reconcileTasks build, on
+// batches of copies of obj passed already encoded: batch_call_make reserves
+// the vector, and batch_call_add parses each item in place as pb_term_to_obj
+// does a binary. Inspecting the terms needs the vm, see mesos_bench
+template<typename T>
+static void bench_batch_call(const string& name, const T& obj, size_t count)
+{
+  string bytes = obj.SerializeAsString();
+
+  run("batch_call_" + name, count, bytes.size() * count, [&]() {
+    vector<T> parsed;
+    parsed.reserve(count);
+    for(size_t i = 0; i < count; i++)
+    {
+      parsed.push_back(T());
+      if(!parsed.back().ParsePartialFromArray(bytes.data(), bytes.size()) ||
+         !parsed.back().IsInitialized()) { abort(); }
+    }
+  });
+}
+
+int main(int argc, char** argv)
+{
+  if(argc > 1) { min_seconds = atof(argv[1]); }
+
+  Offer offer = make_offer(50);
+  TaskInfo smallTask = make_task_info(1024);
+  TaskInfo largeTask = make_task_info(1024 * 1024);
+  TaskStatus status = make_task_status();
+
+  printf("name,items,bytes,iterations,ns_per_item,allocs_per_item\n");
+
+  bench_serialize("offer_50_resources", offer);
+  bench_serialize("task_info_1k_data", smallTask);
+  bench_serialize("task_info_1m_data", largeTask);
+  bench_serialize("task_status", status);
+
+  bench_deserialize("offer_50_resources", offer);
+  bench_deserialize("task_info_1m_data", largeTask);
+
+  size_t batches[] = { 1, 10, 100, 1000, 10000 };
+  for(size_t i = 0; i < sizeof(batches) / sizeof(batches[0]); i++)
+  {
+    bench_batch_call("task_info_1k_data", smallTask, batches[i]);
+    bench_batch_call("task_status", status, batches[i]);
+    bench_batch_call("offer_50_resources", offer, batches[i]);
+  }
+  bench_batch_call("task_info_1m_data", largeTask, 10);
+
+  return 0;
+}
@@ -0,0 +1,95 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include <atomic>
+#include <new>
+#include <string>
+
+#include "ack_handle.hpp"
+
+using namespace mesos;
+using namespace std;
+
+struct AckHandle
+{
+  unsigned long owner;
+  TaskState state;
+  string taskId;
+  bool hasSlaveId;
+  string slaveId;
+  string uuid;
+};
+
+static ErlNifResourceType* ack_handle_type = NULL;
+static atomic<unsigned long> next_owner(1);
+
+static void ack_handle_dtor(ErlNifEnv* env, void* obj)
+{
+  static_cast<AckHandle*>(obj)->~AckHandle();
+}
+
+int ack_handle_load(ErlNifEnv* env)
+{
+  ack_handle_type = enif_open_resource_type(env,
+                                            NULL,
+                                            "scheduler_ack",
+                                            ack_handle_dtor,
+                                            (ErlNifResourceFlags) (ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER),
+                                            NULL);
+  return ack_handle_type != NULL;
+}
+
+unsigned long ack_handle_owner()
+{
+  return next_owner++;
+}
+
+ERL_NIF_TERM ack_handle_make(ErlNifEnv* env, unsigned long owner, const TaskStatus& status)
+{
+  void* obj = enif_alloc_resource(ack_handle_type, sizeof(AckHandle));
+  AckHandle* handle = new (obj) AckHandle();
+
+  handle->owner = owner;
+  handle->state = status.state();
+  handle->taskId = status.task_id().value();
+  handle->hasSlaveId = status.has_slave_id();
+  if(handle->hasSlaveId) { handle->slaveId = status.slave_id().value(); }
+  handle->uuid = status.uuid();
+
+  ERL_NIF_TERM term = enif_make_resource(env, handle);
+  enif_release_resource(handle);
+  return term;
+}
+
+bool ack_handle_get(ErlNifEnv* env, ERL_NIF_TERM term, unsigned long owner, TaskStatus* status)
+{
+  AckHandle* handle;
+  if(!enif_get_resource(env, term, ack_handle_type, (void**) &handle) || handle->owner != owner)
+  {
+    return false;
+  }
+
+  status->Clear();
+  status->set_state(handle->state);
+  status->mutable_task_id()->set_value(handle->taskId);
+  if(handle->hasSlaveId) { status->mutable_slave_id()->set_value(handle->slaveId); }
+  status->set_uuid(handle->uuid);
+  return true;
+}
@@ -0,0 +1,52 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_ACK_HANDLE_HPP
+#define MESOS_ACK_HANDLE_HPP
+
+#include "erl_nif.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // opens the ack handle resource type - call from the nif load function,
+  // returns 0 if it could not be opened
+  int ack_handle_load(ErlNifEnv* env);
+
+#ifdef __cplusplus
+}
+
+#include "mesos/mesos.pb.h"
+
+// a new owner id for a scheduler's handles, never given out twice in the
+// vm so a handle outliving its scheduler matches no other
+unsigned long ack_handle_owner();
+
+// makes an opaque handle holding what acknowledging status needs: the
+// task id, slave id and uuid. owner identifies the scheduler it is for.
+ERL_NIF_TERM ack_handle_make(ErlNifEnv* env, unsigned long owner, const mesos::TaskStatus& status);
+
+// fills status from an ack handle made for owner, returns false if the
+// term is not one
+bool ack_handle_get(ErlNifEnv* env, ERL_NIF_TERM term, unsigned long owner, mesos::TaskStatus* status);
+
+#endif
+#endif // MESOS_ACK_HANDLE_HPP
@@ -0,0 +1,37 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include <system_error>
+#include <thread>
+
+#include "async_call.hpp"
+
+int async_call(void (*fn)(void*), void* arg)
+{
+  try
+  {
+    std::thread(fn, arg).detach();
+  }
+  catch(const std::system_error&)
+  {
+    return 0;
+  }
+  return 1;
+}
@@ -0,0 +1,35 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_ASYNC_CALL_H
+#define MESOS_ASYNC_CALL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // runs fn(arg) on a new detached thread, for driver calls that block for
+  // longer than a nif may. Returns 0 if the thread could not be started.
+  int async_call(void (*fn)(void*), void* arg);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // MESOS_ASYNC_CALL_H
@@ -0,0 +1,112 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+
+#include <new>
+
+#include "batch_call.hpp"
+#include "pb_term.hpp"
+
+using namespace mesos;
+using namespace std;
+
+static ErlNifResourceType* batch_call_type = NULL;
+
+static void batch_call_dtor(ErlNifEnv* env, void* obj)
+{
+  static_cast<BatchCall*>(obj)->~BatchCall();
+}
+
+// items are parsed in place, the vector was reserved for the whole list
+template<typename T>
+static int add(ErlNifEnv* env, vector<T>& objs, ERL_NIF_TERM* list, unsigned int max)
+{
+  ERL_NIF_TERM head;
+  for(unsigned int i = 0; i < max; i++)
+  {
+    if(!enif_get_list_cell(env, *list, &head, list))
+    {
+      return enif_is_empty_list(env, *list) ? 1 : -1;
+    }
+
+    objs.push_back(T());
+    if(!pb_term_to_obj(env, head, &objs.back())) { return -1; }
+  }
+  return enif_is_empty_list(env, *list) ? 1 : 0;
+}
+
+extern "C" {
+
+int batch_call_load(ErlNifEnv* env)
+{
+  batch_call_type = enif_open_resource_type(env,
+                                            NULL,
+                                            "scheduler_batch_call",
+                                            batch_call_dtor,
+                                            (ErlNifResourceFlags) (ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER),
+                                            NULL);
+  return batch_call_type != NULL;
+}
+
+ERL_NIF_TERM batch_call_make(ErlNifEnv* env, int kind, unsigned int length)
+{
+  void* obj = enif_alloc_resource(batch_call_type, sizeof(BatchCall));
+  BatchCall* batch = new (obj) BatchCall();
+  batch->kind = kind;
+
+  switch(kind)
+  {
+    case BATCH_LAUNCH_TASKS: batch->tasks.reserve(length); break;
+    case BATCH_ACCEPT_OFFERS: batch->operations.reserve(length); break;
+    case BATCH_REQUEST_RESOURCES: batch->requests.reserve(length); break;
+    case BATCH_RECONCILE_TASKS: batch->statuses.reserve(length); break;
+  }
+
+  ERL_NIF_TERM term = enif_make_resource(env, batch);
+  enif_release_resource(batch);
+  return term;
+}
+
+int batch_call_add(ErlNifEnv* env, ERL_NIF_TERM call, ERL_NIF_TERM* list, unsigned int max)
+{
+  BatchCall* batch = batch_call_get(env, call);
+  if(batch == NULL) { return -1; }
+
+  switch(batch->kind)
+  {
+    case BATCH_LAUNCH_TASKS: return add(env, batch->tasks, list, max);
+    case BATCH_ACCEPT_OFFERS: return add(env, batch->operations, list, max);
+    case BATCH_REQUEST_RESOURCES: return add(env, batch->requests, list, max);
+    case BATCH_RECONCILE_TASKS: return add(env, batch->statuses, list, max);
+  }
+  return -1;
+}
+
+}
+
+BatchCall* batch_call_get(ErlNifEnv* env, ERL_NIF_TERM term)
+{
+  BatchCall* batch;
+  if(!enif_get_resource(env, term, batch_call_type, (void**) &batch))
+  {
+    return NULL;
+  }
+  return batch;
+}
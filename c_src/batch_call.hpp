@@ -0,0 +1,77 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+
+#ifndef MESOS_BATCH_CALL_HPP
+#define MESOS_BATCH_CALL_HPP
+
+#include "erl_nif.h"
+
+// the driver call a batch is for, which decides the type of its list items
+#define BATCH_LAUNCH_TASKS 0
+#define BATCH_ACCEPT_OFFERS 1
+#define BATCH_REQUEST_RESOURCES 2
+#define BATCH_RECONCILE_TASKS 3
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // opens the batch resource type - call from the nif load function,
+  // returns 0 if it could not be opened
+  int batch_call_load(ErlNifEnv* env);
+
+  // makes an empty batch for a call of kind with room for length items
+  ERL_NIF_TERM batch_call_make(ErlNifEnv* env, int kind, unsigned int length);
+
+  // converts up to max items from the head of *list into the batch, and moves *list
+  // past them. Returns 1 once the list is empty, 0 if items remain, or -1 if an item
+  // or call is not valid
+  int batch_call_add(ErlNifEnv* env, ERL_NIF_TERM call, ERL_NIF_TERM* list, unsigned int max);
+
+#ifdef __cplusplus
+}
+
+#include <vector>
+
+#include "mesos/mesos.pb.h"
+
+/**
+ * The messages of a driver call whose list argument may be too long to
+ * convert within one nif call. The nif converts a slice of the list at a
+ * time and reschedules itself with enif_schedule_nif, with the rest of
+ * the list and the batch as arguments, until the list is used up and the
+ * driver call can be made. The batch is a resource so it is freed even if
+ * the calling process dies half way through.
+ */
+struct BatchCall
+{
+  int kind;
+  std::vector<mesos::TaskInfo> tasks;
+  std::vector<mesos::Offer::Operation> operations;
+  std::vector<mesos::Request> requests;
+  std::vector<mesos::TaskStatus> statuses;
+};
+
+// the batch behind term, NULL if it is not one
+BatchCall* batch_call_get(ErlNifEnv* env, ERL_NIF_TERM term);
+
+#endif
+#endif // MESOS_BATCH_CALL_HPP
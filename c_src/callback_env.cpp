@@ -0,0 +1,178 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include <assert.h>
+#include <string.h>
+#include <atomic>
+
+#include "erl_nif.h"
+
+#include "callback_env.hpp"
+#include "metrics.hpp"
+
+using namespace std;
+
+CallbackAtoms callback_atoms;
+
+static std::atomic<unsigned long> envs_live(0);
+static std::atomic<unsigned long> envs_allocated(0);
+static std::atomic<unsigned long> messages_sent(0);
+static std::atomic<unsigned long> bytes_current(0);
+static std::atomic<unsigned long> bytes_peak(0);
+
+// owns the environment of one callback thread for the life of the thread
+struct ThreadEnv
+{
+  ThreadEnv() : env(NULL), inUse(false) {}
+
+  ~ThreadEnv()
+  {
+    if(env != NULL)
+    {
+      enif_free_env(env);
+      envs_live--;
+    }
+  }
+
+  ErlNifEnv* env;
+  bool inUse;
+};
+
+static thread_local ThreadEnv thread_env;
+
+void callback_env_load(ErlNifEnv* env)
+{
+  callback_atoms.registered = enif_make_atom(env, "registered");
+  callback_atoms.reregistered = enif_make_atom(env, "reregistered");
+  callback_atoms.disconnected = enif_make_atom(env, "disconnected");
+  callback_atoms.resourceOffers = enif_make_atom(env, "resourceOffers");
+  callback_atoms.offerRescinded = enif_make_atom(env, "offerRescinded");
+  callback_atoms.statusUpdate = enif_make_atom(env, "statusUpdate");
+  callback_atoms.statusUpdatesPending = enif_make_atom(env, "statusUpdatesPending");
+  callback_atoms.frameworkMessage = enif_make_atom(env, "frameworkMessage");
+  callback_atoms.slaveLost = enif_make_atom(env, "slaveLost");
+  callback_atoms.executorLost = enif_make_atom(env, "executorLost");
+  callback_atoms.error = enif_make_atom(env, "error");
+  callback_atoms.launchTask = enif_make_atom(env, "launchTask");
+  callback_atoms.killTask = enif_make_atom(env, "killTask");
+  callback_atoms.shutdown = enif_make_atom(env, "shutdown");
+}
+
+ERL_NIF_TERM callback_env_stats(ErlNifEnv* env)
+{
+  ERL_NIF_TERM stats[] = {
+    enif_make_tuple2(env, enif_make_atom(env, "envs"), enif_make_ulong(env, envs_live)),
+    enif_make_tuple2(env, enif_make_atom(env, "envs_allocated"), enif_make_ulong(env, envs_allocated)),
+    enif_make_tuple2(env, enif_make_atom(env, "messages"), enif_make_ulong(env, messages_sent)),
+    enif_make_tuple2(env, enif_make_atom(env, "bytes"), enif_make_ulong(env, bytes_current)),
+    enif_make_tuple2(env, enif_make_atom(env, "peak_bytes"), enif_make_ulong(env, bytes_peak))
+  };
+  return enif_make_list_from_array(env, stats, sizeof(stats) / sizeof(stats[0]));
+}
+
+CallbackEnv::CallbackEnv() : env(NULL), bytes(0)
+{
+  if(thread_env.inUse)
+  {
+    // a callback sending while another message is being built on this
+    // thread - fall back to a private environment
+    env = enif_alloc_env();
+    envs_live++;
+    envs_allocated++;
+    return;
+  }
+
+  if(thread_env.env == NULL)
+  {
+    thread_env.env = enif_alloc_env();
+    envs_live++;
+    envs_allocated++;
+  }
+  thread_env.inUse = true;
+  env = thread_env.env;
+}
+
+CallbackEnv::~CallbackEnv()
+{
+  release();
+
+  if(env == thread_env.env)
+  {
+    thread_env.inUse = false;
+  }else
+  {
+    enif_free_env(env);
+    envs_live--;
+  }
+}
+
+void CallbackEnv::binaries(const google::protobuf::MessageLite* const objs[], 
+                           ERL_NIF_TERM terms[], 
+                           unsigned int count)
+{
+  pb_objs_to_binaries(env, objs, terms, count);
+
+  for(unsigned int i = 0; i < count; i++)
+  {
+    account(objs[i]->GetCachedSize());
+  }
+}
+
+ERL_NIF_TERM CallbackEnv::string(const std::string& str)
+{
+  // a list costs two words per character
+  account(str.size() * 2 * sizeof(ERL_NIF_TERM));
+  return enif_make_string_len(env, str.data(), str.size(), ERL_NIF_LATIN1);
+}
+
+ERL_NIF_TERM CallbackEnv::data(const std::string& str)
+{
+  ERL_NIF_TERM term;
+  unsigned char* bytes = enif_make_new_binary(env, str.size(), &term);
+  memcpy(bytes, str.data(), str.size());
+  account(str.size());
+  return term;
+}
+
+int CallbackEnv::send(const ErlNifPid* pid, ERL_NIF_TERM message)
+{
+  assert(pid != NULL);
+
+  int ret = enif_send(NULL, pid, env, message);
+  messages_sent++;
+  release();
+  return ret;
+}
+
+void CallbackEnv::account(size_t size)
+{
+  bytes += size;
+  metrics_thread_bytes += size;
+  unsigned long current = (bytes_current += size);
+  unsigned long peak = bytes_peak;
+  while(current > peak && !bytes_peak.compare_exchange_weak(peak, current)) {}
+}
+
+void CallbackEnv::release()
+{
+  enif_clear_env(env);
+  bytes_current -= bytes;
+  bytes = 0;
+}
@@ -0,0 +1,114 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_CALLBACK_ENV_H
+#define MESOS_CALLBACK_ENV_H
+
+#include "erl_nif.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // creates the callback message atoms - call from the nif load function
+  void callback_env_load(ErlNifEnv* env);
+  // returns a proplist describing the memory held by callback environments
+  ERL_NIF_TERM callback_env_stats(ErlNifEnv* env);
+
+#ifdef __cplusplus
+}
+
+#include <string>
+
+#include "erlang_mesos.hpp"
+#include "utils.hpp"
+
+// atoms used to tag the messages sent from libmesos callbacks.
+// Atoms are not bound to an environment so they are made once at load.
+struct CallbackAtoms
+{
+  ERL_NIF_TERM registered;
+  ERL_NIF_TERM reregistered;
+  ERL_NIF_TERM disconnected;
+  ERL_NIF_TERM resourceOffers;
+  ERL_NIF_TERM offerRescinded;
+  ERL_NIF_TERM statusUpdate;
+  ERL_NIF_TERM statusUpdatesPending;
+  ERL_NIF_TERM frameworkMessage;
+  ERL_NIF_TERM slaveLost;
+  ERL_NIF_TERM executorLost;
+  ERL_NIF_TERM error;
+  ERL_NIF_TERM launchTask;
+  ERL_NIF_TERM killTask;
+  ERL_NIF_TERM shutdown;
+};
+
+extern CallbackAtoms callback_atoms;
+
+/**
+ * Scoped access to the message environment of the calling thread.
+ *
+ * Each libprocess thread that invokes a callback owns one environment
+ * which is allocated on first use and reused for every later callback.
+ * The environment is cleared when the CallbackEnv goes out of scope and
+ * freed when the thread exits.
+ */
+class CallbackEnv
+{
+public:
+  CallbackEnv();
+  ~CallbackEnv();
+
+  operator ErlNifEnv*() const { return env; }
+
+  // serializes a protobuf object into a binary owned by this environment
+  template <class T> ERL_NIF_TERM binary(const T& obj)
+  {
+    ERL_NIF_TERM term = pb_obj_to_binary(env, obj);
+    account(obj.GetCachedSize());
+    return term;
+  }
+
+  // serializes several protobuf objects into one binary, see pb_objs_to_binaries
+  void binaries(const google::protobuf::MessageLite* const objs[], 
+                ERL_NIF_TERM terms[], 
+                unsigned int count);
+
+  ERL_NIF_TERM string(const std::string& str);
+
+  // copies the bytes of str into a binary owned by this environment
+  ERL_NIF_TERM data(const std::string& str);
+
+  // sends the message, the environment is left ready for the next message
+  int send(const ErlNifPid* pid, ERL_NIF_TERM message);
+
+private:
+  CallbackEnv(const CallbackEnv&);
+  CallbackEnv& operator=(const CallbackEnv&);
+
+  void account(size_t size);
+  void release();
+
+  ErlNifEnv* env;
+  size_t bytes;
+};
+
+#endif
+#endif // MESOS_CALLBACK_ENV_H
@@ -0,0 +1,390 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include <assert.h>
+#include <string.h>
+#include <system_error>
+
+#include "command_queue.hpp"
+#include "callback_env.hpp"
+#include "pb_term.hpp"
+#include "metrics.hpp"
+#include "utils.hpp"
+
+using namespace mesos;
+using namespace std;
+
+// commands waiting for the worker, a full ring is reported to the caller
+#define COMMAND_QUEUE_SIZE 4096
+// commands taken off the ring before they are run
+#define COMMAND_BATCH_SIZE 256
+// offers whose slave is remembered, past this declines are no longer merged
+// until the offers in hand are used
+#define COMMAND_MAX_OFFERS 65536
+
+// fills the executor and slave ids of a framework message from a list of
+// {ExecutorID, SlaveID}, or marks it for every executor for the atom all
+static bool get_targets(ErlNifEnv* env, ERL_NIF_TERM term, DriverCommand* command)
+{
+  if(is_atom(env, term, "all"))
+  {
+    command->allExecutors = true;
+    return true;
+  }
+
+  unsigned int length;
+  if(!enif_get_list_length(env, term, &length)) { return false; }
+  command->executorIds.resize(length);
+  command->slaveIds.resize(length);
+
+  ERL_NIF_TERM head, tail = term;
+  for(unsigned int i = 0; enif_get_list_cell(env, tail, &head, &tail); i++)
+  {
+    int arity;
+    const ERL_NIF_TERM* target;
+    if(!enif_get_tuple(env, head, &arity, &target) || arity != 2 ||
+       !pb_term_to_obj(env, target[0], &command->executorIds[i]) ||
+       !pb_term_to_obj(env, target[1], &command->slaveIds[i]))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+DriverCommand* DriverCommand::fromTerm(ErlNifEnv* env, ERL_NIF_TERM term, const char** invalid)
+{
+  assert(invalid != NULL);
+
+  int arity;
+  const ERL_NIF_TERM* args;
+  char tag[32];
+
+  if(!enif_get_tuple(env, term, &arity, &args) ||
+     !enif_get_atom(env, args[0], tag, sizeof(tag), ERL_NIF_LATIN1))
+  {
+    *invalid = "command";
+    return NULL;
+  }
+
+  DriverCommand* command = new DriverCommand();
+  command->allExecutors = false;
+
+  if(arity == 4 && strcmp(tag, "launchTasks") == 0)
+  {
+    command->kind = LAUNCH_TASKS;
+    command->offerIds.resize(1);
+    if(!pb_term_to_obj(env, args[1], &command->offerIds[0])) { *invalid = "offer_id"; }
+    else if(!pb_terms_to_objs<TaskInfo>(env, args[2], command->tasks)) { *invalid = "task_info_array"; }
+    else if(!pb_term_to_obj(env, args[3], &command->filters)) { *invalid = "filters"; }
+  }else if(arity == 3 && strcmp(tag, "declineOffer") == 0)
+  {
+    command->kind = DECLINE_OFFER;
+    command->offerIds.resize(1);
+    if(!pb_term_to_obj(env, args[1], &command->offerIds[0])) { *invalid = "offer_id"; }
+    else if(!pb_term_to_obj(env, args[2], &command->filters)) { *invalid = "filters"; }
+  }else if(arity == 2 && strcmp(tag, "killTask") == 0)
+  {
+    command->kind = KILL_TASK;
+    if(!pb_term_to_obj(env, args[1], &command->taskId)) { *invalid = "task_id"; }
+  }else if(arity == 2 && strcmp(tag, "acknowledgeStatusUpdate") == 0)
+  {
+    command->kind = ACKNOWLEDGE;
+    command->statuses.resize(1);
+    if(!pb_term_to_obj(env, args[1], &command->statuses[0])) { *invalid = "task_status"; }
+  }else if(arity == 2 && strcmp(tag, "reconcileTasks") == 0)
+  {
+    command->kind = RECONCILE_TASKS;
+    if(!pb_terms_to_objs<TaskStatus>(env, args[1], command->statuses)) { *invalid = "task_status_array"; }
+  }else if(arity == 3 && strcmp(tag, "frameworkMessage") == 0)
+  {
+    ErlNifBinary data;
+    command->kind = FRAMEWORK_MESSAGE;
+    if(!get_targets(env, args[1], command)) { *invalid = "targets"; }
+    else if(!enif_inspect_iolist_as_binary(env, args[2], &data)) { *invalid = "data"; }
+    else { command->data.assign((const char*) data.data, data.size); }
+  }else
+  {
+    *invalid = "command";
+  }
+
+  if(*invalid != NULL)
+  {
+    delete command;
+    return NULL;
+  }
+  return command;
+}
+
+CommandQueue::CommandQueue(SchedulerDriver* driver, MessageChannel* channel)
+  : driver(driver),
+    channel(channel),
+    ring(COMMAND_QUEUE_SIZE),
+    nextId(1),
+    sleeping(false),
+    woken(false),
+    stopping(false)
+{
+  assert(driver != NULL);
+  assert(channel != NULL);
+}
+
+CommandQueue::~CommandQueue()
+{
+  stop();
+}
+
+void CommandQueue::stop()
+{
+  worker.stop(signalLock, wakeup, stopping);
+}
+
+void CommandQueue::offered(const vector<const Offer*>& offers)
+{
+  lock_guard<mutex> guard(slavesLock);
+  if(slaves.size() + offers.size() > COMMAND_MAX_OFFERS) { return; }
+
+  for(size_t i = 0; i < offers.size(); i++)
+  {
+    slaves[offers[i]->id().value()] = offers[i]->slave_id().value();
+  }
+}
+
+void CommandQueue::rescinded(const OfferID& offerId)
+{
+  lock_guard<mutex> guard(slavesLock);
+  slaves.erase(offerId.value());
+}
+
+string CommandQueue::slaveOf(const OfferID& offerId)
+{
+  lock_guard<mutex> guard(slavesLock);
+
+  unordered_map<string, string>::const_iterator it = slaves.find(offerId.value());
+  return it == slaves.end() ? string() : it->second;
+}
+
+void CommandQueue::forget(const OfferID& offerId)
+{
+  lock_guard<mutex> guard(slavesLock);
+  slaves.erase(offerId.value());
+}
+
+CommandQueue::PushResult CommandQueue::push(DriverCommand* command, unsigned long* id)
+{
+  assert(command != NULL);
+  assert(id != NULL);
+
+  if(!worker.start([this]() { run(); })) { return NO_WORKER; }
+
+  // the worker may run and free the command as soon as it is on the ring
+  *id = command->id = nextId++;
+  if(!ring.push(command)) { return FULL; }
+
+  // pairs with the fence in wait, either the worker sees the command on
+  // the ring or this sees the worker asleep
+  atomic_thread_fence(memory_order_seq_cst);
+  if(sleeping.load(memory_order_relaxed))
+  {
+    {
+      lock_guard<mutex> guard(signalLock);
+      woken = true;
+    }
+    wakeup.notify_one();
+  }
+  return QUEUED;
+}
+
+void CommandQueue::run()
+{
+  vector<DriverCommand*> batch;
+  batch.reserve(COMMAND_BATCH_SIZE);
+
+  for(;;)
+  {
+    DriverCommand* command;
+    while(batch.size() < COMMAND_BATCH_SIZE && ring.pop(command))
+    {
+      batch.push_back(command);
+    }
+
+    if(!batch.empty())
+    {
+      execute(batch);
+      batch.clear();
+      continue;
+    }
+
+    {
+      lock_guard<mutex> guard(signalLock);
+      // the ring is drained, anything pushed after this is not run
+      if(stopping) { return; }
+    }
+    wait();
+  }
+}
+
+void CommandQueue::wait()
+{
+  unique_lock<mutex> lock(signalLock);
+
+  sleeping.store(true, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if(ring.empty())
+  {
+    wakeup.wait(lock, [this]() { return woken || stopping; });
+  }
+  woken = false;
+  sleeping.store(false, memory_order_relaxed);
+}
+
+static bool same_filters(const Filters& a, const Filters& b)
+{
+  return a.has_refuse_seconds() == b.has_refuse_seconds() &&
+         a.refuse_seconds() == b.refuse_seconds();
+}
+
+void CommandQueue::execute(vector<DriverCommand*>& batch)
+{
+  METRIC_TIMER(timer, "command_queue_execute");
+
+  size_t i = 0;
+  while(i < batch.size())
+  {
+    DriverCommand* command = batch[i];
+    size_t end = i + 1;
+    Status status;
+
+    switch(command->kind)
+    {
+    case DriverCommand::LAUNCH_TASKS:
+      forget(command->offerIds[0]);
+      status = driver->launchTasks(command->offerIds, command->tasks, command->filters);
+      break;
+
+    case DriverCommand::DECLINE_OFFER:
+      {
+        // an unknown slave is never merged
+        string slave = slaveOf(command->offerIds[0]);
+        while(!slave.empty() &&
+              end < batch.size() &&
+              batch[end]->kind == DriverCommand::DECLINE_OFFER &&
+              same_filters(batch[end]->filters, command->filters) &&
+              slaveOf(batch[end]->offerIds[0]) == slave)
+        {
+          end++;
+        }
+      }
+
+      for(size_t j = i; j < end; j++)
+      {
+        forget(batch[j]->offerIds[0]);
+      }
+
+      if(end - i == 1)
+      {
+        status = driver->declineOffer(command->offerIds[0], command->filters);
+      }else
+      {
+        // accepting offers with no operations declines them
+        vector<OfferID> offerIds;
+        offerIds.reserve(end - i);
+        for(size_t j = i; j < end; j++)
+        {
+          offerIds.push_back(batch[j]->offerIds[0]);
+        }
+        status = driver->acceptOffers(offerIds, vector<Offer::Operation>(), command->filters);
+      }
+      break;
+
+    case DriverCommand::KILL_TASK:
+      status = driver->killTask(command->taskId);
+      break;
+
+    case DriverCommand::ACKNOWLEDGE:
+      status = driver->acknowledgeStatusUpdate(command->statuses[0]);
+      break;
+
+    case DriverCommand::RECONCILE_TASKS:
+      // an empty list asks for implicit reconciliation so is never merged
+      if(!command->statuses.empty())
+      {
+        while(end < batch.size() &&
+              batch[end]->kind == DriverCommand::RECONCILE_TASKS &&
+              !batch[end]->statuses.empty())
+        {
+          command->statuses.insert(command->statuses.end(),
+                                   batch[end]->statuses.begin(),
+                                   batch[end]->statuses.end());
+          end++;
+        }
+      }
+      status = driver->reconcileTasks(command->statuses);
+      break;
+
+    case DriverCommand::FRAMEWORK_MESSAGE:
+      // one failure is reported for the whole broadcast, the first
+      status = DRIVER_RUNNING;
+      for(size_t j = 0; j < command->executorIds.size(); j++)
+      {
+        Status sent = channel->enabled()
+                        ? channel->send(command->executorIds[j], command->slaveIds[j], command->data)
+                        : driver->sendFrameworkMessage(command->executorIds[j], command->slaveIds[j], command->data);
+        if(status == DRIVER_RUNNING) { status = sent; }
+      }
+      break;
+
+    default:
+      status = DRIVER_ABORTED;
+    }
+
+    for(size_t j = i; j < end; j++)
+    {
+      if(status != DRIVER_RUNNING) { report(batch[j], status); }
+      delete batch[j];
+    }
+    i = end;
+  }
+}
+
+static const char* status_name(Status status)
+{
+  switch(status)
+  {
+  case DRIVER_NOT_STARTED: return "driver_not_started";
+  case DRIVER_RUNNING: return "driver_running";
+  case DRIVER_ABORTED: return "driver_aborted";
+  case DRIVER_STOPPED: return "driver_stopped";
+  default: return "unknown";
+  }
+}
+
+void CommandQueue::report(const DriverCommand* command, Status status)
+{
+  CallbackEnv env;
+
+  ERL_NIF_TERM message = enif_make_tuple3(env,
+                            enif_make_atom(env, "command_failed"),
+                            enif_make_ulong(env, command->id),
+                            enif_make_atom(env, status_name(status)));
+
+  env.send(&command->caller, message);
+}
@@ -0,0 +1,218 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_COMMAND_QUEUE_HPP
+#define MESOS_COMMAND_QUEUE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "erl_nif.h"
+
+#include <mesos/scheduler.hpp>
+#include "mesos/mesos.pb.h"
+
+#include "message_channel.hpp"
+#include "worker_thread.hpp"
+
+/**
+ * Bounded lock-free ring for many producers and a single consumer.
+ *
+ * Each cell carries a sequence number telling producers whether it is free
+ * for the current lap and the consumer whether it has been filled, so a
+ * push is one compare-and-swap on the tail and a pop takes no atomic
+ * read-modify-write at all. The size must be a power of two.
+ */
+template<typename T> class MpscRing
+{
+public:
+  explicit MpscRing(size_t size) : cells(size), mask(size - 1), tail(0), head(0)
+  {
+    for(size_t i = 0; i < size; i++)
+    {
+      cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // returns false if the ring is full
+  bool push(T value)
+  {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    Cell* cell;
+    for(;;)
+    {
+      cell = &cells[pos & mask];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+      if(diff == 0)
+      {
+        if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+      }else if(diff < 0)
+      {
+        return false;
+      }else
+      {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = value;
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer only, returns false if the ring is empty
+  bool pop(T& value)
+  {
+    Cell* cell = &cells[head & mask];
+    if(cell->seq.load(std::memory_order_acquire) != head + 1) { return false; }
+
+    value = cell->value;
+    cell->seq.store(head + mask + 1, std::memory_order_release);
+    head++;
+    return true;
+  }
+
+  // consumer only
+  bool empty() const
+  {
+    return cells[head & mask].seq.load(std::memory_order_acquire) != head + 1;
+  }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  MpscRing(const MpscRing&);
+  MpscRing& operator=(const MpscRing&);
+
+  std::vector<Cell> cells;
+  const size_t mask;
+  std::atomic<size_t> tail;
+  size_t head;
+};
+
+// a driver call queued by an erlang process, built and validated by the nif
+struct DriverCommand
+{
+  enum Kind { LAUNCH_TASKS, DECLINE_OFFER, KILL_TASK, ACKNOWLEDGE, RECONCILE_TASKS, FRAMEWORK_MESSAGE };
+
+  // parses one of
+  //   {launchTasks, OfferId, [TaskInfo], Filters}
+  //   {declineOffer, OfferId, Filters}
+  //   {killTask, TaskId}
+  //   {acknowledgeStatusUpdate, TaskStatus}
+  //   {reconcileTasks, [TaskStatus]}
+  //   {frameworkMessage, [{ExecutorId, SlaveId}] | all, iodata()}
+  // returns NULL and sets invalid to the name of the bad argument otherwise
+  static DriverCommand* fromTerm(ErlNifEnv* env, ERL_NIF_TERM term, const char** invalid);
+
+  Kind kind;
+  unsigned long id;
+  ErlNifPid caller;
+
+  std::vector<mesos::OfferID> offerIds;
+  std::vector<mesos::TaskInfo> tasks;
+  mesos::Filters filters;
+  mesos::TaskID taskId;
+  std::vector<mesos::TaskStatus> statuses;
+
+  // the targets of a framework message, filled in by the caller when the
+  // message is for all executors
+  std::vector<mesos::ExecutorID> executorIds;
+  std::vector<mesos::SlaveID> slaveIds;
+  bool allExecutors;
+  std::string data;
+};
+
+/**
+ * Runs queued commands against a scheduler driver on a worker thread.
+ *
+ * Callers return as soon as the command is on the ring. The worker drains
+ * the ring in batches, turning runs of declines of offers from the same
+ * slave with the same filters into a single acceptOffers call with no
+ * operations and runs of explicit reconciliations into a single
+ * reconcileTasks call. The master only aggregates offers of one slave so
+ * the queue is told the slave of each offer as it arrives. A command whose
+ * driver call does not leave the driver running is reported to the
+ * process that queued it as {command_failed, Id, Status}.
+ *
+ * The worker is started by the first push and stopped, after running
+ * whatever is still queued, by stop.
+ */
+class CommandQueue
+{
+public:
+  enum PushResult { QUEUED, FULL, NO_WORKER };
+
+  // framework messages are sent through channel once it is enabled, the
+  // channel must outlive stop
+  CommandQueue(mesos::SchedulerDriver* driver, MessageChannel* channel);
+  ~CommandQueue();
+
+  // takes ownership of command once QUEUED, id is set to the id failures
+  // of the command are reported with
+  PushResult push(DriverCommand* command, unsigned long* id);
+
+  // runs the commands still queued and joins the worker, see WorkerThread
+  void stop();
+
+  // called from the driver callbacks to track the slave of each offer
+  void offered(const std::vector<const mesos::Offer*>& offers);
+  void rescinded(const mesos::OfferID& offerId);
+
+private:
+  CommandQueue(const CommandQueue&);
+  CommandQueue& operator=(const CommandQueue&);
+
+  void run();
+  void wait();
+  void execute(std::vector<DriverCommand*>& batch);
+  void report(const DriverCommand* command, mesos::Status status);
+  std::string slaveOf(const mesos::OfferID& offerId);
+  void forget(const mesos::OfferID& offerId);
+
+  mesos::SchedulerDriver* driver;
+  MessageChannel* channel;
+  MpscRing<DriverCommand*> ring;
+  std::atomic<unsigned long> nextId;
+
+  WorkerThread worker;
+
+  // offer id to slave id of the offers in hand, kept before the first push
+  // too so the offers that lead to it are known
+  std::mutex slavesLock;
+  std::unordered_map<std::string, std::string> slaves;
+
+  // the worker sleeps on wakeup only after announcing it in sleeping
+  std::mutex signalLock;
+  std::condition_variable wakeup;
+  std::atomic<bool> sleeping;
+  bool woken;
+  bool stopping;
+};
+
+#endif // MESOS_COMMAND_QUEUE_HPP
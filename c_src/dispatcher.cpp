@@ -0,0 +1,122 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include <functional>
+
+#include "dispatcher.hpp"
+
+using namespace mesos;
+using namespace std;
+
+// offers whose slave is remembered for routing their rescinding
+#define DISPATCH_MAX_OFFERS 65536
+
+Dispatcher::Dispatcher() : enabled(false)
+{
+}
+
+bool Dispatcher::set(ErlNifEnv* env, ERL_NIF_TERM pids)
+{
+  vector<ErlNifPid> workers_;
+
+  ERL_NIF_TERM head, tail = pids;
+  if(!enif_is_list(env, tail)) { return false; }
+
+  while(enif_get_list_cell(env, tail, &head, &tail))
+  {
+    ErlNifPid pid;
+    if(!enif_get_local_pid(env, head, &pid)) { return false; }
+    workers_.push_back(pid);
+  }
+
+  lock_guard<mutex> guard(lock);
+  workers.swap(workers_);
+  routed.assign(workers.size(), 0);
+  offerSlaves.clear();
+  offerOrder.clear();
+  enabled = !workers.empty();
+  return true;
+}
+
+const ErlNifPid* Dispatcher::route(const string& key, const ErlNifPid* owner, ErlNifPid* worker)
+{
+  if(!enabled || key.empty()) { return owner; }
+
+  lock_guard<mutex> guard(lock);
+  return pick(key, owner, worker);
+}
+
+const ErlNifPid* Dispatcher::routeOffer(const Offer& offer, const ErlNifPid* owner, ErlNifPid* worker)
+{
+  if(!enabled) { return owner; }
+
+  lock_guard<mutex> guard(lock);
+  if(offerSlaves.insert(make_pair(offer.id().value(), offer.slave_id().value())).second)
+  {
+    offerOrder.push_back(offer.id().value());
+    if(offerOrder.size() > DISPATCH_MAX_OFFERS)
+    {
+      offerSlaves.erase(offerOrder.front());
+      offerOrder.pop_front();
+    }
+  }
+  return pick(offer.slave_id().value(), owner, worker);
+}
+
+const ErlNifPid* Dispatcher::routeRescinded(const OfferID& offerId, const ErlNifPid* owner, ErlNifPid* worker)
+{
+  if(!enabled) { return owner; }
+
+  lock_guard<mutex> guard(lock);
+  unordered_map<string, string>::const_iterator it = offerSlaves.find(offerId.value());
+  if(it == offerSlaves.end()) { return owner; }
+
+  // left in offerOrder, erasing it there would be a scan
+  string slaveId = it->second;
+  offerSlaves.erase(it);
+  return pick(slaveId, owner, worker);
+}
+
+const ErlNifPid* Dispatcher::pick(const string& key, const ErlNifPid* owner, ErlNifPid* worker)
+{
+  if(workers.empty() || key.empty()) { return owner; }
+
+  size_t i = hash<string>()(key) % workers.size();
+  routed[i]++;
+  *worker = workers[i];
+  return worker;
+}
+
+ERL_NIF_TERM Dispatcher::stats(ErlNifEnv* env) const
+{
+  lock_guard<mutex> guard(lock);
+
+  vector<ERL_NIF_TERM> counts(routed.size());
+  for(size_t i = 0; i < routed.size(); i++)
+  {
+    counts[i] = enif_make_ulong(env, routed[i]);
+  }
+
+  ERL_NIF_TERM stats[] = {
+    enif_make_tuple2(env, enif_make_atom(env, "workers"), enif_make_ulong(env, workers.size())),
+    enif_make_tuple2(env, enif_make_atom(env, "routed"), enif_make_list_from_array(env, counts.data(), counts.size()))
+  };
+  return enif_make_list_from_array(env, stats, sizeof(stats) / sizeof(stats[0]));
+}
@@ -0,0 +1,84 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_DISPATCHER_HPP
+#define MESOS_DISPATCHER_HPP
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "erl_nif.h"
+
+#include "mesos/mesos.pb.h"
+
+/**
+ * Routes callback messages that carry a key, a task, slave or executor
+ * id, to one of a set of worker processes instead of the owner.
+ *
+ * The worker is chosen by a hash of the key, so every message for a key
+ * goes to the same worker and arrives in the order it was sent, while
+ * messages for different keys are handled in parallel. Messages without
+ * a key, and every message while there are no workers, go to the owner.
+ *
+ * An offer is keyed by its slave, and so is its rescinding while the
+ * offer is among the last few thousand routed.
+ */
+class Dispatcher
+{
+public:
+  Dispatcher();
+
+  // sets the workers to a list of pids, [] sends everything to the owner
+  // again. Returns false and changes nothing if the list is invalid.
+  bool set(ErlNifEnv* env, ERL_NIF_TERM pids);
+
+  // the pid the message for key goes to, owner or a worker copied into worker
+  const ErlNifPid* route(const std::string& key, const ErlNifPid* owner, ErlNifPid* worker);
+
+  // as route, remembering the slave of the offer or looking it up
+  const ErlNifPid* routeOffer(const mesos::Offer& offer, const ErlNifPid* owner, ErlNifPid* worker);
+  const ErlNifPid* routeRescinded(const mesos::OfferID& offerId, const ErlNifPid* owner, ErlNifPid* worker);
+
+  ERL_NIF_TERM stats(ErlNifEnv* env) const;
+
+private:
+  Dispatcher(const Dispatcher&);
+  Dispatcher& operator=(const Dispatcher&);
+
+  // with lock held
+  const ErlNifPid* pick(const std::string& key, const ErlNifPid* owner, ErlNifPid* worker);
+
+  std::atomic<bool> enabled;
+
+  mutable std::mutex lock;
+  std::vector<ErlNifPid> workers;
+  // messages routed to each worker since the workers were set
+  std::vector<unsigned long> routed;
+
+  // slave of each offer routed, oldest first in offerOrder
+  std::unordered_map<std::string, std::string> offerSlaves;
+  std::deque<std::string> offerOrder;
+};
+
+#endif // MESOS_DISPATCHER_HPP
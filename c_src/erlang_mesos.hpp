@@ -40,7 +40,12 @@ typedef int SchedulerDriverStatus ;
 
 struct state_t
 {
+    ErlNifRWLock* lock;
     int initilised;
+    // callers blocked in join, counted under join_lock so destroy can wait them out
+    ErlNifMutex* join_lock;
+    ErlNifCond* joined;
+    int joining;
     SchedulerPtrPair scheduler_state;
     ExecutorPtrPair executor_state;
 };
@@ -19,6 +19,95 @@
 
 
 #include "erl_nif.h"
+#include "erlang_mesos.hpp"
+#include "async_call.hpp"
+
+// driver calls that can block for seconds (join, stop, abort, destroy) run on
+// the dirty io schedulers when the vm has been built with them, and otherwise
+// on a thread of their own. NIF_BLOCKING(fn) is the function and flags of such
+// a nif in its ErlNifFunc, NIF_ON_THREAD(fn) defines the function run without
+// dirty schedulers, which returns {nif_thread, Ref} and sends {Ref, Result}
+// to the caller once fn returns
+#ifdef ERL_NIF_DIRTY_SCHEDULER_SUPPORT
+#define NIF_BLOCKING(fn) fn, ERL_NIF_DIRTY_JOB_IO_BOUND
+#define NIF_ON_THREAD(fn)
+#else
+#define NIF_BLOCKING(fn) fn##_on_thread, 0
+#define NIF_ON_THREAD(fn) \
+    static ERL_NIF_TERM \
+    fn##_on_thread(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]) \
+    { \
+        return nif_on_thread(env, argc, argv, fn); \
+    }
+
+#define NIF_THREAD_MAX_ARGS 4
+
+typedef ERL_NIF_TERM (*nif_func_t)(ErlNifEnv*, int, const ERL_NIF_TERM[]);
+
+typedef struct
+{
+    nif_func_t fn;
+    ErlNifPid caller;
+    ErlNifEnv* env;
+    ERL_NIF_TERM ref;
+    int argc;
+    ERL_NIF_TERM argv[NIF_THREAD_MAX_ARGS];
+} thread_call_t;
+
+static void
+thread_call_run(void* arg)
+{
+    thread_call_t* job = (thread_call_t*) arg;
+    ERL_NIF_TERM result = job->fn(job->env, job->argc, job->argv);
+
+    enif_send(NULL, &job->caller, job->env, enif_make_tuple2(job->env, job->ref, result));
+
+    enif_free_env(job->env);
+    enif_free(job);
+}
+
+// the arguments are copied into the job's environment, which keeps the
+// handle they refer to alive until fn has returned
+static ERL_NIF_TERM
+nif_on_thread(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[], nif_func_t fn)
+{
+    int i;
+
+    if(argc > NIF_THREAD_MAX_ARGS)
+    {
+        return enif_make_badarg(env);
+    }
+
+    thread_call_t* job = (thread_call_t*) enif_alloc(sizeof(thread_call_t));
+    job->fn = fn;
+    job->env = enif_alloc_env();
+    job->argc = argc;
+    for(i = 0; i < argc; i++)
+    {
+        job->argv[i] = enif_make_copy(job->env, argv[i]);
+    }
+    enif_self(env, &job->caller);
+
+    ERL_NIF_TERM ref = enif_make_ref(env);
+    job->ref = enif_make_copy(job->env, ref);
+
+    if(!async_call(thread_call_run, job))
+    {
+        enif_free_env(job->env);
+        enif_free(job);
+        return enif_make_tuple2(env, 
+            enif_make_atom(env, "error"), 
+            enif_make_atom(env, "thread_not_started"));
+    }
+    return enif_make_tuple2(env, enif_make_atom(env, "nif_thread"), ref);
+}
+#endif
+
+// nifs that convert long lists reschedule themselves between slices of the
+// list, which needs enif_schedule_nif from nif 2.7 (otp 17.3)
+#if ERL_NIF_MAJOR_VERSION > 2 || (ERL_NIF_MAJOR_VERSION == 2 && ERL_NIF_MINOR_VERSION >= 7)
+#define NIF_YIELD 1
+#endif
 
 //helper method to turn status into an erlang atom
 ERL_NIF_TERM get_atom_from_status(ErlNifEnv* env, int status)
@@ -79,6 +168,37 @@ int inspect_array_of_binary_objects(ErlNifEnv* env, ERL_NIF_TERM term, ErlNifBin
     return 1;
 }
 
+//helper method to inspect a list of binaries of any length into an array
+//allocated with enif_alloc, released with enif_free(array->obj)
+int alloc_array_of_binary_objects(ErlNifEnv* env, ERL_NIF_TERM term, BinaryNifArray* array)
+{
+    if(!enif_get_list_length(env, term, &array->length))
+    {
+        return 0;
+    }
+
+    array->obj = (ErlNifBinary*) enif_alloc(sizeof(ErlNifBinary) * (array->length > 0 ? array->length : 1));
+    if(!inspect_array_of_binary_objects(env, term, array->obj))
+    {
+        enif_free(array->obj);
+        return 0;
+    }
+    return 1;
+}
+
+//helper method to return a list of statuses to erlang
+ERL_NIF_TERM get_return_values_from_statuses(ErlNifEnv* env, int* statuses, unsigned int length)
+{
+    ERL_NIF_TERM list = enif_make_list(env, 0);
+    unsigned int i;
+
+    for(i = length; i > 0; i--)
+    {
+        list = enif_make_list_cell(env, get_return_value_from_status(env, statuses[i - 1]), list);
+    }
+    return list;
+}
+
 // helper method to make an argument error object
 ERL_NIF_TERM make_argument_error(ErlNifEnv* env, const char* reason, char* invalid_parameter)
 {
@@ -19,27 +19,61 @@
 
 
 #include <stdio.h>
+#include <string.h>
 #include "erl_nif.h"
 #include "erlang_mesos_util.c"
 #include "erlang_mesos.hpp" 
 #include "executor_c_api.hpp" 
+#include "callback_env.hpp"
+#include "pb_term.hpp"
+#include "metrics.hpp"
 
 #define MAXBUFLEN 1024
 
+// kept outside priv data too, the nifs run by NIF_ON_THREAD are given an
+// environment of their own which has none
+static ErlNifResourceType* state_type = NULL;
+
+// each executor is a resource, the driver is destroyed by nif_executor_destroy
+// or, failing that, when the last reference to the handle is garbage collected
+static void
+executor_state_dtor(ErlNifEnv* env, void* obj)
+{
+    state_ptr state = (state_ptr) obj;
+
+    if(state->initilised == 1)
+    {
+        // the driver is stopped before it is deleted, as by destroy
+        executor_abort(state->executor_state);
+        executor_destroy(state->executor_state);
+        state->initilised = 0;
+    }
+    enif_rwlock_destroy(state->lock);
+    enif_cond_destroy(state->joined);
+    enif_mutex_destroy(state->join_lock);
+}
+
 static int
 executor_load(ErlNifEnv* env, void** priv, ERL_NIF_TERM load_info)
 {
-    state_ptr state = (state_ptr) enif_alloc(sizeof(struct state_t));
-    state->initilised = 0;
-    *priv = (void*) state;
+    state_type = enif_open_resource_type(env, 
+                                                            NULL, 
+                                                            "executor_state", 
+                                                            executor_state_dtor, 
+                                                            ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, 
+                                                            NULL);
+    if(state_type == NULL)
+    {
+        return -1;
+    }
+    *priv = (void*) state_type;
+    callback_env_load(env);
     return 0;
 }
 
 static void
 executor_unload(ErlNifEnv* env, void* priv)
 {
-    state_ptr state = (state_ptr) priv;
-    enif_free(state);
 }
 
 static int 
@@ -48,44 +82,115 @@ executor_upgrade(ErlNifEnv* env, void** priv, void** old_priv_data, ERL_NIF_TERM
     return executor_load(env, priv, load_info);
 }
 
+// read locks the executor behind a handle for the length of a driver call,
+// returns 0 if the term is not a handle or the executor has been destroyed
+static int
+lock_state(ErlNifEnv* env, ERL_NIF_TERM handle, state_ptr* state)
+{
+
+    if(!enif_get_resource(env, handle, state_type, (void**) state))
+    {
+        return 0;
+    }
+
+    enif_rwlock_rlock((*state)->lock);
+    if((*state)->initilised == 0)
+    {
+        enif_rwlock_runlock((*state)->lock);
+        return 0;
+    }
+    return 1;
+}
+
+static void
+unlock_state(state_ptr state)
+{
+    enif_rwlock_runlock(state->lock);
+}
+
+// join blocks until the driver stops, so the lock is only held to find the
+// driver; a destroy waits for the joiners instead of the joiners holding it off
+static int
+enter_join(state_ptr state)
+{
+    enif_rwlock_rlock(state->lock);
+    if(state->initilised == 0)
+    {
+        enif_rwlock_runlock(state->lock);
+        return 0;
+    }
+    enif_mutex_lock(state->join_lock);
+    state->joining++;
+    enif_mutex_unlock(state->join_lock);
+    enif_rwlock_runlock(state->lock);
+    return 1;
+}
+
+static void
+leave_join(state_ptr state)
+{
+    enif_mutex_lock(state->join_lock);
+    state->joining--;
+    enif_cond_broadcast(state->joined);
+    enif_mutex_unlock(state->join_lock);
+}
+
+static ERL_NIF_TERM
+make_not_inited_error(ErlNifEnv* env)
+{
+    return enif_make_tuple2(env, 
+        enif_make_atom(env, "error"), 
+        enif_make_atom(env, "executor_not_inited"));
+}
+
 static ERL_NIF_TERM
 nif_executor_init(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
+    ErlNifPid pid;
+    char fake[MAXBUFLEN];
 
-    state_ptr state = (state_ptr) enif_priv_data(env);
-    
-    if(state->initilised == 1) 
+    if(!enif_get_local_pid(env, argv[0], &pid))
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "executor_already_inited"));
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "pid");
     }
 
-    ErlNifPid* pid = (ErlNifPid*) enif_alloc(sizeof(ErlNifPid));
+    if(argc == 2 && !enif_get_string(env, argv[1], fake, MAXBUFLEN, ERL_NIF_LATIN1))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "driver");
+    }
 
-    if(!enif_get_local_pid(env, argv[0], pid))
+    ExecutorPtrPair executor_state = executor_init(&pid, argc == 2 ? fake : NULL);
+    if(executor_state.driver == NULL)
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "pid");
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "driver");
     }
-    state->executor_state = executor_init(pid);
-    
+
+    state_ptr state = (state_ptr) enif_alloc_resource(state_type, sizeof(struct state_t));
+    state->lock = enif_rwlock_create("executor_state");
+    state->join_lock = enif_mutex_create("executor_join");
+    state->joined = enif_cond_create("executor_joined");
+    state->joining = 0;
+    state->executor_state = executor_state;
     state->initilised = 1;
-    return enif_make_atom(env, "ok");
+
+    ERL_NIF_TERM handle = enif_make_resource(env, state);
+    enif_release_resource(state);
+
+    return enif_make_tuple2(env, enif_make_atom(env, "ok"), handle);
 }
 
 static ERL_NIF_TERM
 nif_executor_start(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
-    state_ptr state = (state_ptr) enif_priv_data(env);
+    state_ptr state;
     
-    if(state->initilised == 0 ) 
+    if(!lock_state(env, argv[0], &state)) 
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "executor_not_inited"));
+        return make_not_inited_error(env);
     }
     
     ExecutorDriverStatus status = executor_start( state->executor_state );
+    unlock_state(state);
 
     return get_return_value_from_status(env, status);
 }
@@ -94,16 +199,15 @@ nif_executor_start(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 static ERL_NIF_TERM
 nif_executor_abort(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
-    state_ptr state = (state_ptr) enif_priv_data(env);
+    state_ptr state;
     
-    if(state->initilised == 0 ) 
+    if(!lock_state(env, argv[0], &state)) 
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "executor_not_inited"));
+        return make_not_inited_error(env);
     }
     
     ExecutorDriverStatus status = executor_abort( state->executor_state );
+    unlock_state(state);
     
     if(status == 3){ // DRIVER_ABORTED
         return enif_make_tuple2(env, 
@@ -120,16 +224,15 @@ nif_executor_abort(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 static ERL_NIF_TERM
 nif_executor_join(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
-    state_ptr state = (state_ptr) enif_priv_data(env);
+    state_ptr state;
 
-    if(state->initilised == 0 ) 
+    if(!enif_get_resource(env, argv[0], state_type, (void**) &state) || !enter_join(state))
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "executor_not_inited"));
+        return make_not_inited_error(env);
     }
     
     ExecutorDriverStatus status = executor_join( state->executor_state );
+    leave_join(state);
 
     return get_return_value_from_status(env, status);
 }
@@ -138,17 +241,15 @@ nif_executor_join(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 static ERL_NIF_TERM
 nif_executor_stop(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
-
-    state_ptr state = (state_ptr) enif_priv_data(env);
+    state_ptr state;
     
-    if(state->initilised == 0 ) 
+    if(!lock_state(env, argv[0], &state)) 
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "executor_not_inited"));
+        return make_not_inited_error(env);
     }
 
     ExecutorDriverStatus status = executor_stop( state->executor_state );
+    unlock_state(state);
     
     if(status == 4){ // driver_stopped
         return enif_make_tuple2(env, 
@@ -164,25 +265,24 @@ nif_executor_stop(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 static ERL_NIF_TERM
 nif_executor_sendFrameworkMessage(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
 
-    char data[MAXBUFLEN];
-
-    state_ptr state = (state_ptr) enif_priv_data(env);
+    ErlNifBinary data_binary;
+    state_ptr state;
     
-    if(state->initilised == 0 ) 
+    // as nif_scheduler_sendFrameworkMessage
+    if(!enif_inspect_iolist_as_binary(env, argv[1], &data_binary))
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "executor_not_inited"));
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "data");
     }
-    
-    //REVIEW : buffer length
-    if(!enif_get_string(env, argv[0], data , MAXBUFLEN, ERL_NIF_LATIN1 ))
+
+    if(!lock_state(env, argv[0], &state)) 
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "data");
+        return make_not_inited_error(env);
     }
 
     ExecutorDriverStatus status = executor_sendFrameworkMessage( state->executor_state, 
-                                                                        data);
+                                                                        &data_binary);
+    unlock_state(state);
+
     return get_return_value_from_status(env, status);
 }
 
@@ -190,50 +290,375 @@ static ERL_NIF_TERM
 nif_executor_sendStatusUpdate(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
 
     ErlNifBinary taskStatus_binary;
-    state_ptr state = (state_ptr) enif_priv_data(env);
+    state_ptr state;
     
-    if(state->initilised == 0 ) 
+    if (!enif_inspect_binary(env, argv[1], &taskStatus_binary)) 
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "executor_not_inited"));
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_status");
     }
-    
-    if (!enif_inspect_binary(env, argv[0], &taskStatus_binary)) 
+
+    if(!lock_state(env, argv[0], &state)) 
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_status");
+        return make_not_inited_error(env);
     }
 
     ExecutorDriverStatus status = executor_sendStatusUpdate( state->executor_state, 
                                                                     &taskStatus_binary);
+    unlock_state(state);
+
     return get_return_value_from_status(env, status);
 }
 
+static ERL_NIF_TERM
+nif_executor_sendStatusUpdates(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    unsigned int length;
+    state_ptr state;
+
+    if(!enif_get_list_length(env, argv[1], &length))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_status_array");
+    }
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    ExecutorDriverStatus* statuses = (ExecutorDriverStatus*) enif_alloc(sizeof(ExecutorDriverStatus) * (length + 1));
+    int valid = executor_sendStatusUpdates(state->executor_state, env, argv[1], statuses);
+    unlock_state(state);
+
+    ERL_NIF_TERM ret = valid ? get_return_values_from_statuses(env, statuses, length) :
+                               make_argument_error(env, "invalid_or_corrupted_parameter", "task_status_array");
+    enif_free(statuses);
+    return ret;
+}
+
+static ERL_NIF_TERM
+nif_executor_setStatusUpdateWindow(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    unsigned long millis;
+    state_ptr state;
+
+    if(!enif_get_ulong( env, argv[1], &millis))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "millis");
+    }
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    executor_setStatusUpdateWindow(state->executor_state, millis);
+    unlock_state(state);
+
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_executor_statusUpdateStats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    ERL_NIF_TERM stats = executor_statusUpdateStats(state->executor_state, env);
+    unlock_state(state);
+
+    return stats;
+}
+
 static ERL_NIF_TERM
 nif_executor_destroy(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
 
-    state_ptr state = (state_ptr) enif_priv_data(env);
-    
+    state_ptr state;
+
+    if(!enif_get_resource(env, argv[0], state_type, (void**) &state))
+    {
+        return make_not_inited_error(env);
+    }
+
+    // a driver still running is aborted first, which wakes anyone blocked in join
+    if(lock_state(env, argv[0], &state))
+    {
+        executor_abort(state->executor_state);
+        unlock_state(state);
+    }
+
+    // waits for any driver call in progress on another scheduler thread
+    enif_rwlock_rwlock(state->lock);
     if(state->initilised == 0 ) 
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "executor_not_inited"));
+        enif_rwlock_rwunlock(state->lock);
+        return make_not_inited_error(env);
+    }
+    enif_mutex_lock(state->join_lock);
+    while(state->joining > 0)
+    {
+        enif_cond_wait(state->joined, state->join_lock);
     }
+    enif_mutex_unlock(state->join_lock);
     executor_destroy(state->executor_state);
     state->initilised = 0;
+    enif_rwlock_rwunlock(state->lock);
+
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_executor_setMessageFormat(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    char type[MAXBUFLEN];
+    int format;
+    state_ptr state;
+
+    if(!enif_get_atom(env, argv[1], type, MAXBUFLEN, ERL_NIF_LATIN1))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "type");
+    }
+
+    if(!enif_get_int( env, argv[2], &format) || !pb_term_format_supported(format))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "format");
+    }
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int known = executor_setMessageFormat(state->executor_state, type, format);
+    unlock_state(state);
+
+    if(!known)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "type");
+    }
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_executor_setFlowControl(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int valid = executor_setFlowControl(state->executor_state, env, argv[1]);
+    unlock_state(state);
+
+    if(!valid)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "options");
+    }
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_executor_grant(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    unsigned long credits;
+    state_ptr state;
+
+    if(!enif_get_ulong( env, argv[1], &credits))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "credits");
+    }
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    executor_grant(state->executor_state, env, credits);
+    unlock_state(state);
+
     return enif_make_atom(env, "ok");
 }
 
+static ERL_NIF_TERM
+nif_executor_flowControlStats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    ERL_NIF_TERM stats = executor_flowControlStats(state->executor_state, env);
+    unlock_state(state);
+
+    return stats;
+}
+
+static ERL_NIF_TERM
+nif_executor_setMessageChannel(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int valid = executor_setMessageChannel(state->executor_state, env, argv[1]);
+    unlock_state(state);
+
+    if(!valid)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "options");
+    }
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_executor_messageChannelStats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    ERL_NIF_TERM stats = executor_messageChannelStats(state->executor_state, env);
+    unlock_state(state);
+
+    return stats;
+}
+
+static ERL_NIF_TERM
+nif_executor_setDispatch(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int valid = executor_setDispatch(state->executor_state, env, argv[1]);
+    unlock_state(state);
+
+    if(!valid)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "workers");
+    }
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_executor_dispatchStats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    ERL_NIF_TERM stats = executor_dispatchStats(state->executor_state, env);
+    unlock_state(state);
+
+    return stats;
+}
+
+static ERL_NIF_TERM
+nif_executor_fakeDriverStats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+    ERL_NIF_TERM stats;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int fake = executor_fakeDriverStats(state->executor_state, env, &stats);
+    unlock_state(state);
+
+    if(!fake)
+    {
+        return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_atom(env, "not_fake_driver"));
+    }
+    return stats;
+}
+
+static ERL_NIF_TERM
+nif_executor_envStats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return callback_env_stats(env);
+}
+
+static ERL_NIF_TERM
+nif_executor_stats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return metrics_snapshot(env);
+}
+
+// records how long the executor process took to handle a callback message
+static ERL_NIF_TERM
+nif_executor_observe(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    char name[MAXBUFLEN] = "executor_handle_";
+    size_t prefix = strlen(name);
+    unsigned long nanos;
+
+    if(!enif_get_atom(env, argv[0], name + prefix, MAXBUFLEN - prefix, ERL_NIF_LATIN1))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "message");
+    }
+
+    if(!enif_get_ulong(env, argv[1], &nanos))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "nanos");
+    }
+
+    metrics_observe(name, nanos);
+    return enif_make_atom(env, "ok");
+}
+
+NIF_ON_THREAD(nif_executor_join)
+NIF_ON_THREAD(nif_executor_abort)
+NIF_ON_THREAD(nif_executor_stop)
+NIF_ON_THREAD(nif_executor_sendStatusUpdates)
+NIF_ON_THREAD(nif_executor_destroy)
+
 static ErlNifFunc executor_nif_funcs[] = {
     {"nif_executor_init", 1, nif_executor_init},
-    {"nif_executor_start", 0, nif_executor_start},
-    {"nif_executor_join", 0, nif_executor_join},
-    {"nif_executor_abort", 0, nif_executor_abort},
-    {"nif_executor_stop", 0, nif_executor_stop},
-    {"nif_executor_sendFrameworkMessage", 1,nif_executor_sendFrameworkMessage},
-    {"nif_executor_sendStatusUpdate", 1,nif_executor_sendStatusUpdate},
-    {"nif_executor_destroy" , 0, nif_executor_destroy}
+    {"nif_executor_init", 2, nif_executor_init},
+    {"nif_executor_start", 1, nif_executor_start},
+    {"nif_executor_join", 1, NIF_BLOCKING(nif_executor_join)},
+    {"nif_executor_abort", 1, NIF_BLOCKING(nif_executor_abort)},
+    {"nif_executor_stop", 1, NIF_BLOCKING(nif_executor_stop)},
+    {"nif_executor_sendFrameworkMessage", 2,nif_executor_sendFrameworkMessage},
+    {"nif_executor_sendStatusUpdate", 2,nif_executor_sendStatusUpdate},
+    // a driver call per update, long lists take longer than a nif should
+    {"nif_executor_sendStatusUpdates", 2, NIF_BLOCKING(nif_executor_sendStatusUpdates)},
+    {"nif_executor_setStatusUpdateWindow", 2, nif_executor_setStatusUpdateWindow},
+    {"nif_executor_statusUpdateStats", 1, nif_executor_statusUpdateStats},
+    {"nif_executor_destroy" , 1, NIF_BLOCKING(nif_executor_destroy)},
+    {"nif_executor_envStats", 0, nif_executor_envStats},
+    {"nif_executor_stats", 0, nif_executor_stats},
+    {"nif_executor_observe", 2, nif_executor_observe},
+    {"nif_executor_setMessageFormat", 3, nif_executor_setMessageFormat},
+    {"nif_executor_setFlowControl", 2, nif_executor_setFlowControl},
+    {"nif_executor_grant", 2, nif_executor_grant},
+    {"nif_executor_flowControlStats", 1, nif_executor_flowControlStats},
+    {"nif_executor_fakeDriverStats", 1, nif_executor_fakeDriverStats},
+    {"nif_executor_setMessageChannel", 2, nif_executor_setMessageChannel},
+    {"nif_executor_messageChannelStats", 1, nif_executor_messageChannelStats},
+    {"nif_executor_setDispatch", 2, nif_executor_setDispatch},
+    {"nif_executor_dispatchStats", 1, nif_executor_dispatchStats}
     
 };
 
@@ -19,7 +19,9 @@
 
 
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
+#include <memory>
 
 #include "erl_nif.h"
 
@@ -30,6 +32,14 @@
 #include <mesos/executor.hpp>
 #include "mesos/mesos.pb.h"
 #include "utils.hpp"
+#include "callback_env.hpp"
+#include "pb_term.hpp"
+#include "metrics.hpp"
+#include "flow_control.hpp"
+#include "fake_driver.hpp"
+#include "message_channel.hpp"
+#include "dispatcher.hpp"
+#include "status_coalescer.hpp"
 
 using namespace mesos;
 using namespace std;
@@ -107,18 +117,54 @@ public:
    */
   virtual void error(ExecutorDriver* driver, const string& message);
 
-  ErlNifPid* pid;
+  ErlNifPid pid;
+
+  // binary, record or map per message type
+  PbTermFormats formats;
+
+  // credits granted by the owner for callback messages
+  FlowControl flow;
+
+  // framework messages sent and received in frames, once configured
+  std::unique_ptr<MessageChannel> channel;
+
+  // worker processes task callbacks go to instead of pid, once set
+  Dispatcher dispatch;
+
+  // status updates sent, with non-terminal ones held once a window is set
+  std::unique_ptr<StatusCoalescer> statusUpdates;
 };
 
-ExecutorPtrPair executor_init(ErlNifPid* pid)
+ExecutorPtrPair executor_init(ErlNifPid* pid, const char* fake)
 {
+    METRIC_TIMER(timer, "executor_init");
+
 
     ExecutorPtrPair ret ;
     
     CExecutor* executor = new CExecutor();
-    executor->pid = pid;
-
-    MesosExecutorDriver* driver = new MesosExecutorDriver(executor);
+    executor->pid = *pid;
+
+    ExecutorDriver* driver;
+
+    if(fake != NULL)
+    {
+      FakeExecutorDriver::Config config;
+      if(strncmp(fake, FAKE_DRIVER_SCHEME, strlen(FAKE_DRIVER_SCHEME)) != 0 || !config.parse(fake))
+      {
+        delete executor;
+        ret.driver = NULL;
+        ret.executor = NULL;
+        return ret;
+      }
+      driver = new FakeExecutorDriver(executor, config);
+    }else
+    {
+      driver = new MesosExecutorDriver(executor);
+    }
+
+    executor->channel.reset(new MessageChannel(driver));
+    executor->statusUpdates.reset(new StatusCoalescer(driver));
 
     ret.driver = driver;
     ret.executor = executor;
@@ -127,54 +173,79 @@ ExecutorPtrPair executor_init(ErlNifPid* pid)
 
 ExecutorDriverStatus executor_start(ExecutorPtrPair state)
 {
+    METRIC_TIMER(timer, "executor_start");
+
     assert(state.driver != NULL);
 
-    MesosExecutorDriver* driver = reinterpret_cast<MesosExecutorDriver*> (state.driver);
+    ExecutorDriver* driver = reinterpret_cast<ExecutorDriver*> (state.driver);
     return driver->start();
 }
 
 ExecutorDriverStatus executor_stop(ExecutorPtrPair state)
 {
+    METRIC_TIMER(timer, "executor_stop");
+
     assert(state.driver != NULL);
 
-    MesosExecutorDriver* driver = reinterpret_cast<MesosExecutorDriver*> (state.driver);
+    // the slave is still told of the tasks' latest states
+    reinterpret_cast<CExecutor*>(state.executor)->statusUpdates->flush();
+
+    ExecutorDriver* driver = reinterpret_cast<ExecutorDriver*> (state.driver);
     return driver->stop();
 }
 
 ExecutorDriverStatus executor_abort(ExecutorPtrPair state)
 {
+    METRIC_TIMER(timer, "executor_abort");
+
     assert(state.driver != NULL);
 
-    MesosExecutorDriver* driver = reinterpret_cast<MesosExecutorDriver*> (state.driver);
+    ExecutorDriver* driver = reinterpret_cast<ExecutorDriver*> (state.driver);
     return driver->abort();
 }
 
 ExecutorDriverStatus executor_join(ExecutorPtrPair state)
 {
+    METRIC_TIMER(timer, "executor_join");
+
     assert(state.driver != NULL);
 
-    MesosExecutorDriver* driver = reinterpret_cast<MesosExecutorDriver*> (state.driver);
+    ExecutorDriver* driver = reinterpret_cast<ExecutorDriver*> (state.driver);
     return driver->join();
 }
 
 ExecutorDriverStatus executor_run(ExecutorPtrPair state)
 {
+    METRIC_TIMER(timer, "executor_run");
+
     assert(state.driver != NULL);
 
-    MesosExecutorDriver* driver = reinterpret_cast<MesosExecutorDriver*> (state.driver);
+    ExecutorDriver* driver = reinterpret_cast<ExecutorDriver*> (state.driver);
     return driver->run();
 
 }
-ExecutorDriverStatus executor_sendFrameworkMessage(ExecutorPtrPair state, const char* data)
+ExecutorDriverStatus executor_sendFrameworkMessage(ExecutorPtrPair state, ErlNifBinary* data)
 {
+    METRIC_TIMER(timer, "executor_sendFrameworkMessage");
+    timer.addBytes(binary_bytes(data));
+
     assert(state.driver != NULL);
     assert(data != NULL);    
 
-    MesosExecutorDriver* driver = reinterpret_cast<MesosExecutorDriver*> (state.driver);
-    return driver->sendFrameworkMessage(data);
+    MessageChannel* channel = reinterpret_cast<CExecutor*>(state.executor)->channel.get();
+    if(channel->enabled())
+    {
+      return channel->send(ExecutorID(), SlaveID(), string((const char*) data->data, data->size));
+    }
+
+    ExecutorDriver* driver = reinterpret_cast<ExecutorDriver*> (state.driver);
+    return driver->sendFrameworkMessage(string((const char*) data->data, data->size));
 }
 ExecutorDriverStatus executor_sendStatusUpdate(ExecutorPtrPair state, ErlNifBinary* taskStatus)
 {
+    METRIC_TIMER(timer, "executor_sendStatusUpdate");
+    timer.addBytes(binary_bytes(taskStatus));
+
     assert(state.driver != NULL);
     assert(taskStatus != NULL);    
 
@@ -182,18 +253,161 @@ ExecutorDriverStatus executor_sendStatusUpdate(ExecutorPtrPair state, ErlNifBina
 
     if(!deserialize<TaskStatus>(taskStatus_pb,taskStatus)) { return DRIVER_ABORTED; };
 
-    MesosExecutorDriver* driver = reinterpret_cast<MesosExecutorDriver*> (state.driver);
-    return driver->sendStatusUpdate(taskStatus_pb);
+    return reinterpret_cast<CExecutor*>(state.executor)->statusUpdates->send(taskStatus_pb);
+}
+
+int executor_sendStatusUpdates(ExecutorPtrPair state, 
+                               ErlNifEnv* env,
+                               ERL_NIF_TERM taskStatuses, 
+                               ExecutorDriverStatus* statuses)
+{
+    METRIC_TIMER(timer, "executor_sendStatusUpdates");
+
+    assert(state.executor != NULL);
+    assert(statuses != NULL);
+
+    vector<TaskStatus> taskStatus_;
+    if(!pb_terms_to_objs<TaskStatus>(env, taskStatuses, taskStatus_)) { return 0; }
+
+    StatusCoalescer* coalescer = reinterpret_cast<CExecutor*>(state.executor)->statusUpdates.get();
+    for(size_t i = 0; i < taskStatus_.size(); i++)
+    {
+      statuses[i] = coalescer->send(taskStatus_[i]);
+    }
+    return 1;
+}
+
+void executor_setStatusUpdateWindow(ExecutorPtrPair state, unsigned long millis)
+{
+    METRIC_TIMER(timer, "executor_setStatusUpdateWindow");
+
+    assert(state.executor != NULL);
+
+    reinterpret_cast<CExecutor*>(state.executor)->statusUpdates->setWindow(millis);
+}
+
+ERL_NIF_TERM executor_statusUpdateStats(ExecutorPtrPair state, ErlNifEnv* env)
+{
+    METRIC_TIMER(timer, "executor_statusUpdateStats");
+
+    assert(state.executor != NULL);
+
+    return reinterpret_cast<CExecutor*>(state.executor)->statusUpdates->stats(env);
+}
+
+int executor_setMessageFormat(ExecutorPtrPair state, const char* type, int format)
+{
+    METRIC_TIMER(timer, "executor_setMessageFormat");
+
+    assert(state.executor != NULL);
+    assert(type != NULL);
+
+    const google::protobuf::Descriptor* descriptor = pb_find_type(type);
+    if(descriptor == NULL || !pb_term_format_supported(format)) { return 0; }
+
+    CExecutor* executor = reinterpret_cast<CExecutor*>(state.executor);
+    executor->formats.set(descriptor, format);
+    return 1;
+}
+
+int executor_setFlowControl(ExecutorPtrPair state, ErlNifEnv* env, ERL_NIF_TERM options)
+{
+    METRIC_TIMER(timer, "executor_setFlowControl");
+
+    assert(state.executor != NULL);
+
+    CExecutor* executor = reinterpret_cast<CExecutor*>(state.executor);
+    return executor->flow.configure(env, options) ? 1 : 0;
+}
+
+void executor_grant(ExecutorPtrPair state, ErlNifEnv* env, unsigned long credits)
+{
+    METRIC_TIMER(timer, "executor_grant");
+
+    assert(state.executor != NULL);
+
+    CExecutor* executor = reinterpret_cast<CExecutor*>(state.executor);
+    executor->flow.grant(env, credits);
+}
+
+ERL_NIF_TERM executor_flowControlStats(ExecutorPtrPair state, ErlNifEnv* env)
+{
+    METRIC_TIMER(timer, "executor_flowControlStats");
+
+    assert(state.executor != NULL);
+
+    CExecutor* executor = reinterpret_cast<CExecutor*>(state.executor);
+    return executor->flow.stats(env);
+}
+
+int executor_setMessageChannel(ExecutorPtrPair state, ErlNifEnv* env, ERL_NIF_TERM options)
+{
+    METRIC_TIMER(timer, "executor_setMessageChannel");
+
+    assert(state.executor != NULL);
+
+    CExecutor* executor = reinterpret_cast<CExecutor*>(state.executor);
+    return executor->channel->configure(env, options) ? 1 : 0;
+}
+
+int executor_setDispatch(ExecutorPtrPair state, ErlNifEnv* env, ERL_NIF_TERM workers)
+{
+    METRIC_TIMER(timer, "executor_setDispatch");
+
+    assert(state.executor != NULL);
+
+    CExecutor* executor = reinterpret_cast<CExecutor*>(state.executor);
+    return executor->dispatch.set(env, workers) ? 1 : 0;
+}
+
+ERL_NIF_TERM executor_dispatchStats(ExecutorPtrPair state, ErlNifEnv* env)
+{
+    METRIC_TIMER(timer, "executor_dispatchStats");
+
+    assert(state.executor != NULL);
+
+    CExecutor* executor = reinterpret_cast<CExecutor*>(state.executor);
+    return executor->dispatch.stats(env);
+}
+
+ERL_NIF_TERM executor_messageChannelStats(ExecutorPtrPair state, ErlNifEnv* env)
+{
+    METRIC_TIMER(timer, "executor_messageChannelStats");
+
+    assert(state.executor != NULL);
+
+    CExecutor* executor = reinterpret_cast<CExecutor*>(state.executor);
+    return executor->channel->stats(env);
+}
+
+int executor_fakeDriverStats(ExecutorPtrPair state, ErlNifEnv* env, ERL_NIF_TERM* stats)
+{
+    METRIC_TIMER(timer, "executor_fakeDriverStats");
+
+    assert(state.driver != NULL);
+
+    FakeExecutorDriver* driver = dynamic_cast<FakeExecutorDriver*>(reinterpret_cast<ExecutorDriver*>(state.driver));
+    if(driver == NULL)
+    {
+        return 0;
+    }
+    *stats = driver->stats(env);
+    return 1;
 }
 
 void executor_destroy(ExecutorPtrPair state)
 {
+    METRIC_TIMER(timer, "executor_destroy");
+
     assert(state.driver != NULL);
     assert(state.executor != NULL);
 
-    MesosExecutorDriver* driver = reinterpret_cast<MesosExecutorDriver*>(state.driver);
+    ExecutorDriver* driver = reinterpret_cast<ExecutorDriver*>(state.driver);
     CExecutor* executor = reinterpret_cast<CExecutor*>(state.executor);
 
+    // the workers of the channel and of the held status updates call the driver
+    executor->statusUpdates->stop();
+    executor->channel->stop();
     delete driver;
     delete executor;
 }
@@ -204,125 +418,135 @@ void CExecutor::registered(ExecutorDriver* driver,
                       const FrameworkInfo& frameworkInfo,
                       const SlaveInfo& slaveInfo)
 {
-    assert(this->pid != NULL);
+    METRIC_TIMER(timer, "executor_callback_registered");
+
 
-    ErlNifEnv* env = enif_alloc_env();
+    CallbackEnv env;
 
-    ERL_NIF_TERM executorInfo_pb = pb_obj_to_binary(env, executorInfo);
-    ERL_NIF_TERM frameworkInfo_pb = pb_obj_to_binary(env, frameworkInfo);
-    ERL_NIF_TERM slaveInfo_pb = pb_obj_to_binary(env, slaveInfo);
+    const google::protobuf::Message* objs[] = { &executorInfo, &frameworkInfo, &slaveInfo };
+    ERL_NIF_TERM objs_pb[3];
+    this->formats.encode(env, objs, objs_pb, 3);
 
     ERL_NIF_TERM message = enif_make_tuple4(env, 
-                              enif_make_atom(env, "registered"), 
-                              executorInfo_pb,
-                              frameworkInfo_pb,
-                              slaveInfo_pb);
+                              callback_atoms.registered, 
+                              objs_pb[0],
+                              objs_pb[1],
+                              objs_pb[2]);
     
-    enif_send(NULL, this->pid, env, message);
-    enif_clear_env(env);
+    this->flow.send(env, &this->pid, message, FlowControl::RELIABLE);
 }
 
 void CExecutor::reregistered(ExecutorDriver* driver,
                       const SlaveInfo& slaveInfo)
 {
-    assert(this->pid != NULL);
+    METRIC_TIMER(timer, "executor_callback_reregistered");
+
 
-    ErlNifEnv* env = enif_alloc_env();
+    CallbackEnv env;
 
-    ERL_NIF_TERM slaveInfo_pb = pb_obj_to_binary(env, slaveInfo);
+    ERL_NIF_TERM slaveInfo_pb = this->formats.encode(env, slaveInfo);
 
     ERL_NIF_TERM message = enif_make_tuple2(env, 
-                              enif_make_atom(env, "reregistered"), 
+                              callback_atoms.reregistered, 
                               slaveInfo_pb);
     
-    enif_send(NULL, this->pid, env, message);
-    enif_clear_env(env);
+    this->flow.send(env, &this->pid, message, FlowControl::RELIABLE);
 }
 
 void CExecutor::disconnected(ExecutorDriver* driver)
 {
-    assert(this->pid != NULL);
+    METRIC_TIMER(timer, "executor_callback_disconnected");
 
-    ErlNifEnv* env = enif_alloc_env();
 
-    ERL_NIF_TERM message = enif_make_tuple(env, 
-                              enif_make_atom(env, "disconnected"));
+    CallbackEnv env;
+
+    ERL_NIF_TERM message = enif_make_tuple1(env, 
+                              callback_atoms.disconnected);
     
-    enif_send(NULL, this->pid, env, message);
-    enif_clear_env(env);
+    this->flow.send(env, &this->pid, message, FlowControl::RELIABLE);
 }
 
 void CExecutor::launchTask(ExecutorDriver* driver, const TaskInfo& task)
 {
-    assert(this->pid != NULL);
+    METRIC_TIMER(timer, "executor_callback_launchTask");
+
 
-    ErlNifEnv* env = enif_alloc_env();
+    CallbackEnv env;
 
-    ERL_NIF_TERM task_pb = pb_obj_to_binary(env, task);
+    ERL_NIF_TERM task_pb = this->formats.encode(env, task);
 
     ERL_NIF_TERM message = enif_make_tuple2(env, 
-                              enif_make_atom(env, "launchTask"), 
+                              callback_atoms.launchTask, 
                               task_pb);
     
-    enif_send(NULL, this->pid, env, message);
-    enif_clear_env(env);
+    ErlNifPid worker;
+    this->flow.send(env, this->dispatch.route(task.task_id().value(), &this->pid, &worker), message, FlowControl::RELIABLE);
 }
 
 void CExecutor::killTask(ExecutorDriver* driver, const TaskID& taskId)
 {
-    assert(this->pid != NULL);
+    METRIC_TIMER(timer, "executor_callback_killTask");
+
 
-    ErlNifEnv* env = enif_alloc_env();
+    CallbackEnv env;
 
-    ERL_NIF_TERM taskid_pb = pb_obj_to_binary(env, taskId);
+    ERL_NIF_TERM taskid_pb = this->formats.encode(env, taskId);
 
     ERL_NIF_TERM message = enif_make_tuple2(env, 
-                              enif_make_atom(env, "killTask"), 
+                              callback_atoms.killTask, 
                               taskid_pb);
     
-    enif_send(NULL, this->pid, env, message);
-    enif_clear_env(env);    
+    ErlNifPid worker;
+    this->flow.send(env, this->dispatch.route(taskId.value(), &this->pid, &worker), message, FlowControl::RELIABLE);
 }
 
 void CExecutor::frameworkMessage(ExecutorDriver* driver, const string& data)
 {
-    assert(this->pid != NULL);
+    METRIC_TIMER(timer, "executor_callback_frameworkMessage");
 
-    ErlNifEnv* env = enif_alloc_env();
 
-    ERL_NIF_TERM message = enif_make_tuple2(env, 
-                              enif_make_atom(env, "frameworkMessage"), 
-                               enif_make_string(env, data.c_str(), ERL_NIF_LATIN1));
-    
-    enif_send(NULL, this->pid, env, message);
-    enif_clear_env(env);    
+    // as CScheduler::frameworkMessage
+    vector<string> unpacked;
+    bool framed = this->channel->unpack(data, unpacked);
+    size_t count = framed ? unpacked.size() : 1;
+
+    CallbackEnv env;
+
+    for(size_t i = 0; i < count; i++)
+    {
+      ERL_NIF_TERM message = enif_make_tuple2(env, 
+                                callback_atoms.frameworkMessage, 
+                                env.data(framed ? unpacked[i] : data));
+      
+      this->flow.send(env, &this->pid, message, FlowControl::BEST_EFFORT);
+    }
 }
 
 
 void CExecutor::shutdown(ExecutorDriver* driver)
 {
-    assert(this->pid != NULL);
+    METRIC_TIMER(timer, "executor_callback_shutdown");
+
 
-    ErlNifEnv* env = enif_alloc_env();
+    CallbackEnv env;
 
-    ERL_NIF_TERM message = enif_make_tuple(env, 
-                              enif_make_atom(env, "shutdown"));
+    ERL_NIF_TERM message = enif_make_tuple1(env, 
+                              callback_atoms.shutdown);
     
-    enif_send(NULL, this->pid, env, message);
-    enif_clear_env(env);
+    this->flow.send(env, &this->pid, message, FlowControl::RELIABLE);
 }
 
 void CExecutor::error(ExecutorDriver* driver, const string& messageStr)
 {
-    assert(this->pid != NULL);
+    METRIC_TIMER(timer, "executor_callback_error");
+
 
-    ErlNifEnv* env = enif_alloc_env();
+    CallbackEnv env;
 
     ERL_NIF_TERM message = enif_make_tuple2(env, 
-                              enif_make_atom(env, "error"), 
-                              enif_make_string(env, messageStr.c_str(), ERL_NIF_LATIN1));
+                              callback_atoms.error, 
+                              env.string(messageStr));
     
-    enif_send(NULL, this->pid, env, message);
-    enif_clear_env(env);
+    this->flow.send(env, &this->pid, message, FlowControl::RELIABLE);
 
 }
\ No newline at end of file
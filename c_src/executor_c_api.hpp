@@ -30,15 +30,40 @@
 extern "C" {
 #endif
 
-    ExecutorPtrPair executor_init(ErlNifPid* pid);
+    // fake is NULL for the mesos driver or a fake:// url selecting FakeExecutorDriver,
+    // the driver is NULL if the url is not valid
+    ExecutorPtrPair executor_init(ErlNifPid* pid, const char* fake);
     ExecutorDriverStatus executor_start(ExecutorPtrPair state);
     ExecutorDriverStatus executor_stop(ExecutorPtrPair state);
     ExecutorDriverStatus executor_abort(ExecutorPtrPair state);
     ExecutorDriverStatus executor_join(ExecutorPtrPair state);
     ExecutorDriverStatus executor_run(ExecutorPtrPair state);
-    ExecutorDriverStatus executor_sendFrameworkMessage(ExecutorPtrPair state, const char* data);
+    // data is any bytes, of any length mesos allows
+    ExecutorDriverStatus executor_sendFrameworkMessage(ExecutorPtrPair state, ErlNifBinary* data);
     ExecutorDriverStatus executor_sendStatusUpdate(ExecutorPtrPair state, ErlNifBinary* taskStatus);
+    // taskStatuses is a list of records, maps or binaries, see pb_term.hpp. Sets a status
+    // per update in statuses, which has room for them all, returns 0 and sends none if
+    // any is not a TaskStatus
+    int executor_sendStatusUpdates(ExecutorPtrPair state, ErlNifEnv* env, ERL_NIF_TERM taskStatuses, ExecutorDriverStatus* statuses);
+    // holds non-terminal status updates for millis, see status_coalescer.hpp, 0 to stop
+    void executor_setStatusUpdateWindow(ExecutorPtrPair state, unsigned long millis);
+    ERL_NIF_TERM executor_statusUpdateStats(ExecutorPtrPair state, ErlNifEnv* env);
     void executor_destroy(ExecutorPtrPair state);
+    int executor_setMessageFormat(ExecutorPtrPair state, const char* type, int format);
+    // as scheduler_setFlowControl, scheduler_grant and scheduler_flowControlStats
+    int executor_setFlowControl(ExecutorPtrPair state, ErlNifEnv* env, ERL_NIF_TERM options);
+    void executor_grant(ExecutorPtrPair state, ErlNifEnv* env, unsigned long credits);
+    ERL_NIF_TERM executor_flowControlStats(ExecutorPtrPair state, ErlNifEnv* env);
+    // as scheduler_fakeDriverStats
+    int executor_fakeDriverStats(ExecutorPtrPair state, ErlNifEnv* env, ERL_NIF_TERM* stats);
+    // as scheduler_setMessageChannel and scheduler_messageChannelStats, with the scheduler
+    // as the one destination
+    int executor_setMessageChannel(ExecutorPtrPair state, ErlNifEnv* env, ERL_NIF_TERM options);
+    ERL_NIF_TERM executor_messageChannelStats(ExecutorPtrPair state, ErlNifEnv* env);
+    // as scheduler_setDispatch and scheduler_dispatchStats, launchTask and killTask are
+    // routed by task id
+    int executor_setDispatch(ExecutorPtrPair state, ErlNifEnv* env, ERL_NIF_TERM workers);
+    ERL_NIF_TERM executor_dispatchStats(ExecutorPtrPair state, ErlNifEnv* env);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,91 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include "executor_set.hpp"
+
+using namespace mesos;
+using namespace std;
+
+string ExecutorSet::key(const ExecutorID& executorId, const SlaveID& slaveId)
+{
+  string key(executorId.value());
+  key.push_back('\0');
+  key.append(slaveId.value());
+  return key;
+}
+
+void ExecutorSet::add(const ExecutorID& executorId, const SlaveID& slaveId)
+{
+  string key_ = key(executorId, slaveId);
+
+  lock_guard<mutex> guard(lock);
+  if(executors.count(key_) > 0) { return; }
+
+  executors[key_] = make_pair(executorId, slaveId);
+}
+
+void ExecutorSet::launched(const vector<TaskInfo>& tasks)
+{
+  for(size_t i = 0; i < tasks.size(); i++)
+  {
+    if(tasks[i].has_executor())
+    {
+      add(tasks[i].executor().executor_id(), tasks[i].slave_id());
+    }
+  }
+}
+
+void ExecutorSet::remove(const ExecutorID& executorId, const SlaveID& slaveId)
+{
+  string key_ = key(executorId, slaveId);
+
+  lock_guard<mutex> guard(lock);
+  executors.erase(key_);
+}
+
+void ExecutorSet::removeSlave(const SlaveID& slaveId)
+{
+  lock_guard<mutex> guard(lock);
+
+  unordered_map<string, pair<ExecutorID, SlaveID> >::iterator it = executors.begin();
+  while(it != executors.end())
+  {
+    if(it->second.second.value() == slaveId.value())
+    {
+      it = executors.erase(it);
+    }else
+    {
+      ++it;
+    }
+  }
+}
+
+void ExecutorSet::list(vector<ExecutorID>& executorIds, vector<SlaveID>& slaveIds) const
+{
+  lock_guard<mutex> guard(lock);
+
+  executorIds.reserve(executorIds.size() + executors.size());
+  slaveIds.reserve(slaveIds.size() + executors.size());
+  for(unordered_map<string, pair<ExecutorID, SlaveID> >::const_iterator it = executors.begin(); it != executors.end(); ++it)
+  {
+    executorIds.push_back(it->second.first);
+    slaveIds.push_back(it->second.second);
+  }
+}
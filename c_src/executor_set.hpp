@@ -0,0 +1,60 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_EXECUTOR_SET_HPP
+#define MESOS_EXECUTOR_SET_HPP
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mesos/mesos.pb.h"
+
+/**
+ * The executors of the framework known to be running, the targets of a
+ * broadcast to all of them.
+ *
+ * An executor is added when a task naming it is launched, or when a
+ * status update or framework message comes from it, and removed when it
+ * or its slave is lost. Tasks run by the command executor are not
+ * tracked, it takes no framework messages.
+ */
+class ExecutorSet
+{
+public:
+  void add(const mesos::ExecutorID& executorId, const mesos::SlaveID& slaveId);
+  // adds the executor of each task that has one
+  void launched(const std::vector<mesos::TaskInfo>& tasks);
+  void remove(const mesos::ExecutorID& executorId, const mesos::SlaveID& slaveId);
+  void removeSlave(const mesos::SlaveID& slaveId);
+
+  // appends every executor and its slave
+  void list(std::vector<mesos::ExecutorID>& executorIds, std::vector<mesos::SlaveID>& slaveIds) const;
+
+private:
+  static std::string key(const mesos::ExecutorID& executorId, const mesos::SlaveID& slaveId);
+
+  mutable std::mutex lock;
+  std::unordered_map<std::string, std::pair<mesos::ExecutorID, mesos::SlaveID> > executors;
+};
+
+#endif // MESOS_EXECUTOR_SET_HPP
@@ -0,0 +1,781 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fake_driver.hpp"
+#include "erlang_mesos.hpp"
+#include "utils.hpp"
+
+using namespace mesos;
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// splits the key=value pairs after the scheme, and the '?' if there is one
+static bool parse_query(const string& url, vector<pair<string, double> >& pairs)
+{
+  string query = url.substr(url.compare(0, strlen(FAKE_DRIVER_SCHEME), FAKE_DRIVER_SCHEME) == 0 ? strlen(FAKE_DRIVER_SCHEME) : 0);
+  size_t start = query.find('?');
+  start = start == string::npos ? 0 : start + 1;
+
+  while(start < query.size())
+  {
+    size_t end = query.find('&', start);
+    if(end == string::npos) { end = query.size(); }
+
+    string pair = query.substr(start, end - start);
+    start = end + 1;
+    if(pair.empty()) { continue; }
+
+    size_t equals = pair.find('=');
+    if(equals == string::npos || equals == 0 || equals + 1 == pair.size()) { return false; }
+
+    string value = pair.substr(equals + 1);
+    char* last;
+    double number = strtod(value.c_str(), &last);
+    if(*last != '\0' || number < 0) { return false; }
+
+    pairs.push_back(make_pair(pair.substr(0, equals), number));
+  }
+  return true;
+}
+
+// the time between events at rate per second
+static Clock::duration interval(double rate)
+{
+  return chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / rate));
+}
+
+// moves next on by step, without letting it fall behind now so a slow
+// consumer is not flooded by the events it missed
+static void advance(Clock::time_point& next, Clock::duration step, Clock::time_point now)
+{
+  next += step;
+  if(next < now) { next = now; }
+}
+
+static double timestamp()
+{
+  return chrono::duration<double>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static void add_scalar(Offer& offer, const char* name, double value)
+{
+  Resource* resource = offer.add_resources();
+  resource->set_name(name);
+  resource->set_type(Value::SCALAR);
+  resource->mutable_scalar()->set_value(value);
+  resource->set_role("*");
+}
+
+FakeSchedulerDriver::Config::Config()
+  : offerRate(1000),
+    offersPerCycle(10),
+    slaves(100),
+    maxOutstanding(1000),
+    cpus(4),
+    mem(8192),
+    disk(65536),
+    attributes(0),
+    finishTasks(true),
+    duplicateUpdates(false),
+    answerReconciliation(true),
+    messageRate(0),
+    messageSize(64),
+    echoMessages(false)
+{
+}
+
+bool FakeSchedulerDriver::Config::parse(const string& url)
+{
+  vector<pair<string, double> > pairs;
+  if(!parse_query(url, pairs)) { return false; }
+
+  for(size_t i = 0; i < pairs.size(); i++)
+  {
+    const string& key = pairs[i].first;
+    double value = pairs[i].second;
+
+    if(key == "offer_rate") { offerRate = value; }
+    else if(key == "offers_per_cycle") { offersPerCycle = value; }
+    else if(key == "slaves") { slaves = value; }
+    else if(key == "max_outstanding") { maxOutstanding = value; }
+    else if(key == "cpus") { cpus = value; }
+    else if(key == "mem") { mem = value; }
+    else if(key == "disk") { disk = value; }
+    else if(key == "attributes") { attributes = value; }
+    else if(key == "finish_tasks") { finishTasks = value != 0; }
+    else if(key == "duplicate_updates") { duplicateUpdates = value != 0; }
+    else if(key == "answer_reconciliation") { answerReconciliation = value != 0; }
+    else if(key == "message_rate") { messageRate = value; }
+    else if(key == "message_size") { messageSize = value; }
+    else if(key == "echo_messages") { echoMessages = value != 0; }
+    else { return false; }
+  }
+  return offersPerCycle > 0 && slaves > 0;
+}
+
+FakeSchedulerDriver::FakeSchedulerDriver(Scheduler* scheduler_,
+                                         const FrameworkInfo& framework_,
+                                         const Config& config_,
+                                         bool implicitAcknowledgements_)
+  : scheduler(scheduler_),
+    framework(framework_),
+    config(config_),
+    implicitAcknowledgements(implicitAcknowledgements_),
+    status(DRIVER_NOT_STARTED),
+    suppressed(false),
+    revived(true),
+    nextOfferId(0),
+    nextUuid(0),
+    offered(0),
+    launchedTasks(0),
+    accepted(0),
+    declined(0),
+    killed(0),
+    acknowledged(0),
+    reconciled(0),
+    revives(0),
+    requests(0),
+    updatesSent(0),
+    messagesSent(0),
+    messagesReceived(0),
+    invalidOffers(0)
+{
+  if(!framework.has_id())
+  {
+    framework.mutable_id()->set_value("fake-framework");
+  }
+}
+
+FakeSchedulerDriver::~FakeSchedulerDriver()
+{
+  {
+    lock_guard<mutex> guard(lock);
+    if(status == DRIVER_RUNNING) { status = DRIVER_STOPPED; }
+    changed.notify_all();
+  }
+  if(thread.joinable()) { thread.join(); }
+}
+
+Status FakeSchedulerDriver::start()
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_NOT_STARTED) { return status; }
+
+  status = DRIVER_RUNNING;
+  thread = std::thread(&FakeSchedulerDriver::generate, this);
+  return status;
+}
+
+Status FakeSchedulerDriver::stop(bool failover)
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING && status != DRIVER_ABORTED) { return status; }
+
+  bool aborted = status == DRIVER_ABORTED;
+  status = DRIVER_STOPPED;
+  changed.notify_all();
+  return aborted ? DRIVER_ABORTED : DRIVER_STOPPED;
+}
+
+Status FakeSchedulerDriver::abort()
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING) { return status; }
+
+  status = DRIVER_ABORTED;
+  changed.notify_all();
+  return status;
+}
+
+Status FakeSchedulerDriver::join()
+{
+  unique_lock<mutex> guard(lock);
+  while(status == DRIVER_RUNNING)
+  {
+    changed.wait(guard);
+  }
+  return status;
+}
+
+Status FakeSchedulerDriver::run()
+{
+  Status started = start();
+  return started != DRIVER_RUNNING ? started : join();
+}
+
+Status FakeSchedulerDriver::requestResources(const vector<Request>& requests_)
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING) { return status; }
+
+  requests++;
+  return status;
+}
+
+Status FakeSchedulerDriver::launchTasks(const vector<OfferID>& offerIds,
+                                        const vector<TaskInfo>& tasks,
+                                        const Filters& filters)
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING) { return status; }
+
+  bool valid = useOffers(offerIds);
+  for(size_t i = 0; i < tasks.size(); i++)
+  {
+    if(valid) { launched(tasks[i]); }
+    else { queueStatus(tasks[i].task_id(), tasks[i].slave_id(), TASK_LOST, false); }
+  }
+  changed.notify_all();
+  return status;
+}
+
+Status FakeSchedulerDriver::launchTasks(const OfferID& offerId,
+                                        const vector<TaskInfo>& tasks,
+                                        const Filters& filters)
+{
+  return launchTasks(vector<OfferID>(1, offerId), tasks, filters);
+}
+
+Status FakeSchedulerDriver::killTask(const TaskID& taskId)
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING) { return status; }
+
+  killed++;
+  unordered_map<string, string>::iterator task = running.find(taskId.value());
+  bool found = task != running.end();
+  SlaveID slaveId;
+  if(found)
+  {
+    slaveId.set_value(task->second);
+    running.erase(task);
+  }
+  queueStatus(taskId, slaveId, found ? TASK_KILLED : TASK_LOST, false);
+  changed.notify_all();
+  return status;
+}
+
+Status FakeSchedulerDriver::acceptOffers(const vector<OfferID>& offerIds,
+                                         const vector<Offer::Operation>& operations,
+                                         const Filters& filters)
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING) { return status; }
+
+  accepted++;
+  bool valid = useOffers(offerIds);
+  for(size_t i = 0; i < operations.size(); i++)
+  {
+    if(operations[i].type() != Offer::Operation::LAUNCH) { continue; }
+
+    const Offer::Operation::Launch& launch = operations[i].launch();
+    for(int j = 0; j < launch.task_infos_size(); j++)
+    {
+      const TaskInfo& task = launch.task_infos(j);
+      if(valid) { launched(task); }
+      else { queueStatus(task.task_id(), task.slave_id(), TASK_LOST, false); }
+    }
+  }
+  changed.notify_all();
+  return status;
+}
+
+Status FakeSchedulerDriver::declineOffer(const OfferID& offerId, const Filters& filters)
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING) { return status; }
+
+  declined++;
+  useOffers(vector<OfferID>(1, offerId));
+  changed.notify_all();
+  return status;
+}
+
+Status FakeSchedulerDriver::reviveOffers()
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING) { return status; }
+
+  revives++;
+  suppressed = false;
+  revived = true;
+  changed.notify_all();
+  return status;
+}
+
+Status FakeSchedulerDriver::suppressOffers()
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING) { return status; }
+
+  suppressed = true;
+  return status;
+}
+
+Status FakeSchedulerDriver::acknowledgeStatusUpdate(const TaskStatus& taskStatus)
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING) { return status; }
+
+  acknowledged++;
+  return status;
+}
+
+Status FakeSchedulerDriver::sendFrameworkMessage(const ExecutorID& executorId,
+                                                 const SlaveID& slaveId,
+                                                 const string& data)
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING) { return status; }
+
+  messagesReceived++;
+  if(config.echoMessages)
+  {
+    Echo echo;
+    echo.executorId.CopyFrom(executorId);
+    echo.slaveId.CopyFrom(slaveId);
+    echo.data = data;
+    echoes.push_back(echo);
+    changed.notify_one();
+  }
+  return status;
+}
+
+Status FakeSchedulerDriver::reconcileTasks(const vector<TaskStatus>& statuses)
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING) { return status; }
+
+  reconciled++;
+  if(!config.answerReconciliation) { return status; }
+
+  if(statuses.empty())
+  {
+    for(unordered_map<string, string>::const_iterator task = running.begin(); task != running.end(); ++task)
+    {
+      TaskID taskId;
+      SlaveID slaveId;
+      taskId.set_value(task->first);
+      slaveId.set_value(task->second);
+      queueStatus(taskId, slaveId, TASK_RUNNING, true);
+    }
+  }
+
+  for(size_t i = 0; i < statuses.size(); i++)
+  {
+    unordered_map<string, string>::const_iterator task = running.find(statuses[i].task_id().value());
+    SlaveID slaveId;
+    if(task != running.end()) { slaveId.set_value(task->second); }
+    queueStatus(statuses[i].task_id(), slaveId, task != running.end() ? TASK_RUNNING : TASK_LOST, true);
+  }
+  changed.notify_all();
+  return status;
+}
+
+// called with the lock held, returns false if an offer was not outstanding
+bool FakeSchedulerDriver::useOffers(const vector<OfferID>& offerIds)
+{
+  bool valid = true;
+  for(size_t i = 0; i < offerIds.size(); i++)
+  {
+    if(outstanding.erase(offerIds[i].value()) == 0)
+    {
+      invalidOffers++;
+      valid = false;
+    }
+  }
+  return valid;
+}
+
+// called with the lock held
+void FakeSchedulerDriver::launched(const TaskInfo& task)
+{
+  launchedTasks++;
+  queueStatus(task.task_id(), task.slave_id(), TASK_RUNNING, false);
+  if(config.finishTasks)
+  {
+    queueStatus(task.task_id(), task.slave_id(), TASK_FINISHED, false);
+  }else
+  {
+    running[task.task_id().value()] = task.slave_id().value();
+  }
+}
+
+// called with the lock held, updates other than those answering a
+// reconciliation carry a uuid to acknowledge when acknowledgements are explicit
+void FakeSchedulerDriver::queueStatus(const TaskID& taskId, const SlaveID& slaveId, TaskState state, bool reconciliation)
+{
+  updates.push_back(TaskStatus());
+  TaskStatus& update = updates.back();
+  update.mutable_task_id()->CopyFrom(taskId);
+  update.set_state(state);
+  if(!slaveId.value().empty()) { update.mutable_slave_id()->CopyFrom(slaveId); }
+  update.set_timestamp(timestamp());
+
+  if(reconciliation)
+  {
+    update.set_source(TaskStatus::SOURCE_MASTER);
+    update.set_reason(TaskStatus::REASON_RECONCILIATION);
+  }else
+  {
+    update.set_source(TaskStatus::SOURCE_EXECUTOR);
+    if(!implicitAcknowledgements) { update.set_uuid("fake-uuid-" + to_string(nextUuid++)); }
+    if(config.duplicateUpdates) { updates.push_back(TaskStatus(update)); }
+  }
+}
+
+// called with the lock held
+void FakeSchedulerDriver::makeOffers(vector<Offer>& offers)
+{
+  size_t count = min<size_t>(config.offersPerCycle, config.maxOutstanding - outstanding.size());
+  offers.resize(count);
+
+  for(size_t i = 0; i < count; i++)
+  {
+    Offer& offer = offers[i];
+    unsigned long id = nextOfferId++;
+    string slave = to_string(id % config.slaves);
+
+    offer.mutable_id()->set_value("fake-offer-" + to_string(id));
+    offer.mutable_framework_id()->CopyFrom(framework.id());
+    offer.mutable_slave_id()->set_value("fake-slave-" + slave);
+    offer.set_hostname("fake-host-" + slave);
+    add_scalar(offer, "cpus", config.cpus);
+    add_scalar(offer, "mem", config.mem);
+    add_scalar(offer, "disk", config.disk);
+
+    for(unsigned long j = 0; j < config.attributes; j++)
+    {
+      Attribute* attribute = offer.add_attributes();
+      attribute->set_name("attribute-" + to_string(j));
+      attribute->set_type(Value::TEXT);
+      attribute->mutable_text()->set_value("value-" + to_string(j));
+    }
+
+    outstanding.insert(offer.id().value());
+  }
+}
+
+// the callback thread, the lock is never held while a callback runs so the
+// scheduler can call back into the driver
+void FakeSchedulerDriver::generate()
+{
+  MasterInfo master;
+  master.set_id("fake-master");
+  master.set_ip(0x0100007f);
+  master.set_port(5050);
+  master.set_hostname("localhost");
+  scheduler->registered(this, framework.id(), master);
+
+  ExecutorID executorId;
+  SlaveID slaveId;
+  executorId.set_value("fake-executor");
+  slaveId.set_value("fake-slave-0");
+  string message(config.messageSize, 'x');
+
+  Clock::time_point nextOffers = Clock::now();
+  Clock::time_point nextMessage = nextOffers;
+
+  unique_lock<mutex> guard(lock);
+  while(status == DRIVER_RUNNING)
+  {
+    if(!updates.empty())
+    {
+      deque<TaskStatus> batch;
+      batch.swap(updates);
+      guard.unlock();
+      updatesSent += batch.size();
+      for(size_t i = 0; i < batch.size(); i++)
+      {
+        scheduler->statusUpdate(this, batch[i]);
+      }
+      guard.lock();
+      continue;
+    }
+
+    if(!echoes.empty())
+    {
+      deque<Echo> batch;
+      batch.swap(echoes);
+      guard.unlock();
+      messagesSent += batch.size();
+      for(size_t i = 0; i < batch.size(); i++)
+      {
+        scheduler->frameworkMessage(this, batch[i].executorId, batch[i].slaveId, batch[i].data);
+      }
+      guard.lock();
+      continue;
+    }
+
+    Clock::time_point now = Clock::now();
+    bool canOffer = !suppressed && outstanding.size() < config.maxOutstanding;
+
+    if(canOffer && (config.offerRate > 0 ? now >= nextOffers : revived))
+    {
+      vector<Offer> offers;
+      makeOffers(offers);
+      revived = false;
+      if(config.offerRate > 0)
+      {
+        advance(nextOffers, interval(config.offerRate / config.offersPerCycle), now);
+      }
+
+      offered += offers.size();
+      guard.unlock();
+      scheduler->resourceOffers(this, offers);
+      guard.lock();
+      continue;
+    }
+
+    if(config.messageRate > 0 && now >= nextMessage)
+    {
+      advance(nextMessage, interval(config.messageRate), now);
+
+      messagesSent++;
+      guard.unlock();
+      scheduler->frameworkMessage(this, executorId, slaveId, message);
+      guard.lock();
+      continue;
+    }
+
+    Clock::time_point wake = now + chrono::seconds(1);
+    if(canOffer && config.offerRate > 0) { wake = min(wake, nextOffers); }
+    if(config.messageRate > 0) { wake = min(wake, nextMessage); }
+    changed.wait_until(guard, wake);
+  }
+}
+
+ERL_NIF_TERM FakeSchedulerDriver::stats(ErlNifEnv* env) const
+{
+  size_t pending;
+  {
+    lock_guard<mutex> guard(lock);
+    pending = outstanding.size();
+  }
+
+  ERL_NIF_TERM stats[] = {
+    make_stat(env, "offered", offered),
+    make_stat(env, "outstanding", pending),
+    make_stat(env, "launched", launchedTasks),
+    make_stat(env, "accepted", accepted),
+    make_stat(env, "declined", declined),
+    make_stat(env, "invalid_offers", invalidOffers),
+    make_stat(env, "killed", killed),
+    make_stat(env, "acknowledged", acknowledged),
+    make_stat(env, "reconciled", reconciled),
+    make_stat(env, "revived", revives),
+    make_stat(env, "requests", requests),
+    make_stat(env, "status_updates", updatesSent),
+    make_stat(env, "messages_sent", messagesSent),
+    make_stat(env, "messages_received", messagesReceived)
+  };
+  return enif_make_list_from_array(env, stats, sizeof(stats) / sizeof(stats[0]));
+}
+
+FakeExecutorDriver::Config::Config()
+  : launchRate(0),
+    taskSize(0),
+    messageRate(0),
+    messageSize(64)
+{
+}
+
+bool FakeExecutorDriver::Config::parse(const string& url)
+{
+  vector<pair<string, double> > pairs;
+  if(!parse_query(url, pairs)) { return false; }
+
+  for(size_t i = 0; i < pairs.size(); i++)
+  {
+    const string& key = pairs[i].first;
+    double value = pairs[i].second;
+
+    if(key == "launch_rate") { launchRate = value; }
+    else if(key == "task_size") { taskSize = value; }
+    else if(key == "message_rate") { messageRate = value; }
+    else if(key == "message_size") { messageSize = value; }
+    else { return false; }
+  }
+  return true;
+}
+
+FakeExecutorDriver::FakeExecutorDriver(Executor* executor_, const Config& config_)
+  : executor(executor_),
+    config(config_),
+    status(DRIVER_NOT_STARTED),
+    launchedTasks(0),
+    messagesSent(0),
+    updatesReceived(0),
+    messagesReceived(0)
+{
+}
+
+FakeExecutorDriver::~FakeExecutorDriver()
+{
+  {
+    lock_guard<mutex> guard(lock);
+    if(status == DRIVER_RUNNING) { status = DRIVER_STOPPED; }
+    changed.notify_all();
+  }
+  if(thread.joinable()) { thread.join(); }
+}
+
+Status FakeExecutorDriver::start()
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_NOT_STARTED) { return status; }
+
+  status = DRIVER_RUNNING;
+  thread = std::thread(&FakeExecutorDriver::generate, this);
+  return status;
+}
+
+Status FakeExecutorDriver::stop()
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING && status != DRIVER_ABORTED) { return status; }
+
+  bool aborted = status == DRIVER_ABORTED;
+  status = DRIVER_STOPPED;
+  changed.notify_all();
+  return aborted ? DRIVER_ABORTED : DRIVER_STOPPED;
+}
+
+Status FakeExecutorDriver::abort()
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING) { return status; }
+
+  status = DRIVER_ABORTED;
+  changed.notify_all();
+  return status;
+}
+
+Status FakeExecutorDriver::join()
+{
+  unique_lock<mutex> guard(lock);
+  while(status == DRIVER_RUNNING)
+  {
+    changed.wait(guard);
+  }
+  return status;
+}
+
+Status FakeExecutorDriver::run()
+{
+  Status started = start();
+  return started != DRIVER_RUNNING ? started : join();
+}
+
+Status FakeExecutorDriver::sendStatusUpdate(const TaskStatus& taskStatus)
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING) { return status; }
+
+  updatesReceived++;
+  return status;
+}
+
+Status FakeExecutorDriver::sendFrameworkMessage(const string& data)
+{
+  lock_guard<mutex> guard(lock);
+  if(status != DRIVER_RUNNING) { return status; }
+
+  messagesReceived++;
+  return status;
+}
+
+// as FakeSchedulerDriver::generate
+void FakeExecutorDriver::generate()
+{
+  ExecutorInfo executorInfo;
+  FrameworkInfo frameworkInfo;
+  SlaveInfo slaveInfo;
+  executorInfo.mutable_executor_id()->set_value("fake-executor");
+  executorInfo.mutable_framework_id()->set_value("fake-framework");
+  executorInfo.mutable_command()->set_value("true");
+  frameworkInfo.set_user("");
+  frameworkInfo.set_name("fake-framework");
+  frameworkInfo.mutable_id()->set_value("fake-framework");
+  slaveInfo.set_hostname("fake-host-0");
+  slaveInfo.mutable_id()->set_value("fake-slave-0");
+  executor->registered(this, executorInfo, frameworkInfo, slaveInfo);
+
+  TaskInfo task;
+  task.set_name("fake-task");
+  task.mutable_slave_id()->set_value("fake-slave-0");
+  task.mutable_executor()->CopyFrom(executorInfo);
+  task.set_data(string(config.taskSize, 'x'));
+  string message(config.messageSize, 'x');
+  unsigned long nextTaskId = 0;
+
+  Clock::time_point nextLaunch = Clock::now();
+  Clock::time_point nextMessage = nextLaunch;
+
+  unique_lock<mutex> guard(lock);
+  while(status == DRIVER_RUNNING)
+  {
+    Clock::time_point now = Clock::now();
+
+    if(config.launchRate > 0 && now >= nextLaunch)
+    {
+      advance(nextLaunch, interval(config.launchRate), now);
+      task.mutable_task_id()->set_value("fake-task-" + to_string(nextTaskId++));
+
+      launchedTasks++;
+      guard.unlock();
+      executor->launchTask(this, task);
+      guard.lock();
+      continue;
+    }
+
+    if(config.messageRate > 0 && now >= nextMessage)
+    {
+      advance(nextMessage, interval(config.messageRate), now);
+
+      messagesSent++;
+      guard.unlock();
+      executor->frameworkMessage(this, message);
+      guard.lock();
+      continue;
+    }
+
+    Clock::time_point wake = now + chrono::seconds(1);
+    if(config.launchRate > 0) { wake = min(wake, nextLaunch); }
+    if(config.messageRate > 0) { wake = min(wake, nextMessage); }
+    changed.wait_until(guard, wake);
+  }
+}
+
+ERL_NIF_TERM FakeExecutorDriver::stats(ErlNifEnv* env) const
+{
+  ERL_NIF_TERM stats[] = {
+    make_stat(env, "launched", launchedTasks),
+    make_stat(env, "messages_sent", messagesSent),
+    make_stat(env, "status_updates", updatesReceived),
+    make_stat(env, "messages_received", messagesReceived)
+  };
+  return enif_make_list_from_array(env, stats, sizeof(stats) / sizeof(stats[0]));
+}
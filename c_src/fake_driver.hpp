@@ -0,0 +1,230 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+
+#ifndef MESOS_FAKE_DRIVER_HPP
+#define MESOS_FAKE_DRIVER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "erl_nif.h"
+
+#include <mesos/scheduler.hpp>
+#include <mesos/executor.hpp>
+#include "mesos/mesos.pb.h"
+
+// master urls and executor driver names starting with this select the fakes
+#define FAKE_DRIVER_SCHEME "fake://"
+
+/**
+ * In process stand-ins for the mesos drivers, used to exercise and
+ * benchmark the bridge without a master or a slave.
+ *
+ * They are configured by the query of a fake:// url, a list of
+ * key=value pairs separated by '&' (see FakeSchedulerDriver::Config and
+ * FakeExecutorDriver::Config for the keys). Once started a thread of
+ * their own makes the callbacks at the configured rates, as the driver
+ * threads of libmesos would, and every driver call is counted so a test
+ * can check what the framework did.
+ */
+class FakeSchedulerDriver : public mesos::SchedulerDriver
+{
+public:
+  struct Config
+  {
+    Config();
+
+    // returns false if the url has an unknown key or a value is not a number
+    bool parse(const std::string& url);
+
+    // offers per second, 0 offers once per revive
+    double offerRate;
+    // offers in each resourceOffers callback
+    unsigned long offersPerCycle;
+    // offers are spread over this many slaves
+    unsigned long slaves;
+    // no offers are made while this many are neither used nor declined
+    unsigned long maxOutstanding;
+    double cpus;
+    double mem;
+    double disk;
+    // text attributes added to each offer, to vary its size
+    unsigned long attributes;
+    // launched tasks get a TASK_FINISHED after their TASK_RUNNING
+    bool finishTasks;
+    // each update of a launched task is sent twice, as a master retrying it would
+    bool duplicateUpdates;
+    // reconcileTasks is answered, otherwise it is only counted
+    bool answerReconciliation;
+    // framework messages per second from a fake executor, and their size
+    double messageRate;
+    unsigned long messageSize;
+    // framework messages sent to an executor are sent back from it
+    bool echoMessages;
+  };
+
+  FakeSchedulerDriver(mesos::Scheduler* scheduler,
+                      const mesos::FrameworkInfo& framework,
+                      const Config& config,
+                      bool implicitAcknowledgements);
+  virtual ~FakeSchedulerDriver();
+
+  virtual mesos::Status start();
+  virtual mesos::Status stop(bool failover = false);
+  virtual mesos::Status abort();
+  virtual mesos::Status join();
+  virtual mesos::Status run();
+  virtual mesos::Status requestResources(const std::vector<mesos::Request>& requests);
+  virtual mesos::Status launchTasks(const std::vector<mesos::OfferID>& offerIds,
+                                    const std::vector<mesos::TaskInfo>& tasks,
+                                    const mesos::Filters& filters = mesos::Filters());
+  virtual mesos::Status launchTasks(const mesos::OfferID& offerId,
+                                    const std::vector<mesos::TaskInfo>& tasks,
+                                    const mesos::Filters& filters = mesos::Filters());
+  virtual mesos::Status killTask(const mesos::TaskID& taskId);
+  virtual mesos::Status acceptOffers(const std::vector<mesos::OfferID>& offerIds,
+                                     const std::vector<mesos::Offer::Operation>& operations,
+                                     const mesos::Filters& filters = mesos::Filters());
+  virtual mesos::Status declineOffer(const mesos::OfferID& offerId,
+                                     const mesos::Filters& filters = mesos::Filters());
+  virtual mesos::Status reviveOffers();
+  virtual mesos::Status suppressOffers();
+  virtual mesos::Status acknowledgeStatusUpdate(const mesos::TaskStatus& status);
+  virtual mesos::Status sendFrameworkMessage(const mesos::ExecutorID& executorId,
+                                             const mesos::SlaveID& slaveId,
+                                             const std::string& data);
+  virtual mesos::Status reconcileTasks(const std::vector<mesos::TaskStatus>& statuses);
+
+  // counts of the callbacks made and the driver calls received
+  ERL_NIF_TERM stats(ErlNifEnv* env) const;
+
+private:
+  FakeSchedulerDriver(const FakeSchedulerDriver&);
+  FakeSchedulerDriver& operator=(const FakeSchedulerDriver&);
+
+  void generate();
+  void makeOffers(std::vector<mesos::Offer>& offers);
+  bool useOffers(const std::vector<mesos::OfferID>& offerIds);
+  void launched(const mesos::TaskInfo& task);
+  void queueStatus(const mesos::TaskID& taskId, const mesos::SlaveID& slaveId,
+                   mesos::TaskState state, bool reconciliation);
+
+  struct Echo
+  {
+    mesos::ExecutorID executorId;
+    mesos::SlaveID slaveId;
+    std::string data;
+  };
+
+  mesos::Scheduler* scheduler;
+  mesos::FrameworkInfo framework;
+  const Config config;
+  const bool implicitAcknowledgements;
+
+  mutable std::mutex lock;
+  std::condition_variable changed;
+  std::thread thread;
+  mesos::Status status;
+  bool suppressed;
+  bool revived;
+  unsigned long nextOfferId;
+  unsigned long nextUuid;
+  std::unordered_set<std::string> outstanding;
+  // slave of each task not yet finished
+  std::unordered_map<std::string, std::string> running;
+  std::deque<mesos::TaskStatus> updates;
+  std::deque<Echo> echoes;
+
+  std::atomic<unsigned long> offered;
+  std::atomic<unsigned long> launchedTasks;
+  std::atomic<unsigned long> accepted;
+  std::atomic<unsigned long> declined;
+  std::atomic<unsigned long> killed;
+  std::atomic<unsigned long> acknowledged;
+  std::atomic<unsigned long> reconciled;
+  std::atomic<unsigned long> revives;
+  std::atomic<unsigned long> requests;
+  std::atomic<unsigned long> updatesSent;
+  std::atomic<unsigned long> messagesSent;
+  std::atomic<unsigned long> messagesReceived;
+  std::atomic<unsigned long> invalidOffers;
+};
+
+class FakeExecutorDriver : public mesos::ExecutorDriver
+{
+public:
+  struct Config
+  {
+    Config();
+
+    // as FakeSchedulerDriver::Config::parse
+    bool parse(const std::string& url);
+
+    // tasks launched per second, and the size of their data
+    double launchRate;
+    unsigned long taskSize;
+    // framework messages per second from the scheduler, and their size
+    double messageRate;
+    unsigned long messageSize;
+  };
+
+  FakeExecutorDriver(mesos::Executor* executor, const Config& config);
+  virtual ~FakeExecutorDriver();
+
+  virtual mesos::Status start();
+  virtual mesos::Status stop();
+  virtual mesos::Status abort();
+  virtual mesos::Status join();
+  virtual mesos::Status run();
+  virtual mesos::Status sendStatusUpdate(const mesos::TaskStatus& status);
+  virtual mesos::Status sendFrameworkMessage(const std::string& data);
+
+  ERL_NIF_TERM stats(ErlNifEnv* env) const;
+
+private:
+  FakeExecutorDriver(const FakeExecutorDriver&);
+  FakeExecutorDriver& operator=(const FakeExecutorDriver&);
+
+  void generate();
+
+  mesos::Executor* executor;
+  const Config config;
+
+  std::mutex lock;
+  std::condition_variable changed;
+  std::thread thread;
+  mesos::Status status;
+
+  std::atomic<unsigned long> launchedTasks;
+  std::atomic<unsigned long> messagesSent;
+  std::atomic<unsigned long> updatesReceived;
+  std::atomic<unsigned long> messagesReceived;
+};
+
+#endif // MESOS_FAKE_DRIVER_HPP
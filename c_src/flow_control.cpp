@@ -0,0 +1,296 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include <assert.h>
+
+#include "flow_control.hpp"
+
+using namespace std;
+
+FlowControl::FlowControl()
+  : enabled(false),
+    window(0),
+    maxQueue(0),
+    offerPolicy(QUEUE),
+    messagePolicy(QUEUE),
+    refuse(-1),
+    credits(0),
+    coalescing(NULL),
+    highWater(0),
+    queued(0),
+    overflowed(0),
+    dropped(0),
+    declined(0),
+    coalesced(0)
+{
+}
+
+FlowControl::~FlowControl()
+{
+  for(size_t i = 0; i < queue.size(); i++)
+  {
+    enif_free_env(queue[i].env);
+  }
+}
+
+bool FlowControl::configure(ErlNifEnv* env, ERL_NIF_TERM options)
+{
+  unsigned long window_ = 1000, maxQueue_ = 10000;
+  Policy offerPolicy_ = QUEUE, messagePolicy_ = QUEUE;
+  double refuse_ = -1;
+
+  ERL_NIF_TERM head, tail = options;
+  if(!enif_is_list(env, tail)) { return false; }
+
+  while(enif_get_list_cell(env, tail, &head, &tail))
+  {
+    int arity;
+    const ERL_NIF_TERM* option;
+
+    if(!enif_get_tuple(env, head, &arity, &option) || arity != 2) { return false; }
+
+    if(is_atom(env, option[0], "window"))
+    {
+      if(!enif_get_ulong(env, option[1], &window_) || window_ == 0) { return false; }
+    }
+    else if(is_atom(env, option[0], "max_queue"))
+    {
+      if(!enif_get_ulong(env, option[1], &maxQueue_)) { return false; }
+    }
+    else if(is_atom(env, option[0], "offers"))
+    {
+      if(is_atom(env, option[1], "queue")) { offerPolicy_ = QUEUE; }
+      else if(is_atom(env, option[1], "coalesce")) { offerPolicy_ = COALESCE; }
+      else if(is_atom(env, option[1], "decline")) { offerPolicy_ = DECLINE; }
+      else { return false; }
+    }
+    else if(is_atom(env, option[0], "framework_messages"))
+    {
+      if(is_atom(env, option[1], "queue")) { messagePolicy_ = QUEUE; }
+      else if(is_atom(env, option[1], "drop")) { messagePolicy_ = DROP; }
+      else { return false; }
+    }
+    else if(is_atom(env, option[0], "refuse_seconds"))
+    {
+      if(!get_number(env, option[1], &refuse_) || refuse_ < 0) { return false; }
+    }
+    else { return false; }
+  }
+
+  lock_guard<mutex> guard(lock);
+  window = window_;
+  maxQueue = maxQueue_;
+  offerPolicy = offerPolicy_;
+  messagePolicy = messagePolicy_;
+  refuse = refuse_;
+  // the owner starts over with a full window
+  credits = window;
+  enabled = true;
+  drain(env);
+  return true;
+}
+
+void FlowControl::enqueue(const ErlNifPid* pid, ERL_NIF_TERM message)
+{
+  Queued item;
+  item.pid = *pid;
+  item.env = enif_alloc_env();
+  item.message = enif_make_copy(item.env, message);
+  item.coalesced = false;
+  item.batched = false;
+  item.sent = 0;
+  queue.push_back(item);
+
+  queued++;
+  if(queue.size() > highWater) { highWater = queue.size(); }
+}
+
+FlowControl::Result FlowControl::send(CallbackEnv& env, const ErlNifPid* pid, ERL_NIF_TERM message, Kind kind)
+{
+  if(!enabled)
+  {
+    env.send(pid, message);
+    return SENT;
+  }
+
+  lock_guard<mutex> guard(lock);
+  if(credits > 0)
+  {
+    credits--;
+    env.send(pid, message);
+    return SENT;
+  }
+
+  if(queue.size() >= maxQueue)
+  {
+    if(kind == BEST_EFFORT && messagePolicy == DROP)
+    {
+      dropped++;
+      return REFUSED;
+    }
+    overflowed++;
+  }
+
+  enqueue(pid, message);
+  return QUEUED;
+}
+
+FlowControl::Result FlowControl::sendOffers(CallbackEnv& env, 
+                                            const ErlNifPid* pid, 
+                                            ERL_NIF_TERM message, 
+                                            const ERL_NIF_TERM* offers, 
+                                            unsigned int count,
+                                            bool batched)
+{
+  if(!enabled)
+  {
+    env.send(pid, message);
+    return SENT;
+  }
+
+  lock_guard<mutex> guard(lock);
+  if(credits > 0)
+  {
+    credits--;
+    env.send(pid, message);
+    return SENT;
+  }
+
+  switch(offerPolicy)
+  {
+  case COALESCE:
+    if(coalescing != NULL 
+       && (enif_compare(coalescing->pid.pid, pid->pid) != 0 || coalescing->batched != batched))
+    {
+      coalescing = NULL;
+    }
+    // an offer held past the bound is better declined
+    if((coalescing == NULL ? 0 : coalescing->offers.size() - coalescing->sent) + count > maxQueue)
+    {
+      declined += count;
+      return REFUSED;
+    }
+    if(coalescing == NULL)
+    {
+      Queued item;
+      item.pid = *pid;
+      item.env = enif_alloc_env();
+      item.message = callback_atoms.resourceOffers;
+      item.coalesced = true;
+      item.batched = batched;
+      item.sent = 0;
+      queue.push_back(item);
+      // references to deque elements survive pushes at either end
+      coalescing = &queue.back();
+
+      queued++;
+      if(queue.size() > highWater) { highWater = queue.size(); }
+    }
+    for(unsigned int i = 0; i < count; i++)
+    {
+      coalescing->offers.push_back(enif_make_copy(coalescing->env, offers[i]));
+    }
+    coalesced += count;
+    return QUEUED;
+
+  case QUEUE:
+    if(queue.size() < maxQueue)
+    {
+      enqueue(pid, message);
+      return QUEUED;
+    }
+    // fall through, an offer held past the bound is better declined
+  default:
+    declined += count;
+    return REFUSED;
+  }
+}
+
+void FlowControl::grant(ErlNifEnv* env, unsigned long credits_)
+{
+  lock_guard<mutex> guard(lock);
+  credits += credits_;
+  drain(env);
+}
+
+void FlowControl::drain(ErlNifEnv* env)
+{
+  while(credits > 0 && !queue.empty())
+  {
+    Queued& item = queue.front();
+
+    if(item.coalesced && !item.batched)
+    {
+      // sending clears the env, each offer is copied into one of its own
+      for(; credits > 0 && item.sent < item.offers.size(); item.sent++, credits--)
+      {
+        ErlNifEnv* msg_env = enif_alloc_env();
+        enif_send(env, &item.pid, msg_env, enif_make_tuple2(msg_env, 
+                                                            callback_atoms.resourceOffers,
+                                                            enif_make_copy(msg_env, item.offers[item.sent])));
+        enif_free_env(msg_env);
+      }
+      if(item.sent < item.offers.size()) { break; }
+
+      if(coalescing == &item) { coalescing = NULL; }
+      enif_free_env(item.env);
+      queue.pop_front();
+      continue;
+    }
+
+    ERL_NIF_TERM message = item.message;
+    if(item.coalesced)
+    {
+      message = enif_make_tuple2(item.env, 
+                                 callback_atoms.resourceOffers,
+                                 enif_make_list_from_array(item.env, item.offers.data(), item.offers.size()));
+      if(coalescing == &item) { coalescing = NULL; }
+    }
+
+    enif_send(env, &item.pid, item.env, message);
+    enif_free_env(item.env);
+    queue.pop_front();
+    credits--;
+  }
+}
+
+double FlowControl::refuseSeconds() const
+{
+  return refuse;
+}
+
+ERL_NIF_TERM FlowControl::stats(ErlNifEnv* env) const
+{
+  lock_guard<mutex> guard(lock);
+
+  ERL_NIF_TERM stats[] = {
+    enif_make_tuple2(env, enif_make_atom(env, "enabled"), enif_make_atom(env, enabled ? "true" : "false")),
+    enif_make_tuple2(env, enif_make_atom(env, "window"), enif_make_ulong(env, window)),
+    enif_make_tuple2(env, enif_make_atom(env, "credits"), enif_make_ulong(env, credits)),
+    enif_make_tuple2(env, enif_make_atom(env, "depth"), enif_make_ulong(env, queue.size())),
+    enif_make_tuple2(env, enif_make_atom(env, "high_water"), enif_make_ulong(env, highWater)),
+    enif_make_tuple2(env, enif_make_atom(env, "queued"), enif_make_ulong(env, queued)),
+    enif_make_tuple2(env, enif_make_atom(env, "overflowed"), enif_make_ulong(env, overflowed)),
+    enif_make_tuple2(env, enif_make_atom(env, "dropped"), enif_make_ulong(env, dropped)),
+    enif_make_tuple2(env, enif_make_atom(env, "declined"), enif_make_ulong(env, declined)),
+    enif_make_tuple2(env, enif_make_atom(env, "coalesced"), enif_make_ulong(env, coalesced))
+  };
+  return enif_make_list_from_array(env, stats, sizeof(stats) / sizeof(stats[0]));
+}
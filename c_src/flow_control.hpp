@@ -0,0 +1,140 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_FLOW_CONTROL_HPP
+#define MESOS_FLOW_CONTROL_HPP
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "erl_nif.h"
+
+#include "callback_env.hpp"
+
+/**
+ * Credit based delivery of callback messages to the owner process, or
+ * the workers a Dispatcher routes them to.
+ *
+ * Until it is enabled every message is sent as it is built. Once enabled
+ * a message is only sent while the owner has credit, each message using
+ * one, and is otherwise copied into an environment of its own and queued
+ * until the owner grants more. Credits are shared by every destination,
+ * and a queued message is sent to the pid it was meant for. The queue is
+ * bounded by max_queue, past which each kind of message has its own policy:
+ *
+ *   reliable messages (status updates, registration, task launches, ...)
+ *   are always queued, only counted as overflow.
+ *
+ *   best effort messages (framework messages, which mesos does not
+ *   retransmit either) are queued or dropped.
+ *
+ *   offers are queued, coalesced into a single pending entry of at most
+ *   max_queue offers whatever the queue depth, or refused as soon as there
+ *   is no credit. A coalesced entry is sent as one {resourceOffers, [Offer]}
+ *   message if the offers came batched, otherwise as one message per offer,
+ *   each using a credit. Refused offers, and those past max_queue, are for
+ *   the caller to decline, for refuse_seconds if it is set so they are not
+ *   offered again while the owner is still behind.
+ */
+class FlowControl
+{
+public:
+  enum Kind { RELIABLE, BEST_EFFORT };
+  enum Policy { QUEUE, DROP, COALESCE, DECLINE };
+  enum Result { SENT, QUEUED, REFUSED };
+
+  FlowControl();
+  ~FlowControl();
+
+  // parses a proplist of {window, N}, {max_queue, N}, {offers, queue |
+  // coalesce | decline}, {framework_messages, queue | drop} and
+  // {refuse_seconds, Seconds} and enables
+  // flow control with window credits. Messages queued are sent if the
+  // credits allow. Returns false and changes nothing if invalid.
+  bool configure(ErlNifEnv* env, ERL_NIF_TERM options);
+
+  // called from the callbacks instead of env.send
+  Result send(CallbackEnv& env, const ErlNifPid* pid, ERL_NIF_TERM message, Kind kind);
+
+  // as send for a message carrying the count offers in offers, as a list
+  // if batched or else the single offer
+  Result sendOffers(CallbackEnv& env, 
+                    const ErlNifPid* pid, 
+                    ERL_NIF_TERM message, 
+                    const ERL_NIF_TERM* offers, 
+                    unsigned int count,
+                    bool batched);
+
+  // adds credits and sends as many queued messages as they allow, from a
+  // nif called in env
+  void grant(ErlNifEnv* env, unsigned long credits);
+
+  // how long refused offers are declined for, negative when not set
+  double refuseSeconds() const;
+
+  ERL_NIF_TERM stats(ErlNifEnv* env) const;
+
+private:
+  struct Queued
+  {
+    ErlNifPid pid;
+    ErlNifEnv* env;
+    ERL_NIF_TERM message;
+    // the offers of a coalesced message, which is built when it is sent,
+    // those before sent already delivered one at a time if not batched
+    bool coalesced;
+    bool batched;
+    size_t sent;
+    std::vector<ERL_NIF_TERM> offers;
+  };
+
+  FlowControl(const FlowControl&);
+  FlowControl& operator=(const FlowControl&);
+
+  void enqueue(const ErlNifPid* pid, ERL_NIF_TERM message);
+  void drain(ErlNifEnv* env);
+
+  std::atomic<bool> enabled;
+
+  mutable std::mutex lock;
+  unsigned long window;
+  size_t maxQueue;
+  Policy offerPolicy;
+  Policy messagePolicy;
+  std::atomic<double> refuse;
+
+  // while there is credit nothing is queued
+  unsigned long credits;
+  std::deque<Queued> queue;
+  // the coalesced offers message still queued, if any, offers for
+  // another pid or sent otherwise batched start a new one
+  Queued* coalescing;
+
+  size_t highWater;
+  unsigned long queued;
+  unsigned long overflowed;
+  unsigned long dropped;
+  unsigned long declined;
+  unsigned long coalesced;
+};
+
+#endif // MESOS_FLOW_CONTROL_HPP
@@ -0,0 +1,433 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include <assert.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "message_channel.hpp"
+#include "erlang_mesos.hpp"
+#include "utils.hpp"
+#include "metrics.hpp"
+
+using namespace mesos;
+using namespace std;
+
+#define FRAME_MAGIC "\0emc"
+#define FRAME_MAGIC_SIZE 4
+#define FRAME_DEFLATED 1
+
+// how long a destination nothing is sent to is kept
+#define DESTINATION_IDLE_AFTER chrono::seconds(60)
+
+static void append_varint(string& out, uint32_t value)
+{
+  while(value >= 0x80)
+  {
+    out.push_back((char) (value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((char) value);
+}
+
+static bool read_varint(const string& in, size_t* pos, uint32_t* value)
+{
+  *value = 0;
+  for(int shift = 0; shift < 35 && *pos < in.size(); shift += 7)
+  {
+    unsigned char byte = in[(*pos)++];
+    *value |= (uint32_t) (byte & 0x7f) << shift;
+    if(byte < 0x80) { return true; }
+  }
+  return false;
+}
+
+static ERL_NIF_TERM make_binary(ErlNifEnv* env, const string& value)
+{
+  ERL_NIF_TERM term;
+  memcpy(enif_make_new_binary(env, value.size(), &term), value.data(), value.size());
+  return term;
+}
+
+MessageChannel::MessageChannel(SchedulerDriver* driver)
+  : schedulerDriver(driver),
+    executorDriver(NULL),
+    isEnabled(false),
+    lastStatus(DRIVER_RUNNING),
+    stopping(false),
+    flushAfter(chrono::milliseconds(5)),
+    maxFrame(65536),
+    compress(false),
+    compressMin(512),
+    framesReceived(0),
+    messagesUnpacked(0),
+    corruptFrames(0)
+{
+  assert(driver != NULL);
+}
+
+MessageChannel::MessageChannel(ExecutorDriver* driver)
+  : schedulerDriver(NULL),
+    executorDriver(driver),
+    isEnabled(false),
+    lastStatus(DRIVER_RUNNING),
+    stopping(false),
+    flushAfter(chrono::milliseconds(5)),
+    maxFrame(65536),
+    compress(false),
+    compressMin(512),
+    framesReceived(0),
+    messagesUnpacked(0),
+    corruptFrames(0)
+{
+  assert(driver != NULL);
+}
+
+MessageChannel::~MessageChannel()
+{
+  stop();
+}
+
+void MessageChannel::stop()
+{
+  worker.stop(lock, wakeup, stopping);
+}
+
+bool MessageChannel::configure(ErlNifEnv* env, ERL_NIF_TERM options)
+{
+  unsigned long flushMillis = 5, maxFrame_ = 65536, compressMin_ = 512;
+  bool compress_ = false;
+
+  ERL_NIF_TERM head, tail = options;
+  if(!enif_is_list(env, tail)) { return false; }
+
+  while(enif_get_list_cell(env, tail, &head, &tail))
+  {
+    int arity;
+    const ERL_NIF_TERM* option;
+
+    if(!enif_get_tuple(env, head, &arity, &option) || arity != 2) { return false; }
+
+    if(is_atom(env, option[0], "flush_millis"))
+    {
+      if(!enif_get_ulong(env, option[1], &flushMillis)) { return false; }
+    }
+    else if(is_atom(env, option[0], "max_frame"))
+    {
+      if(!enif_get_ulong(env, option[1], &maxFrame_) || maxFrame_ == 0) { return false; }
+    }
+    else if(is_atom(env, option[0], "compress"))
+    {
+      if(is_atom(env, option[1], "true")) { compress_ = true; }
+      else if(is_atom(env, option[1], "false")) { compress_ = false; }
+      else { return false; }
+    }
+    else if(is_atom(env, option[0], "compress_min"))
+    {
+      if(!enif_get_ulong(env, option[1], &compressMin_)) { return false; }
+    }
+    else { return false; }
+  }
+
+  {
+    lock_guard<mutex> guard(lock);
+    flushAfter = chrono::milliseconds(flushMillis);
+    maxFrame = maxFrame_;
+    compress = compress_;
+    compressMin = compressMin_;
+    isEnabled = true;
+  }
+  // a shorter window may mean the worker is asleep for too long
+  wakeup.notify_one();
+  return true;
+}
+
+Status MessageChannel::send(const ExecutorID& executorId, const SlaveID& slaveId, const string& data)
+{
+  if(!worker.start([this]() { run(); })) { return DRIVER_ABORTED; }
+
+  string key;
+  if(schedulerDriver != NULL)
+  {
+    key = executorId.value();
+    key.push_back('\0');
+    key.append(slaveId.value());
+  }
+
+  lock_guard<mutex> guard(lock);
+
+  map<string, Destination>::iterator it = destinations.find(key);
+  if(it == destinations.end())
+  {
+    it = destinations.insert(make_pair(key, Destination())).first;
+    Destination& added = it->second;
+    added.executorId.CopyFrom(executorId);
+    added.slaveId.CopyFrom(slaveId);
+    added.pendingMessages = added.messages = added.frames = 0;
+    added.bytes = added.wireBytes = added.sizeFlushes = added.failed = 0;
+    added.flushed = Clock::now();
+  }
+
+  Destination& destination = it->second;
+  append_varint(destination.pending, data.size());
+  destination.pending.append(data);
+  destination.messages++;
+  destination.bytes += data.size();
+
+  if(destination.pendingMessages++ == 0)
+  {
+    destination.since = Clock::now();
+    wakeup.notify_one();
+  }
+
+  if(destination.pending.size() >= maxFrame)
+  {
+    destination.sizeFlushes++;
+    flush(destination);
+  }
+  return (Status) lastStatus.load();
+}
+
+void MessageChannel::flush(Destination& destination)
+{
+  string frame(FRAME_MAGIC, FRAME_MAGIC_SIZE);
+  frame.push_back(0);
+
+  if(compress && destination.pending.size() >= compressMin)
+  {
+    uLongf size = compressBound(destination.pending.size());
+    string deflated(size, '\0');
+    if(compress2((Bytef*) &deflated[0], &size,
+                 (const Bytef*) destination.pending.data(), destination.pending.size(),
+                 Z_BEST_SPEED) == Z_OK &&
+       size + 4 < destination.pending.size())
+    {
+      uint32_t length = destination.pending.size();
+      frame[FRAME_MAGIC_SIZE] = FRAME_DEFLATED;
+      frame.push_back((char) (length >> 24));
+      frame.push_back((char) (length >> 16));
+      frame.push_back((char) (length >> 8));
+      frame.push_back((char) length);
+      frame.append(deflated, 0, size);
+    }
+  }
+  if(frame[FRAME_MAGIC_SIZE] == 0)
+  {
+    frame.append(destination.pending);
+  }
+
+  Status status;
+  {
+    METRIC_TIMER(timer, "message_channel_flush");
+    timer.addBytes(frame.size());
+
+    status = schedulerDriver != NULL
+               ? schedulerDriver->sendFrameworkMessage(destination.executorId, destination.slaveId, frame)
+               : executorDriver->sendFrameworkMessage(frame);
+  }
+
+  lastStatus = status;
+  destination.frames++;
+  destination.wireBytes += frame.size();
+  if(status != DRIVER_RUNNING) { destination.failed++; }
+
+  destination.pending.clear();
+  destination.pendingMessages = 0;
+  destination.flushed = Clock::now();
+}
+
+map<string, MessageChannel::Destination>::iterator 
+MessageChannel::forget(map<string, Destination>::iterator it)
+{
+  if(it->second.pendingMessages > 0) { flush(it->second); }
+  return destinations.erase(it);
+}
+
+void MessageChannel::remove(const ExecutorID& executorId, const SlaveID& slaveId)
+{
+  string key = executorId.value();
+  key.push_back('\0');
+  key.append(slaveId.value());
+
+  lock_guard<mutex> guard(lock);
+  map<string, Destination>::iterator it = destinations.find(key);
+  if(it != destinations.end()) { forget(it); }
+}
+
+void MessageChannel::removeSlave(const SlaveID& slaveId)
+{
+  lock_guard<mutex> guard(lock);
+  for(map<string, Destination>::iterator it = destinations.begin(); it != destinations.end(); )
+  {
+    if(it->second.slaveId.value() == slaveId.value())
+    {
+      it = forget(it);
+    }else
+    {
+      ++it;
+    }
+  }
+}
+
+void MessageChannel::run()
+{
+  unique_lock<mutex> guard(lock);
+
+  while(!stopping)
+  {
+    Clock::time_point now = Clock::now();
+    Clock::time_point due = Clock::time_point::max();
+
+    for(map<string, Destination>::iterator it = destinations.begin(); it != destinations.end(); )
+    {
+      Destination& destination = it->second;
+      if(destination.pendingMessages == 0)
+      {
+        if(destination.flushed + DESTINATION_IDLE_AFTER <= now)
+        {
+          it = forget(it);
+          continue;
+        }
+        due = min(due, destination.flushed + DESTINATION_IDLE_AFTER);
+      }else if(destination.since + flushAfter <= now)
+      {
+        flush(destination);
+        due = min(due, destination.flushed + DESTINATION_IDLE_AFTER);
+      }else
+      {
+        due = min(due, destination.since + flushAfter);
+      }
+      ++it;
+    }
+
+    if(due == Clock::time_point::max())
+    {
+      wakeup.wait(guard);
+    }else
+    {
+      wakeup.wait_until(guard, due);
+    }
+  }
+
+  for(map<string, Destination>::iterator it = destinations.begin(); it != destinations.end(); ++it)
+  {
+    if(it->second.pendingMessages > 0) { flush(it->second); }
+  }
+}
+
+bool MessageChannel::unpack(const string& data, vector<string>& messages)
+{
+  if(!isEnabled || data.size() <= FRAME_MAGIC_SIZE || memcmp(data.data(), FRAME_MAGIC, FRAME_MAGIC_SIZE) != 0)
+  {
+    return false;
+  }
+
+  unsigned char flags = data[FRAME_MAGIC_SIZE];
+  size_t pos = FRAME_MAGIC_SIZE + 1;
+  string inflated;
+  const string* packed = &data;
+
+  bool valid = (flags & ~FRAME_DEFLATED) == 0;
+  if(valid && (flags & FRAME_DEFLATED))
+  {
+    uLongf size = 0;
+    if(data.size() >= pos + 4)
+    {
+      const unsigned char* length = (const unsigned char*) data.data() + pos;
+      size = ((uLongf) length[0] << 24) | (length[1] << 16) | (length[2] << 8) | length[3];
+      pos += 4;
+    }
+
+    // deflate shrinks data at most about a thousand times, a larger length
+    // is corrupt and not worth allocating
+    valid = pos == FRAME_MAGIC_SIZE + 5 && size / 1032 <= data.size() - pos;
+    if(valid)
+    {
+      inflated.resize(size);
+      valid = uncompress((Bytef*) &inflated[0], &size,
+                         (const Bytef*) data.data() + pos, data.size() - pos) == Z_OK &&
+              size == inflated.size();
+      packed = &inflated;
+      pos = 0;
+    }
+  }
+
+  messages.clear();
+  while(valid && pos < packed->size())
+  {
+    uint32_t length;
+    valid = read_varint(*packed, &pos, &length) && length <= packed->size() - pos;
+    if(valid)
+    {
+      messages.push_back(packed->substr(pos, length));
+      pos += length;
+    }
+  }
+
+  if(!valid)
+  {
+    messages.clear();
+    corruptFrames++;
+    return false;
+  }
+
+  framesReceived++;
+  messagesUnpacked += messages.size();
+  return true;
+}
+
+ERL_NIF_TERM MessageChannel::stats(ErlNifEnv* env) const
+{
+  lock_guard<mutex> guard(lock);
+
+  vector<ERL_NIF_TERM> perDestination;
+  for(map<string, Destination>::const_iterator it = destinations.begin(); it != destinations.end(); ++it)
+  {
+    const Destination& destination = it->second;
+
+    ERL_NIF_TERM key = schedulerDriver != NULL
+                         ? enif_make_tuple2(env,
+                                            make_binary(env, destination.executorId.value()),
+                                            make_binary(env, destination.slaveId.value()))
+                         : enif_make_atom(env, "scheduler");
+
+    ERL_NIF_TERM counts[] = {
+      make_stat(env, "messages", destination.messages),
+      make_stat(env, "frames", destination.frames),
+      make_stat(env, "bytes", destination.bytes),
+      make_stat(env, "wire_bytes", destination.wireBytes),
+      make_stat(env, "size_flushes", destination.sizeFlushes),
+      make_stat(env, "failed", destination.failed),
+      make_stat(env, "pending", destination.pendingMessages)
+    };
+    perDestination.push_back(enif_make_tuple2(env, key,
+                             enif_make_list_from_array(env, counts, sizeof(counts) / sizeof(counts[0]))));
+  }
+
+  ERL_NIF_TERM stats[] = {
+    enif_make_tuple2(env, enif_make_atom(env, "enabled"), enif_make_atom(env, isEnabled ? "true" : "false")),
+    make_stat(env, "frames_received", framesReceived),
+    make_stat(env, "messages_unpacked", messagesUnpacked),
+    make_stat(env, "corrupt_frames", corruptFrames),
+    enif_make_tuple2(env, enif_make_atom(env, "destinations"),
+                     enif_make_list_from_array(env, perDestination.data(), perDestination.size()))
+  };
+  return enif_make_list_from_array(env, stats, sizeof(stats) / sizeof(stats[0]));
+}
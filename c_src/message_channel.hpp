@@ -0,0 +1,158 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_MESSAGE_CHANNEL_HPP
+#define MESOS_MESSAGE_CHANNEL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "erl_nif.h"
+
+#include <mesos/scheduler.hpp>
+#include <mesos/executor.hpp>
+#include "mesos/mesos.pb.h"
+
+#include "worker_thread.hpp"
+
+/**
+ * Framework messages packed into frames, one driver call per frame.
+ *
+ * Once configured, messages sent through the channel are appended to the
+ * frame pending for their executor and slave, or for the scheduler when
+ * the channel belongs to an executor. A frame is handed to the driver
+ * when it reaches max_frame bytes or has waited flush_millis, whichever
+ * is first, by a worker thread for the latter. Frames of at least
+ * compress_min bytes are deflated when compress is set and that makes
+ * them smaller.
+ *
+ * A frame is the four bytes "\0emc", a flags byte (1 when deflated), the
+ * length of the packed messages as four big endian bytes if deflated, and
+ * the messages, each a varint length followed by its bytes. Received
+ * frameworkMessage data is only taken for a frame by a configured channel,
+ * so both ends must configure theirs. Anything else, a corrupt frame
+ * included, is delivered as is.
+ *
+ * A destination is forgotten, once its pending frame is sent, when its
+ * executor or slave is lost or when nothing has been sent to it for
+ * idle_after.
+ *
+ * The worker is started by the first message and stopped, after sending
+ * every pending frame, by stop.
+ */
+class MessageChannel
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  explicit MessageChannel(mesos::SchedulerDriver* driver);
+  explicit MessageChannel(mesos::ExecutorDriver* driver);
+  ~MessageChannel();
+
+  // parses a proplist of {flush_millis, N}, {max_frame, Bytes},
+  // {compress, boolean()} and {compress_min, Bytes} and enables the
+  // channel, returns false and changes nothing if it is not valid
+  bool configure(ErlNifEnv* env, ERL_NIF_TERM options);
+
+  bool enabled() const { return isEnabled; }
+
+  // queues data for the destination, the ids are ignored by the channel of
+  // an executor. Returns the status of the last frame sent, or
+  // DRIVER_ABORTED if the worker could not be started
+  mesos::Status send(const mesos::ExecutorID& executorId,
+                     const mesos::SlaveID& slaveId,
+                     const std::string& data);
+
+  // called from the frameworkMessage callback, returns false if data is
+  // not a frame, or is a corrupt one
+  bool unpack(const std::string& data, std::vector<std::string>& messages);
+
+  // called from the executorLost and slaveLost callbacks
+  void remove(const mesos::ExecutorID& executorId, const mesos::SlaveID& slaveId);
+  void removeSlave(const mesos::SlaveID& slaveId);
+
+  // sends the pending frames and joins the worker, see WorkerThread
+  void stop();
+
+  ERL_NIF_TERM stats(ErlNifEnv* env) const;
+
+private:
+  struct Destination
+  {
+    mesos::ExecutorID executorId;
+    mesos::SlaveID slaveId;
+
+    // the packed messages not yet sent, and when the first was added
+    std::string pending;
+    unsigned long pendingMessages;
+    Clock::time_point since;
+    // when the last frame was sent
+    Clock::time_point flushed;
+
+    unsigned long messages;
+    unsigned long frames;
+    unsigned long bytes;
+    unsigned long wireBytes;
+    unsigned long sizeFlushes;
+    unsigned long failed;
+  };
+
+  MessageChannel(const MessageChannel&);
+  MessageChannel& operator=(const MessageChannel&);
+
+  void run();
+  // called with the lock held, the driver calls are made under it so the
+  // frames of a destination are sent in order
+  void flush(Destination& destination);
+  // flushes and forgets a destination, called with the lock held
+  std::map<std::string, Destination>::iterator 
+  forget(std::map<std::string, Destination>::iterator it);
+
+  mesos::SchedulerDriver* schedulerDriver;
+  mesos::ExecutorDriver* executorDriver;
+
+  std::atomic<bool> isEnabled;
+  std::atomic<int> lastStatus;
+
+  WorkerThread worker;
+
+  mutable std::mutex lock;
+  std::condition_variable wakeup;
+  bool stopping;
+
+  Clock::duration flushAfter;
+  size_t maxFrame;
+  bool compress;
+  size_t compressMin;
+
+  // keyed by executor id and slave id, separated by a nul
+  std::map<std::string, Destination> destinations;
+
+  std::atomic<unsigned long> framesReceived;
+  std::atomic<unsigned long> messagesUnpacked;
+  std::atomic<unsigned long> corruptFrames;
+};
+
+#endif // MESOS_MESSAGE_CHANNEL_HPP
@@ -0,0 +1,181 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+#include "metrics.hpp"
+
+using namespace std;
+
+thread_local uint64_t metrics_thread_bytes = 0;
+
+// constant initialised, so metrics made during static initialisation of
+// another translation unit still find it
+static atomic<Metric*> metrics_head(NULL);
+static mutex metrics_observe_lock;
+
+// metrics made by metrics_observe, which are never freed. Its names come
+// from erlang, so past this many the rest are recorded as observe_other
+#define METRICS_MAX_OBSERVED 256
+static unsigned int metrics_observed = 0;
+
+Metric::Metric(const char* name)
+  : name_(name),
+    next_(NULL),
+    count(0),
+    sum(0),
+    max(0),
+    bytes(0)
+{
+  for(unsigned int i = 0; i < BUCKETS; i++)
+  {
+    buckets[i].store(0, memory_order_relaxed);
+  }
+
+  next_ = metrics_head.load();
+  while(!metrics_head.compare_exchange_weak(next_, this)) {}
+}
+
+Metric* Metric::first()
+{
+  return metrics_head.load();
+}
+
+unsigned int Metric::bucket(uint64_t nanos)
+{
+  if(nanos < LINEAR) { return (unsigned int) nanos; }
+
+  unsigned int exponent = 63 - __builtin_clzll(nanos);
+  unsigned int sub = (nanos >> (exponent - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+  return LINEAR + (exponent - 4) * (1 << SUB_BITS) + sub;
+}
+
+uint64_t Metric::upperBound(unsigned int bucket)
+{
+  if(bucket < LINEAR) { return bucket; }
+
+  unsigned int exponent = (bucket - LINEAR) / (1 << SUB_BITS) + 4;
+  uint64_t sub = (bucket - LINEAR) % (1 << SUB_BITS);
+  uint64_t width = (uint64_t) 1 << (exponent - SUB_BITS);
+  return (((1 << SUB_BITS) + sub) * width) + width - 1;
+}
+
+void Metric::record(uint64_t nanos, uint64_t bytes_)
+{
+  count.fetch_add(1, memory_order_relaxed);
+  sum.fetch_add(nanos, memory_order_relaxed);
+  bytes.fetch_add(bytes_, memory_order_relaxed);
+  buckets[bucket(nanos)].fetch_add(1, memory_order_relaxed);
+
+  uint64_t current = max.load(memory_order_relaxed);
+  while(nanos > current && !max.compare_exchange_weak(current, nanos, memory_order_relaxed)) {}
+}
+
+static ERL_NIF_TERM make_stat(ErlNifEnv* env, const char* name, uint64_t value)
+{
+  return enif_make_tuple2(env, enif_make_atom(env, name), enif_make_uint64(env, value));
+}
+
+ERL_NIF_TERM Metric::snapshot(ErlNifEnv* env) const
+{
+  uint64_t counts[BUCKETS];
+  uint64_t total = 0;
+  for(unsigned int i = 0; i < BUCKETS; i++)
+  {
+    counts[i] = buckets[i].load(memory_order_relaxed);
+    total += counts[i];
+  }
+
+  // percentiles in microseconds, from the buckets rather than count so
+  // they agree with each other
+  static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+  static const char* names[] = { "p50", "p90", "p99", "p999" };
+  uint64_t values[4] = { 0, 0, 0, 0 };
+
+  uint64_t seen = 0;
+  unsigned int q = 0;
+  for(unsigned int i = 0; i < BUCKETS && q < 4; i++)
+  {
+    seen += counts[i];
+    while(q < 4 && total > 0 && seen >= quantiles[q] * total)
+    {
+      values[q++] = upperBound(i) / 1000;
+    }
+  }
+
+  uint64_t count_ = count.load(memory_order_relaxed);
+  ERL_NIF_TERM stats[] = {
+    make_stat(env, "count", count_),
+    make_stat(env, "bytes", bytes.load(memory_order_relaxed)),
+    make_stat(env, "mean", count_ == 0 ? 0 : sum.load(memory_order_relaxed) / count_ / 1000),
+    make_stat(env, "max", max.load(memory_order_relaxed) / 1000),
+    make_stat(env, names[0], values[0]),
+    make_stat(env, names[1], values[1]),
+    make_stat(env, names[2], values[2]),
+    make_stat(env, names[3], values[3])
+  };
+  return enif_make_tuple2(env, 
+                          enif_make_atom(env, name_), 
+                          enif_make_list_from_array(env, stats, sizeof(stats) / sizeof(stats[0])));
+}
+
+ERL_NIF_TERM metrics_snapshot(ErlNifEnv* env)
+{
+  vector<ERL_NIF_TERM> metrics;
+  for(Metric* metric = Metric::first(); metric != NULL; metric = metric->next())
+  {
+    // registered by a call still in progress
+    if(metric->recorded() == 0) { continue; }
+    metrics.push_back(metric->snapshot(env));
+  }
+  return enif_make_list_from_array(env, metrics.data(), metrics.size());
+}
+
+static Metric* find_metric(const char* name)
+{
+  for(Metric* metric = Metric::first(); metric != NULL; metric = metric->next())
+  {
+    if(strcmp(metric->name(), name) == 0) { return metric; }
+  }
+  return NULL;
+}
+
+void metrics_observe(const char* name, unsigned long nanos)
+{
+  Metric* metric = find_metric(name);
+  if(metric == NULL)
+  {
+    lock_guard<mutex> guard(metrics_observe_lock);
+    metric = find_metric(name);
+    if(metric == NULL && metrics_observed < METRICS_MAX_OBSERVED)
+    {
+      metric = new Metric(strdup(name));
+      metrics_observed++;
+    }
+    else if(metric == NULL)
+    {
+      static Metric other("observe_other");
+      metric = &other;
+    }
+  }
+  metric->record(nanos, 0);
+}
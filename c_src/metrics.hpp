@@ -0,0 +1,150 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_METRICS_HPP
+#define MESOS_METRICS_HPP
+
+#include "erl_nif.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // returns [{Name, Stats}] for every metric recorded at least once
+  ERL_NIF_TERM metrics_snapshot(ErlNifEnv* env);
+  // records nanos against the metric called name, made on first use up
+  // to a bound after which names not seen before share one metric
+  void metrics_observe(const char* name, unsigned long nanos);
+
+#ifdef __cplusplus
+}
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+#include "erlang_mesos.hpp"
+
+// bytes encoded into callback messages by the calling thread, see MetricTimer
+extern thread_local uint64_t metrics_thread_bytes;
+
+/**
+ * A latency histogram with a byte counter, cheap enough to record every
+ * callback and driver call.
+ *
+ * Buckets are log-linear: exact below 16ns, then 8 per power of two, so
+ * a percentile is within 12.5% of the true value up to hours. Recording
+ * is a few relaxed atomic adds, and snapshots read the counts without
+ * stopping writers, so a snapshot taken during a record may be off by
+ * that one value.
+ *
+ * Metrics live as long as the library and register themselves in a list
+ * the snapshot walks.
+ */
+class Metric
+{
+public:
+  explicit Metric(const char* name);
+
+  void record(uint64_t nanos, uint64_t bytes);
+
+  const char* name() const { return name_; }
+  uint64_t recorded() const { return count.load(std::memory_order_relaxed); }
+
+  // {Name, [{count, N}, {bytes, N}, {mean, Us}, {max, Us}, {p50, Us}, ...]}
+  ERL_NIF_TERM snapshot(ErlNifEnv* env) const;
+
+  static Metric* first();
+  Metric* next() const { return next_; }
+
+private:
+  enum { LINEAR = 16, SUB_BITS = 3, BUCKETS = LINEAR + (64 - 4) * (1 << SUB_BITS) };
+
+  Metric(const Metric&);
+  Metric& operator=(const Metric&);
+
+  static unsigned int bucket(uint64_t nanos);
+  static uint64_t upperBound(unsigned int bucket);
+
+  const char* name_;
+  Metric* next_;
+
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> max;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> buckets[BUCKETS];
+};
+
+// records the time until it goes out of scope, and the bytes of callback
+// messages encoded on this thread meanwhile plus any added with bytes()
+class MetricTimer
+{
+public:
+  explicit MetricTimer(Metric& metric)
+    : metric(metric),
+      started(std::chrono::steady_clock::now()),
+      startBytes(metrics_thread_bytes),
+      extraBytes(0)
+  {
+  }
+
+  ~MetricTimer()
+  {
+    std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - started;
+    metric.record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                  metrics_thread_bytes - startBytes + extraBytes);
+  }
+
+  void addBytes(uint64_t count) { extraBytes += count; }
+
+private:
+  MetricTimer(const MetricTimer&);
+  MetricTimer& operator=(const MetricTimer&);
+
+  Metric& metric;
+  std::chrono::steady_clock::time_point started;
+  uint64_t startBytes;
+  uint64_t extraBytes;
+};
+
+inline uint64_t binary_bytes(const ErlNifBinary* binary)
+{
+  return binary == NULL ? 0 : binary->size;
+}
+
+inline uint64_t binary_array_bytes(const BinaryNifArray* array)
+{
+  uint64_t bytes = 0;
+  for(unsigned int i = 0; array != NULL && i < array->length; i++)
+  {
+    bytes += array->obj[i].size;
+  }
+  return bytes;
+}
+
+// times the rest of the enclosing scope as the metric called name, which is
+// registered the first time the scope is entered
+#define METRIC_TIMER(timer, name) \
+  static Metric timer##_metric(name); \
+  MetricTimer timer(timer##_metric)
+
+#endif
+#endif // MESOS_METRICS_HPP
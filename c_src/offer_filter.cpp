@@ -0,0 +1,199 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include <stdlib.h>
+
+#include "offer_filter.hpp"
+#include "erlang_mesos.hpp"
+#include "utils.hpp"
+
+using namespace mesos;
+using namespace std;
+
+// arity of {offer_filter, MinCpus, MinMem, MinDisk, Role, Attributes, RefuseSeconds}
+#define OFFER_FILTER_ARITY 7
+
+OfferFilter::OfferFilter()
+  : passed(0),
+    declinedCpus(0),
+    declinedMem(0),
+    declinedDisk(0),
+    declinedAttributes(0)
+{
+}
+
+bool OfferFilter::set(ErlNifEnv* env, ERL_NIF_TERM term)
+{
+  if(is_atom(env, term, "undefined"))
+  {
+    lock_guard<mutex> guard(lock);
+    predicate.reset();
+    return true;
+  }
+
+  int arity;
+  const ERL_NIF_TERM* fields;
+  if(!enif_get_tuple(env, term, &arity, &fields) ||
+     arity != OFFER_FILTER_ARITY ||
+     !is_atom(env, fields[0], "offer_filter"))
+  {
+    return false;
+  }
+
+  shared_ptr<Predicate> next(new Predicate());
+
+  if(!get_number(env, fields[1], &next->cpus) ||
+     !get_number(env, fields[2], &next->mem) ||
+     !get_number(env, fields[3], &next->disk))
+  {
+    return false;
+  }
+
+  if(!is_atom(env, fields[4], "undefined") && !get_text(env, fields[4], next->role))
+  {
+    return false;
+  }
+
+  ERL_NIF_TERM head, tail = fields[5];
+  if(!enif_is_list(env, tail)) { return false; }
+  while(enif_get_list_cell(env, tail, &head, &tail))
+  {
+    pair<string, string> attribute;
+    const ERL_NIF_TERM* nameValue;
+
+    if(enif_get_tuple(env, head, &arity, &nameValue))
+    {
+      if(arity != 2 ||
+         !get_text(env, nameValue[0], attribute.first) ||
+         !get_text(env, nameValue[1], attribute.second))
+      {
+        return false;
+      }
+    }else if(!get_text(env, head, attribute.first))
+    {
+      return false;
+    }
+    next->attributes.push_back(attribute);
+  }
+
+  double refuseSeconds;
+  if(get_number(env, fields[6], &refuseSeconds))
+  {
+    next->filters.set_refuse_seconds(refuseSeconds);
+  }else if(!is_atom(env, fields[6], "undefined"))
+  {
+    return false;
+  }
+
+  lock_guard<mutex> guard(lock);
+  predicate = next;
+  return true;
+}
+
+bool OfferFilter::hasAttributes(const Predicate& predicate, const Offer& offer)
+{
+  for(size_t i = 0; i < predicate.attributes.size(); i++)
+  {
+    const string& name = predicate.attributes[i].first;
+    const string& value = predicate.attributes[i].second;
+    bool found = false;
+
+    for(int j = 0; j < offer.attributes_size() && !found; j++)
+    {
+      const Attribute& attribute = offer.attributes(j);
+      if(attribute.name() != name) { continue; }
+
+      if(value.empty())
+      {
+        found = true;
+      }else if(attribute.type() == Value::TEXT)
+      {
+        found = attribute.text().value() == value;
+      }else if(attribute.type() == Value::SCALAR)
+      {
+        found = attribute.scalar().value() == strtod(value.c_str(), NULL);
+      }else if(attribute.type() == Value::SET)
+      {
+        for(int k = 0; k < attribute.set().item_size() && !found; k++)
+        {
+          found = attribute.set().item(k) == value;
+        }
+      }
+    }
+
+    if(!found) { return false; }
+  }
+  return true;
+}
+
+bool OfferFilter::accept(const Offer& offer, Filters* filters)
+{
+  shared_ptr<const Predicate> current;
+  {
+    lock_guard<mutex> guard(lock);
+    current = predicate;
+  }
+
+  if(!current)
+  {
+    passed++;
+    return true;
+  }
+
+  double cpus = 0, mem = 0, disk = 0;
+  for(int i = 0; i < offer.resources_size(); i++)
+  {
+    const Resource& resource = offer.resources(i);
+    if(resource.type() != Value::SCALAR) { continue; }
+    if(!current->role.empty() && resource.role() != current->role && resource.role() != "*") { continue; }
+
+    if(resource.name() == "cpus") { cpus += resource.scalar().value(); }
+    else if(resource.name() == "mem") { mem += resource.scalar().value(); }
+    else if(resource.name() == "disk") { disk += resource.scalar().value(); }
+  }
+
+  if(cpus < current->cpus) { declinedCpus++; }
+  else if(mem < current->mem) { declinedMem++; }
+  else if(disk < current->disk) { declinedDisk++; }
+  else if(!hasAttributes(*current, offer)) { declinedAttributes++; }
+  else
+  {
+    passed++;
+    return true;
+  }
+
+  filters->CopyFrom(current->filters);
+  return false;
+}
+
+ERL_NIF_TERM OfferFilter::stats(ErlNifEnv* env) const
+{
+  unsigned long cpus = declinedCpus, mem = declinedMem, disk = declinedDisk, attributes = declinedAttributes;
+
+  ERL_NIF_TERM stats[] = {
+    enif_make_tuple2(env, enif_make_atom(env, "passed"), enif_make_ulong(env, passed)),
+    enif_make_tuple2(env, enif_make_atom(env, "declined"), enif_make_ulong(env, cpus + mem + disk + attributes)),
+    enif_make_tuple2(env, enif_make_atom(env, "declined_cpus"), enif_make_ulong(env, cpus)),
+    enif_make_tuple2(env, enif_make_atom(env, "declined_mem"), enif_make_ulong(env, mem)),
+    enif_make_tuple2(env, enif_make_atom(env, "declined_disk"), enif_make_ulong(env, disk)),
+    enif_make_tuple2(env, enif_make_atom(env, "declined_attributes"), enif_make_ulong(env, attributes))
+  };
+  return enif_make_list_from_array(env, stats, sizeof(stats) / sizeof(stats[0]));
+}
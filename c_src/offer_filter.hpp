@@ -0,0 +1,87 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_OFFER_FILTER_HPP
+#define MESOS_OFFER_FILTER_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "erl_nif.h"
+
+#include "mesos/mesos.pb.h"
+
+/**
+ * Offers the framework will never use, judged in the resourceOffers
+ * callback so they can be declined without being sent to erlang.
+ *
+ * The predicate is set from an #offer_filter{} record (see
+ * mesos_erlang.hrl) and replaced as a whole, so the callback thread only
+ * takes the lock long enough to copy a pointer to it.
+ */
+class OfferFilter
+{
+public:
+  OfferFilter();
+
+  // sets the predicate from an #offer_filter{} record, undefined removes
+  // it. Returns false if the record is not valid.
+  bool set(ErlNifEnv* env, ERL_NIF_TERM term);
+
+  // true if offer should go to erlang, otherwise filters is set to the
+  // filters to decline it with
+  bool accept(const mesos::Offer& offer, mesos::Filters* filters);
+
+  // counts of offers passed and declined, by the first test each failed
+  ERL_NIF_TERM stats(ErlNifEnv* env) const;
+
+private:
+  struct Predicate
+  {
+    double cpus;
+    double mem;
+    double disk;
+    // empty if resources of every role count
+    std::string role;
+    // name and value of each required attribute, an empty value only
+    // requires the attribute to be present
+    std::vector<std::pair<std::string, std::string> > attributes;
+    mesos::Filters filters;
+  };
+
+  OfferFilter(const OfferFilter&);
+  OfferFilter& operator=(const OfferFilter&);
+
+  static bool hasAttributes(const Predicate& predicate, const mesos::Offer& offer);
+
+  mutable std::mutex lock;
+  std::shared_ptr<const Predicate> predicate;
+
+  std::atomic<unsigned long> passed;
+  std::atomic<unsigned long> declinedCpus;
+  std::atomic<unsigned long> declinedMem;
+  std::atomic<unsigned long> declinedDisk;
+  std::atomic<unsigned long> declinedAttributes;
+};
+
+#endif // MESOS_OFFER_FILTER_HPP
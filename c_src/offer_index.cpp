@@ -0,0 +1,188 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include "offer_index.hpp"
+#include "erlang_mesos.hpp"
+#include "utils.hpp"
+
+using namespace mesos;
+using namespace std;
+
+bool OfferIndex::Query::fromTerm(ErlNifEnv* env, ERL_NIF_TERM term)
+{
+  ERL_NIF_TERM head, tail = term;
+  if(!enif_is_list(env, tail)) { return false; }
+
+  while(enif_get_list_cell(env, tail, &head, &tail))
+  {
+    int arity;
+    const ERL_NIF_TERM* option;
+    unsigned long count;
+
+    if(is_atom(env, head, "distinct_hosts"))
+    {
+      distinctHosts = true;
+      continue;
+    }
+
+    if(!enif_get_tuple(env, head, &arity, &option) || arity != 2) { return false; }
+
+    if(is_atom(env, option[0], "cpus")) { if(!get_number(env, option[1], &cpus)) { return false; } }
+    else if(is_atom(env, option[0], "mem")) { if(!get_number(env, option[1], &mem)) { return false; } }
+    else if(is_atom(env, option[0], "disk")) { if(!get_number(env, option[1], &disk)) { return false; } }
+    else if(is_atom(env, option[0], "hostname")) { if(!get_text(env, option[1], hostname)) { return false; } }
+    else if(is_atom(env, option[0], "limit"))
+    {
+      if(!enif_get_ulong(env, option[1], &count)) { return false; }
+      limit = count;
+    }
+    else { return false; }
+  }
+  return true;
+}
+
+OfferIndex::OfferIndex() : enabled(false)
+{
+}
+
+void OfferIndex::setEnabled(bool enable)
+{
+  lock_guard<mutex> guard(lock);
+  enabled = enable;
+  if(!enable)
+  {
+    offers.clear();
+    bySlave.clear();
+    byHost.clear();
+    byCpus.clear();
+  }
+}
+
+void OfferIndex::add(const vector<const Offer*>& added)
+{
+  if(!enabled) { return; }
+
+  lock_guard<mutex> guard(lock);
+  for(size_t i = 0; i < added.size(); i++)
+  {
+    const Offer& offer = *added[i];
+    const string& id = offer.id().value();
+    if(offers.count(id) > 0) { continue; }
+
+    Entry& entry = offers[id];
+    entry.offer.CopyFrom(offer);
+    entry.cpus = entry.mem = entry.disk = 0;
+
+    for(int j = 0; j < offer.resources_size(); j++)
+    {
+      const Resource& resource = offer.resources(j);
+      if(resource.type() != Value::SCALAR) { continue; }
+
+      if(resource.name() == "cpus") { entry.cpus += resource.scalar().value(); }
+      else if(resource.name() == "mem") { entry.mem += resource.scalar().value(); }
+      else if(resource.name() == "disk") { entry.disk += resource.scalar().value(); }
+    }
+
+    entry.byCpus = byCpus.insert(make_pair(entry.cpus, id));
+    bySlave[offer.slave_id().value()].insert(id);
+    byHost[offer.hostname()].insert(id);
+  }
+}
+
+void OfferIndex::erase(unordered_map<string, Entry>::iterator it)
+{
+  const string& id = it->first;
+  const Offer& offer = it->second.offer;
+
+  byCpus.erase(it->second.byCpus);
+
+  unordered_map<string, set<string> >::iterator slave = bySlave.find(offer.slave_id().value());
+  slave->second.erase(id);
+  if(slave->second.empty()) { bySlave.erase(slave); }
+
+  unordered_map<string, set<string> >::iterator host = byHost.find(offer.hostname());
+  host->second.erase(id);
+  if(host->second.empty()) { byHost.erase(host); }
+
+  offers.erase(it);
+}
+
+void OfferIndex::remove(const OfferID& offerId)
+{
+  if(!enabled) { return; }
+
+  lock_guard<mutex> guard(lock);
+  unordered_map<string, Entry>::iterator it = offers.find(offerId.value());
+  if(it != offers.end()) { erase(it); }
+}
+
+void OfferIndex::removeSlave(const SlaveID& slaveId)
+{
+  if(!enabled) { return; }
+
+  lock_guard<mutex> guard(lock);
+  unordered_map<string, set<string> >::iterator slave = bySlave.find(slaveId.value());
+  if(slave == bySlave.end()) { return; }
+
+  // erasing the last offer of the slave erases the set being walked
+  set<string> ids(slave->second);
+  for(set<string>::const_iterator id = ids.begin(); id != ids.end(); ++id)
+  {
+    erase(offers.find(*id));
+  }
+}
+
+bool OfferIndex::matches(const Query& query, const Entry& entry) const
+{
+  return entry.cpus >= query.cpus && entry.mem >= query.mem && entry.disk >= query.disk;
+}
+
+void OfferIndex::find(const Query& query, vector<Offer>& found) const
+{
+  lock_guard<mutex> guard(lock);
+
+  // one host has so few offers that a scan of them is cheapest
+  if(!query.hostname.empty())
+  {
+    unordered_map<string, set<string> >::const_iterator host = byHost.find(query.hostname);
+    if(host == byHost.end()) { return; }
+
+    for(set<string>::const_iterator id = host->second.begin(); id != host->second.end(); ++id)
+    {
+      const Entry& entry = offers.find(*id)->second;
+      if(!matches(query, entry)) { continue; }
+
+      found.push_back(entry.offer);
+      if(query.distinctHosts || found.size() == query.limit) { return; }
+    }
+    return;
+  }
+
+  set<string> hosts;
+  for(multimap<double, string>::const_iterator it = byCpus.lower_bound(query.cpus); it != byCpus.end(); ++it)
+  {
+    const Entry& entry = offers.find(it->second)->second;
+    if(!matches(query, entry)) { continue; }
+    if(query.distinctHosts && !hosts.insert(entry.offer.hostname()).second) { continue; }
+
+    found.push_back(entry.offer);
+    if(found.size() == query.limit) { return; }
+  }
+}
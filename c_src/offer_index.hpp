@@ -0,0 +1,106 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_OFFER_INDEX_HPP
+#define MESOS_OFFER_INDEX_HPP
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "erl_nif.h"
+
+#include "mesos/mesos.pb.h"
+
+/**
+ * The offers the framework holds, kept in step with the driver so they
+ * can be searched without a copy of them in erlang.
+ *
+ * Offers are added as they are sent to erlang and removed when they are
+ * rescinded, their slave is lost, or they are used by acceptOffers,
+ * launchTasks or a decline. Besides the offer id they are indexed by
+ * slave, by hostname and by their total cpus, which queries scan in
+ * ascending order so the smallest offers that fit come first.
+ *
+ * The index is empty and every call is a no-op until it is enabled.
+ */
+class OfferIndex
+{
+public:
+  struct Query
+  {
+    Query() : cpus(0), mem(0), disk(0), distinctHosts(false), limit(0) {}
+
+    // parses a proplist of {cpus, N}, {mem, N}, {disk, N},
+    // {hostname, Host}, distinct_hosts and {limit, N}
+    bool fromTerm(ErlNifEnv* env, ERL_NIF_TERM term);
+
+    double cpus;
+    double mem;
+    double disk;
+    // only offers from this host when not empty
+    std::string hostname;
+    // at most one offer per host
+    bool distinctHosts;
+    // no limit when 0
+    size_t limit;
+  };
+
+  OfferIndex();
+
+  void setEnabled(bool enabled);
+
+  void add(const std::vector<const mesos::Offer*>& offers);
+  void remove(const mesos::OfferID& offerId);
+  void removeSlave(const mesos::SlaveID& slaveId);
+
+  // copies the offers matching query into found
+  void find(const Query& query, std::vector<mesos::Offer>& found) const;
+
+private:
+  struct Entry
+  {
+    mesos::Offer offer;
+    double cpus;
+    double mem;
+    double disk;
+    std::multimap<double, std::string>::iterator byCpus;
+  };
+
+  OfferIndex(const OfferIndex&);
+  OfferIndex& operator=(const OfferIndex&);
+
+  void erase(std::unordered_map<std::string, Entry>::iterator it);
+  bool matches(const Query& query, const Entry& entry) const;
+
+  std::atomic<bool> enabled;
+
+  mutable std::mutex lock;
+  std::unordered_map<std::string, Entry> offers;
+  std::unordered_map<std::string, std::set<std::string> > bySlave;
+  std::unordered_map<std::string, std::set<std::string> > byHost;
+  std::multimap<double, std::string> byCpus;
+};
+
+#endif // MESOS_OFFER_INDEX_HPP
@@ -0,0 +1,646 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include <math.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "erl_nif.h"
+
+#include "mesos/mesos.pb.h"
+#include "pb_term.hpp"
+
+using namespace std;
+using google::protobuf::Descriptor;
+using google::protobuf::DescriptorPool;
+using google::protobuf::EnumValueDescriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::Message;
+using google::protobuf::Reflection;
+
+// atoms are global so each thread keeps its own cache of the record,
+// field and enum atoms it has made - no locking on the callback path
+static thread_local unordered_map<const void*, ERL_NIF_TERM> atom_cache;
+
+static ERL_NIF_TERM cached_atom(ErlNifEnv* env, const void* key, const string& name)
+{
+  unordered_map<const void*, ERL_NIF_TERM>::const_iterator it = atom_cache.find(key);
+  if(it != atom_cache.end())
+  {
+    return it->second;
+  }
+  ERL_NIF_TERM atom = enif_make_atom_len(env, name.data(), name.size());
+  atom_cache[key] = atom;
+  return atom;
+}
+
+static ERL_NIF_TERM undefined_atom(ErlNifEnv* env)
+{
+  static const string name("undefined");
+  return cached_atom(env, &name, name);
+}
+
+// gpb names records after the message without the package, 'Offer.Operation'
+static string record_name(const Descriptor* type)
+{
+  const string& package = type->file()->package();
+  const string& full_name = type->full_name();
+  if(package.empty())
+  {
+    return full_name;
+  }
+  return full_name.substr(package.size() + 1);
+}
+
+// gpb decodes strings as lists of unicode code points
+static ERL_NIF_TERM make_unicode_list(ErlNifEnv* env, const string& str)
+{
+  vector<ERL_NIF_TERM> chars;
+  chars.reserve(str.size());
+
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(str.data());
+  const unsigned char* end = p + str.size();
+
+  while(p < end)
+  {
+    unsigned int c = *p;
+    int extra = 0;
+
+    if(c < 0x80) { extra = 0; }
+    else if((c & 0xE0) == 0xC0) { c &= 0x1F; extra = 1; }
+    else if((c & 0xF0) == 0xE0) { c &= 0x0F; extra = 2; }
+    else if((c & 0xF8) == 0xF0) { c &= 0x07; extra = 3; }
+    else
+    {
+      // not utf8, hand back the bytes
+      return enif_make_string_len(env, str.data(), str.size(), ERL_NIF_LATIN1);
+    }
+
+    if(end - p <= extra)
+    {
+      return enif_make_string_len(env, str.data(), str.size(), ERL_NIF_LATIN1);
+    }
+
+    for(int i = 1; i <= extra; i++)
+    {
+      if((p[i] & 0xC0) != 0x80)
+      {
+        return enif_make_string_len(env, str.data(), str.size(), ERL_NIF_LATIN1);
+      }
+      c = (c << 6) | (p[i] & 0x3F);
+    }
+    p += extra + 1;
+    chars.push_back(enif_make_uint(env, c));
+  }
+  return enif_make_list_from_array(env, chars.data(), chars.size());
+}
+
+static ERL_NIF_TERM make_double(ErlNifEnv* env, double value)
+{
+  // gpb represents the non finite values as atoms
+  if(isnan(value))
+  {
+    return enif_make_atom(env, "nan");
+  }
+  if(isinf(value))
+  {
+    return enif_make_atom(env, value > 0 ? "infinity" : "-infinity");
+  }
+  return enif_make_double(env, value);
+}
+
+static ERL_NIF_TERM make_message(ErlNifEnv* env, const Message& obj, int format);
+
+static ERL_NIF_TERM make_value(ErlNifEnv* env,
+                               const Message& obj,
+                               const FieldDescriptor* field,
+                               int index,
+                               int format)
+{
+  const Reflection* r = obj.GetReflection();
+  bool repeated = field->is_repeated();
+
+  switch(field->cpp_type())
+  {
+    case FieldDescriptor::CPPTYPE_INT32:
+      return enif_make_int(env, repeated ? r->GetRepeatedInt32(obj, field, index) : r->GetInt32(obj, field));
+    case FieldDescriptor::CPPTYPE_INT64:
+      return enif_make_int64(env, repeated ? r->GetRepeatedInt64(obj, field, index) : r->GetInt64(obj, field));
+    case FieldDescriptor::CPPTYPE_UINT32:
+      return enif_make_uint(env, repeated ? r->GetRepeatedUInt32(obj, field, index) : r->GetUInt32(obj, field));
+    case FieldDescriptor::CPPTYPE_UINT64:
+      return enif_make_uint64(env, repeated ? r->GetRepeatedUInt64(obj, field, index) : r->GetUInt64(obj, field));
+    case FieldDescriptor::CPPTYPE_DOUBLE:
+      return make_double(env, repeated ? r->GetRepeatedDouble(obj, field, index) : r->GetDouble(obj, field));
+    case FieldDescriptor::CPPTYPE_FLOAT:
+      return make_double(env, repeated ? r->GetRepeatedFloat(obj, field, index) : r->GetFloat(obj, field));
+    case FieldDescriptor::CPPTYPE_BOOL:
+    {
+      bool value = repeated ? r->GetRepeatedBool(obj, field, index) : r->GetBool(obj, field);
+      return enif_make_atom(env, value ? "true" : "false");
+    }
+    case FieldDescriptor::CPPTYPE_ENUM:
+    {
+      const EnumValueDescriptor* value = repeated ? r->GetRepeatedEnum(obj, field, index) : r->GetEnum(obj, field);
+      return cached_atom(env, value, value->name());
+    }
+    case FieldDescriptor::CPPTYPE_STRING:
+    {
+      string scratch;
+      const string& value = repeated ? r->GetRepeatedStringReference(obj, field, index, &scratch)
+                                     : r->GetStringReference(obj, field, &scratch);
+      if(field->type() == FieldDescriptor::TYPE_BYTES)
+      {
+        ERL_NIF_TERM term;
+        unsigned char* data = enif_make_new_binary(env, value.size(), &term);
+        memcpy(data, value.data(), value.size());
+        return term;
+      }
+      return make_unicode_list(env, value);
+    }
+    case FieldDescriptor::CPPTYPE_MESSAGE:
+      return make_message(env, repeated ? r->GetRepeatedMessage(obj, field, index) : r->GetMessage(obj, field), format);
+  }
+  return enif_make_atom(env, "undefined");
+}
+
+static ERL_NIF_TERM make_field(ErlNifEnv* env, const Message& obj, const FieldDescriptor* field, int format)
+{
+  const Reflection* r = obj.GetReflection();
+
+  if(field->is_repeated())
+  {
+    int size = r->FieldSize(obj, field);
+    vector<ERL_NIF_TERM> values(size);
+    for(int i = 0; i < size; i++)
+    {
+      values[i] = make_value(env, obj, field, i, format);
+    }
+    return enif_make_list_from_array(env, values.data(), size);
+  }
+  return make_value(env, obj, field, -1, format);
+}
+
+static ERL_NIF_TERM make_record(ErlNifEnv* env, const Message& obj)
+{
+  const Descriptor* type = obj.GetDescriptor();
+  const Reflection* r = obj.GetReflection();
+  int count = type->field_count();
+
+  vector<ERL_NIF_TERM> elements(count + 1);
+  elements[0] = cached_atom(env, type, record_name(type));
+
+  for(int i = 0; i < count; i++)
+  {
+    const FieldDescriptor* field = type->field(i);
+    if(!field->is_repeated() && !r->HasField(obj, field))
+    {
+      elements[i + 1] = undefined_atom(env);
+    }else
+    {
+      elements[i + 1] = make_field(env, obj, field, PB_TERM_RECORD);
+    }
+  }
+  return enif_make_tuple_from_array(env, elements.data(), count + 1);
+}
+
+#ifdef PB_TERM_MAPS
+static ERL_NIF_TERM make_map(ErlNifEnv* env, const Message& obj)
+{
+  const Descriptor* type = obj.GetDescriptor();
+  const Reflection* r = obj.GetReflection();
+  ERL_NIF_TERM map = enif_make_new_map(env);
+
+  for(int i = 0; i < type->field_count(); i++)
+  {
+    const FieldDescriptor* field = type->field(i);
+    if(!field->is_repeated() && !r->HasField(obj, field))
+    {
+      continue;
+    }
+    enif_make_map_put(env, map,
+                      cached_atom(env, field, field->name()),
+                      make_field(env, obj, field, PB_TERM_MAP),
+                      &map);
+  }
+  return map;
+}
+#endif
+
+static ERL_NIF_TERM make_message(ErlNifEnv* env, const Message& obj, int format)
+{
+#ifdef PB_TERM_MAPS
+  if(format == PB_TERM_MAP)
+  {
+    return make_map(env, obj);
+  }
+#endif
+  return make_record(env, obj);
+}
+
+ERL_NIF_TERM pb_obj_to_record(ErlNifEnv* env, const Message& obj)
+{
+  return make_record(env, obj);
+}
+
+#ifdef PB_TERM_MAPS
+ERL_NIF_TERM pb_obj_to_map(ErlNifEnv* env, const Message& obj)
+{
+  return make_map(env, obj);
+}
+#endif
+
+// appends the utf8 encoding of a unicode chardata term - a binary or a
+// possibly nested list of code points and binaries, as gpb accepts
+static bool append_unicode(ErlNifEnv* env, ERL_NIF_TERM term, string& out)
+{
+  ErlNifBinary bin;
+  if(enif_inspect_binary(env, term, &bin))
+  {
+    out.append(reinterpret_cast<const char*>(bin.data), bin.size);
+    return true;
+  }
+
+  ERL_NIF_TERM head, tail = term;
+  while(enif_get_list_cell(env, tail, &head, &tail))
+  {
+    unsigned int c;
+    if(!enif_get_uint(env, head, &c))
+    {
+      if(!append_unicode(env, head, out)) { return false; }
+      continue;
+    }
+
+    if(c < 0x80)
+    {
+      out += static_cast<char>(c);
+    }else if(c < 0x800)
+    {
+      out += static_cast<char>(0xC0 | (c >> 6));
+      out += static_cast<char>(0x80 | (c & 0x3F));
+    }else if(c < 0x10000)
+    {
+      out += static_cast<char>(0xE0 | (c >> 12));
+      out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (c & 0x3F));
+    }else if(c < 0x110000)
+    {
+      out += static_cast<char>(0xF0 | (c >> 18));
+      out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (c & 0x3F));
+    }else
+    {
+      return false;
+    }
+  }
+  return enif_is_empty_list(env, tail);
+}
+
+static bool get_double(ErlNifEnv* env, ERL_NIF_TERM term, double* value)
+{
+  if(enif_get_double(env, term, value))
+  {
+    return true;
+  }
+
+  ErlNifSInt64 integer;
+  if(enif_get_int64(env, term, &integer))
+  {
+    *value = static_cast<double>(integer);
+    return true;
+  }
+
+  char name[16];
+  if(!enif_get_atom(env, term, name, sizeof(name), ERL_NIF_LATIN1))
+  {
+    return false;
+  }
+  if(strcmp(name, "nan") == 0) { *value = NAN; return true; }
+  if(strcmp(name, "infinity") == 0) { *value = INFINITY; return true; }
+  if(strcmp(name, "-infinity") == 0) { *value = -INFINITY; return true; }
+  return false;
+}
+
+static bool get_bool(ErlNifEnv* env, ERL_NIF_TERM term, bool* value)
+{
+  char name[8];
+  int integer;
+  if(enif_get_atom(env, term, name, sizeof(name), ERL_NIF_LATIN1))
+  {
+    if(strcmp(name, "true") == 0) { *value = true; return true; }
+    if(strcmp(name, "false") == 0) { *value = false; return true; }
+    return false;
+  }
+  if(enif_get_int(env, term, &integer) && (integer == 0 || integer == 1))
+  {
+    *value = integer == 1;
+    return true;
+  }
+  return false;
+}
+
+static const EnumValueDescriptor* get_enum(ErlNifEnv* env, const FieldDescriptor* field, ERL_NIF_TERM term)
+{
+  char name[256];
+  int number;
+  if(enif_get_atom(env, term, name, sizeof(name), ERL_NIF_LATIN1))
+  {
+    return field->enum_type()->FindValueByName(name);
+  }
+  if(enif_get_int(env, term, &number))
+  {
+    return field->enum_type()->FindValueByNumber(number);
+  }
+  return NULL;
+}
+
+static bool fill_message(ErlNifEnv* env, ERL_NIF_TERM term, Message* obj);
+
+// sets a singular field, or appends to a repeated one
+static bool set_value(ErlNifEnv* env, Message* obj, const FieldDescriptor* field, ERL_NIF_TERM term)
+{
+  const Reflection* r = obj->GetReflection();
+  bool repeated = field->is_repeated();
+
+  switch(field->cpp_type())
+  {
+    case FieldDescriptor::CPPTYPE_INT32:
+    {
+      int value;
+      if(!enif_get_int(env, term, &value)) { return false; }
+      repeated ? r->AddInt32(obj, field, value) : r->SetInt32(obj, field, value);
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_INT64:
+    {
+      ErlNifSInt64 value;
+      if(!enif_get_int64(env, term, &value)) { return false; }
+      repeated ? r->AddInt64(obj, field, value) : r->SetInt64(obj, field, value);
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_UINT32:
+    {
+      unsigned int value;
+      if(!enif_get_uint(env, term, &value)) { return false; }
+      repeated ? r->AddUInt32(obj, field, value) : r->SetUInt32(obj, field, value);
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_UINT64:
+    {
+      ErlNifUInt64 value;
+      if(!enif_get_uint64(env, term, &value)) { return false; }
+      repeated ? r->AddUInt64(obj, field, value) : r->SetUInt64(obj, field, value);
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_DOUBLE:
+    {
+      double value;
+      if(!get_double(env, term, &value)) { return false; }
+      repeated ? r->AddDouble(obj, field, value) : r->SetDouble(obj, field, value);
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_FLOAT:
+    {
+      double value;
+      if(!get_double(env, term, &value)) { return false; }
+      repeated ? r->AddFloat(obj, field, value) : r->SetFloat(obj, field, value);
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_BOOL:
+    {
+      bool value;
+      if(!get_bool(env, term, &value)) { return false; }
+      repeated ? r->AddBool(obj, field, value) : r->SetBool(obj, field, value);
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_ENUM:
+    {
+      const EnumValueDescriptor* value = get_enum(env, field, term);
+      if(value == NULL) { return false; }
+      repeated ? r->AddEnum(obj, field, value) : r->SetEnum(obj, field, value);
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_STRING:
+    {
+      string value;
+      if(field->type() == FieldDescriptor::TYPE_BYTES)
+      {
+        ErlNifBinary bin;
+        if(!enif_inspect_iolist_as_binary(env, term, &bin)) { return false; }
+        value.assign(reinterpret_cast<const char*>(bin.data), bin.size);
+      }else if(!append_unicode(env, term, value))
+      {
+        return false;
+      }
+      repeated ? r->AddString(obj, field, value) : r->SetString(obj, field, value);
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_MESSAGE:
+      return fill_message(env, term, repeated ? r->AddMessage(obj, field) : r->MutableMessage(obj, field));
+  }
+  return false;
+}
+
+static bool set_field(ErlNifEnv* env, Message* obj, const FieldDescriptor* field, ERL_NIF_TERM term)
+{
+  if(enif_is_identical(term, undefined_atom(env)))
+  {
+    return true;
+  }
+
+  if(!field->is_repeated())
+  {
+    return set_value(env, obj, field, term);
+  }
+
+  ERL_NIF_TERM head, tail = term;
+  while(enif_get_list_cell(env, tail, &head, &tail))
+  {
+    if(!set_value(env, obj, field, head)) { return false; }
+  }
+  return enif_is_empty_list(env, tail);
+}
+
+// fills obj from a gpb record, a map keyed by field name or an encoded binary
+static bool fill_message(ErlNifEnv* env, ERL_NIF_TERM term, Message* obj)
+{
+  const Descriptor* type = obj->GetDescriptor();
+
+  int arity;
+  const ERL_NIF_TERM* elements;
+  if(enif_get_tuple(env, term, &arity, &elements))
+  {
+    if(arity != type->field_count() + 1 ||
+       !enif_is_identical(elements[0], cached_atom(env, type, record_name(type))))
+    {
+      return false;
+    }
+    for(int i = 0; i < type->field_count(); i++)
+    {
+      if(!set_field(env, obj, type->field(i), elements[i + 1])) { return false; }
+    }
+    return true;
+  }
+
+  ErlNifBinary bin;
+  if(enif_inspect_binary(env, term, &bin))
+  {
+    return obj->ParsePartialFromArray(bin.data, bin.size);
+  }
+
+#ifdef PB_TERM_MAPS
+  ErlNifMapIterator it;
+  if(enif_is_map(env, term) && enif_map_iterator_create(env, term, &it, ERL_NIF_MAP_ITERATOR_HEAD))
+  {
+    bool ok = true;
+    ERL_NIF_TERM key, value;
+    char name[256];
+    while(ok && enif_map_iterator_get_pair(env, &it, &key, &value))
+    {
+      const FieldDescriptor* field = NULL;
+      if(enif_get_atom(env, key, name, sizeof(name), ERL_NIF_LATIN1))
+      {
+        field = type->FindFieldByName(name);
+      }
+      ok = field != NULL && set_field(env, obj, field, value);
+      enif_map_iterator_next(env, &it);
+    }
+    enif_map_iterator_destroy(env, &it);
+    return ok;
+  }
+#endif
+  return false;
+}
+
+bool pb_term_to_obj(ErlNifEnv* env, ERL_NIF_TERM term, Message* obj)
+{
+  return fill_message(env, term, obj) && obj->IsInitialized();
+}
+
+const Descriptor* pb_find_type(const char* name)
+{
+  const string& package = mesos::Offer::descriptor()->file()->package();
+  return DescriptorPool::generated_pool()->FindMessageTypeByName(package + "." + name);
+}
+
+int pb_term_format_supported(int format)
+{
+#ifdef PB_TERM_MAPS
+  return format == PB_TERM_BINARY || format == PB_TERM_RECORD || format == PB_TERM_MAP;
+#else
+  return format == PB_TERM_BINARY || format == PB_TERM_RECORD;
+#endif
+}
+
+int pb_binary_to_term(ErlNifEnv* env, ErlNifBinary* bin, const char* type, int format, ERL_NIF_TERM* term)
+{
+  const Descriptor* descriptor = pb_find_type(type);
+  if(descriptor == NULL || !pb_term_format_supported(format))
+  {
+    return 0;
+  }
+
+  const Message* prototype = google::protobuf::MessageFactory::generated_factory()->GetPrototype(descriptor);
+  std::unique_ptr<Message> obj(prototype->New());
+
+  if(!obj->ParseFromArray(bin->data, bin->size))
+  {
+    return 0;
+  }
+
+  if(format == PB_TERM_BINARY)
+  {
+    unsigned char* data = enif_make_new_binary(env, bin->size, term);
+    memcpy(data, bin->data, bin->size);
+  }else
+  {
+    *term = make_message(env, *obj, format);
+  }
+  return 1;
+}
+
+void PbTermFormats::set(const Descriptor* type, int format)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  formats[type] = format;
+}
+
+int PbTermFormats::get(const Descriptor* type) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  std::map<const Descriptor*, int>::const_iterator it = formats.find(type);
+  return it == formats.end() ? PB_TERM_BINARY : it->second;
+}
+
+ERL_NIF_TERM PbTermFormats::encode(CallbackEnv& env, const Message& obj) const
+{
+  int format = get(obj.GetDescriptor());
+  if(format == PB_TERM_BINARY)
+  {
+    return env.binary(obj);
+  }
+  return make_message(env, obj, format);
+}
+
+ERL_NIF_TERM PbTermFormats::encode(ErlNifEnv* env, const Message& obj) const
+{
+  int format = get(obj.GetDescriptor());
+  if(format == PB_TERM_BINARY)
+  {
+    return pb_obj_to_binary(env, obj);
+  }
+  return make_message(env, obj, format);
+}
+
+void PbTermFormats::encode(CallbackEnv& env,
+                           const Message* const objs[],
+                           ERL_NIF_TERM terms[],
+                           unsigned int count) const
+{
+  vector<const google::protobuf::MessageLite*> binaries;
+  vector<unsigned int> positions;
+
+  for(unsigned int i = 0; i < count; i++)
+  {
+    int format = get(objs[i]->GetDescriptor());
+    if(format == PB_TERM_BINARY)
+    {
+      binaries.push_back(objs[i]);
+      positions.push_back(i);
+    }else
+    {
+      terms[i] = make_message(env, *objs[i], format);
+    }
+  }
+
+  if(!binaries.empty())
+  {
+    vector<ERL_NIF_TERM> packed(binaries.size());
+    env.binaries(binaries.data(), packed.data(), binaries.size());
+    for(unsigned int i = 0; i < positions.size(); i++)
+    {
+      terms[positions[i]] = packed[i];
+    }
+  }
+}
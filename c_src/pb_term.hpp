@@ -0,0 +1,123 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_PB_TERM_HPP
+#define MESOS_PB_TERM_HPP
+
+#include "erl_nif.h"
+
+// how a protobuf message is handed to erlang
+enum PbTermFormat
+{
+  PB_TERM_BINARY = 0, // serialized, decoded by mesos_pb in erlang
+  PB_TERM_RECORD = 1, // tuple matching the gpb generated record
+  PB_TERM_MAP = 2     // map keyed by field name, unset optional fields omitted
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // returns 1 if format is one this build can produce
+  int pb_term_format_supported(int format);
+  // parses bin as the mesos message type named by its gpb record name and
+  // builds the term for it, returns 0 if the type is unknown or bin is invalid
+  int pb_binary_to_term(ErlNifEnv* env, ErlNifBinary* bin, const char* type, int format, ERL_NIF_TERM* term);
+
+#ifdef __cplusplus
+}
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <google/protobuf/message.h>
+#include <google/protobuf/descriptor.h>
+
+#include "callback_env.hpp"
+
+// the nif map api arrived with OTP 18
+#if ERL_NIF_MAJOR_VERSION > 2 || (ERL_NIF_MAJOR_VERSION == 2 && ERL_NIF_MINOR_VERSION >= 8)
+#define PB_TERM_MAPS 1
+#endif
+
+// builds the gpb compatible record for obj
+ERL_NIF_TERM pb_obj_to_record(ErlNifEnv* env, const google::protobuf::Message& obj);
+
+#ifdef PB_TERM_MAPS
+// builds a map for obj
+ERL_NIF_TERM pb_obj_to_map(ErlNifEnv* env, const google::protobuf::Message& obj);
+#endif
+
+// builds obj from a gpb record, a map or an encoded binary of the same
+// type, nested messages may be given in any of the three forms.
+// Returns false if the term does not describe a complete obj.
+bool pb_term_to_obj(ErlNifEnv* env, ERL_NIF_TERM term, google::protobuf::Message* obj);
+
+// as above for a list of terms
+template<typename T> bool pb_terms_to_objs(ErlNifEnv* env, ERL_NIF_TERM list, std::vector<T>& ret)
+{
+  unsigned int length;
+  if(!enif_get_list_length(env, list, &length))
+  {
+    return false;
+  }
+
+  ret.resize(length);
+
+  ERL_NIF_TERM head, tail = list;
+  for(unsigned int i = 0; enif_get_list_cell(env, tail, &head, &tail); i++)
+  {
+    if(!pb_term_to_obj(env, head, &ret[i])) { return false; }
+  }
+  return true;
+}
+
+// looks up a mesos message type by its gpb record name, e.g. 'Offer' or 'Value.Scalar'
+const google::protobuf::Descriptor* pb_find_type(const char* name);
+
+/**
+ * The format each message type is delivered in. Types not configured
+ * are delivered as binaries.
+ */
+class PbTermFormats
+{
+public:
+  void set(const google::protobuf::Descriptor* type, int format);
+  int get(const google::protobuf::Descriptor* type) const;
+
+  // makes the term for obj in its configured format
+  ERL_NIF_TERM encode(CallbackEnv& env, const google::protobuf::Message& obj) const;
+  // as above in the environment of a nif call
+  ERL_NIF_TERM encode(ErlNifEnv* env, const google::protobuf::Message& obj) const;
+
+  // as above for several objects, packing the binaries into one allocation
+  void encode(CallbackEnv& env,
+              const google::protobuf::Message* const objs[],
+              ERL_NIF_TERM terms[],
+              unsigned int count) const;
+
+private:
+  mutable std::mutex lock;
+  std::map<const google::protobuf::Descriptor*, int> formats;
+};
+
+#endif
+#endif // MESOS_PB_TERM_HPP
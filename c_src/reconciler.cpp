@@ -0,0 +1,255 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include <assert.h>
+#include <math.h>
+
+#include "reconciler.hpp"
+#include "erlang_mesos.hpp"
+#include "utils.hpp"
+#include "metrics.hpp"
+
+using namespace mesos;
+using namespace std;
+
+Reconciler::Reconciler(SchedulerDriver* driver)
+  : driver(driver),
+    stopping(false),
+    pageSize(1000),
+    rate(1),
+    initialBackoff(10),
+    maxBackoff(600),
+    maxAttempts(0),
+    outstanding(0),
+    implicitRequested(false),
+    pages(0),
+    sent(0),
+    retried(0),
+    confirmedCount(0),
+    abandoned(0),
+    implicitCount(0)
+{
+  assert(driver != NULL);
+}
+
+Reconciler::~Reconciler()
+{
+  stop();
+}
+
+void Reconciler::stop()
+{
+  worker.stop(lock, wakeup, stopping);
+}
+
+bool Reconciler::setOptions(ErlNifEnv* env, ERL_NIF_TERM options)
+{
+  size_t pageSize_ = pageSize;
+  double rate_ = rate, backoff_ = initialBackoff, maxBackoff_ = maxBackoff;
+  unsigned int maxAttempts_ = maxAttempts;
+
+  ERL_NIF_TERM head, tail = options;
+  if(!enif_is_list(env, tail)) { return false; }
+
+  while(enif_get_list_cell(env, tail, &head, &tail))
+  {
+    int arity;
+    const ERL_NIF_TERM* option;
+    unsigned long count;
+
+    if(!enif_get_tuple(env, head, &arity, &option) || arity != 2) { return false; }
+
+    if(is_atom(env, option[0], "page_size"))
+    {
+      if(!enif_get_ulong(env, option[1], &count) || count == 0) { return false; }
+      pageSize_ = count;
+    }
+    else if(is_atom(env, option[0], "rate")) { if(!get_number(env, option[1], &rate_) || rate_ <= 0) { return false; } }
+    else if(is_atom(env, option[0], "backoff")) { if(!get_number(env, option[1], &backoff_) || backoff_ < 0) { return false; } }
+    else if(is_atom(env, option[0], "max_backoff")) { if(!get_number(env, option[1], &maxBackoff_) || maxBackoff_ < 0) { return false; } }
+    else if(is_atom(env, option[0], "max_attempts"))
+    {
+      if(!enif_get_ulong(env, option[1], &count)) { return false; }
+      maxAttempts_ = count;
+    }
+    else { return false; }
+  }
+
+  {
+    lock_guard<mutex> guard(lock);
+    pageSize = pageSize_;
+    rate = rate_;
+    initialBackoff = backoff_;
+    maxBackoff = maxBackoff_;
+    maxAttempts = maxAttempts_;
+    // a slower rate may mean the worker is asleep for too long
+    nextPage = Clock::now();
+  }
+  wakeup.notify_one();
+  return true;
+}
+
+bool Reconciler::reconcile(const vector<TaskStatus>& statuses)
+{
+  if(!worker.start([this]() { run(); })) { return false; }
+
+  {
+    lock_guard<mutex> guard(lock);
+    Clock::time_point now = Clock::now();
+
+    if(statuses.empty()) { implicitRequested = true; }
+
+    for(size_t i = 0; i < statuses.size(); i++)
+    {
+      const string& taskId = statuses[i].task_id().value();
+      unordered_map<string, Pending>::iterator it = pending.find(taskId);
+      if(it == pending.end())
+      {
+        it = pending.insert(make_pair(taskId, Pending())).first;
+      }else
+      {
+        schedule.erase(it->second.due);
+      }
+      it->second.status.CopyFrom(statuses[i]);
+      it->second.attempts = 0;
+      it->second.due = schedule.insert(make_pair(now, taskId));
+    }
+    outstanding = pending.size();
+  }
+  wakeup.notify_one();
+  return true;
+}
+
+void Reconciler::confirmed(const TaskStatus& status)
+{
+  if(outstanding == 0) { return; }
+
+  lock_guard<mutex> guard(lock);
+  unordered_map<string, Pending>::iterator it = pending.find(status.task_id().value());
+  if(it == pending.end()) { return; }
+
+  schedule.erase(it->second.due);
+  pending.erase(it);
+  outstanding = pending.size();
+  confirmedCount++;
+}
+
+void Reconciler::cancel()
+{
+  lock_guard<mutex> guard(lock);
+  pending.clear();
+  schedule.clear();
+  outstanding = 0;
+  implicitRequested = false;
+}
+
+Reconciler::Clock::duration Reconciler::backoff(unsigned int attempts) const
+{
+  // attempts is at least 1, capped so the shift cannot overflow
+  double seconds = initialBackoff * ldexp(1.0, (int) min(attempts - 1, 30u));
+  if(seconds > maxBackoff) { seconds = maxBackoff; }
+  return chrono::duration_cast<Clock::duration>(chrono::duration<double>(seconds));
+}
+
+void Reconciler::run()
+{
+  vector<TaskStatus> page;
+  unique_lock<mutex> guard(lock);
+
+  while(!stopping)
+  {
+    Clock::time_point now = Clock::now();
+    if(now < nextPage)
+    {
+      wakeup.wait_until(guard, nextPage);
+      continue;
+    }
+
+    bool implicit = implicitRequested;
+    if(!implicit)
+    {
+      if(schedule.empty())
+      {
+        wakeup.wait(guard);
+        continue;
+      }
+      if(schedule.begin()->first > now)
+      {
+        wakeup.wait_until(guard, schedule.begin()->first);
+        continue;
+      }
+    }
+
+    // an implicit reconciliation is a page of its own, tasks wait for the next
+    page.clear();
+    while(!implicit && page.size() < pageSize && !schedule.empty() && schedule.begin()->first <= now)
+    {
+      unordered_map<string, Pending>::iterator it = pending.find(schedule.begin()->second);
+      schedule.erase(schedule.begin());
+
+      Pending& task = it->second;
+      if(maxAttempts > 0 && task.attempts >= maxAttempts)
+      {
+        pending.erase(it);
+        abandoned++;
+        continue;
+      }
+
+      if(task.attempts > 0) { retried++; }
+      task.attempts++;
+      task.due = schedule.insert(make_pair(now + backoff(task.attempts), it->first));
+      page.push_back(task.status);
+    }
+    outstanding = pending.size();
+
+    if(!implicit && page.empty()) { continue; }
+
+    implicitRequested = false;
+    nextPage = now + chrono::duration_cast<Clock::duration>(chrono::duration<double>(1 / rate));
+
+    // confirmations for the page may arrive while the driver is called
+    guard.unlock();
+    {
+      METRIC_TIMER(timer, "reconciler_reconcileTasks");
+      driver->reconcileTasks(page);
+    }
+    guard.lock();
+
+    pages++;
+    sent += page.size();
+    if(implicit) { implicitCount++; }
+  }
+}
+
+ERL_NIF_TERM Reconciler::stats(ErlNifEnv* env) const
+{
+  lock_guard<mutex> guard(lock);
+
+  ERL_NIF_TERM stats[] = {
+    enif_make_tuple2(env, enif_make_atom(env, "outstanding"), enif_make_ulong(env, pending.size())),
+    enif_make_tuple2(env, enif_make_atom(env, "pages"), enif_make_ulong(env, pages)),
+    enif_make_tuple2(env, enif_make_atom(env, "sent"), enif_make_ulong(env, sent)),
+    enif_make_tuple2(env, enif_make_atom(env, "retried"), enif_make_ulong(env, retried)),
+    enif_make_tuple2(env, enif_make_atom(env, "confirmed"), enif_make_ulong(env, confirmedCount)),
+    enif_make_tuple2(env, enif_make_atom(env, "abandoned"), enif_make_ulong(env, abandoned)),
+    enif_make_tuple2(env, enif_make_atom(env, "implicit"), enif_make_ulong(env, implicitCount))
+  };
+  return enif_make_list_from_array(env, stats, sizeof(stats) / sizeof(stats[0]));
+}
@@ -0,0 +1,124 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_RECONCILER_HPP
+#define MESOS_RECONCILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "erl_nif.h"
+
+#include <mesos/scheduler.hpp>
+#include "mesos/mesos.pb.h"
+
+#include "worker_thread.hpp"
+
+/**
+ * Reconciles tasks with the master in the background.
+ *
+ * Tasks handed to reconcile are outstanding until a status update for
+ * them arrives. A worker thread sends them to the master in pages of at
+ * most page_size tasks, no more than rate pages a second, and sends each
+ * outstanding task again after a backoff that doubles with every attempt
+ * up to max_backoff. A task still unconfirmed after max_attempts is given
+ * up on, 0 never gives up. An empty reconcile asks for implicit
+ * reconciliation, sent as a page of its own.
+ *
+ * The worker is started by the first reconcile and stopped by stop.
+ */
+class Reconciler
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  explicit Reconciler(mesos::SchedulerDriver* driver);
+  ~Reconciler();
+
+  // parses a proplist of {page_size, N}, {rate, PagesPerSecond},
+  // {backoff, Seconds}, {max_backoff, Seconds} and {max_attempts, N},
+  // returns false and changes nothing if it is not valid
+  bool setOptions(ErlNifEnv* env, ERL_NIF_TERM options);
+
+  // queues statuses to be reconciled, a task already outstanding starts
+  // over. Returns false if the worker could not be started.
+  bool reconcile(const std::vector<mesos::TaskStatus>& statuses);
+
+  // called from the statusUpdate callback
+  void confirmed(const mesos::TaskStatus& status);
+
+  // forgets every outstanding task
+  void cancel();
+
+  // joins the worker, see WorkerThread
+  void stop();
+
+  ERL_NIF_TERM stats(ErlNifEnv* env) const;
+
+private:
+  struct Pending
+  {
+    mesos::TaskStatus status;
+    unsigned int attempts;
+    std::multimap<Clock::time_point, std::string>::iterator due;
+  };
+
+  Reconciler(const Reconciler&);
+  Reconciler& operator=(const Reconciler&);
+
+  void run();
+  Clock::duration backoff(unsigned int attempts) const;
+
+  mesos::SchedulerDriver* driver;
+
+  WorkerThread worker;
+
+  mutable std::mutex lock;
+  std::condition_variable wakeup;
+  bool stopping;
+
+  size_t pageSize;
+  double rate;
+  double initialBackoff;
+  double maxBackoff;
+  unsigned int maxAttempts;
+
+  // task id to its outstanding status, ordered by when it is next due
+  std::unordered_map<std::string, Pending> pending;
+  std::multimap<Clock::time_point, std::string> schedule;
+  std::atomic<size_t> outstanding;
+  bool implicitRequested;
+  Clock::time_point nextPage;
+
+  unsigned long pages;
+  unsigned long sent;
+  unsigned long retried;
+  unsigned long confirmedCount;
+  unsigned long abandoned;
+  unsigned long implicitCount;
+};
+
+#endif // MESOS_RECONCILER_HPP
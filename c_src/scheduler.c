@@ -19,27 +19,73 @@
 
 
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include "erl_nif.h"
 #include "erlang_mesos_util.c"
 #include "erlang_mesos.hpp" 
 #include "scheduler_c_api.hpp"    
+#include "callback_env.hpp"
+#include "pb_term.hpp"
+#include "metrics.hpp"
+#include "async_call.hpp"
+#include "ack_handle.hpp"
+#include "batch_call.hpp"
 
 #define MAXBUFLEN 1024
 
+// kept outside priv data too, the nifs run by NIF_ON_THREAD are given an
+// environment of their own which has none
+static ErlNifResourceType* state_type = NULL;
+
+// each scheduler is a resource, the driver is destroyed by nif_scheduler_destroy
+// or, failing that, when the last reference to the handle is garbage collected
+static void
+scheduler_state_dtor(ErlNifEnv* env, void* obj)
+{
+    state_ptr state = (state_ptr) obj;
+
+    if(state->initilised == 1)
+    {
+        // the driver is stopped before it is deleted, as by destroy
+        scheduler_abort(state->scheduler_state);
+        scheduler_destroy(state->scheduler_state);
+        state->initilised = 0;
+    }
+    enif_rwlock_destroy(state->lock);
+    enif_cond_destroy(state->joined);
+    enif_mutex_destroy(state->join_lock);
+}
+
 static int
 scheduler_load(ErlNifEnv* env, void** priv, ERL_NIF_TERM load_info)
 {
-    state_ptr state = (state_ptr) enif_alloc(sizeof(struct state_t));
-    state->initilised = 0;
-    *priv = (void*) state;
+    state_type = enif_open_resource_type(env, 
+                                                            NULL, 
+                                                            "scheduler_state", 
+                                                            scheduler_state_dtor, 
+                                                            ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, 
+                                                            NULL);
+    if(state_type == NULL)
+    {
+        return -1;
+    }
+    if(!ack_handle_load(env))
+    {
+        return -1;
+    }
+    if(!batch_call_load(env))
+    {
+        return -1;
+    }
+    *priv = (void*) state_type;
+    callback_env_load(env);
     return 0;
 }
 
 static void
 scheduler_unload(ErlNifEnv* env, void* priv)
 {
-    state_ptr state = (state_ptr) priv;
-    enif_free(state);
 }
 
 static int 
@@ -48,6 +94,67 @@ scheduler_upgrade(ErlNifEnv* env, void** priv, void** old_priv_data, ERL_NIF_TER
     return scheduler_load(env, priv, load_info);
 }
 
+// read locks the scheduler behind a handle for the length of a driver call,
+// returns 0 if the term is not a handle or the scheduler has been destroyed
+static int
+lock_state(ErlNifEnv* env, ERL_NIF_TERM handle, state_ptr* state)
+{
+
+    if(!enif_get_resource(env, handle, state_type, (void**) state))
+    {
+        return 0;
+    }
+
+    enif_rwlock_rlock((*state)->lock);
+    if((*state)->initilised == 0)
+    {
+        enif_rwlock_runlock((*state)->lock);
+        return 0;
+    }
+    return 1;
+}
+
+static void
+unlock_state(state_ptr state)
+{
+    enif_rwlock_runlock(state->lock);
+}
+
+// join blocks until the driver stops, so the lock is only held to find the
+// driver; a destroy waits for the joiners instead of the joiners holding it off
+static int
+enter_join(state_ptr state)
+{
+    enif_rwlock_rlock(state->lock);
+    if(state->initilised == 0)
+    {
+        enif_rwlock_runlock(state->lock);
+        return 0;
+    }
+    enif_mutex_lock(state->join_lock);
+    state->joining++;
+    enif_mutex_unlock(state->join_lock);
+    enif_rwlock_runlock(state->lock);
+    return 1;
+}
+
+static void
+leave_join(state_ptr state)
+{
+    enif_mutex_lock(state->join_lock);
+    state->joining--;
+    enif_cond_broadcast(state->joined);
+    enif_mutex_unlock(state->join_lock);
+}
+
+static ERL_NIF_TERM
+make_not_inited_error(ErlNifEnv* env)
+{
+    return enif_make_tuple2(env, 
+        enif_make_atom(env, "error"), 
+        enif_make_atom(env, "scheduler_not_inited"));
+}
+
 static ERL_NIF_TERM
 nif_scheduler_init(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
@@ -55,19 +162,10 @@ nif_scheduler_init(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
     ErlNifBinary credentials_binary;
     char masterUrl[MAXBUFLEN];
     int implicitAcknowledgements = 1 ;
+    ErlNifPid pid;
 
-    state_ptr state = (state_ptr) enif_priv_data(env);
-    
-    if(state->initilised == 1) 
-    {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "scheduler_already_inited"));
-    }
-
-    ErlNifPid* pid = (ErlNifPid*) enif_alloc(sizeof(ErlNifPid));
 
-    if(!enif_get_local_pid(env, argv[0], pid))
+    if(!enif_get_local_pid(env, argv[0], &pid))
     {
         return make_argument_error(env, "invalid_or_corrupted_parameter", "pid");
     }
@@ -87,35 +185,45 @@ nif_scheduler_init(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
         return make_argument_error(env, "invalid_or_corrupted_parameter", "implicit_acknowledgements");   
     }
 
-    if(argc == 5 )
-    {
-        if(!enif_inspect_binary(env,argv[4], &credentials_binary))
-        {       
-            return make_argument_error(env, "invalid_or_corrupted_parameter", "credential");    
-        }
-        state->scheduler_state = scheduler_init(pid, &frameworkInfo_binary, masterUrl, implicitAcknowledgements, 1, &credentials_binary);
+    if(argc == 5 && !enif_inspect_binary(env,argv[4], &credentials_binary))
+    {       
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "credential");    
     }
-    else
+
+    SchedulerPtrPair scheduler_state = scheduler_init(&pid, &frameworkInfo_binary, masterUrl, implicitAcknowledgements, argc == 5, &credentials_binary);
+
+    // only a fake:// master is checked before the driver is started
+    if(scheduler_state.driver == NULL)
     {
-        state->scheduler_state = scheduler_init(pid, &frameworkInfo_binary, masterUrl, implicitAcknowledgements, 0, &credentials_binary);
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "master_info");
     }
+
+    state_ptr state = (state_ptr) enif_alloc_resource(state_type, sizeof(struct state_t));
+    state->lock = enif_rwlock_create("scheduler_state");
+    state->join_lock = enif_mutex_create("scheduler_join");
+    state->joined = enif_cond_create("scheduler_joined");
+    state->joining = 0;
+    state->scheduler_state = scheduler_state;
     state->initilised = 1;
-    return enif_make_atom(env, "ok");
+
+    ERL_NIF_TERM handle = enif_make_resource(env, state);
+    enif_release_resource(state);
+
+    return enif_make_tuple2(env, enif_make_atom(env, "ok"), handle);
 }
 
 static ERL_NIF_TERM
 nif_scheduler_start(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
-    state_ptr state = (state_ptr) enif_priv_data(env);
+    state_ptr state;
     
-    if(state->initilised == 0 ) 
+    if(!lock_state(env, argv[0], &state)) 
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "scheduler_not_inited"));
+        return make_not_inited_error(env);
     }
     
     SchedulerDriverStatus status = scheduler_start( state->scheduler_state );
+    unlock_state(state);
 
     return get_return_value_from_status(env, status);
 }
@@ -123,33 +231,96 @@ nif_scheduler_start(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 static ERL_NIF_TERM
 nif_scheduler_join(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
-    state_ptr state = (state_ptr) enif_priv_data(env);
+    state_ptr state;
 
-    if(state->initilised == 0 ) 
+    if(!enif_get_resource(env, argv[0], state_type, (void**) &state) || !enter_join(state))
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "scheduler_not_inited"));
+        return make_not_inited_error(env);
     }
     
     SchedulerDriverStatus status = scheduler_join( state->scheduler_state );
+    leave_join(state);
 
     return get_return_value_from_status(env, status);
 }
 
+typedef struct
+{
+    state_ptr state;
+    ErlNifPid caller;
+    ErlNifEnv* env;
+    ERL_NIF_TERM ref;
+} join_job_t;
+
+// runs on its own thread and sends {Ref, Result} to the caller once the driver stops
+static void
+join_job_run(void* arg)
+{
+    join_job_t* job = (join_job_t*) arg;
+    ERL_NIF_TERM result;
+
+    if(!enter_join(job->state))
+    {
+        result = make_not_inited_error(job->env);
+    }else
+    {
+        SchedulerDriverStatus status = scheduler_join( job->state->scheduler_state );
+        leave_join(job->state);
+        result = get_return_value_from_status(job->env, status);
+    }
+
+    enif_send(NULL, &job->caller, job->env, enif_make_tuple2(job->env, job->ref, result));
+
+    enif_free_env(job->env);
+    enif_release_resource(job->state);
+    enif_free(job);
+}
+
 static ERL_NIF_TERM
-nif_scheduler_abort(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+nif_scheduler_joinAsync(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
-    state_ptr state = (state_ptr) enif_priv_data(env);
-    
-    if(state->initilised == 0 ) 
+    state_ptr state;
+
+    if(!enif_get_resource(env, argv[0], state_type, (void**) &state))
+    {
+        return make_not_inited_error(env);
+    }
+
+    join_job_t* job = (join_job_t*) enif_alloc(sizeof(join_job_t));
+    job->state = state;
+    job->env = enif_alloc_env();
+    enif_self(env, &job->caller);
+
+    ERL_NIF_TERM ref = enif_make_ref(env);
+    job->ref = enif_make_copy(job->env, ref);
+
+    // the job holds a reference so the driver outlives the handle
+    enif_keep_resource(state);
+
+    if(!async_call(join_job_run, job))
     {
+        enif_release_resource(state);
+        enif_free_env(job->env);
+        enif_free(job);
         return enif_make_tuple2(env, 
             enif_make_atom(env, "error"), 
-            enif_make_atom(env, "scheduler_not_inited"));
+            enif_make_atom(env, "thread_not_started"));
+    }
+    return enif_make_tuple2(env, enif_make_atom(env, "ok"), ref);
+}
+
+static ERL_NIF_TERM
+nif_scheduler_abort(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    state_ptr state;
+    
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
     }
     
     SchedulerDriverStatus status = scheduler_abort( state->scheduler_state );
+    unlock_state(state);
     
     if(status == 3){ // DRIVER_ABORTED
         return enif_make_tuple2(env, 
@@ -166,16 +337,9 @@ static ERL_NIF_TERM
 nif_scheduler_stop(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
     int failover;
-    state_ptr state = (state_ptr) enif_priv_data(env);
-    
-    if(state->initilised == 0 ) 
-    {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "sheduler_not_inited"));
-    }
+    state_ptr state;
     
-    if(!enif_get_int( env, argv[0], &failover))
+    if(!enif_get_int( env, argv[1], &failover))
     {
         return make_argument_error(env, "invalid_or_corrupted_parameter", "failover");
     }
@@ -185,7 +349,13 @@ nif_scheduler_stop(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
         return make_argument_error(env, "invalid_or_corrupted_parameter", "failover");
     }
 
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
     SchedulerDriverStatus status = scheduler_stop( state->scheduler_state, failover );
+    unlock_state(state);
     
     if(status == 4){ // driver_stopped
         return enif_make_tuple2(env, 
@@ -198,65 +368,110 @@ nif_scheduler_stop(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
     }
 }
 
+// items of a batch converted between checks of the time slice
+#define BATCH_SLICE 64
+
+// the argument error for a bad item, by batch kind
+static char* batch_list_names[] = {"task_info_array", "operations_array", "request_array", "task_status_array"};
+
+static long
+batch_micros()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000;
+}
+
+// argv is {Handle, Arg, List, Filters, Batch, Kind}. Converts the list into the
+// batch a slice at a time and, once the vm asks for the scheduler thread back,
+// reschedules itself with what is left of the list. The driver call is made
+// when the list is used up, so a list of any length never holds a scheduler
+// thread for much more than a time slice
 static ERL_NIF_TERM
-nif_scheduler_acceptOffers(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
-    unsigned int ids_length ;
-    unsigned int ops_length ;
+nif_scheduler_batch(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    ERL_NIF_TERM list = argv[2];
+    const char* invalid = NULL;
+    state_ptr state;
+    int kind;
+    int done;
 
-    state_ptr state = (state_ptr) enif_priv_data(env);
-    
-    if(state->initilised == 0 ) 
-    {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "scheduler_not_inited"));
-    }
+    enif_get_int(env, argv[5], &kind);
 
-    if(!enif_is_list(env, argv[0])) 
+    do
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "offerid_array");
-    };
+#ifdef NIF_YIELD
+        long start = batch_micros();
+        done = batch_call_add(env, argv[4], &list, BATCH_SLICE);
+        if(done == 0)
+        {
+            // a time slice is about a millisecond
+            int percent = (int) ((batch_micros() - start) / 10);
+            if(enif_consume_timeslice(env, percent < 1 ? 1 : (percent > 100 ? 100 : percent)))
+            {
+                ERL_NIF_TERM args[6] = {argv[0], argv[1], list, argv[3], argv[4], argv[5]};
+                return enif_schedule_nif(env, "nif_scheduler_batch", 0, nif_scheduler_batch, 6, args);
+            }
+        }
+#else
+        done = batch_call_add(env, argv[4], &list, (unsigned int) -1);
+#endif
+    } while(done == 0);
 
-    if(!enif_get_list_length(env, argv[0], &ids_length))
+    if(done < 0)
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "offerid_array");
+        return make_argument_error(env, "invalid_or_corrupted_parameter", batch_list_names[kind]);
     }
-    if(!enif_is_list(env, argv[1])) 
-    {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "operations_array");
-    };
 
-    if(!enif_get_list_length(env, argv[1], &ops_length))
+    if(!lock_state(env, argv[0], &state)) 
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "operations_array");
+        return make_not_inited_error(env);
     }
 
-    ErlNifBinary ids_binary_arr[ids_length];
-    if(!inspect_array_of_binary_objects(env, argv[0], ids_binary_arr ))
+    // the records are built into protobuf objects directly, no intermediate binaries
+    SchedulerDriverStatus status = scheduler_batchCall(state->scheduler_state, env, argv[4], argv[1], argv[3], &invalid);
+    unlock_state(state);
+
+    if(invalid != NULL)
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "offerid_array");
+        return make_argument_error(env, "invalid_or_corrupted_parameter", (char*) invalid);
     }
-    ErlNifBinary ops_binary_arr[ops_length];
-    if(!inspect_array_of_binary_objects(env, argv[1], ops_binary_arr ))
+    return get_return_value_from_status(env, status);
+}
+
+// starts the batch of a launchTasks, acceptOffers, requestResources or
+// reconcileTasks call, arg and filters are unused by the last two
+static ERL_NIF_TERM
+start_batch(ErlNifEnv* env, int kind, ERL_NIF_TERM handle, ERL_NIF_TERM arg, ERL_NIF_TERM list, ERL_NIF_TERM filters)
+{
+    unsigned int length;
+    state_ptr state;
+
+    if(!enif_get_list_length(env, list, &length))
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "operations_array");
+        return make_argument_error(env, "invalid_or_corrupted_parameter", batch_list_names[kind]);
     }
-    ErlNifBinary filters_binary;
-    if (!enif_inspect_binary(env, argv[2], &filters_binary)) 
+
+    // fail before the list is converted rather than after
+    if(!lock_state(env, handle, &state)) 
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "filters");
+        return make_not_inited_error(env);
     }
+    unlock_state(state);
 
-    BinaryNifArray ids_binaryNifArrayHolder ;
-    ids_binaryNifArrayHolder.length = ids_length;
-    ids_binaryNifArrayHolder.obj = &ids_binary_arr[0];
-    BinaryNifArray ops_binaryNifArrayHolder ;
-    ops_binaryNifArrayHolder.length = ops_length;
-    ops_binaryNifArrayHolder.obj = &ops_binary_arr[0];
+    ERL_NIF_TERM args[6] = {handle, arg, list, filters, batch_call_make(env, kind, length), enif_make_int(env, kind)};
+    return nif_scheduler_batch(env, 6, args);
+}
 
-    SchedulerDriverStatus status =  scheduler_acceptOffers(
-        state->scheduler_state, &ids_binaryNifArrayHolder, &ops_binaryNifArrayHolder, &filters_binary);
-    return get_return_value_from_status(env, status);
+static ERL_NIF_TERM
+nif_scheduler_acceptOffers(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    if(!enif_is_list(env, argv[1])) 
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "offerid_array");
+    };
+
+    return start_batch(env, BATCH_ACCEPT_OFFERS, argv[0], argv[1], argv[2], argv[3]);
 }
 
 static ERL_NIF_TERM
@@ -264,25 +479,24 @@ nif_scheduler_declineOffer(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
 
     ErlNifBinary offerId_binary;
     ErlNifBinary filters_binary;
+    state_ptr state;
 
-    state_ptr state = (state_ptr) enif_priv_data(env);
-    
-    if(state->initilised == 0 ) 
-    {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "scheduler_not_inited"));
-    }
-    if (!enif_inspect_binary(env, argv[0], &offerId_binary)) 
+    if (!enif_inspect_binary(env, argv[1], &offerId_binary)) 
     {
         return make_argument_error(env, "invalid_or_corrupted_parameter", "offer_id");
     }
-    if (!enif_inspect_binary(env, argv[1], &filters_binary)) 
+    if (!enif_inspect_binary(env, argv[2], &filters_binary)) 
     {
         return make_argument_error(env, "invalid_or_corrupted_parameter", "filters");
     }
 
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
     SchedulerDriverStatus status = scheduler_declineOffer( state->scheduler_state, &offerId_binary, &filters_binary );
+    unlock_state(state);
 
     return get_return_value_from_status(env, status);
 }
@@ -291,38 +505,96 @@ static ERL_NIF_TERM
 nif_scheduler_killTask(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
 
     ErlNifBinary taskId_binary;
+    state_ptr state;
 
-    state_ptr state = (state_ptr) enif_priv_data(env);
-    
-    if(state->initilised == 0 ) 
+    if (!enif_inspect_binary(env, argv[1], &taskId_binary)) 
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "scheduler_not_inited"));
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_id");
     }
-    if (!enif_inspect_binary(env, argv[0], &taskId_binary)) 
+
+    if(!lock_state(env, argv[0], &state)) 
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_id");
+        return make_not_inited_error(env);
     }
 
     SchedulerDriverStatus status = scheduler_killTask( state->scheduler_state, &taskId_binary);
+    unlock_state(state);
 
     return get_return_value_from_status(env, status);
 }
 
+static ERL_NIF_TERM
+nif_scheduler_declineOffers(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    BinaryNifArray offerIds;
+    ErlNifBinary filters_binary;
+    state_ptr state;
+
+    if (!enif_inspect_binary(env, argv[2], &filters_binary)) 
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "filters");
+    }
+    if(!alloc_array_of_binary_objects(env, argv[1], &offerIds))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "offer_id_array");
+    }
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        enif_free(offerIds.obj);
+        return make_not_inited_error(env);
+    }
+
+    SchedulerDriverStatus* statuses = (SchedulerDriverStatus*) enif_alloc(sizeof(SchedulerDriverStatus) * (offerIds.length + 1));
+    scheduler_declineOffers(state->scheduler_state, &offerIds, &filters_binary, statuses);
+    unlock_state(state);
+
+    ERL_NIF_TERM ret = get_return_values_from_statuses(env, statuses, offerIds.length);
+    enif_free(statuses);
+    enif_free(offerIds.obj);
+    return ret;
+}
+
+static ERL_NIF_TERM
+nif_scheduler_killTasks(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    BinaryNifArray taskIds;
+    state_ptr state;
+
+    if(!alloc_array_of_binary_objects(env, argv[1], &taskIds))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_id_array");
+    }
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        enif_free(taskIds.obj);
+        return make_not_inited_error(env);
+    }
+
+    SchedulerDriverStatus* statuses = (SchedulerDriverStatus*) enif_alloc(sizeof(SchedulerDriverStatus) * (taskIds.length + 1));
+    scheduler_killTasks(state->scheduler_state, &taskIds, statuses);
+    unlock_state(state);
+
+    ERL_NIF_TERM ret = get_return_values_from_statuses(env, statuses, taskIds.length);
+    enif_free(statuses);
+    enif_free(taskIds.obj);
+    return ret;
+}
+
 static ERL_NIF_TERM
 nif_scheduler_reviveOffers(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
-    state_ptr state = (state_ptr) enif_priv_data(env);
+    state_ptr state;
     
-    if(state->initilised == 0 ) 
+    if(!lock_state(env, argv[0], &state)) 
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "scheduler_not_inited"));
+        return make_not_inited_error(env);
     }
     
     SchedulerDriverStatus status =  scheduler_reviveOffers( state->scheduler_state );
+    unlock_state(state);
+
     return get_return_value_from_status(env, status);
 }
 
@@ -331,220 +603,796 @@ nif_scheduler_sendFrameworkMessage(ErlNifEnv* env, int argc, const ERL_NIF_TERM
 
     ErlNifBinary executorId_binary;
     ErlNifBinary slaveId_binary;
-    char data[MAXBUFLEN];
+    ErlNifBinary data_binary;
+    state_ptr state;
 
-    state_ptr state = (state_ptr) enif_priv_data(env);
-    
-    if(state->initilised == 0 ) 
-    {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "scheduler_not_inited"));
-    }
-    if (!enif_inspect_binary(env, argv[0], &executorId_binary)) 
+    if (!enif_inspect_binary(env, argv[1], &executorId_binary)) 
     {
         return make_argument_error(env, "invalid_or_corrupted_parameter", "executor_id");
     }
-    if (!enif_inspect_binary(env, argv[1], &slaveId_binary)) 
+    if (!enif_inspect_binary(env, argv[2], &slaveId_binary)) 
     {
         return make_argument_error(env, "invalid_or_corrupted_parameter", "slave_id");
     }
-    //REVIEW : buffer length
-    if(!enif_get_string(env, argv[2], data , MAXBUFLEN, ERL_NIF_LATIN1 ))
+    // any iodata, flattened without a copy when it is already a binary
+    if(!enif_inspect_iolist_as_binary(env, argv[3], &data_binary))
     {
         return make_argument_error(env, "invalid_or_corrupted_parameter", "data");
     }
 
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
     SchedulerDriverStatus status = scheduler_sendFrameworkMessage( state->scheduler_state , 
                                                                         &executorId_binary, 
                                                                         &slaveId_binary, 
-                                                                        data);
+                                                                        &data_binary);
+    unlock_state(state);
+
     return get_return_value_from_status(env, status);
 }
 
 static ERL_NIF_TERM
 nif_scheduler_requestResources(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
-    unsigned int length ;
+    ERL_NIF_TERM undefined = enif_make_atom(env, "undefined");
+    return start_batch(env, BATCH_REQUEST_RESOURCES, argv[0], undefined, argv[1], undefined);
+}
 
-    state_ptr state = (state_ptr) enif_priv_data(env);
-    
-    if(state->initilised == 0 ) 
+static ERL_NIF_TERM
+nif_scheduler_reconcileTasks(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    ERL_NIF_TERM undefined = enif_make_atom(env, "undefined");
+    return start_batch(env, BATCH_RECONCILE_TASKS, argv[0], undefined, argv[1], undefined);
+}
+
+static ERL_NIF_TERM
+nif_scheduler_launchTasks(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return start_batch(env, BATCH_LAUNCH_TASKS, argv[0], argv[1], argv[2], argv[3]);
+}
+
+static ERL_NIF_TERM
+nif_scheduler_destroy(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!enif_get_resource(env, argv[0], state_type, (void**) &state))
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "scheduler_not_inited"));
+        return make_not_inited_error(env);
     }
 
-    if(!enif_is_list(env, argv[0])) 
+    // a driver still running is aborted first, which wakes anyone blocked in join
+    if(lock_state(env, argv[0], &state))
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "request_array");
-    };
+        scheduler_abort(state->scheduler_state);
+        unlock_state(state);
+    }
 
-    if(!enif_get_list_length(env, argv[0], &length))
+    // waits for any driver call in progress on another scheduler thread
+    enif_rwlock_rwlock(state->lock);
+    if(state->initilised == 0 ) 
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "request_array");
+        enif_rwlock_rwunlock(state->lock);
+        return make_not_inited_error(env);
     }
-
-    ErlNifBinary binary_arr[length];
-    if(!inspect_array_of_binary_objects(env, argv[0], binary_arr ))
+    enif_mutex_lock(state->join_lock);
+    while(state->joining > 0)
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "request_array");
+        enif_cond_wait(state->joined, state->join_lock);
     }
+    enif_mutex_unlock(state->join_lock);
+    scheduler_destroy(state->scheduler_state);
+    state->initilised = 0;
+    enif_rwlock_rwunlock(state->lock);
 
-    BinaryNifArray binaryNifArrayHolder ;
-    binaryNifArrayHolder.length = length;
-    binaryNifArrayHolder.obj = &binary_arr[0];
-
-    SchedulerDriverStatus status =  scheduler_requestResources( state->scheduler_state, &binaryNifArrayHolder);
-    return get_return_value_from_status(env, status);
+    return enif_make_atom(env, "ok");
 }
 
 static ERL_NIF_TERM
-nif_scheduler_reconcileTasks(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
-{
-    unsigned int length ;
+nif_scheduler_acknowledgeStatusUpdate(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
 
-    state_ptr state = (state_ptr) enif_priv_data(env);
-    
-    if(state->initilised == 0 ) 
-    {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "scheduler_not_inited"));
-    }
+    ErlNifBinary task_status_binary;
+    state_ptr state;
 
-    if(!enif_is_list(env, argv[0])) 
+    if (!enif_inspect_binary(env, argv[1], &task_status_binary)) 
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_status_array");
-    };
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_status");
+    }
 
-    if(!enif_get_list_length(env, argv[0], &length))
+    if(!lock_state(env, argv[0], &state)) 
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_status_array");
+        return make_not_inited_error(env);
     }
-    
-    ErlNifBinary binary_arr[length];
-    if(!inspect_array_of_binary_objects(env, argv[0], binary_arr ))
-    {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_status_array");
-    }   
 
-    BinaryNifArray binaryNifArrayHolder ;
-    binaryNifArrayHolder.length = length;
-    binaryNifArrayHolder.obj = &binary_arr[0];
+    SchedulerDriverStatus status = scheduler_acknowledgeStatusUpdate(state->scheduler_state, &task_status_binary);
+    unlock_state(state);
 
-    SchedulerDriverStatus status =  scheduler_reconcileTasks( state->scheduler_state, &binaryNifArrayHolder);
     return get_return_value_from_status(env, status);
 }
 
 static ERL_NIF_TERM
-nif_scheduler_launchTasks(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
-{
-    unsigned int length ;
-    ErlNifBinary offerId_binary;
-    ErlNifBinary filters_binary;
+nif_scheduler_acknowledgeStatusUpdates(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
 
-    state_ptr state = (state_ptr) enif_priv_data(env);
-    
-    if(state->initilised == 0 ) 
+    BinaryNifArray taskStatuses;
+    state_ptr state;
+
+    if(!alloc_array_of_binary_objects(env, argv[1], &taskStatuses))
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "scheduler_not_inited"));
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_status_array");
     }
 
-    if (!enif_inspect_binary(env, argv[0], &offerId_binary)) 
+    if(!lock_state(env, argv[0], &state)) 
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "offer_id");
+        enif_free(taskStatuses.obj);
+        return make_not_inited_error(env);
     }
-    
-    if(!enif_is_list(env, argv[1])) 
+
+    SchedulerDriverStatus* statuses = (SchedulerDriverStatus*) enif_alloc(sizeof(SchedulerDriverStatus) * (taskStatuses.length + 1));
+    scheduler_acknowledgeStatusUpdates(state->scheduler_state, &taskStatuses, statuses);
+    unlock_state(state);
+
+    ERL_NIF_TERM ret = get_return_values_from_statuses(env, statuses, taskStatuses.length);
+    enif_free(statuses);
+    enif_free(taskStatuses.obj);
+    return ret;
+}
+
+static ERL_NIF_TERM
+nif_scheduler_ack(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    SchedulerDriverStatus status;
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_info_array");
-    };
+        return make_not_inited_error(env);
+    }
+
+    int valid = scheduler_ack(state->scheduler_state, env, enif_make_list1(env, argv[1]), &status);
+    unlock_state(state);
+
+    if(!valid)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "ack");
+    }
+    return get_return_value_from_status(env, status);
+}
+
+static ERL_NIF_TERM
+nif_scheduler_ackMany(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    unsigned int length;
+    state_ptr state;
 
     if(!enif_get_list_length(env, argv[1], &length))
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_info_array");
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "ack_array");
     }
-    
-    ErlNifBinary task_info_binary_arr[length];
 
-    if(!inspect_array_of_binary_objects(env, argv[1], task_info_binary_arr ))
+    if(!lock_state(env, argv[0], &state)) 
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_info_array");
-    }   
+        return make_not_inited_error(env);
+    }
 
-    if (!enif_inspect_binary(env, argv[2], &filters_binary)) 
+    SchedulerDriverStatus* statuses = (SchedulerDriverStatus*) enif_alloc(sizeof(SchedulerDriverStatus) * (length + 1));
+    int valid = scheduler_ack(state->scheduler_state, env, argv[1], statuses);
+    unlock_state(state);
+
+    ERL_NIF_TERM ret = valid ? get_return_values_from_statuses(env, statuses, length) :
+                               make_argument_error(env, "invalid_or_corrupted_parameter", "ack_array");
+    enif_free(statuses);
+    return ret;
+}
+
+static ERL_NIF_TERM
+nif_scheduler_setBatchOffers(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    int enabled;
+    state_ptr state;
+
+    if(!enif_get_int( env, argv[1], &enabled))
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "filters");
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "enabled");
+    }
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
     }
 
-    BinaryNifArray binaryNifArrayHolder ;
-    binaryNifArrayHolder.length = length;
-    binaryNifArrayHolder.obj = &task_info_binary_arr[0];
+    scheduler_setBatchOffers(state->scheduler_state, enabled);
+    unlock_state(state);
 
-    SchedulerDriverStatus status = scheduler_launchTasks(state->scheduler_state, &offerId_binary, &binaryNifArrayHolder, &filters_binary);
-    return get_return_value_from_status(env, status);
+    return enif_make_atom(env, "ok");
 }
 
 static ERL_NIF_TERM
-nif_scheduler_destroy(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+nif_scheduler_setMessageFormat(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
 
-    state_ptr state = (state_ptr) enif_priv_data(env);
-    
-    if(state->initilised == 0 ) 
+    char type[MAXBUFLEN];
+    int format;
+    state_ptr state;
+
+    if(!enif_get_atom(env, argv[1], type, MAXBUFLEN, ERL_NIF_LATIN1))
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "scheduler_not_inited"));
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "type");
+    }
+
+    if(!enif_get_int( env, argv[2], &format) || !pb_term_format_supported(format))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "format");
+    }
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int known = scheduler_setMessageFormat(state->scheduler_state, type, format);
+    unlock_state(state);
+
+    if(!known)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "type");
     }
-    scheduler_destroy(state->scheduler_state);
-    state->initilised = 0;
     return enif_make_atom(env, "ok");
 }
 
 static ERL_NIF_TERM
-nif_scheduler_acknowledgeStatusUpdate(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+nif_scheduler_setCoalesceStatusUpdates(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
 
-    state_ptr state = (state_ptr) enif_priv_data(env);
-    
-    ErlNifBinary task_status_binary;
+    int enabled;
+    state_ptr state;
 
-    if(state->initilised == 0 ) 
+    if(!enif_get_int( env, argv[1], &enabled))
     {
-        return enif_make_tuple2(env, 
-            enif_make_atom(env, "error"), 
-            enif_make_atom(env, "scheduler_not_inited"));
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "enabled");
     }
 
-    if (!enif_inspect_binary(env, argv[0], &task_status_binary)) 
+    if(!lock_state(env, argv[0], &state)) 
     {
-        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_status");
+        return make_not_inited_error(env);
     }
 
-    SchedulerDriverStatus status = scheduler_acknowledgeStatusUpdate(state->scheduler_state, &task_status_binary);
-    return get_return_value_from_status(env, status);
+    scheduler_setCoalesceStatusUpdates(state->scheduler_state, enabled);
+    unlock_state(state);
+
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_scheduler_takeStatusUpdates(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    unsigned int max;
+    ERL_NIF_TERM statuses;
+    state_ptr state;
+
+    if(!enif_get_uint( env, argv[1], &max) || max == 0)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "max");
+    }
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int more = scheduler_takeStatusUpdates(state->scheduler_state, env, max, &statuses);
+    unlock_state(state);
+
+    return enif_make_tuple2(env, statuses, enif_make_atom(env, more ? "true" : "false"));
+}
+
+static ERL_NIF_TERM
+nif_scheduler_taskState(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    ERL_NIF_TERM info;
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int found = scheduler_taskState(state->scheduler_state, env, argv[1], &info);
+    unlock_state(state);
+
+    if(found < 0)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_id");
+    }else if(found == 0)
+    {
+        return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_atom(env, "not_found"));
+    }
+    return enif_make_tuple2(env, enif_make_atom(env, "ok"), info);
+}
+
+static ERL_NIF_TERM
+nif_scheduler_taskStats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    ERL_NIF_TERM stats = scheduler_taskStats(state->scheduler_state, env);
+    unlock_state(state);
+
+    return stats;
+}
+
+static ERL_NIF_TERM
+nif_scheduler_reconcile(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!enif_is_list(env, argv[1]))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_status_array");
+    }
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int queued = scheduler_reconcile(state->scheduler_state, env, argv[1]);
+    unlock_state(state);
+
+    if(queued < 0)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "task_status_array");
+    }else if(queued == 0)
+    {
+        return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_atom(env, "thread_not_started"));
+    }
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_scheduler_setReconcileOptions(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int valid = scheduler_setReconcileOptions(state->scheduler_state, env, argv[1]);
+    unlock_state(state);
+
+    if(!valid)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "options");
+    }
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_scheduler_cancelReconcile(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    scheduler_cancelReconcile(state->scheduler_state);
+    unlock_state(state);
+
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_scheduler_reconcileStats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    ERL_NIF_TERM stats = scheduler_reconcileStats(state->scheduler_state, env);
+    unlock_state(state);
+
+    return stats;
+}
+
+static ERL_NIF_TERM
+nif_scheduler_setFlowControl(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int valid = scheduler_setFlowControl(state->scheduler_state, env, argv[1]);
+    unlock_state(state);
+
+    if(!valid)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "options");
+    }
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_scheduler_grant(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    unsigned long credits;
+    state_ptr state;
+
+    if(!enif_get_ulong( env, argv[1], &credits))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "credits");
+    }
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    scheduler_grant(state->scheduler_state, env, credits);
+    unlock_state(state);
+
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_scheduler_flowControlStats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    ERL_NIF_TERM stats = scheduler_flowControlStats(state->scheduler_state, env);
+    unlock_state(state);
+
+    return stats;
+}
+
+static ERL_NIF_TERM
+nif_scheduler_fakeDriverStats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+    ERL_NIF_TERM stats;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int fake = scheduler_fakeDriverStats(state->scheduler_state, env, &stats);
+    unlock_state(state);
+
+    if(!fake)
+    {
+        return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_atom(env, "not_fake_driver"));
+    }
+    return stats;
+}
+
+static ERL_NIF_TERM
+nif_scheduler_setMessageChannel(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int valid = scheduler_setMessageChannel(state->scheduler_state, env, argv[1]);
+    unlock_state(state);
+
+    if(!valid)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "options");
+    }
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_scheduler_messageChannelStats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    ERL_NIF_TERM stats = scheduler_messageChannelStats(state->scheduler_state, env);
+    unlock_state(state);
+
+    return stats;
+}
+
+static ERL_NIF_TERM
+nif_scheduler_setDispatch(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int valid = scheduler_setDispatch(state->scheduler_state, env, argv[1]);
+    unlock_state(state);
+
+    if(!valid)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "workers");
+    }
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_scheduler_dispatchStats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    ERL_NIF_TERM stats = scheduler_dispatchStats(state->scheduler_state, env);
+    unlock_state(state);
+
+    return stats;
+}
+
+static ERL_NIF_TERM
+nif_scheduler_setOfferIndex(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    int enabled;
+    state_ptr state;
+
+    if(!enif_get_int( env, argv[1], &enabled))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "enabled");
+    }
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    scheduler_setOfferIndex(state->scheduler_state, enabled);
+    unlock_state(state);
+
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_scheduler_findOffers(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    ERL_NIF_TERM offers;
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int valid = scheduler_findOffers(state->scheduler_state, env, argv[1], &offers);
+    unlock_state(state);
+
+    if(!valid)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "query");
+    }
+    return enif_make_tuple2(env, enif_make_atom(env, "ok"), offers);
+}
+
+static ERL_NIF_TERM
+nif_scheduler_setOfferFilter(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int valid = scheduler_setOfferFilter(state->scheduler_state, env, argv[1]);
+    unlock_state(state);
+
+    if(!valid)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "offer_filter");
+    }
+    return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM
+nif_scheduler_offerFilterStats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    state_ptr state;
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    ERL_NIF_TERM stats = scheduler_offerFilterStats(state->scheduler_state, env);
+    unlock_state(state);
+
+    return stats;
+}
+
+static ERL_NIF_TERM
+nif_scheduler_cast(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    const char* invalid = NULL;
+    unsigned long id;
+    ErlNifPid caller;
+    state_ptr state;
+
+    enif_self(env, &caller);
+
+    if(!lock_state(env, argv[0], &state)) 
+    {
+        return make_not_inited_error(env);
+    }
+
+    int result = scheduler_cast(state->scheduler_state, env, &caller, argv[1], &id, &invalid);
+    unlock_state(state);
+
+    if(result == SCHEDULER_CAST_QUEUED)
+    {
+        return enif_make_tuple2(env, enif_make_atom(env, "ok"), enif_make_ulong(env, id));
+    }else if(result == SCHEDULER_CAST_INVALID)
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", (char*) invalid);
+    }else if(result == SCHEDULER_CAST_FULL)
+    {
+        return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_atom(env, "queue_full"));
+    }
+    return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_atom(env, "thread_not_started"));
+}
+
+static ERL_NIF_TERM
+nif_scheduler_decode(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[]){
+
+    ErlNifBinary binary;
+    char type[MAXBUFLEN];
+    int format;
+    ERL_NIF_TERM term;
+
+    if (!enif_inspect_binary(env, argv[0], &binary)) 
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "binary");
+    }
+
+    if(!enif_get_atom(env, argv[1], type, MAXBUFLEN, ERL_NIF_LATIN1))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "type");
+    }
+
+    if(!enif_get_int( env, argv[2], &format) || !pb_term_format_supported(format))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "format");
+    }
+
+    if(!pb_binary_to_term(env, &binary, type, format, &term))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "binary");
+    }
+    return enif_make_tuple2(env, enif_make_atom(env, "ok"), term);
 }
 
+static ERL_NIF_TERM
+nif_scheduler_envStats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return callback_env_stats(env);
+}
+
+static ERL_NIF_TERM
+nif_scheduler_stats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return metrics_snapshot(env);
+}
+
+// records how long the scheduler process took to handle a callback message
+static ERL_NIF_TERM
+nif_scheduler_observe(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    char name[MAXBUFLEN] = "scheduler_handle_";
+    size_t prefix = strlen(name);
+    unsigned long nanos;
+
+    if(!enif_get_atom(env, argv[0], name + prefix, MAXBUFLEN - prefix, ERL_NIF_LATIN1))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "message");
+    }
+
+    if(!enif_get_ulong(env, argv[1], &nanos))
+    {
+        return make_argument_error(env, "invalid_or_corrupted_parameter", "nanos");
+    }
+
+    metrics_observe(name, nanos);
+    return enif_make_atom(env, "ok");
+}
+
+NIF_ON_THREAD(nif_scheduler_join)
+NIF_ON_THREAD(nif_scheduler_abort)
+NIF_ON_THREAD(nif_scheduler_stop)
+NIF_ON_THREAD(nif_scheduler_destroy)
+NIF_ON_THREAD(nif_scheduler_declineOffers)
+NIF_ON_THREAD(nif_scheduler_killTasks)
+NIF_ON_THREAD(nif_scheduler_acknowledgeStatusUpdates)
+NIF_ON_THREAD(nif_scheduler_ackMany)
+NIF_ON_THREAD(nif_scheduler_reconcile)
+
 static ErlNifFunc nif_funcs[] = {
     {"nif_scheduler_init", 4, nif_scheduler_init},
     {"nif_scheduler_init", 5, nif_scheduler_init},
-    {"nif_scheduler_start", 0, nif_scheduler_start},
-    {"nif_scheduler_join", 0, nif_scheduler_join},
-    {"nif_scheduler_abort", 0, nif_scheduler_abort},
-    {"nif_scheduler_stop", 1, nif_scheduler_stop},
-    {"nif_scheduler_acceptOffers", 3,nif_scheduler_acceptOffers},
-    {"nif_scheduler_declineOffer", 2,nif_scheduler_declineOffer},
-    {"nif_scheduler_killTask", 1,nif_scheduler_killTask},
-    {"nif_scheduler_reviveOffers", 0 , nif_scheduler_reviveOffers},
-    {"nif_scheduler_sendFrameworkMessage", 3, nif_scheduler_sendFrameworkMessage},
-    {"nif_scheduler_requestResources", 1, nif_scheduler_requestResources},
-    {"nif_scheduler_reconcileTasks", 1,nif_scheduler_reconcileTasks},
-    {"nif_scheduler_launchTasks", 3,nif_scheduler_launchTasks},
-    {"nif_scheduler_destroy", 0, nif_scheduler_destroy},
-    {"nif_scheduler_acknowledgeStatusUpdate", 1, nif_scheduler_acknowledgeStatusUpdate}
+    {"nif_scheduler_start", 1, nif_scheduler_start},
+    {"nif_scheduler_join", 1, NIF_BLOCKING(nif_scheduler_join)},
+    {"nif_scheduler_joinAsync", 1, nif_scheduler_joinAsync},
+    {"nif_scheduler_abort", 1, NIF_BLOCKING(nif_scheduler_abort)},
+    {"nif_scheduler_stop", 2, NIF_BLOCKING(nif_scheduler_stop)},
+    {"nif_scheduler_acceptOffers", 4,nif_scheduler_acceptOffers},
+    {"nif_scheduler_declineOffer", 3,nif_scheduler_declineOffer},
+    {"nif_scheduler_killTask", 2,nif_scheduler_killTask},
+    {"nif_scheduler_reviveOffers", 1 , nif_scheduler_reviveOffers},
+    {"nif_scheduler_sendFrameworkMessage", 4, nif_scheduler_sendFrameworkMessage},
+    {"nif_scheduler_requestResources", 2, nif_scheduler_requestResources},
+    {"nif_scheduler_reconcileTasks", 2,nif_scheduler_reconcileTasks},
+    {"nif_scheduler_launchTasks", 4,nif_scheduler_launchTasks},
+    {"nif_scheduler_destroy", 1, NIF_BLOCKING(nif_scheduler_destroy)},
+    {"nif_scheduler_acknowledgeStatusUpdate", 2, nif_scheduler_acknowledgeStatusUpdate},
+    {"nif_scheduler_setBatchOffers", 2, nif_scheduler_setBatchOffers},
+    {"nif_scheduler_envStats", 0, nif_scheduler_envStats},
+    {"nif_scheduler_stats", 0, nif_scheduler_stats},
+    {"nif_scheduler_observe", 2, nif_scheduler_observe},
+    {"nif_scheduler_setMessageFormat", 3, nif_scheduler_setMessageFormat},
+    {"nif_scheduler_setCoalesceStatusUpdates", 2, nif_scheduler_setCoalesceStatusUpdates},
+    {"nif_scheduler_takeStatusUpdates", 2, nif_scheduler_takeStatusUpdates},
+    {"nif_scheduler_taskState", 2, nif_scheduler_taskState},
+    {"nif_scheduler_taskStats", 1, nif_scheduler_taskStats},
+    {"nif_scheduler_setReconcileOptions", 2, nif_scheduler_setReconcileOptions},
+    {"nif_scheduler_cancelReconcile", 1, nif_scheduler_cancelReconcile},
+    {"nif_scheduler_reconcileStats", 1, nif_scheduler_reconcileStats},
+    {"nif_scheduler_setFlowControl", 2, nif_scheduler_setFlowControl},
+    {"nif_scheduler_grant", 2, nif_scheduler_grant},
+    {"nif_scheduler_flowControlStats", 1, nif_scheduler_flowControlStats},
+    {"nif_scheduler_fakeDriverStats", 1, nif_scheduler_fakeDriverStats},
+    {"nif_scheduler_setMessageChannel", 2, nif_scheduler_setMessageChannel},
+    {"nif_scheduler_messageChannelStats", 1, nif_scheduler_messageChannelStats},
+    {"nif_scheduler_setDispatch", 2, nif_scheduler_setDispatch},
+    {"nif_scheduler_dispatchStats", 1, nif_scheduler_dispatchStats},
+    {"nif_scheduler_setOfferIndex", 2, nif_scheduler_setOfferIndex},
+    {"nif_scheduler_findOffers", 2, nif_scheduler_findOffers},
+    {"nif_scheduler_setOfferFilter", 2, nif_scheduler_setOfferFilter},
+    {"nif_scheduler_offerFilterStats", 1, nif_scheduler_offerFilterStats},
+    {"nif_scheduler_cast", 2, nif_scheduler_cast},
+    // a driver call per item, long lists take longer than a nif should
+    {"nif_scheduler_declineOffers", 3, NIF_BLOCKING(nif_scheduler_declineOffers)},
+    {"nif_scheduler_killTasks", 2, NIF_BLOCKING(nif_scheduler_killTasks)},
+    {"nif_scheduler_acknowledgeStatusUpdates", 2, NIF_BLOCKING(nif_scheduler_acknowledgeStatusUpdates)},
+    {"nif_scheduler_ack", 2, nif_scheduler_ack},
+    {"nif_scheduler_ackMany", 2, NIF_BLOCKING(nif_scheduler_ackMany)},
+    // builds a TaskStatus per item, for tens of thousands of tasks
+    {"nif_scheduler_reconcile", 2, NIF_BLOCKING(nif_scheduler_reconcile)},
+    {"nif_scheduler_decode", 3, nif_scheduler_decode}
 };
 
 ERL_NIF_INIT(nif_scheduler, nif_funcs, scheduler_load, NULL, scheduler_upgrade, scheduler_unload);
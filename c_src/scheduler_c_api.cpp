@@ -19,7 +19,10 @@
 
 
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
+#include <atomic>
+#include <memory>
 
 #include "erl_nif.h"
 
@@ -30,6 +33,21 @@
 #include <mesos/scheduler.hpp>
 #include "mesos/mesos.pb.h"
 #include "utils.hpp"
+#include "callback_env.hpp"
+#include "pb_term.hpp"
+#include "metrics.hpp"
+#include "command_queue.hpp"
+#include "offer_filter.hpp"
+#include "offer_index.hpp"
+#include "task_table.hpp"
+#include "ack_handle.hpp"
+#include "reconciler.hpp"
+#include "flow_control.hpp"
+#include "fake_driver.hpp"
+#include "batch_call.hpp"
+#include "message_channel.hpp"
+#include "dispatcher.hpp"
+#include "executor_set.hpp"
 
 using namespace mesos;
 using namespace std;
@@ -39,7 +57,7 @@ using namespace std;
 class CScheduler : public Scheduler
 {
 public:
-  CScheduler() {}
+  CScheduler() : implicitAcknowledgements(true), batchOffers(false), ackOwner(ack_handle_owner()) {}
 
    ~CScheduler() {}
 
@@ -147,7 +165,49 @@ public:
    virtual void error(SchedulerDriver* driver, const std::string& message);
 
   FrameworkInfo info;
-  ErlNifPid* pid;
+  ErlNifPid pid;
+  bool implicitAcknowledgements;
+
+  // when set, resourceOffers delivers the whole offer vector as
+  // a single {resourceOffers, [Offer]} message
+  std::atomic<bool> batchOffers;
+
+  // the ack handles this scheduler makes, only it takes them back
+  const unsigned long ackOwner;
+
+  // binary, record or map per message type
+  PbTermFormats formats;
+
+  // driver calls queued by scheduler_cast
+  std::unique_ptr<CommandQueue> commands;
+
+  // offers declined before they reach erlang
+  OfferFilter offerFilter;
+
+  // offers sent to erlang and not yet used
+  OfferIndex offerIndex;
+
+  // latest state per task, drops duplicates and holds coalesced updates
+  TaskTable tasks;
+
+  // paced reconciliation of the tasks given to scheduler_reconcile
+  std::unique_ptr<Reconciler> reconciler;
+
+  // credits granted by the owner for callback messages
+  FlowControl flow;
+
+  // framework messages sent and received in frames, once configured
+  std::unique_ptr<MessageChannel> channel;
+
+  // executors a framework message to all of them is sent to
+  ExecutorSet executors;
+
+  // worker processes keyed callbacks go to instead of pid, once set
+  Dispatcher dispatch;
+
+private:
+  // declines an offer flow control would not deliver
+  void refuseOffer(SchedulerDriver* driver, const Offer& offer);
 };
 
 SchedulerPtrPair scheduler_init(ErlNifPid* pid, 
@@ -157,6 +217,8 @@ SchedulerPtrPair scheduler_init(ErlNifPid* pid,
                                 int credentialssupplied,
                                 ErlNifBinary* credentials)
 {
+    METRIC_TIMER(timer, "scheduler_init");
+
     assert(info != NULL); 
     assert(master != NULL); 
 
@@ -164,12 +226,29 @@ SchedulerPtrPair scheduler_init(ErlNifPid* pid,
     Credential credentials_pb ;
 
     CScheduler* scheduler = new CScheduler();
-    scheduler->pid = pid;
+    scheduler->pid = *pid;
+    scheduler->implicitAcknowledgements = (implicitAcknowledgements == 1);
 
     deserialize<FrameworkInfo>(scheduler->info,info);
-    MesosSchedulerDriver* driver ;
+    SchedulerDriver* driver ;
+
+    if(strncmp(master, FAKE_DRIVER_SCHEME, strlen(FAKE_DRIVER_SCHEME)) == 0)
+    {
+      FakeSchedulerDriver::Config config;
+      if(!config.parse(master))
+      {
+        delete scheduler;
+        ret.driver = NULL;
+        ret.scheduler = NULL;
+        return ret;
+      }
 
-    if(credentialssupplied)
+      driver = new FakeSchedulerDriver(
+                                      scheduler,
+                                      scheduler->info,
+                                      config,
+                                      implicitAcknowledgements == 1 ? true : false);
+    }else if(credentialssupplied)
     {
 
       deserialize<Credential>(credentials_pb,credentials);
@@ -189,6 +268,10 @@ SchedulerPtrPair scheduler_init(ErlNifPid* pid,
                                      implicitAcknowledgements == 1 ? true : false);
     }
 
+    scheduler->channel.reset(new MessageChannel(driver));
+    scheduler->commands.reset(new CommandQueue(driver, scheduler->channel.get()));
+    scheduler->reconciler.reset(new Reconciler(driver));
+
     ret.driver = driver;
     ret.scheduler = scheduler;
     return ret;
@@ -196,33 +279,41 @@ SchedulerPtrPair scheduler_init(ErlNifPid* pid,
 
 SchedulerDriverStatus scheduler_start(SchedulerPtrPair state)
 {
+    METRIC_TIMER(timer, "scheduler_start");
+
     assert(state.driver != NULL);
 
-    MesosSchedulerDriver* driver = reinterpret_cast<MesosSchedulerDriver*> (state.driver);
+    SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
     return driver->start();
 }
 
 SchedulerDriverStatus scheduler_join(SchedulerPtrPair state)
 {
+    METRIC_TIMER(timer, "scheduler_join");
+
     assert(state.driver != NULL);
 
-    MesosSchedulerDriver* driver = reinterpret_cast<MesosSchedulerDriver*> (state.driver);
+    SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
     return driver->join();
 }
 
 SchedulerDriverStatus scheduler_abort(SchedulerPtrPair state)
 {
+    METRIC_TIMER(timer, "scheduler_abort");
+
     assert(state.driver != NULL);
 
-    MesosSchedulerDriver* driver = reinterpret_cast<MesosSchedulerDriver*> (state.driver);
+    SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
     return driver->abort();
 }
 
 SchedulerDriverStatus scheduler_stop(SchedulerPtrPair state, int failover)
 {
+    METRIC_TIMER(timer, "scheduler_stop");
+
     assert(state.driver != NULL);
     
-    MesosSchedulerDriver* driver = reinterpret_cast<MesosSchedulerDriver*> (state.driver);
+    SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
     if(failover){
       return driver->stop(true);
     }else{
@@ -230,26 +321,51 @@ SchedulerDriverStatus scheduler_stop(SchedulerPtrPair state, int failover)
     }
 }
 
-SchedulerDriverStatus scheduler_acceptOffers(SchedulerPtrPair state, BinaryNifArray* offerIds, BinaryNifArray* operations, ErlNifBinary* filters)
+// the operations have been converted by the batch, as in launchTasks
+static SchedulerDriverStatus acceptOffers(SchedulerPtrPair state, 
+                                          ErlNifEnv* env, 
+                                          ERL_NIF_TERM offerIds, 
+                                          const vector<Offer::Operation>& operations_, 
+                                          ERL_NIF_TERM filters, 
+                                          const char** invalid)
  {
+    METRIC_TIMER(timer, "scheduler_acceptOffers");
+
     assert(state.driver != NULL);
-    assert(offerIds != NULL);
-    assert(operations != NULL);
+    assert(invalid != NULL);
 
     vector<OfferID> offerIds_;
-    if(! deserialize<OfferID>( offerIds_, offerIds)) {return DRIVER_ABORTED;};
-    vector<Offer::Operation> operations_;
-    if(! deserialize<Offer::Operation>( operations_, operations)) {return DRIVER_ABORTED;};
+    if(!pb_terms_to_objs<OfferID>(env, offerIds, offerIds_)) { *invalid = "offerid_array"; return DRIVER_ABORTED; };
 
     Filters filter_pb;
 
-    if(!deserialize<Filters>(filter_pb,filters)) { return DRIVER_ABORTED; };
+    if(!pb_term_to_obj(env, filters, &filter_pb)) { *invalid = "filters"; return DRIVER_ABORTED; };
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    for(size_t i = 0; i < offerIds_.size(); i++)
+    {
+      scheduler->offerIndex.remove(offerIds_[i]);
+    }
+    for(size_t i = 0; i < operations_.size(); i++)
+    {
+      if(operations_[i].type() != Offer::Operation::LAUNCH) { continue; }
 
-    MesosSchedulerDriver* driver = reinterpret_cast<MesosSchedulerDriver*> (state.driver);
+      const Offer::Operation::Launch& launch = operations_[i].launch();
+      for(int j = 0; j < launch.task_infos_size(); j++)
+      {
+        const TaskInfo& task = launch.task_infos(j);
+        if(task.has_executor()) { scheduler->executors.add(task.executor().executor_id(), task.slave_id()); }
+      }
+    }
+
+    SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
     return driver->acceptOffers(offerIds_, operations_, filter_pb);
  }
 SchedulerDriverStatus scheduler_declineOffer(SchedulerPtrPair state, ErlNifBinary* offerId, ErlNifBinary* filters)
  {
+    METRIC_TIMER(timer, "scheduler_declineOffer");
+    timer.addBytes(binary_bytes(offerId) + binary_bytes(filters));
+
     assert(state.driver != NULL);
     assert(offerId != NULL);
 
@@ -259,36 +375,102 @@ SchedulerDriverStatus scheduler_declineOffer(SchedulerPtrPair state, ErlNifBinar
     if(!deserialize<OfferID>(offerid_pb,offerId)) { return DRIVER_ABORTED; };
     if(!deserialize<Filters>(filter_pb,filters)) { return DRIVER_ABORTED; };
 
-    MesosSchedulerDriver* driver = reinterpret_cast<MesosSchedulerDriver*> (state.driver);
+    reinterpret_cast<CScheduler*>(state.scheduler)->offerIndex.remove(offerid_pb);
+
+    SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
     return driver->declineOffer(offerid_pb,
                               filter_pb);
  }
 
 SchedulerDriverStatus scheduler_killTask(SchedulerPtrPair state, ErlNifBinary* taskId)
 {
+    METRIC_TIMER(timer, "scheduler_killTask");
+    timer.addBytes(binary_bytes(taskId));
+
     assert(state.driver != NULL);
     assert(taskId != NULL);  
     TaskID taskid_pb;
 
     if(!deserialize<TaskID>(taskid_pb,taskId)) { return DRIVER_ABORTED; };
 
-    MesosSchedulerDriver* driver = reinterpret_cast<MesosSchedulerDriver*> (state.driver);
+    SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
     return driver->killTask(taskid_pb);
 }
 
+void scheduler_declineOffers(SchedulerPtrPair state, 
+                             BinaryNifArray* offerIds, 
+                             ErlNifBinary* filters, 
+                             SchedulerDriverStatus* statuses)
+{
+    METRIC_TIMER(timer, "scheduler_declineOffers");
+    timer.addBytes(binary_array_bytes(offerIds) + binary_bytes(filters));
+
+    assert(state.driver != NULL);
+    assert(offerIds != NULL);
+    assert(statuses != NULL);
+
+    SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    OfferID offerid_pb;
+    Filters filter_pb;
+
+    bool filtersValid = deserialize<Filters>(filter_pb,filters);
+
+    for(unsigned int i = 0; i < offerIds->length; i++)
+    {
+      if(!filtersValid || !deserialize<OfferID>(offerid_pb, &offerIds->obj[i]))
+      {
+        statuses[i] = DRIVER_ABORTED;
+        continue;
+      }
+      scheduler->offerIndex.remove(offerid_pb);
+      statuses[i] = driver->declineOffer(offerid_pb, filter_pb);
+    }
+}
+
+void scheduler_killTasks(SchedulerPtrPair state, 
+                         BinaryNifArray* taskIds, 
+                         SchedulerDriverStatus* statuses)
+{
+    METRIC_TIMER(timer, "scheduler_killTasks");
+    timer.addBytes(binary_array_bytes(taskIds));
+
+    assert(state.driver != NULL);
+    assert(taskIds != NULL);
+    assert(statuses != NULL);
+
+    SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
+    TaskID taskid_pb;
+
+    for(unsigned int i = 0; i < taskIds->length; i++)
+    {
+      if(!deserialize<TaskID>(taskid_pb, &taskIds->obj[i]))
+      {
+        statuses[i] = DRIVER_ABORTED;
+        continue;
+      }
+      statuses[i] = driver->killTask(taskid_pb);
+    }
+}
+
 SchedulerDriverStatus scheduler_reviveOffers(SchedulerPtrPair state)
 {
+    METRIC_TIMER(timer, "scheduler_reviveOffers");
+
     assert(state.driver != NULL);
 
-    MesosSchedulerDriver* driver = reinterpret_cast<MesosSchedulerDriver*> (state.driver);
+    SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
     return driver->reviveOffers();
 }
 
 SchedulerDriverStatus scheduler_sendFrameworkMessage(SchedulerPtrPair state, 
                                                     ErlNifBinary* executorId, 
                                                     ErlNifBinary* slaveId, 
-                                                    const char* data)
+                                                    ErlNifBinary* data)
 {
+    METRIC_TIMER(timer, "scheduler_sendFrameworkMessage");
+    timer.addBytes(binary_bytes(executorId) + binary_bytes(slaveId) + binary_bytes(data));
+
     assert(state.driver != NULL);
     assert(executorId != NULL);
     assert(slaveId != NULL);
@@ -300,70 +482,100 @@ SchedulerDriverStatus scheduler_sendFrameworkMessage(SchedulerPtrPair state,
     if(!deserialize<ExecutorID>(executorid_pb,executorId)) { return DRIVER_ABORTED; };
     if(!deserialize<SlaveID>(slaveid_pb,slaveId)) { return DRIVER_ABORTED; };
 
-    MesosSchedulerDriver* driver = reinterpret_cast<MesosSchedulerDriver*> (state.driver);
-    return driver->sendFrameworkMessage(executorid_pb, slaveid_pb, data);
+    MessageChannel* channel = reinterpret_cast<CScheduler*>(state.scheduler)->channel.get();
+    if(channel->enabled())
+    {
+      return channel->send(executorid_pb, slaveid_pb, string((const char*) data->data, data->size));
+    }
+
+    SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
+    return driver->sendFrameworkMessage(executorid_pb, slaveid_pb, string((const char*) data->data, data->size));
 }
 
-SchedulerDriverStatus scheduler_requestResources(SchedulerPtrPair state, BinaryNifArray* requests)
+static SchedulerDriverStatus requestResources(SchedulerPtrPair state, const vector<Request>& requests_)
 {
-  assert(state.driver != NULL);
-  assert(requests != NULL);
-
-  vector<Request> requests_;
+    METRIC_TIMER(timer, "scheduler_requestResources");
 
-  if(! deserialize<Request>( requests_, requests)) {return DRIVER_ABORTED;};
+  assert(state.driver != NULL);
 
-  MesosSchedulerDriver* driver = reinterpret_cast<MesosSchedulerDriver*> (state.driver);
+  SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
   return driver->requestResources(requests_);
 }
 
-SchedulerDriverStatus scheduler_reconcileTasks(SchedulerPtrPair state, BinaryNifArray* taskStatus)
+static SchedulerDriverStatus reconcileTasks(SchedulerPtrPair state, const vector<TaskStatus>& taskStatus_)
 {
-  assert(state.driver != NULL);
-  assert(taskStatus != NULL);
+    METRIC_TIMER(timer, "scheduler_reconcileTasks");
 
-  vector<TaskStatus> taskStatus_;
-  if(! deserialize<TaskStatus>( taskStatus_, taskStatus)) {return DRIVER_ABORTED;};
+  assert(state.driver != NULL);
 
-  MesosSchedulerDriver* driver = reinterpret_cast<MesosSchedulerDriver*> (state.driver);
+  SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
   return driver->reconcileTasks(taskStatus_);
 }
 
-SchedulerDriverStatus scheduler_launchTasks(SchedulerPtrPair state, 
-                                              ErlNifBinary* offerId, 
-                                              BinaryNifArray* taskInfos, 
-                                              ErlNifBinary* filters)
+// the tasks have been converted by the batch, a slice at a time
+static SchedulerDriverStatus launchTasks(SchedulerPtrPair state, 
+                                         ErlNifEnv* env, 
+                                         ERL_NIF_TERM offerId, 
+                                         const vector<TaskInfo>& taskInfo_, 
+                                         ERL_NIF_TERM filters, 
+                                         const char** invalid)
 {
+    METRIC_TIMER(timer, "scheduler_launchTasks");
+
   assert(state.driver != NULL);
-  assert(offerId != NULL);
-  assert(taskInfos != NULL);
+  assert(invalid != NULL);
 
   OfferID offerid_pb;
-  vector<TaskInfo> taskInfo_ ;
   Filters filter_pb;
 
-  if(!deserialize<OfferID>(offerid_pb,offerId)) { return DRIVER_ABORTED; };
-  if(!deserialize<TaskInfo>( taskInfo_, taskInfos)) {return DRIVER_ABORTED;};
-  if(!deserialize<Filters>(filter_pb,filters)) { return DRIVER_ABORTED; };
+  if(!pb_term_to_obj(env, offerId, &offerid_pb)) { *invalid = "offer_id"; return DRIVER_ABORTED; };
+  if(!pb_term_to_obj(env, filters, &filter_pb)) { *invalid = "filters"; return DRIVER_ABORTED; };
 
-  //offerid_pb.PrintDebugString();
-  //taskInfo_[0].PrintDebugString();
-  //filter_pb.PrintDebugString();
+  reinterpret_cast<CScheduler*>(state.scheduler)->offerIndex.remove(offerid_pb);
+  reinterpret_cast<CScheduler*>(state.scheduler)->executors.launched(taskInfo_);
 
-  MesosSchedulerDriver* driver = reinterpret_cast<MesosSchedulerDriver*> (state.driver);
+  SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
   return driver->launchTasks(offerid_pb, taskInfo_,filter_pb);
 }
 
+SchedulerDriverStatus scheduler_batchCall(SchedulerPtrPair state, 
+                                          ErlNifEnv* env, 
+                                          ERL_NIF_TERM call, 
+                                          ERL_NIF_TERM arg, 
+                                          ERL_NIF_TERM filters, 
+                                          const char** invalid)
+{
+  assert(invalid != NULL);
+
+  BatchCall* batch = batch_call_get(env, call);
+  if(batch == NULL) { *invalid = "batch"; return DRIVER_ABORTED; }
+
+  switch(batch->kind)
+  {
+    case BATCH_LAUNCH_TASKS: return launchTasks(state, env, arg, batch->tasks, filters, invalid);
+    case BATCH_ACCEPT_OFFERS: return acceptOffers(state, env, arg, batch->operations, filters, invalid);
+    case BATCH_REQUEST_RESOURCES: return requestResources(state, batch->requests);
+    case BATCH_RECONCILE_TASKS: return reconcileTasks(state, batch->statuses);
+  }
+
+  *invalid = "batch";
+  return DRIVER_ABORTED;
+}
 
 void scheduler_destroy (SchedulerPtrPair state)
 {
+    METRIC_TIMER(timer, "scheduler_destroy");
+
 
-    assert(state.driver != NULL);
     assert(state.driver != NULL);
 
-    MesosSchedulerDriver* driver = reinterpret_cast<MesosSchedulerDriver*>(state.driver);
+    SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*>(state.driver);
     CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
 
+    // the workers call the driver, the callbacks call the queue, the reconciler and the channel
+    scheduler->commands->stop();
+    scheduler->reconciler->stop();
+    scheduler->channel->stop();
     delete driver;
     delete scheduler;
 }
@@ -371,6 +583,9 @@ void scheduler_destroy (SchedulerPtrPair state)
   SchedulerDriverStatus scheduler_acknowledgeStatusUpdate(SchedulerPtrPair state, 
                                                           ErlNifBinary* taskStatus)
 {
+    METRIC_TIMER(timer, "scheduler_acknowledgeStatusUpdate");
+    timer.addBytes(binary_bytes(taskStatus));
+
    assert(state.driver != NULL);
    assert(taskStatus != NULL);
 
@@ -378,11 +593,393 @@ void scheduler_destroy (SchedulerPtrPair state)
 
    if(!deserialize<TaskStatus>(taskStatus_pb,taskStatus)) { return DRIVER_ABORTED; };
 
-   MesosSchedulerDriver* driver = reinterpret_cast<MesosSchedulerDriver*> (state.driver);
+   reinterpret_cast<CScheduler*>(state.scheduler)->tasks.acknowledged(taskStatus_pb);
+
+   SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
    return driver->acknowledgeStatusUpdate(taskStatus_pb);
 
 }
 
+void scheduler_acknowledgeStatusUpdates(SchedulerPtrPair state, 
+                                        BinaryNifArray* taskStatuses, 
+                                        SchedulerDriverStatus* statuses)
+{
+    METRIC_TIMER(timer, "scheduler_acknowledgeStatusUpdates");
+    timer.addBytes(binary_array_bytes(taskStatuses));
+
+   assert(state.driver != NULL);
+   assert(taskStatuses != NULL);
+   assert(statuses != NULL);
+
+   SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
+   CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+   TaskStatus taskStatus_pb;
+
+   for(unsigned int i = 0; i < taskStatuses->length; i++)
+   {
+     if(!deserialize<TaskStatus>(taskStatus_pb, &taskStatuses->obj[i]))
+     {
+       statuses[i] = DRIVER_ABORTED;
+       continue;
+     }
+     scheduler->tasks.acknowledged(taskStatus_pb);
+     statuses[i] = driver->acknowledgeStatusUpdate(taskStatus_pb);
+   }
+}
+
+int scheduler_ack(SchedulerPtrPair state, 
+                  ErlNifEnv* env, 
+                  ERL_NIF_TERM acks, 
+                  SchedulerDriverStatus* statuses)
+{
+    METRIC_TIMER(timer, "scheduler_ack");
+
+   assert(state.driver != NULL);
+   assert(statuses != NULL);
+
+   CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+   vector<TaskStatus> taskStatuses;
+
+   // every handle is checked before any is acknowledged, undefined (sent
+   // with an update that has no uuid) is left without one
+   ERL_NIF_TERM head, tail = acks;
+   while(enif_get_list_cell(env, tail, &head, &tail))
+   {
+     taskStatuses.push_back(TaskStatus());
+     if(is_atom(env, head, "undefined")) { continue; }
+     if(!ack_handle_get(env, head, scheduler->ackOwner, &taskStatuses.back())) { return 0; }
+   }
+
+   SchedulerDriver* driver = reinterpret_cast<SchedulerDriver*> (state.driver);
+   for(size_t i = 0; i < taskStatuses.size(); i++)
+   {
+     // as ack/2 answers for undefined
+     if(!taskStatuses[i].has_uuid())
+     {
+       statuses[i] = DRIVER_RUNNING;
+       continue;
+     }
+     scheduler->tasks.acknowledged(taskStatuses[i]);
+     statuses[i] = driver->acknowledgeStatusUpdate(taskStatuses[i]);
+   }
+   return 1;
+}
+
+void scheduler_setBatchOffers(SchedulerPtrPair state, int enabled)
+{
+    METRIC_TIMER(timer, "scheduler_setBatchOffers");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    scheduler->batchOffers = (enabled == 1);
+}
+
+int scheduler_cast(SchedulerPtrPair state, 
+                   ErlNifEnv* env, 
+                   ErlNifPid* caller, 
+                   ERL_NIF_TERM command, 
+                   unsigned long* id, 
+                   const char** invalid)
+{
+    METRIC_TIMER(timer, "scheduler_cast");
+
+    assert(state.scheduler != NULL);
+    assert(invalid != NULL);
+
+    DriverCommand* command_ = DriverCommand::fromTerm(env, command, invalid);
+    if(command_ == NULL) { return SCHEDULER_CAST_INVALID; }
+    command_->caller = *caller;
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    if(!command_->offerIds.empty())
+    {
+      // the offer is spoken for once queued
+      scheduler->offerIndex.remove(command_->offerIds[0]);
+    }
+    if(command_->kind == DriverCommand::ACKNOWLEDGE)
+    {
+      scheduler->tasks.acknowledged(command_->statuses[0]);
+    }
+    if(command_->kind == DriverCommand::LAUNCH_TASKS)
+    {
+      scheduler->executors.launched(command_->tasks);
+    }
+    if(command_->allExecutors)
+    {
+      scheduler->executors.list(command_->executorIds, command_->slaveIds);
+    }
+    switch(scheduler->commands->push(command_, id))
+    {
+    case CommandQueue::QUEUED:
+      return SCHEDULER_CAST_QUEUED;
+    case CommandQueue::FULL:
+      delete command_;
+      return SCHEDULER_CAST_FULL;
+    default:
+      delete command_;
+      return SCHEDULER_CAST_NO_WORKER;
+    }
+}
+
+void scheduler_setCoalesceStatusUpdates(SchedulerPtrPair state, int enabled)
+{
+    METRIC_TIMER(timer, "scheduler_setCoalesceStatusUpdates");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    scheduler->tasks.setCoalesce(enabled == 1);
+}
+
+int scheduler_takeStatusUpdates(SchedulerPtrPair state, ErlNifEnv* env, unsigned int max, ERL_NIF_TERM* statuses)
+{
+    METRIC_TIMER(timer, "scheduler_takeStatusUpdates");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    vector<TaskStatus> taken;
+    bool more = scheduler->tasks.take(max, taken);
+
+    vector<ERL_NIF_TERM> statuses_pb(taken.size());
+    for(size_t i = 0; i < taken.size(); i++)
+    {
+      statuses_pb[i] = scheduler->formats.encode(env, taken[i]);
+    }
+    *statuses = enif_make_list_from_array(env, statuses_pb.data(), statuses_pb.size());
+    return more ? 1 : 0;
+}
+
+int scheduler_taskState(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM taskId, ERL_NIF_TERM* info)
+{
+    METRIC_TIMER(timer, "scheduler_taskState");
+
+    assert(state.scheduler != NULL);
+
+    TaskID taskid_pb;
+    if(!pb_term_to_obj(env, taskId, &taskid_pb)) { return -1; }
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    TaskTable::Entry entry;
+    if(!scheduler->tasks.find(taskid_pb.value(), &entry)) { return 0; }
+
+    ERL_NIF_TERM healthy = entry.healthy < 0 ? enif_make_atom(env, "undefined") :
+                           enif_make_atom(env, entry.healthy ? "true" : "false");
+
+    *info = enif_make_tuple4(env,
+                             enif_make_atom(env, TaskState_Name(entry.state).c_str()),
+                             enif_make_double(env, entry.timestamp),
+                             enif_make_string_len(env, entry.slaveId.data(), entry.slaveId.size(), ERL_NIF_LATIN1),
+                             healthy);
+    return 1;
+}
+
+ERL_NIF_TERM scheduler_taskStats(SchedulerPtrPair state, ErlNifEnv* env)
+{
+    METRIC_TIMER(timer, "scheduler_taskStats");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    return scheduler->tasks.stats(env);
+}
+
+int scheduler_reconcile(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM taskStatuses)
+{
+    METRIC_TIMER(timer, "scheduler_reconcile");
+
+    assert(state.scheduler != NULL);
+
+    vector<TaskStatus> taskStatus_;
+    if(!pb_terms_to_objs<TaskStatus>(env, taskStatuses, taskStatus_)) { return -1; }
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    return scheduler->reconciler->reconcile(taskStatus_) ? 1 : 0;
+}
+
+int scheduler_setReconcileOptions(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM options)
+{
+    METRIC_TIMER(timer, "scheduler_setReconcileOptions");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    return scheduler->reconciler->setOptions(env, options) ? 1 : 0;
+}
+
+void scheduler_cancelReconcile(SchedulerPtrPair state)
+{
+    METRIC_TIMER(timer, "scheduler_cancelReconcile");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    scheduler->reconciler->cancel();
+}
+
+ERL_NIF_TERM scheduler_reconcileStats(SchedulerPtrPair state, ErlNifEnv* env)
+{
+    METRIC_TIMER(timer, "scheduler_reconcileStats");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    return scheduler->reconciler->stats(env);
+}
+
+int scheduler_setFlowControl(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM options)
+{
+    METRIC_TIMER(timer, "scheduler_setFlowControl");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    return scheduler->flow.configure(env, options) ? 1 : 0;
+}
+
+void scheduler_grant(SchedulerPtrPair state, ErlNifEnv* env, unsigned long credits)
+{
+    METRIC_TIMER(timer, "scheduler_grant");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    scheduler->flow.grant(env, credits);
+}
+
+ERL_NIF_TERM scheduler_flowControlStats(SchedulerPtrPair state, ErlNifEnv* env)
+{
+    METRIC_TIMER(timer, "scheduler_flowControlStats");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    return scheduler->flow.stats(env);
+}
+
+int scheduler_setMessageChannel(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM options)
+{
+    METRIC_TIMER(timer, "scheduler_setMessageChannel");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    return scheduler->channel->configure(env, options) ? 1 : 0;
+}
+
+ERL_NIF_TERM scheduler_messageChannelStats(SchedulerPtrPair state, ErlNifEnv* env)
+{
+    METRIC_TIMER(timer, "scheduler_messageChannelStats");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    return scheduler->channel->stats(env);
+}
+
+int scheduler_setDispatch(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM workers)
+{
+    METRIC_TIMER(timer, "scheduler_setDispatch");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    return scheduler->dispatch.set(env, workers) ? 1 : 0;
+}
+
+ERL_NIF_TERM scheduler_dispatchStats(SchedulerPtrPair state, ErlNifEnv* env)
+{
+    METRIC_TIMER(timer, "scheduler_dispatchStats");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    return scheduler->dispatch.stats(env);
+}
+
+int scheduler_fakeDriverStats(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM* stats)
+{
+    METRIC_TIMER(timer, "scheduler_fakeDriverStats");
+
+    assert(state.driver != NULL);
+
+    FakeSchedulerDriver* driver = dynamic_cast<FakeSchedulerDriver*>(reinterpret_cast<SchedulerDriver*>(state.driver));
+    if(driver == NULL)
+    {
+        return 0;
+    }
+    *stats = driver->stats(env);
+    return 1;
+}
+
+void scheduler_setOfferIndex(SchedulerPtrPair state, int enabled)
+{
+    METRIC_TIMER(timer, "scheduler_setOfferIndex");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    scheduler->offerIndex.setEnabled(enabled == 1);
+}
+
+int scheduler_findOffers(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM query, ERL_NIF_TERM* offers)
+{
+    METRIC_TIMER(timer, "scheduler_findOffers");
+
+    assert(state.scheduler != NULL);
+
+    OfferIndex::Query query_;
+    if(!query_.fromTerm(env, query)) { return 0; }
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    vector<Offer> found;
+    scheduler->offerIndex.find(query_, found);
+
+    vector<ERL_NIF_TERM> offers_pb(found.size());
+    for(size_t i = 0; i < found.size(); i++)
+    {
+      offers_pb[i] = scheduler->formats.encode(env, found[i]);
+    }
+    *offers = enif_make_list_from_array(env, offers_pb.data(), offers_pb.size());
+    return 1;
+}
+
+int scheduler_setOfferFilter(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM filter)
+{
+    METRIC_TIMER(timer, "scheduler_setOfferFilter");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    return scheduler->offerFilter.set(env, filter) ? 1 : 0;
+}
+
+ERL_NIF_TERM scheduler_offerFilterStats(SchedulerPtrPair state, ErlNifEnv* env)
+{
+    METRIC_TIMER(timer, "scheduler_offerFilterStats");
+
+    assert(state.scheduler != NULL);
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    return scheduler->offerFilter.stats(env);
+}
+
+int scheduler_setMessageFormat(SchedulerPtrPair state, const char* type, int format)
+{
+    METRIC_TIMER(timer, "scheduler_setMessageFormat");
+
+    assert(state.scheduler != NULL);
+    assert(type != NULL);
+
+    const google::protobuf::Descriptor* descriptor = pb_find_type(type);
+    if(descriptor == NULL || !pb_term_format_supported(format)) { return 0; }
+
+    CScheduler* scheduler = reinterpret_cast<CScheduler*>(state.scheduler);
+    scheduler->formats.set(descriptor, format);
+    return 1;
+}
+
 
 /** 
   Callbacks
@@ -393,118 +990,196 @@ void CScheduler::registered(SchedulerDriver* driver,
                           const FrameworkID& frameworkId,
                           const MasterInfo& masterInfo)
                           {
+    METRIC_TIMER(timer, "scheduler_callback_registered");
+
     //fprintf(stderr, "%s \n" , "Registered" );
-    assert(this->pid != NULL);
 
-    ErlNifEnv* env = enif_alloc_env();
+    CallbackEnv env;
 
-    ERL_NIF_TERM framework_pb = pb_obj_to_binary(env, frameworkId);
-    ERL_NIF_TERM masterInfo_pb = pb_obj_to_binary(env, masterInfo);
+    const google::protobuf::Message* objs[] = { &frameworkId, &masterInfo };
+    ERL_NIF_TERM objs_pb[2];
+    this->formats.encode(env, objs, objs_pb, 2);
 
     ERL_NIF_TERM message = enif_make_tuple3(env, 
-                              enif_make_atom(env, "registered"), 
-                              framework_pb,
-                              masterInfo_pb);
+                              callback_atoms.registered, 
+                              objs_pb[0],
+                              objs_pb[1]);
     
-    enif_send(NULL, this->pid, env, message);
-    enif_clear_env(env);
+    this->flow.send(env, &this->pid, message, FlowControl::RELIABLE);
 }
 
 void CScheduler::reregistered(SchedulerDriver* driver,
                             const MasterInfo& masterInfo)
                             {
+    METRIC_TIMER(timer, "scheduler_callback_reregistered");
+
     //fprintf(stderr, "%s \n" , "Reregistered" );
-    assert(this->pid != NULL);
 
-    ErlNifEnv* env = enif_alloc_env();
+    CallbackEnv env;
 
-    ERL_NIF_TERM masterInfo_pb = pb_obj_to_binary(env, masterInfo);
+    ERL_NIF_TERM masterInfo_pb = this->formats.encode(env, masterInfo);
 
     ERL_NIF_TERM message = enif_make_tuple2(env, 
-                              enif_make_atom(env, "reregistered"), 
+                              callback_atoms.reregistered, 
                               masterInfo_pb);
     
-   enif_send(NULL, this->pid, env, message);
-   enif_clear_env(env);
+   this->flow.send(env, &this->pid, message, FlowControl::RELIABLE);
 };
 
 void CScheduler::disconnected(SchedulerDriver* driver)
 {
+    METRIC_TIMER(timer, "scheduler_callback_disconnected");
+
     //fprintf(stderr, "%s \n" , "Disconnected" );
-    assert(this->pid != NULL);
 
-    ErlNifEnv* env = enif_alloc_env();
+    CallbackEnv env;
 
-    ERL_NIF_TERM message = enif_make_tuple(env, 
-                              enif_make_atom(env, "disconnected"));
+    ERL_NIF_TERM message = enif_make_tuple1(env, 
+                              callback_atoms.disconnected);
     
-    enif_send(NULL, this->pid, env, message);
-    enif_clear_env(env);
+    this->flow.send(env, &this->pid, message, FlowControl::RELIABLE);
 };
 
 void CScheduler::offerRescinded(SchedulerDriver* driver,
                               const OfferID& offerId)
 {
+    METRIC_TIMER(timer, "scheduler_callback_offerRescinded");
+
     //fprintf(stderr, "%s \n" , "offerRescinded" );
-    assert(this->pid != NULL);
 
-    ErlNifEnv* env = enif_alloc_env();
+    this->commands->rescinded(offerId);
+    this->offerIndex.remove(offerId);
+
+    CallbackEnv env;
 
     ERL_NIF_TERM message = enif_make_tuple2(env, 
-                              enif_make_atom(env, "offerRescinded"),
-                              pb_obj_to_binary(env, offerId));
+                              callback_atoms.offerRescinded,
+                              this->formats.encode(env, offerId));
     
-    enif_send(NULL, this->pid, env, message);
-    enif_clear_env(env);
+    ErlNifPid worker;
+    this->flow.send(env, this->dispatch.routeRescinded(offerId, &this->pid, &worker), message, FlowControl::RELIABLE);
 } ;
 
 void CScheduler::statusUpdate(SchedulerDriver* driver,
                             const TaskStatus& status){
+    METRIC_TIMER(timer, "scheduler_callback_statusUpdate");
+
     //fprintf(stderr, "%s \n" , "statusUpdate" );
-    assert(this->pid != NULL);
 
-    ErlNifEnv* env = enif_alloc_env();
+    // any update for an outstanding task, duplicates included, answers its reconciliation
+    this->reconciler->confirmed(status);
 
-    ERL_NIF_TERM message = enif_make_tuple2(env, 
-                              enif_make_atom(env, "statusUpdate"),
-                              pb_obj_to_binary(env, status));
+    if(status.has_executor_id() && status.has_slave_id())
+    {
+      this->executors.add(status.executor_id(), status.slave_id());
+    }
+
+    TaskTable::Update update;
+    this->tasks.update(status, &update);
+
+    if(!this->implicitAcknowledgements)
+    {
+      // erlang will not see these to acknowledge them itself
+      if(update.outcome == TaskTable::DUPLICATE && update.acknowledged)
+      {
+        driver->acknowledgeStatusUpdate(status);
+      }
+      if(update.superseded && update.supersededStatus.has_uuid())
+      {
+        driver->acknowledgeStatusUpdate(update.supersededStatus);
+      }
+    }
+
+    if(update.outcome == TaskTable::DUPLICATE) { return; }
+
+    CallbackEnv env;
+
+    if(update.outcome == TaskTable::HELD)
+    {
+      if(update.notify)
+      {
+        this->flow.send(env, &this->pid, enif_make_tuple1(env, callback_atoms.statusUpdatesPending), FlowControl::RELIABLE);
+      }
+      return;
+    }
+
+    ERL_NIF_TERM message;
+
+    if(this->implicitAcknowledgements)
+    {
+      message = enif_make_tuple2(env, 
+                              callback_atoms.statusUpdate,
+                              this->formats.encode(env, status));
+    }else
+    {
+      // updates without a uuid, such as reconciliation replies, need no acknowledgement
+      ERL_NIF_TERM ack = status.has_uuid() ? ack_handle_make(env, this->ackOwner, status) : 
+                                             enif_make_atom(env, "undefined");
+      message = enif_make_tuple3(env, 
+                              callback_atoms.statusUpdate,
+                              this->formats.encode(env, status),
+                              ack);
+    }
     
-    enif_send(NULL, this->pid, env, message);    
-    enif_clear_env(env);
+    ErlNifPid worker;
+    this->flow.send(env, this->dispatch.route(status.task_id().value(), &this->pid, &worker), message, FlowControl::RELIABLE);
 } ;
 
 void CScheduler::frameworkMessage(SchedulerDriver* driver,
                                 const ExecutorID& executorId,
                                 const SlaveID& slaveId,
                                 const std::string& data) {
+    METRIC_TIMER(timer, "scheduler_callback_frameworkMessage");
+
     //fprintf(stderr, "%s \n" , "frameworkMessage" );
-    assert(this->pid != NULL);
 
-    ErlNifEnv* env = enif_alloc_env();
+    this->executors.add(executorId, slaveId);
 
-    ERL_NIF_TERM message = enif_make_tuple4(env, 
-                              enif_make_atom(env, "frameworkMessage"),
-                              pb_obj_to_binary(env, executorId),
-                              pb_obj_to_binary(env, slaveId),
-                              enif_make_string(env, data.c_str(), ERL_NIF_LATIN1));
-    
-    enif_send(NULL, this->pid, env, message);
+    // a frame is delivered as the messages packed into it
+    vector<string> unpacked;
+    bool framed = this->channel->unpack(data, unpacked);
+    size_t count = framed ? unpacked.size() : 1;
+
+    ErlNifPid worker;
+    const ErlNifPid* to = this->dispatch.route(executorId.value(), &this->pid, &worker);
+
+    CallbackEnv env;
+
+    for(size_t i = 0; i < count; i++)
+    {
+      const google::protobuf::Message* objs[] = { &executorId, &slaveId };
+      ERL_NIF_TERM objs_pb[2];
+      this->formats.encode(env, objs, objs_pb, 2);
+
+      ERL_NIF_TERM message = enif_make_tuple4(env, 
+                                callback_atoms.frameworkMessage,
+                                objs_pb[0],
+                                objs_pb[1],
+                                env.data(framed ? unpacked[i] : data));
+      
+      this->flow.send(env, to, message, FlowControl::BEST_EFFORT);
+    }
 };
 
 void CScheduler::slaveLost(SchedulerDriver* driver,
                          const SlaveID& slaveId)
 {
+    METRIC_TIMER(timer, "scheduler_callback_slaveLost");
+
    //fprintf(stderr, "%s \n" , "slaveLost" );
-    assert(this->pid != NULL);
 
-    ErlNifEnv* env = enif_alloc_env();
+    this->offerIndex.removeSlave(slaveId);
+    this->executors.removeSlave(slaveId);
+    this->channel->removeSlave(slaveId);
+
+    CallbackEnv env;
 
     ERL_NIF_TERM message = enif_make_tuple2(env, 
-                              enif_make_atom(env, "slaveLost"),
-                              pb_obj_to_binary(env, slaveId));
+                              callback_atoms.slaveLost,
+                              this->formats.encode(env, slaveId));
     
-    enif_send(NULL, this->pid, env, message);
-    enif_clear_env(env);
+    ErlNifPid worker;
+    this->flow.send(env, this->dispatch.route(slaveId.value(), &this->pid, &worker), message, FlowControl::RELIABLE);
 } ;
 
 void CScheduler::executorLost(SchedulerDriver* driver,
@@ -512,53 +1187,119 @@ void CScheduler::executorLost(SchedulerDriver* driver,
                             const SlaveID& slaveId,
                             int status)
 {
+    METRIC_TIMER(timer, "scheduler_callback_executorLost");
+
     //fprintf(stderr, "%s \n" , "executorLost" );
-    assert(this->pid != NULL);
 
-    ErlNifEnv* env = enif_alloc_env();
+    this->executors.remove(executorId, slaveId);
+    this->channel->remove(executorId, slaveId);
+
+    CallbackEnv env;
+
+    const google::protobuf::Message* objs[] = { &executorId, &slaveId };
+    ERL_NIF_TERM objs_pb[2];
+    this->formats.encode(env, objs, objs_pb, 2);
 
     ERL_NIF_TERM message = enif_make_tuple4(env, 
-                              enif_make_atom(env, "executorLost"),
-                              pb_obj_to_binary(env, executorId),
-                              pb_obj_to_binary(env, slaveId),
+                              callback_atoms.executorLost,
+                              objs_pb[0],
+                              objs_pb[1],
                               enif_make_int(env,status));
     
-    enif_send(NULL, this->pid, env, message);
-    enif_clear_env(env);
+    ErlNifPid worker;
+    this->flow.send(env, this->dispatch.route(executorId.value(), &this->pid, &worker), message, FlowControl::RELIABLE);
 };
 
  void CScheduler::error(SchedulerDriver* driver, const std::string& errormessage)
  {
+    METRIC_TIMER(timer, "scheduler_callback_error");
+
       //fprintf(stderr, "%s \n" , "error" );
-    assert(this->pid != NULL);
 
-    ErlNifEnv* env = enif_alloc_env();
+    CallbackEnv env;
 
     ERL_NIF_TERM message = enif_make_tuple2(env, 
-                              enif_make_atom(env, "error"),
-                              enif_make_string(env, errormessage.c_str(), ERL_NIF_LATIN1));
+                              callback_atoms.error,
+                              env.string(errormessage));
     
-    enif_send(NULL, this->pid, env, message);
-    enif_clear_env(env);
+    this->flow.send(env, &this->pid, message, FlowControl::RELIABLE);
  };
 
+void CScheduler::refuseOffer(SchedulerDriver* driver, const Offer& offer)
+{
+    this->commands->rescinded(offer.id());
+    this->offerIndex.remove(offer.id());
+
+    Filters filters;
+    double seconds = this->flow.refuseSeconds();
+    if(seconds >= 0) { filters.set_refuse_seconds(seconds); }
+    driver->declineOffer(offer.id(), filters);
+}
+
 void CScheduler::resourceOffers(SchedulerDriver* driver,
                               const std::vector<Offer>& offers)
                               {
-      assert(this->pid != NULL);
+    METRIC_TIMER(timer, "scheduler_callback_resourceOffers");
+
 
-      ErlNifEnv* env = enif_alloc_env();
+      vector<const Offer*> wanted;
+      wanted.reserve(offers.size());
 
       for(unsigned int i = 0 ; i < offers.size(); i++)
       {
-        Offer offer = offers.at(i);
+        Filters filters;
+        if(this->offerFilter.accept(offers[i], &filters))
+        {
+          wanted.push_back(&offers[i]);
+        }else
+        {
+          driver->declineOffer(offers[i].id(), filters);
+        }
+      }
 
-        ERL_NIF_TERM message = enif_make_tuple2(env, 
-                              enif_make_atom(env, "resourceOffers"),
-                              pb_obj_to_binary(env, offer));
+      if(wanted.empty()) { return; }
+
+      this->commands->offered(wanted);
+      this->offerIndex.add(wanted);
 
-        enif_send(NULL, this->pid, env, message);
+      CallbackEnv env;
+
+      // a batch goes to the owner whole, single offers to the worker for their slave
+      if(this->batchOffers)
+      {
+        // all offers of the cycle share one binary
+        vector<const google::protobuf::Message*> objs(wanted.begin(), wanted.end());
+        vector<ERL_NIF_TERM> offers_pb(wanted.size());
+
+        this->formats.encode(env, objs.data(), offers_pb.data(), wanted.size());
+
+        ERL_NIF_TERM message = enif_make_tuple2(env, 
+                              callback_atoms.resourceOffers,
+                              enif_make_list_from_array(env, offers_pb.data(), offers_pb.size()));
+
+        if(this->flow.sendOffers(env, &this->pid, message, offers_pb.data(), offers_pb.size(), true) == FlowControl::REFUSED)
+        {
+          for(unsigned int i = 0 ; i < wanted.size(); i++)
+          {
+            this->refuseOffer(driver, *wanted[i]);
+          }
+        }
+        return;
       }
 
-      enif_clear_env(env);
+      for(unsigned int i = 0 ; i < wanted.size(); i++)
+      {
+        ERL_NIF_TERM offer_pb = this->formats.encode(env, *wanted[i]);
+        ERL_NIF_TERM message = enif_make_tuple2(env, 
+                              callback_atoms.resourceOffers,
+                              offer_pb);
+
+        ErlNifPid worker;
+        const ErlNifPid* to = this->dispatch.routeOffer(*wanted[i], &this->pid, &worker);
+
+        if(this->flow.sendOffers(env, to, message, &offer_pb, 1, false) == FlowControl::REFUSED)
+        {
+          this->refuseOffer(driver, *wanted[i]);
+        }
+      }
 } ;
@@ -23,25 +23,79 @@
 
 #include "erl_nif.h"
 
+// results of scheduler_cast
+#define SCHEDULER_CAST_QUEUED 1
+#define SCHEDULER_CAST_INVALID 0
+#define SCHEDULER_CAST_FULL -1
+#define SCHEDULER_CAST_NO_WORKER -2
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+  // a master starting with fake:// selects FakeSchedulerDriver, the driver is NULL if the rest of it is not valid
   SchedulerPtrPair scheduler_init(ErlNifPid* pid, ErlNifBinary* info, const char* master, int implicitAcknoledgements, int credentialssupplied, ErlNifBinary* credentials);
   SchedulerDriverStatus scheduler_start(SchedulerPtrPair state);
   SchedulerDriverStatus scheduler_join(SchedulerPtrPair state);
   SchedulerDriverStatus scheduler_abort(SchedulerPtrPair state);
   SchedulerDriverStatus scheduler_stop(SchedulerPtrPair state, int failover);
-  SchedulerDriverStatus scheduler_acceptOffers(SchedulerPtrPair state, BinaryNifArray* offerIds, BinaryNifArray* operations, ErlNifBinary* filters);
   SchedulerDriverStatus scheduler_declineOffer(SchedulerPtrPair state, ErlNifBinary* offerId, ErlNifBinary* filters);
   SchedulerDriverStatus scheduler_killTask(SchedulerPtrPair state, ErlNifBinary* taskId);
   SchedulerDriverStatus scheduler_reviveOffers(SchedulerPtrPair state);
-  SchedulerDriverStatus scheduler_sendFrameworkMessage(SchedulerPtrPair state, ErlNifBinary* executorId, ErlNifBinary* slaveId, const char* data);
-  SchedulerDriverStatus scheduler_requestResources(SchedulerPtrPair state, BinaryNifArray* requests);
-  SchedulerDriverStatus scheduler_reconcileTasks(SchedulerPtrPair state, BinaryNifArray* taskStatus);
-  SchedulerDriverStatus scheduler_launchTasks(SchedulerPtrPair state, ErlNifBinary* offerId, BinaryNifArray* tasks, ErlNifBinary* filters);
+  SchedulerDriverStatus scheduler_sendFrameworkMessage(SchedulerPtrPair state, ErlNifBinary* executorId, ErlNifBinary* slaveId, ErlNifBinary* data);
+  // makes the launchTasks, acceptOffers, requestResources or reconcileTasks call of a batch whose list
+  // has been converted, see batch_call.hpp. arg is the offer id or list of offer ids of a launch or
+  // accept, and filters their filters. These are records, maps or encoded binaries, invalid is set to
+  // the name of any that is not
+  SchedulerDriverStatus scheduler_batchCall(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM call, ERL_NIF_TERM arg, ERL_NIF_TERM filters, const char** invalid);
   void scheduler_destroy (SchedulerPtrPair state);
   SchedulerDriverStatus scheduler_acknowledgeStatusUpdate(SchedulerPtrPair state, ErlNifBinary* taskStatus);
+  // one driver call per item, statuses must have room for a status per item
+  void scheduler_declineOffers(SchedulerPtrPair state, BinaryNifArray* offerIds, ErlNifBinary* filters, SchedulerDriverStatus* statuses);
+  void scheduler_killTasks(SchedulerPtrPair state, BinaryNifArray* taskIds, SchedulerDriverStatus* statuses);
+  void scheduler_acknowledgeStatusUpdates(SchedulerPtrPair state, BinaryNifArray* taskStatuses, SchedulerDriverStatus* statuses);
+  // acknowledges each ack handle in the list acks, returns 0 without acknowledging any if one is not
+  // a handle from this scheduler
+  int scheduler_ack(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM acks, SchedulerDriverStatus* statuses);
+  void scheduler_setBatchOffers(SchedulerPtrPair state, int enabled);
+  int scheduler_setMessageFormat(SchedulerPtrPair state, const char* type, int format);
+  // filter is an #offer_filter{} record or undefined, returns 0 if it is neither
+  int scheduler_setOfferFilter(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM filter);
+  ERL_NIF_TERM scheduler_offerFilterStats(SchedulerPtrPair state, ErlNifEnv* env);
+  void scheduler_setCoalesceStatusUpdates(SchedulerPtrPair state, int enabled);
+  // sets statuses to a list of up to max held updates, returns 1 if more remain
+  int scheduler_takeStatusUpdates(SchedulerPtrPair state, ErlNifEnv* env, unsigned int max, ERL_NIF_TERM* statuses);
+  // sets info to {State, Timestamp, SlaveId, Healthy}, returns 0 if the task is unknown or -1 if taskId is invalid
+  int scheduler_taskState(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM taskId, ERL_NIF_TERM* info);
+  ERL_NIF_TERM scheduler_taskStats(SchedulerPtrPair state, ErlNifEnv* env);
+  // queues taskStatuses for paced reconciliation, an empty list for implicit reconciliation.
+  // Returns -1 if the list is invalid or 0 if the reconciler could not be started
+  int scheduler_reconcile(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM taskStatuses);
+  // returns 0 if the options proplist is invalid
+  int scheduler_setReconcileOptions(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM options);
+  void scheduler_cancelReconcile(SchedulerPtrPair state);
+  ERL_NIF_TERM scheduler_reconcileStats(SchedulerPtrPair state, ErlNifEnv* env);
+  // enables credit based delivery of callback messages, returns 0 if the options proplist is invalid
+  int scheduler_setFlowControl(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM options);
+  // gives the owner credits more messages, sending queued ones from env
+  void scheduler_grant(SchedulerPtrPair state, ErlNifEnv* env, unsigned long credits);
+  ERL_NIF_TERM scheduler_flowControlStats(SchedulerPtrPair state, ErlNifEnv* env);
+  // sets stats to the counters of a FakeSchedulerDriver, returns 0 if the scheduler has a real driver
+  int scheduler_fakeDriverStats(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM* stats);
+  // packs framework messages into frames per executor, see message_channel.hpp. Returns 0 if the
+  // options proplist is invalid
+  int scheduler_setMessageChannel(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM options);
+  ERL_NIF_TERM scheduler_messageChannelStats(SchedulerPtrPair state, ErlNifEnv* env);
+  // sends keyed callbacks to one of a list of worker pids, see dispatcher.hpp. Returns 0 if
+  // it is not a list of local pids
+  int scheduler_setDispatch(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM workers);
+  ERL_NIF_TERM scheduler_dispatchStats(SchedulerPtrPair state, ErlNifEnv* env);
+  void scheduler_setOfferIndex(SchedulerPtrPair state, int enabled);
+  // sets offers to the list of indexed offers matching the query proplist, returns 0 if it is invalid
+  int scheduler_findOffers(SchedulerPtrPair state, ErlNifEnv* env, ERL_NIF_TERM query, ERL_NIF_TERM* offers);
+  // queues a command tuple for the driver worker, setting id to the id any failure is
+  // reported to caller with, or invalid to the name of the bad argument
+  int scheduler_cast(SchedulerPtrPair state, ErlNifEnv* env, ErlNifPid* caller, ERL_NIF_TERM command, unsigned long* id, const char** invalid);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,181 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include <assert.h>
+
+#include "status_coalescer.hpp"
+#include "erlang_mesos.hpp"
+#include "utils.hpp"
+
+using namespace mesos;
+using namespace std;
+
+StatusCoalescer::StatusCoalescer(ExecutorDriver* driver)
+  : driver(driver),
+    isEnabled(false),
+    lastStatus(DRIVER_RUNNING),
+    stopping(false),
+    window(Clock::duration::zero()),
+    sent(0),
+    heldUpdates(0),
+    superseded(0),
+    terminal(0)
+{
+  assert(driver != NULL);
+}
+
+StatusCoalescer::~StatusCoalescer()
+{
+  stop();
+}
+
+void StatusCoalescer::stop()
+{
+  worker.stop(lock, wakeup, stopping);
+}
+
+void StatusCoalescer::flush()
+{
+  lock_guard<mutex> guard(lock);
+  sendHeld();
+}
+
+void StatusCoalescer::sendHeld()
+{
+  for(unordered_map<string, Held>::iterator it = held.begin(); it != held.end(); ++it)
+  {
+    sendNow(it->second.status);
+  }
+  held.clear();
+  due.clear();
+}
+
+void StatusCoalescer::setWindow(unsigned long millis)
+{
+  lock_guard<mutex> guard(lock);
+  window = chrono::milliseconds(millis);
+  isEnabled = millis > 0;
+  // updates already held keep the window they were held with
+  wakeup.notify_one();
+}
+
+Status StatusCoalescer::sendNow(const TaskStatus& status)
+{
+  Status result = driver->sendStatusUpdate(status);
+  lastStatus = result;
+  sent++;
+  return result;
+}
+
+Status StatusCoalescer::send(const TaskStatus& status)
+{
+  if(!isEnabled)
+  {
+    // the task's held update, if the window was closed since, goes first
+    lock_guard<mutex> guard(lock);
+    unordered_map<string, Held>::iterator it = held.find(status.task_id().value());
+    if(it != held.end())
+    {
+      if(is_terminal(status.state())) { superseded++; }
+      else { sendNow(it->second.status); }
+      held.erase(it);
+    }
+    return sendNow(status);
+  }
+
+  bool terminal_ = is_terminal(status.state());
+  if(!terminal_)
+  {
+    if(!worker.start([this]() { run(); })) { return DRIVER_ABORTED; }
+  }
+
+  lock_guard<mutex> guard(lock);
+
+  unordered_map<string, Held>::iterator it = held.find(status.task_id().value());
+  if(it != held.end()) { superseded++; }
+
+  if(terminal_)
+  {
+    terminal++;
+    if(it != held.end()) { held.erase(it); }
+    return sendNow(status);
+  }
+
+  heldUpdates++;
+  if(it != held.end())
+  {
+    it->second.status.CopyFrom(status);
+    return (Status) lastStatus.load();
+  }
+
+  Held& added = held[status.task_id().value()];
+  added.status.CopyFrom(status);
+  added.deadline = Clock::now() + window;
+  due.push_back(make_pair(status.task_id().value(), added.deadline));
+  if(due.size() == 1) { wakeup.notify_one(); }
+  return (Status) lastStatus.load();
+}
+
+void StatusCoalescer::run()
+{
+  unique_lock<mutex> guard(lock);
+
+  while(!stopping)
+  {
+    Clock::time_point now = Clock::now();
+
+    while(!due.empty() && due.front().second <= now)
+    {
+      unordered_map<string, Held>::iterator it = held.find(due.front().first);
+      if(it != held.end() && it->second.deadline == due.front().second)
+      {
+        sendNow(it->second.status);
+        held.erase(it);
+      }
+      due.pop_front();
+    }
+
+    if(due.empty())
+    {
+      wakeup.wait(guard);
+    }else
+    {
+      wakeup.wait_until(guard, due.front().second);
+    }
+  }
+
+  sendHeld();
+}
+
+ERL_NIF_TERM StatusCoalescer::stats(ErlNifEnv* env) const
+{
+  lock_guard<mutex> guard(lock);
+
+  ERL_NIF_TERM stats[] = {
+    enif_make_tuple2(env, enif_make_atom(env, "enabled"), enif_make_atom(env, isEnabled ? "true" : "false")),
+    make_stat(env, "window_millis", chrono::duration_cast<chrono::milliseconds>(window).count()),
+    make_stat(env, "sent", sent),
+    make_stat(env, "held", heldUpdates),
+    make_stat(env, "superseded", superseded),
+    make_stat(env, "terminal", terminal),
+    make_stat(env, "pending", held.size())
+  };
+  return enif_make_list_from_array(env, stats, sizeof(stats) / sizeof(stats[0]));
+}
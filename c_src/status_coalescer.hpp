@@ -0,0 +1,115 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_STATUS_COALESCER_HPP
+#define MESOS_STATUS_COALESCER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "erl_nif.h"
+
+#include <mesos/executor.hpp>
+#include "mesos/mesos.pb.h"
+
+#include "worker_thread.hpp"
+
+/**
+ * Status updates sent by an executor, with the non-terminal ones held
+ * back for a short window.
+ *
+ * Once a window is set, a non-terminal update is held for up to that
+ * long, and a later update for the same task replaces it. A terminal
+ * update is sent at once, replacing any update held for its task, so a
+ * task that runs and finishes within the window costs the slave one
+ * update. Held updates are sent by a worker thread when their window
+ * ends, and all of them by stop.
+ *
+ * The worker is started by the first update held.
+ */
+class StatusCoalescer
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  explicit StatusCoalescer(mesos::ExecutorDriver* driver);
+  ~StatusCoalescer();
+
+  // holds non-terminal updates for millis, 0 sends every update at once again
+  void setWindow(unsigned long millis);
+
+  // returns the status of the driver call, or of the last one made if
+  // the update is held, or DRIVER_ABORTED if the worker could not be started
+  mesos::Status send(const mesos::TaskStatus& status);
+
+  // sends the held updates, before the driver is stopped
+  void flush();
+
+  // sends the held updates and joins the worker, see WorkerThread
+  void stop();
+
+  ERL_NIF_TERM stats(ErlNifEnv* env) const;
+
+private:
+  struct Held
+  {
+    mesos::TaskStatus status;
+    // the window of the first update still held for the task ends
+    Clock::time_point deadline;
+  };
+
+  StatusCoalescer(const StatusCoalescer&);
+  StatusCoalescer& operator=(const StatusCoalescer&);
+
+  void run();
+  // called with the lock held, so the updates of a task are sent in order
+  mesos::Status sendNow(const mesos::TaskStatus& status);
+  void sendHeld();
+
+  mesos::ExecutorDriver* driver;
+
+  std::atomic<bool> isEnabled;
+  std::atomic<int> lastStatus;
+
+  WorkerThread worker;
+
+  mutable std::mutex lock;
+  std::condition_variable wakeup;
+  bool stopping;
+
+  Clock::duration window;
+
+  // keyed by task id, with the ids in the order their windows end. An id
+  // sent, or held again with a later deadline, since it was queued is skipped
+  std::unordered_map<std::string, Held> held;
+  std::deque<std::pair<std::string, Clock::time_point> > due;
+
+  unsigned long sent;
+  unsigned long heldUpdates;
+  unsigned long superseded;
+  unsigned long terminal;
+};
+
+#endif // MESOS_STATUS_COALESCER_HPP
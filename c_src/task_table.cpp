@@ -0,0 +1,204 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include "task_table.hpp"
+#include "erlang_mesos.hpp"
+#include "utils.hpp"
+
+using namespace mesos;
+using namespace std;
+
+// terminal tasks remembered for recognising duplicates
+#define TASK_TABLE_MAX_TERMINAL 65536
+// all tasks, so those never reported terminal are not kept forever
+#define TASK_TABLE_MAX_TASKS 1048576
+
+TaskTable::TaskTable()
+  : coalesce(false),
+    notified(false),
+    nextAdded(0),
+    delivered(0),
+    duplicates(0),
+    superseded(0)
+{
+}
+
+void TaskTable::setCoalesce(bool enabled)
+{
+  lock_guard<mutex> guard(lock);
+  coalesce = enabled;
+}
+
+void TaskTable::update(const TaskStatus& status, Update* result)
+{
+  lock_guard<mutex> guard(lock);
+
+  result->notify = false;
+  result->acknowledged = false;
+  result->superseded = false;
+
+  const string& taskId = status.task_id().value();
+  unordered_map<string, Entry>::iterator it = tasks.find(taskId);
+
+  if(it != tasks.end() && status.has_uuid() && it->second.uuid == status.uuid())
+  {
+    duplicates++;
+    result->outcome = DUPLICATE;
+    result->acknowledged = it->second.acknowledged;
+    return;
+  }
+
+  bool wasTerminal = it != tasks.end() && is_terminal(it->second.state);
+  if(it == tasks.end())
+  {
+    it = tasks.insert(make_pair(taskId, Entry())).first;
+    it->second.added = nextAdded++;
+    order.push_back(make_pair(it->second.added, taskId));
+  }
+  Entry& entry = it->second;
+
+  entry.state = status.state();
+  entry.timestamp = status.timestamp();
+  entry.slaveId = status.has_slave_id() ? status.slave_id().value() : string();
+  entry.healthy = status.has_healthy() ? (status.healthy() ? 1 : 0) : -1;
+  // an update without a uuid, such as a reconciliation reply, leaves the
+  // last one so its retransmission is still recognised
+  if(status.has_uuid())
+  {
+    entry.uuid = status.uuid();
+    entry.acknowledged = false;
+  }
+
+  if(!wasTerminal && is_terminal(entry.state))
+  {
+    retire(taskId);
+  }
+  trim();
+
+  if(!coalesce)
+  {
+    delivered++;
+    result->outcome = DELIVER;
+    return;
+  }
+
+  unordered_map<string, TaskStatus>::iterator pending = held.find(taskId);
+  if(pending != held.end())
+  {
+    superseded++;
+    result->superseded = true;
+    result->supersededStatus.Swap(&pending->second);
+    pending->second.CopyFrom(status);
+  }else
+  {
+    held[taskId].CopyFrom(status);
+  }
+
+  result->outcome = HELD;
+  if(!notified)
+  {
+    notified = true;
+    result->notify = true;
+  }
+}
+
+void TaskTable::retire(const string& taskId)
+{
+  terminal.push_back(taskId);
+
+  while(terminal.size() > TASK_TABLE_MAX_TERMINAL)
+  {
+    // the id may since have been reused by a running task
+    unordered_map<string, Entry>::iterator it = tasks.find(terminal.front());
+    if(it != tasks.end() && is_terminal(it->second.state) && held.count(it->first) == 0)
+    {
+      tasks.erase(it);
+    }
+    terminal.pop_front();
+  }
+}
+
+void TaskTable::trim()
+{
+  while(order.size() > TASK_TABLE_MAX_TASKS)
+  {
+    // skips tasks already retired, or since seen again under the same id
+    unordered_map<string, Entry>::iterator it = tasks.find(order.front().second);
+    if(it != tasks.end() && it->second.added == order.front().first && held.count(it->first) == 0)
+    {
+      tasks.erase(it);
+    }
+    order.pop_front();
+  }
+}
+
+void TaskTable::acknowledged(const TaskStatus& status)
+{
+  lock_guard<mutex> guard(lock);
+
+  unordered_map<string, Entry>::iterator it = tasks.find(status.task_id().value());
+  if(it != tasks.end() && it->second.uuid == status.uuid())
+  {
+    it->second.acknowledged = true;
+  }
+}
+
+bool TaskTable::take(size_t max, vector<TaskStatus>& taken)
+{
+  lock_guard<mutex> guard(lock);
+
+  unordered_map<string, TaskStatus>::iterator it = held.begin();
+  while(it != held.end() && taken.size() < max)
+  {
+    taken.push_back(TaskStatus());
+    taken.back().Swap(&it->second);
+    it = held.erase(it);
+  }
+  delivered += taken.size();
+
+  // the next update held tells erlang again
+  if(held.empty()) { notified = false; }
+  return !held.empty();
+}
+
+bool TaskTable::find(const string& taskId, Entry* entry) const
+{
+  lock_guard<mutex> guard(lock);
+
+  unordered_map<string, Entry>::const_iterator it = tasks.find(taskId);
+  if(it == tasks.end()) { return false; }
+
+  *entry = it->second;
+  return true;
+}
+
+ERL_NIF_TERM TaskTable::stats(ErlNifEnv* env) const
+{
+  lock_guard<mutex> guard(lock);
+
+  ERL_NIF_TERM stats[] = {
+    enif_make_tuple2(env, enif_make_atom(env, "tasks"), enif_make_ulong(env, tasks.size())),
+    enif_make_tuple2(env, enif_make_atom(env, "held"), enif_make_ulong(env, held.size())),
+    enif_make_tuple2(env, enif_make_atom(env, "delivered"), enif_make_ulong(env, delivered)),
+    enif_make_tuple2(env, enif_make_atom(env, "duplicates"), enif_make_ulong(env, duplicates)),
+    enif_make_tuple2(env, enif_make_atom(env, "superseded"), enif_make_ulong(env, superseded))
+  };
+  return enif_make_list_from_array(env, stats, sizeof(stats) / sizeof(stats[0]));
+}
@@ -0,0 +1,117 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef MESOS_TASK_TABLE_HPP
+#define MESOS_TASK_TABLE_HPP
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "erl_nif.h"
+
+#include "mesos/mesos.pb.h"
+
+/**
+ * The latest known state of every task, fed by the statusUpdate callback.
+ *
+ * An update carrying the uuid of the last update seen for its task is a
+ * duplicate re-sent by the master and is not delivered again. When
+ * coalescing is on, updates are held per task instead of being delivered,
+ * a later update replacing an earlier one, and erlang takes them in
+ * batches after being told some are pending.
+ *
+ * Terminal tasks are kept so their duplicates are still recognised, up to
+ * a limit after which the oldest are dropped. Tasks that never report a
+ * terminal state are bounded too: past a larger limit on all tasks the
+ * one first seen longest ago is dropped.
+ */
+class TaskTable
+{
+public:
+  enum Outcome { DELIVER, DUPLICATE, HELD };
+
+  struct Update
+  {
+    Outcome outcome;
+    // the first update held since erlang last emptied the table
+    bool notify;
+    // a duplicate of an update erlang already acknowledged, which the
+    // master re-sent because the acknowledgement was lost
+    bool acknowledged;
+    // a held update replaced by this one, erlang will never see it
+    bool superseded;
+    mesos::TaskStatus supersededStatus;
+  };
+
+  struct Entry
+  {
+    mesos::TaskState state;
+    double timestamp;
+    std::string slaveId;
+    // -1 when the update had no health check result
+    int healthy;
+    // of the last update that had one, reconciliation replies have none
+    std::string uuid;
+    bool acknowledged;
+    // when the task was first seen, to find the oldest
+    unsigned long added;
+  };
+
+  TaskTable();
+
+  void setCoalesce(bool enabled);
+
+  void update(const mesos::TaskStatus& status, Update* result);
+  void acknowledged(const mesos::TaskStatus& status);
+
+  // moves up to max held updates into taken, returns true if more remain
+  bool take(size_t max, std::vector<mesos::TaskStatus>& taken);
+
+  bool find(const std::string& taskId, Entry* entry) const;
+
+  ERL_NIF_TERM stats(ErlNifEnv* env) const;
+
+private:
+  TaskTable(const TaskTable&);
+  TaskTable& operator=(const TaskTable&);
+
+  void retire(const std::string& taskId);
+  void trim();
+
+  mutable std::mutex lock;
+  bool coalesce;
+  bool notified;
+  std::unordered_map<std::string, Entry> tasks;
+  std::unordered_map<std::string, mesos::TaskStatus> held;
+  std::deque<std::string> terminal;
+  // every task in the order first seen, with its added, which may since
+  // have been dropped or seen again
+  std::deque<std::pair<unsigned long, std::string> > order;
+  unsigned long nextAdded;
+
+  unsigned long delivered;
+  unsigned long duplicates;
+  unsigned long superseded;
+};
+
+#endif // MESOS_TASK_TABLE_HPP
@@ -21,15 +21,47 @@
 #ifndef __MESOS_C_UTILS_HPP__
 #define __MESOS_C_UTILS_HPP__
 
+#include <string.h>
+#include <string>
+#include <vector>
+
 #include "mesos/mesos.pb.h"
 #include "erl_nif.h"
 
+// ByteSize() walks the message once and caches the size of every nested
+// message, the serialization then reuses those sizes rather than walking
+// the message a second time as SerializeToArray() does.
 template <class T> 
 ERL_NIF_TERM pb_obj_to_binary(ErlNifEnv *env, const T& obj)  {
-    ErlNifBinary res;
-    enif_alloc_binary(obj.ByteSize(), &res); // Review : do I need to dealloc this?
-    obj.SerializeToArray(res.data, res.size);
-    return enif_make_binary(env, &res);
+    ERL_NIF_TERM term;
+    unsigned char* data = enif_make_new_binary(env, obj.ByteSize(), &term);
+    obj.SerializeWithCachedSizesToArray(data);
+    return term;
+}
+
+// serializes several objects into a single binary and returns a sub binary
+// of it for each object - one allocation per callback rather than one per object
+inline void pb_objs_to_binaries(ErlNifEnv *env, 
+                                const google::protobuf::MessageLite* const objs[], 
+                                ERL_NIF_TERM terms[],
+                                unsigned int count)  {
+    size_t total = 0;
+    for(unsigned int i = 0; i < count; i++)
+    {
+      total += objs[i]->ByteSize();
+    }
+
+    ERL_NIF_TERM binary;
+    unsigned char* data = enif_make_new_binary(env, total, &binary);
+
+    size_t offset = 0;
+    for(unsigned int i = 0; i < count; i++)
+    {
+      size_t size = objs[i]->GetCachedSize();
+      objs[i]->SerializeWithCachedSizesToArray(data + offset);
+      terms[i] = enif_make_sub_binary(env, binary, offset, size);
+      offset += size;
+    }
 }
 
 template<typename T> inline bool deserialize(T& ret, void* data, size_t size)
@@ -48,18 +80,59 @@ template<typename T> inline bool deserialize(T& ret, ErlNifBinary* obj) {
   return deserialize<T>(ret, obj->data, obj->size);
 }
 
-template<typename T> inline bool deserialize(
-      std::vector<T>& ret,
-      BinaryNifArray* request)
+// an integer or a float
+inline bool get_number(ErlNifEnv* env, ERL_NIF_TERM term, double* value)
+{
+  long integer;
+  if(enif_get_long(env, term, &integer))
   {
-    for(int i = 0; i < request->length; i++)
-    {
-      T obj;
-      if(!deserialize<T>(obj, &request->obj[i])){return false;}
-      ret.push_back(obj);
-    }
+    *value = static_cast<double>(integer);
     return true;
   }
+  return enif_get_double(env, term, value);
+}
+
+// a latin-1 string or a binary
+inline bool get_text(ErlNifEnv* env, ERL_NIF_TERM term, std::string& text)
+{
+  ErlNifBinary binary;
+  if(enif_inspect_binary(env, term, &binary))
+  {
+    text.assign(reinterpret_cast<const char*>(binary.data), binary.size);
+    return true;
+  }
+
+  unsigned int length;
+  if(!enif_get_list_length(env, term, &length)) { return false; }
+
+  text.resize(length + 1);
+  if(enif_get_string(env, term, &text[0], length + 1, ERL_NIF_LATIN1) <= 0) { return false; }
+  text.resize(length);
+  return true;
+}
+
+// {name, value}, as the stats functions return them
+inline ERL_NIF_TERM make_stat(ErlNifEnv* env, const char* name, unsigned long value)
+{
+  return enif_make_tuple2(env, enif_make_atom(env, name), enif_make_ulong(env, value));
+}
+
+// a state no later update replaces
+inline bool is_terminal(mesos::TaskState state)
+{
+  return state == mesos::TASK_FINISHED ||
+         state == mesos::TASK_FAILED ||
+         state == mesos::TASK_KILLED ||
+         state == mesos::TASK_LOST ||
+         state == mesos::TASK_ERROR;
+}
+
+// true if term is the atom name, which must be short
+inline bool is_atom(ErlNifEnv* env, ERL_NIF_TERM term, const char* name)
+{
+  char atom[16];
+  return enif_get_atom(env, term, atom, sizeof(atom), ERL_NIF_LATIN1) > 0 && strcmp(atom, name) == 0;
+}
 
 #endif
   
\ No newline at end of file
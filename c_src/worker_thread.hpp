@@ -0,0 +1,84 @@
+// -------------------------------------------------------------------
+// Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+
+#ifndef MESOS_WORKER_THREAD_HPP
+#define MESOS_WORKER_THREAD_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+/**
+ * The thread a CommandQueue, Reconciler, MessageChannel or StatusCoalescer
+ * runs its loop on. It is started by the first call that needs it, and
+ * stop sets the stopping flag the loop waits on and joins it, so whatever
+ * the loop calls, the driver above all, must outlive stop.
+ */
+class WorkerThread
+{
+public:
+  WorkerThread() : isRunning(false) {}
+
+  // starts body the first time it is called, returns false if the thread
+  // could not be started then
+  template<typename Body> bool start(Body body)
+  {
+    std::call_once(started, [this, &body]() {
+      try
+      {
+        worker = std::thread(body);
+        isRunning = true;
+      }catch(const std::system_error&)
+      {
+      }
+    });
+    return isRunning;
+  }
+
+  bool running() const { return isRunning; }
+
+  // sets stopping under lock, wakes the loop waiting on wakeup and joins
+  // it, unless it never started
+  void stop(std::mutex& lock, std::condition_variable& wakeup, bool& stopping)
+  {
+    if(!isRunning) { return; }
+
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+    }
+    wakeup.notify_one();
+    worker.join();
+    isRunning = false;
+  }
+
+private:
+  WorkerThread(const WorkerThread&);
+  WorkerThread& operator=(const WorkerThread&);
+
+  std::once_flag started;
+  std::thread worker;
+  std::atomic<bool> isRunning;
+};
+
+#endif // MESOS_WORKER_THREAD_HPP
@@ -22,13 +22,25 @@
 
 %api
 -export ([  start/2,
+            start/3,
             start_link/2,
+            start_link/3,
             join/0,
             abort/0,
             stop/0,
             sendFrameworkMessage/1,
             sendStatusUpdate/1,
-            destroy/0]).
+            sendStatusUpdates/1,
+            statusUpdateStats/0,
+            destroy/0,
+            envStats/0,
+            flowControlStats/0,
+            fakeDriverStats/0,
+            messageChannelStats/0,
+            dispatchStats/0,
+            stats/0,
+            attach/1,
+            detach/0]).
 
 %gen server
 -export([init/1, handle_call/3, handle_info/2, terminate/2, handle_cast/2,code_change/3]).
@@ -52,12 +64,27 @@
 
 -callback killTask(TaskID :: #'TaskID'{}, State :: any()) -> {ok, State :: any()}.
 
--callback frameworkMessage(Message :: string(), State :: any()) -> {ok, State :: any()}.
+-callback frameworkMessage(Message :: binary(), State :: any()) -> {ok, State :: any()}.
 
 -callback shutdown(State :: any()) -> {ok, State :: any()}.
 
 -callback error(Message :: string(), State :: any()) -> {ok, State :: any()}.    
 
+% as in scheduler, with the workers option a handler may export init_worker(Index, State)
+
+%% -----------------------------------------------------------------------------------------
+
+-type executor_option() :: {name, atom() | undefined} |
+                           {driver, string()} |
+                           {flow_control, scheduler:flow_control_options()} |
+                           {message_channel, scheduler:message_channel_options()} |
+                           {handler_stats, boolean()} |
+                           {workers, non_neg_integer()} |
+                           {status_update_window, non_neg_integer()} |
+                           {message_formats, [{MessageType :: atom(), scheduler:message_format()}]}.
+
+-export_type([executor_option/0]).
+
 %% -----------------------------------------------------------------------------------------
 
 %% implementation
@@ -69,48 +96,78 @@
     handler_state %% Handler state
 }).
 
+%% the driver a process talks to, kept in the process dictionary of the executor
+%% and of any process that has attached to it
+-record(instance, {
+    handle,  %% nif handle
+    name,    %% registered name or undefined
+    pid,     %% executor process
+    workers = [] %% processes started by the workers option
+}).
+
+-define(INSTANCE, {?MODULE, instance}).
+
+% {GrantEvery, Used} while flow control is on, see consumed/0
+-define(FLOW, {?MODULE, flow}).
+
+% true when the handler_stats option is set
+-define(HANDLER_STATS, {?MODULE, handler_stats}).
+
+% credits the nif starts with unless the flow_control option says otherwise
+-define(FLOW_WINDOW, 1000).
+
 %% -----------------------------------------------------------------------------------------
 
 -spec start( Module :: atom(), Args :: term()) ->
     {ok, Server :: pid()} | {error, Reason :: term()}.
 start(Module, Args) ->
-    gen_server:start(?MODULE, {Module, Args}, []).
+    start(Module, Args, []).
+
+-spec start( Module :: atom(), Args :: term(), Options :: [executor_option()]) ->
+    {ok, Server :: pid()} | {error, Reason :: term()}.
+start(Module, Args, Options) when is_list(Options) ->
+    gen_server:start(?MODULE, {Module, Args, Options}, []).
 
 %% -----------------------------------------------------------------------------------------
 
 -spec start_link( Module :: atom(), Args :: term()) ->
     {ok, Server :: pid()} | {error, Reason :: term()}.
 start_link(Module, Args ) ->
-    gen_server:start_link(?MODULE, {Module, Args}, []).
+    start_link(Module, Args, []).
+
+-spec start_link( Module :: atom(), Args :: term(), Options :: [executor_option()]) ->
+    {ok, Server :: pid()} | {error, Reason :: term()}.
+start_link(Module, Args, Options) when is_list(Options) ->
+    gen_server:start_link(?MODULE, {Module, Args, Options}, []).
 
 %% -----------------------------------------------------------------------------------------
 
 -spec join() -> {ok, driver_running } | { error, executor_not_inited} | {error, driver_state()}.
 join() ->
-    nif_executor:join().
+    nif_executor:join(handle()).
 
 %% -----------------------------------------------------------------------------------------
 
 -spec abort() -> {ok, driver_running } | { error, executor_not_inited} | {error, driver_state()}.
 abort() ->
-    nif_executor:abort().
+    nif_executor:abort(handle()).
 
 %% -----------------------------------------------------------------------------------------
 
 -spec stop() -> {ok, driver_running } | { error, executor_not_inited} | {error, driver_state()}.
 stop() ->       
-    nif_executor:stop().
+    nif_executor:stop(handle()).
 
 %% -----------------------------------------------------------------------------------------
 
--spec sendFrameworkMessage( Message :: string() ) -> 
+-spec sendFrameworkMessage( Message :: iodata() ) -> 
                           {ok, driver_running } 
                         | {error, {invalid_or_corrupted_parameter, data }}
                         | {error, executor_not_inited} 
                         | {error, driver_state()}.
 
-sendFrameworkMessage(Data) when is_list(Data) ->
-    nif_executor:sendFrameworkMessage(Data).
+sendFrameworkMessage(Data) when is_list(Data); is_binary(Data) ->
+    nif_executor:sendFrameworkMessage(handle(), Data).
 %% -----------------------------------------------------------------------------------------
 
 -spec sendStatusUpdate( TaskStatus :: #'TaskStatus'{} ) -> 
@@ -120,20 +177,101 @@ sendFrameworkMessage(Data) when is_list(Data) ->
                         | {error, driver_state()}.
 
 sendStatusUpdate(TaskStatus) when is_record(TaskStatus, 'TaskStatus') ->
-    nif_executor:sendStatusUpdate(TaskStatus).
+    nif_executor:sendStatusUpdate(handle(), TaskStatus).
+%% -----------------------------------------------------------------------------------------
+
+% sends the updates with one nif call, returning a result for each
+-spec sendStatusUpdates( TaskStatuses :: [#'TaskStatus'{}] ) -> 
+                          [{ok, driver_running} | {error, driver_state()}]
+                        | {error, {invalid_or_corrupted_parameter, task_status_array }}
+                        | {error, executor_not_inited}.
+
+sendStatusUpdates(TaskStatuses) when is_list(TaskStatuses) ->
+    nif_executor:sendStatusUpdates(handle(), TaskStatuses).
 %% -----------------------------------------------------------------------------------------
 
 -spec destroy() -> ok | {error, executor_not_inited}.
 
 destroy() ->
-    Response = nif_executor:destroy(),
+    #instance{handle = Handle, name = Name, pid = Pid, workers = Workers} = instance(),
+    Response = nif_executor:destroy(Handle),
+    ok = mesos_workers:stop(Workers),
 
-    case whereis(?MODULE) of
-        undefined  -> ok;
-        _ -> unregister(?MODULE)
+    case Name =/= undefined andalso whereis(Name) of
+        Pid when is_pid(Pid) -> unregister(Name);
+        _ -> ok
     end,
     
     Response.
+
+%% -----------------------------------------------------------------------------------------
+
+% memory held by the environments used to deliver callback messages
+-spec envStats() -> [{envs | envs_allocated | messages | bytes | peak_bytes, non_neg_integer()}].
+envStats() ->
+    nif_executor:envStats().
+
+% messages held back by the flow_control option
+-spec flowControlStats() -> [{enabled, boolean()} |
+                             {window | credits | depth | high_water | queued | overflowed | 
+                              dropped | declined | coalesced, non_neg_integer()}]
+                          | {error, executor_not_inited}.
+flowControlStats() ->
+    nif_executor:flowControlStats(handle()).
+
+% as scheduler:fakeDriverStats/0, for an executor started with the driver option
+-spec fakeDriverStats() -> [{launched | messages_sent | status_updates | messages_received, non_neg_integer()}]
+                         | {error, executor_not_inited | not_fake_driver}.
+fakeDriverStats() ->
+    nif_executor:fakeDriverStats(handle()).
+
+% status updates sent and held back by the status_update_window option
+-spec statusUpdateStats() -> [{enabled, boolean()} |
+                              {window_millis | sent | held | superseded | terminal | pending, non_neg_integer()}]
+                           | {error, executor_not_inited}.
+statusUpdateStats() ->
+    nif_executor:statusUpdateStats(handle()).
+
+% as scheduler:messageChannelStats/0, with the scheduler as the one destination
+-spec messageChannelStats() -> [{enabled, boolean()} |
+                                {frames_received | messages_unpacked | corrupt_frames, non_neg_integer()} |
+                                {destinations, [{scheduler, [{atom(), non_neg_integer()}]}]}]
+                             | {error, executor_not_inited}.
+messageChannelStats() ->
+    nif_executor:messageChannelStats(handle()).
+
+% as scheduler:dispatchStats/0
+-spec dispatchStats() -> [{workers, non_neg_integer()} | {routed, [non_neg_integer()]}]
+                       | {error, executor_not_inited}.
+dispatchStats() ->
+    nif_executor:dispatchStats(handle()).
+
+% latency of each callback and driver call made by executors in the vm, and with the
+% handler_stats option of each message handled, in microseconds. Bytes
+% are those encoded into callback messages or passed to the driver.
+-spec stats() -> [{Name :: atom(), [{count | bytes | mean | max | p50 | p90 | p99 | p999, non_neg_integer()}]}].
+stats() ->
+    nif_executor:stats().
+
+%% -----------------------------------------------------------------------------------------
+
+% the functions in this module act on the executor started by the calling process,
+% or on the one registered as 'executor'. attach/1 points them at another executor
+% until detach/0 is called.
+-spec attach(Server :: pid() | atom()) -> ok | {error, executor_not_inited}.
+attach(Server) ->
+    case server_instance(Server) of
+        #instance{handle = undefined} -> {error, executor_not_inited};
+        Instance -> 
+            put(?INSTANCE, Instance),
+            ok
+    end.
+
+% undoes attach/1
+-spec detach() -> ok.
+detach() ->
+    erase(?INSTANCE),
+    ok.
     
 %% -----------------------------------------------------------------------------------------
 %% -----------------------------------------------------------------------------------------
@@ -144,19 +282,17 @@ destroy() ->
 %% -----------------------------------------------------------------------------------------
 %% -----------------------------------------------------------------------------------------
 %% -----------------------------------------------------------------------------------------
-init({Module, Args}) ->
+init({Module, Args, Options}) ->
     
-     case whereis(?MODULE) of
+     Name = proplists:get_value(name, Options, ?MODULE),
+     process_flag(trap_exit, true),
+
+     case whereis_name(Name) of
         undefined ->
-            register(?MODULE, self()),
+            register_name(Name),
             case Module:init(Args) of
              {ok, State} ->
-                    ok = nif_executor:init(self()),
-                    {ok,driver_running} = nif_executor:start(),               
-                    {ok, #state{
-                                handler_module = Module,
-                                handler_state = State
-                            }};
+                    init_result(start_driver(init_driver(proplists:get_value(driver, Options)), Name, Options, Module, State), Module, State);
              Else ->  
                 Error = {bad_return_value, Else},   
                 {stop, Error}                                           
@@ -165,53 +301,68 @@ init({Module, Args}) ->
             {stop, {already_started,Pid}} 
     end.
 
+handle_call(instance, _From, State) ->
+    {reply, get(?INSTANCE), State};
+
 handle_call(_Request, _From, State) ->
     {reply, ok, State}.
 
 handle_cast(_Msg, State) ->
   {noreply, State}.
 
+% as in scheduler, a linked process that fails stops the executor and the driver
+handle_info({'EXIT', _, normal}, State) ->
+    {noreply, State};
+handle_info({'EXIT', _, Reason}, State) ->
+    {stop, Reason, State};
+
+handle_info(Info, State) ->
+    Started = started(),
+    Reply = handle_message(Info, State),
+    ok = handled(Info, Started),
+    ok = consumed(),
+    Reply.
 
-handle_info({registered , ExecutorInfoBin, FrameworkInfoBin, SlaveInfoBin }, #state{ handler_module = Module, handler_state = HandlerState }) ->
-    ExecutorInfo = mesos_pb:decode_msg(ExecutorInfoBin, 'ExecutorInfo'),
-    FrameworkInfo = mesos_pb:decode_msg(FrameworkInfoBin, 'FrameworkInfo'),
-    SlaveInfo = mesos_pb:decode_msg(SlaveInfoBin, 'SlaveInfo'),
+handle_message({registered , ExecutorInfoBin, FrameworkInfoBin, SlaveInfoBin }, #state{ handler_module = Module, handler_state = HandlerState }) ->
+    ExecutorInfo = decode(ExecutorInfoBin, 'ExecutorInfo'),
+    FrameworkInfo = decode(FrameworkInfoBin, 'FrameworkInfo'),
+    SlaveInfo = decode(SlaveInfoBin, 'SlaveInfo'),
 
     {ok, State1} = Module:registered(ExecutorInfo, FrameworkInfo, SlaveInfo, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({reregistered, SlaveInfoBin}, #state{ handler_module = Module, handler_state = HandlerState }) ->
-    SlaveInfo = mesos_pb:decode_msg(SlaveInfoBin, 'SlaveInfo'),
+handle_message({reregistered, SlaveInfoBin}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+    SlaveInfo = decode(SlaveInfoBin, 'SlaveInfo'),
 
     {ok, State1} = Module:reregistered(SlaveInfo, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({disconnected}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+handle_message({disconnected}, #state{ handler_module = Module, handler_state = HandlerState }) ->
 
     {ok, State1} = Module:disconnected(HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({launchTask, TaskInfoBin}, #state{ handler_module = Module, handler_state = HandlerState }) ->
-    TaskInfo = mesos_pb:decode_msg(TaskInfoBin, 'TaskInfo'),
+handle_message({launchTask, TaskInfoBin}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+    TaskInfo = decode(TaskInfoBin, 'TaskInfo'),
 
     {ok, State1} = Module:launchTask(TaskInfo, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({killTask, TaskIDBin} , #state{ handler_module = Module, handler_state = HandlerState }) ->
-    TaskID = mesos_pb:decode_msg(TaskIDBin, 'TaskID'),
+handle_message({killTask, TaskIDBin} , #state{ handler_module = Module, handler_state = HandlerState }) ->
+    TaskID = decode(TaskIDBin, 'TaskID'),
     
     {ok, State1} = Module:killTask(TaskID, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({frameworkMessage, Message}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+handle_message({frameworkMessage, Message}, #state{ handler_module = Module, handler_state = HandlerState }) ->
     {ok, State1} = Module:frameworkMessage(Message, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({shutdown}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+handle_message({shutdown}, #state{ handler_module = Module, handler_state = HandlerState }) ->
     {ok, State1} = Module:shutdown(HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({error, Message}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+handle_message({error, Message}, #state{ handler_module = Module, handler_state = HandlerState }) ->
     {ok, State1} = Module:error(Message, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }}.
 
@@ -223,6 +374,136 @@ terminate(_Reason, _State) ->
     ok.
 
 % helpers
+% the driver option is a fake:// url, for running without a slave
+init_result({ok, driver_running}, Module, State) ->
+    {ok, #state{
+                handler_module = Module,
+                handler_state = State
+            }};
+init_result({error, Reason}, _, _) ->
+    {stop, Reason}.
+
+% as scheduler:start_driver/5, an option the nif refuses stops init
+start_driver({ok, Handle}, Name, Options, Module, State) ->
+    put(?INSTANCE, #instance{handle = Handle, name = Name, pid = self()}),
+    case apply_options(Handle, Options) of
+        ok ->
+            ok = start_workers(Handle, proplists:get_value(workers, Options, 0), Module, State),
+            nif_executor:start(Handle);
+        Error ->
+            nif_executor:destroy(Handle),
+            Error
+    end;
+start_driver(Error, _, _, _, _) ->
+    Error.
+
+init_driver(undefined) ->
+    nif_executor:init(self());
+init_driver(Driver) ->
+    nif_executor:init(self(), Driver).
+
+apply_options(_, []) -> ok;
+apply_options(Handle, [{name, _} | Rest]) ->
+    apply_options(Handle, Rest);
+apply_options(Handle, [{driver, _} | Rest]) ->
+    apply_options(Handle, Rest);
+apply_options(Handle, [{handler_stats, Enabled} | Rest]) when is_boolean(Enabled) ->
+    put(?HANDLER_STATS, Enabled),
+    apply_options(Handle, Rest);
+apply_options(Handle, [{workers, Count} | Rest]) when is_integer(Count), Count >= 0 ->
+    apply_options(Handle, Rest);
+apply_options(Handle, [{status_update_window, Millis} = Option | Rest]) when is_integer(Millis), Millis >= 0 ->
+    apply_option(nif_executor:setStatusUpdateWindow(Handle, Millis), Handle, Option, Rest);
+apply_options(Handle, [{flow_control, FlowOptions} = Option | Rest]) when is_list(FlowOptions) ->
+    Window = proplists:get_value(window, FlowOptions, ?FLOW_WINDOW),
+    put(?FLOW, {max(1, Window div 2), 0}),
+    apply_option(nif_executor:setFlowControl(Handle, FlowOptions), Handle, Option, Rest);
+apply_options(Handle, [{message_channel, ChannelOptions} = Option | Rest]) when is_list(ChannelOptions) ->
+    apply_option(nif_executor:setMessageChannel(Handle, ChannelOptions), Handle, Option, Rest);
+apply_options(Handle, [{message_formats, Formats} = Option | Rest]) when is_list(Formats) ->
+    apply_option(set_message_formats(Handle, Formats), Handle, Option, Rest);
+apply_options(_, [Option | _]) ->
+    {error, {invalid_option, Option}}.
+
+apply_option(ok, Handle, _, Rest) ->
+    apply_options(Handle, Rest);
+apply_option(_, _, Option, _) ->
+    {error, {invalid_option, Option}}.
+
+set_message_formats(_, []) ->
+    ok;
+set_message_formats(Handle, [{Type, Format} | Rest]) when is_atom(Type) ->
+    case lists:member(Format, [binary, record, map]) andalso nif_executor:setMessageFormat(Handle, Type, Format) of
+        ok -> set_message_formats(Handle, Rest);
+        _ -> error
+    end;
+set_message_formats(_, _) ->
+    error.
+
+% as scheduler:start_workers/4, launchTask and killTask are routed by task id
+start_workers(_, 0, _, _) ->
+    ok;
+start_workers(Handle, Count, Module, State) ->
+    Workers = mesos_workers:start(Count, ?FLOW, [?INSTANCE, ?HANDLER_STATS],
+                                  fun(Index) -> init_worker(Index, Module, State) end,
+                                  fun handle_info/2),
+    put(?INSTANCE, (get(?INSTANCE))#instance{workers = Workers}),
+    nif_executor:setDispatch(Handle, Workers).
+
+init_worker(Index, Module, State) ->
+    {ok, State1} = case erlang:function_exported(Module, init_worker, 2) of
+        true -> Module:init_worker(Index, State);
+        false -> {ok, State}
+    end,
+    #state{handler_module = Module, handler_state = State1}.
+
+% with the handler_stats option the time taken by each message is recorded in the nif
+started() ->
+    case get(?HANDLER_STATS) of
+        true -> os:timestamp();
+        _ -> undefined
+    end.
+
+handled(_, undefined) ->
+    ok;
+handled(Info, Started) ->
+    nif_executor:observe(element(1, Info), timer:now_diff(os:timestamp(), Started) * 1000).
+
+% each callback message uses a credit with flow control, see mesos_workers:consumed/2
+consumed() ->
+    mesos_workers:consumed(?FLOW, fun(Credits) -> nif_executor:grant(handle(), Credits) end).
+
+whereis_name(undefined) -> undefined;
+whereis_name(Name) -> whereis(Name).
+
+register_name(undefined) -> true;
+register_name(Name) -> register(Name, self()).
+
+handle() ->
+    #instance{handle = Handle} = instance(),
+    Handle.
+
+instance() ->
+    case get(?INSTANCE) of
+        undefined -> server_instance(?MODULE);
+        Instance -> Instance
+    end.
+
+% an instance without a handle makes the nif return executor_not_inited
+server_instance(Server) ->
+    try gen_server:call(Server, instance) of
+        #instance{} = Instance -> Instance;
+        _ -> #instance{}
+    catch
+        exit:_ -> #instance{}
+    end.
+
+% messages arrive as binaries unless a native format has been set for the type
+decode(Bin, Type) when is_binary(Bin) ->
+    mesos_pb:decode_msg(Bin, Type);
+decode(Msg, _Type) ->
+    Msg.
+
 do_terminate()->
     executor:stop(),
     executor:destroy().
\ No newline at end of file
@@ -0,0 +1,78 @@
+%% -------------------------------------------------------------------
+%% Copyright (c) 2015 Mark deVilliers.  All Rights Reserved.
+%%
+%% This file is provided to you under the Apache License,
+%% Version 2.0 (the "License"); you may not use this file
+%% except in compliance with the License.  You may obtain
+%% a copy of the License at
+%%
+%%   http://www.apache.org/licenses/LICENSE-2.0
+%%
+%% Unless required by applicable law or agreed to in writing,
+%% software distributed under the License is distributed on an
+%% "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+%% KIND, either express or implied.  See the License for the
+%% specific language governing permissions and limitations
+%% under the License.
+%%
+%% -------------------------------------------------------------------
+
+-module (mesos_workers).
+
+% the processes started by the workers option of scheduler and executor, and
+% the flow control credits every process handling callbacks hands back
+
+-export ([start/5, stop/1, consumed/2]).
+
+%% -----------------------------------------------------------------------------------------
+
+% starts Count processes linked to the caller, each with a copy of the caller's
+% process dictionary entries for FlowKey and Keys, that handle messages with
+% HandleInfo from the state Init(Index) returns until stop/1. Every process
+% holds back up to GrantEvery - 1 credits, together less than the window.
+-spec start(Count :: pos_integer(), FlowKey :: term(), Keys :: [term()],
+            Init :: fun((pos_integer()) -> State),
+            HandleInfo :: fun((term(), State) -> {noreply, State})) -> [pid()].
+start(Count, FlowKey, Keys, Init, HandleInfo) ->
+    case get(FlowKey) of
+        {GrantEvery, Used} -> put(FlowKey, {max(1, GrantEvery div (Count + 1)), Used});
+        undefined -> ok
+    end,
+    Dictionary = [{Key, get(Key)} || Key <- [FlowKey | Keys]],
+    [spawn_link(fun() -> init(Index, Dictionary, Init, HandleInfo) end)
+     || Index <- lists:seq(1, Count)].
+
+-spec stop(Workers :: [pid()]) -> ok.
+stop(Workers) ->
+    [Worker ! {?MODULE, stop} || Worker <- Workers],
+    ok.
+
+% with flow control each callback message uses a credit, handed back to the
+% nif by Grant once the message is handled, in batches of half the window
+-spec consumed(FlowKey :: term(), Grant :: fun((pos_integer()) -> term())) -> term().
+consumed(FlowKey, Grant) ->
+    case get(FlowKey) of
+        undefined ->
+            ok;
+        {GrantEvery, Used} when Used + 1 >= GrantEvery ->
+            put(FlowKey, {GrantEvery, 0}),
+            Grant(Used + 1);
+        {GrantEvery, Used} ->
+            put(FlowKey, {GrantEvery, Used + 1}),
+            ok
+    end.
+
+%% -----------------------------------------------------------------------------------------
+
+init(Index, Dictionary, Init, HandleInfo) ->
+    [put(Key, Value) || {Key, Value} <- Dictionary, Value =/= undefined],
+    loop(Init(Index), HandleInfo).
+
+loop(State, HandleInfo) ->
+    receive
+        {?MODULE, stop} ->
+            ok;
+        Info ->
+            {noreply, State1} = HandleInfo(Info, State),
+            loop(State1, HandleInfo)
+    end.
@@ -22,61 +22,168 @@
 -include_lib("mesos_pb.hrl").
 
 -export ([  init/1,
-            start/0,
-            join/0,
-            abort/0,
-            stop/0,
-            sendFrameworkMessage/1,
-            sendStatusUpdate/1,
-            destroy/0]).
+            init/2,
+            start/1,
+            join/1,
+            abort/1,
+            stop/1,
+            sendFrameworkMessage/2,
+            sendStatusUpdate/2,
+            sendStatusUpdates/2,
+            setStatusUpdateWindow/2,
+            statusUpdateStats/1,
+            destroy/1,
+            envStats/0,
+            stats/0,
+            observe/2,
+            setMessageFormat/3,
+            setFlowControl/2,
+            grant/2,
+            flowControlStats/1,
+            fakeDriverStats/1,
+            setMessageChannel/2,
+            messageChannelStats/1,
+            setDispatch/2,
+            dispatchStats/1]).
 
 -on_load(init/0).
 
 -define(APPNAME, erlang_mesos).
 -define(LIBNAME, executor).
 
+% init returns {ok, Handle} - every other call takes the handle of the executor it is for.
+% The driver is destroyed by destroy/1 or when the handle is garbage collected.
 init(Pid) when is_pid(Pid) ->
     nif_executor_init(Pid).
 
-start() ->
-    nif_executor_start().
+% as init/1 with the fake driver configured by a fake:// url in place of mesos
+init(Pid, Driver) when is_pid(Pid), is_list(Driver) ->
+    nif_executor_init(Pid, Driver).
 
-join() ->
-    nif_executor_join().
+start(Handle) ->
+    nif_executor_start(Handle).
 
-abort() ->
-    nif_executor_abort().
+join(Handle) ->
+    on_thread(nif_executor_join(Handle)).
 
-stop() ->
-    nif_executor_stop().
+abort(Handle) ->
+    on_thread(nif_executor_abort(Handle)).
 
-sendFrameworkMessage(Data) when is_list(Data)->
-    nif_executor_sendFrameworkMessage(Data).
+stop(Handle) ->
+    on_thread(nif_executor_stop(Handle)).
 
-sendStatusUpdate(TaskStatus) when is_record(TaskStatus, 'TaskStatus') ->
-    nif_executor_sendStatusUpdate(mesos_pb:encode_msg(TaskStatus)).
+sendFrameworkMessage(Handle, Data) when is_list(Data); is_binary(Data)->
+    nif_executor_sendFrameworkMessage(Handle, Data).
 
-destroy() ->
-    nif_executor_destroy().
+sendStatusUpdate(Handle, TaskStatus) when is_record(TaskStatus, 'TaskStatus') ->
+    nif_executor_sendStatusUpdate(Handle, mesos_pb:encode_msg(TaskStatus)).
+
+% one result per update, in order. The records are read by the nif as they are
+sendStatusUpdates(Handle, TaskStatuses) when is_list(TaskStatuses) ->
+    on_thread(nif_executor_sendStatusUpdates(Handle, TaskStatuses)).
+
+% non-terminal updates are held for Millis, and replaced by a later update for the
+% same task, before they are sent. Terminal updates are sent at once. 0 holds none
+setStatusUpdateWindow(Handle, Millis) when is_integer(Millis), Millis >= 0 ->
+    nif_executor_setStatusUpdateWindow(Handle, Millis).
+
+statusUpdateStats(Handle) ->
+    nif_executor_statusUpdateStats(Handle).
+
+destroy(Handle) ->
+    on_thread(nif_executor_destroy(Handle)).
+
+envStats() ->
+    nif_executor_envStats().
+
+% latency histograms of the callbacks and driver calls of every executor in the vm
+stats() ->
+    nif_executor_stats().
+
+observe(Message, Nanos) when is_atom(Message), is_integer(Nanos), Nanos >= 0 ->
+    nif_executor_observe(Message, Nanos).
+
+setMessageFormat(Handle, Type, Format) when is_atom(Type) ->
+    nif_executor_setMessageFormat(Handle, Type, format_to_int(Format)).
+
+% as nif_scheduler:setFlowControl/2, an executor is never sent offers
+setFlowControl(Handle, Options) when is_list(Options) ->
+    nif_executor_setFlowControl(Handle, Options).
+
+grant(Handle, Credits) when is_integer(Credits), Credits > 0 ->
+    nif_executor_grant(Handle, Credits).
+
+flowControlStats(Handle) ->
+    nif_executor_flowControlStats(Handle).
+
+% as nif_scheduler:fakeDriverStats/1
+fakeDriverStats(Handle) ->
+    nif_executor_fakeDriverStats(Handle).
+
+% as nif_scheduler:setMessageChannel/2, every frame goes to the scheduler
+setMessageChannel(Handle, Options) when is_list(Options) ->
+    nif_executor_setMessageChannel(Handle, Options).
+
+messageChannelStats(Handle) ->
+    nif_executor_messageChannelStats(Handle).
+
+% as nif_scheduler:setDispatch/2, launchTask and killTask are sent by task id
+setDispatch(Handle, Workers) when is_list(Workers) ->
+    nif_executor_setDispatch(Handle, Workers).
+
+dispatchStats(Handle) ->
+    nif_executor_dispatchStats(Handle).
 
 % nif functions
 
 nif_executor_init(_)->
     not_loaded(?LINE).
-nif_executor_start() ->
+nif_executor_init(_, _)->
+    not_loaded(?LINE).
+nif_executor_start(_) ->
     not_loaded(?LINE).
-nif_executor_join() ->
+nif_executor_join(_) ->
     not_loaded(?LINE).
-nif_executor_abort() ->
+nif_executor_abort(_) ->
     not_loaded(?LINE).
-nif_executor_stop() ->
+nif_executor_stop(_) ->
     not_loaded(?LINE).
-nif_executor_sendFrameworkMessage(_)->
+nif_executor_sendFrameworkMessage(_,_)->
     not_loaded(?LINE).
-nif_executor_sendStatusUpdate(_) ->
+nif_executor_sendStatusUpdate(_,_) ->
     not_loaded(?LINE).
-nif_executor_destroy() ->
+nif_executor_sendStatusUpdates(_,_) ->
+    not_loaded(?LINE).
+nif_executor_setStatusUpdateWindow(_,_) ->
+    not_loaded(?LINE).
+nif_executor_statusUpdateStats(_) ->
+    not_loaded(?LINE).
+nif_executor_destroy(_) ->
 	not_loaded(?LINE).
+nif_executor_envStats() ->
+    not_loaded(?LINE).
+nif_executor_stats() ->
+    not_loaded(?LINE).
+nif_executor_observe(_, _) ->
+    not_loaded(?LINE).
+nif_executor_setFlowControl(_, _) ->
+    not_loaded(?LINE).
+nif_executor_grant(_, _) ->
+    not_loaded(?LINE).
+nif_executor_flowControlStats(_) ->
+    not_loaded(?LINE).
+nif_executor_fakeDriverStats(_) ->
+    not_loaded(?LINE).
+nif_executor_setMessageChannel(_, _) ->
+    not_loaded(?LINE).
+nif_executor_messageChannelStats(_) ->
+    not_loaded(?LINE).
+nif_executor_setDispatch(_, _) ->
+    not_loaded(?LINE).
+nif_executor_dispatchStats(_) ->
+    not_loaded(?LINE).
+nif_executor_setMessageFormat(_, _, _) ->
+    not_loaded(?LINE).
 	
 init() ->
     SoName = case code:priv_dir(?APPNAME) of
@@ -94,3 +201,15 @@ init() ->
 
 not_loaded(Line) ->
     exit({not_loaded, [{module, ?MODULE}, {line, Line}]}).
+
+% helpers
+format_to_int(binary) -> 0;
+format_to_int(record) -> 1;
+format_to_int(map) -> 2.
+
+% without dirty schedulers the nifs that can block run on a thread of their own
+% and return {nif_thread, Ref}, their result is sent to the caller as {Ref, Result}
+on_thread({nif_thread, Ref}) ->
+    receive {Ref, Result} -> Result end;
+on_thread(Result) ->
+    Result.
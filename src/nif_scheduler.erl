@@ -21,32 +21,69 @@
 -module (nif_scheduler).
 
 -include_lib("mesos_pb.hrl").
+-include_lib("mesos_erlang.hrl").
 
 -export ([  init/5,
             init/4,
-            start/0,
-            join/0,
-            abort/0,
-            stop/1,
-            acceptOffers/2,
+            start/1,
+            join/1,
+            joinAsync/1,
+            abort/1,
+            stop/2,
             acceptOffers/3,
-            declineOffer/1,
+            acceptOffers/4,
             declineOffer/2,
-            killTask/1,
-            reviveOffers/0,
-            sendFrameworkMessage/3,
-            requestResources/1,
-            reconcileTasks/1,
-            launchTasks/2,
+            declineOffer/3,
+            declineOffers/2,
+            declineOffers/3,
+            killTask/2,
+            killTasks/2,
+            reviveOffers/1,
+            sendFrameworkMessage/4,
+            requestResources/2,
+            reconcileTasks/2,
             launchTasks/3,
-            destroy/0,
-            acknowledgeStatusUpdate/1]).
+            launchTasks/4,
+            destroy/1,
+            acknowledgeStatusUpdate/2,
+            acknowledgeStatusUpdates/2,
+            ack/2,
+            ackMany/2,
+            setBatchOffers/2,
+            envStats/0,
+            stats/0,
+            observe/2,
+            setMessageFormat/3,
+            setCoalesceStatusUpdates/2,
+            takeStatusUpdates/2,
+            taskState/2,
+            taskStats/1,
+            setFlowControl/2,
+            grant/2,
+            flowControlStats/1,
+            fakeDriverStats/1,
+            setMessageChannel/2,
+            messageChannelStats/1,
+            setDispatch/2,
+            dispatchStats/1,
+            reconcile/2,
+            setReconcileOptions/2,
+            cancelReconcile/1,
+            reconcileStats/1,
+            setOfferIndex/2,
+            findOffers/2,
+            setOfferFilter/2,
+            offerFilterStats/1,
+            cast/2,
+            decode/3]).
 
 -on_load(init/0).
 
 -define(APPNAME, erlang_mesos).
 -define(LIBNAME, scheduler).
 
+% init returns {ok, Handle} - every other call takes the handle of the scheduler it is for.
+% The driver is destroyed by destroy/1 or when the handle is garbage collected.
 init(Pid, FrameworkInfo, MasterLocation, ImplicitAcknowledgements, Credential) when is_pid(Pid), 
                                                             is_record(FrameworkInfo, 'FrameworkInfo'), 
                                                             is_list(MasterLocation),
@@ -60,105 +97,296 @@ init(Pid, FrameworkInfo, MasterLocation, ImplicitAcknowledgements) when is_pid(P
                                                 is_boolean(ImplicitAcknowledgements)->
     nif_scheduler_init(Pid, mesos_pb:encode_msg(FrameworkInfo), MasterLocation, bool_to_int(ImplicitAcknowledgements)).
 
-start() ->
-    nif_scheduler_start().
+start(Handle) ->
+    nif_scheduler_start(Handle).
 
-join() ->
-    nif_scheduler_join().
+join(Handle) ->
+    on_thread(nif_scheduler_join(Handle)).
 
-abort() ->
-    nif_scheduler_abort().
+joinAsync(Handle) ->
+    nif_scheduler_joinAsync(Handle).
 
-stop(Failover) when is_integer(Failover), 
+abort(Handle) ->
+    on_thread(nif_scheduler_abort(Handle)).
+
+stop(Handle, Failover) when is_integer(Failover), 
                                 Failover > -1, 
                                 Failover < 2 ->
-    nif_scheduler_stop(Failover).
+    on_thread(nif_scheduler_stop(Handle, Failover)).
 
-acceptOffers(OfferIDs, Operations) when is_list(OfferIDs), 
+acceptOffers(Handle, OfferIDs, Operations) when is_list(OfferIDs), 
                                         is_list(Operations) ->
-  acceptOffers(OfferIDs, Operations, #'Filters'{}).
-acceptOffers(OfferIDs, Operations, Filters) when is_list(OfferIDs), 
-                                                 is_list(Operations),
-                                                 is_record(Filters, 'Filters') ->
-    nif_scheduler_acceptOffers( encode_array(OfferIDs, []), encode_array(Operations, []), mesos_pb:encode_msg(Filters)).
+  acceptOffers(Handle, OfferIDs, Operations, #'Filters'{}).
+% the records (or maps) are passed as they are and built into protobuf objects by the nif
+acceptOffers(Handle, OfferIDs, Operations, Filters) when is_list(OfferIDs), 
+                                                 is_list(Operations) ->
+    nif_scheduler_acceptOffers(Handle, OfferIDs, Operations, Filters).
 
-declineOffer(OfferId) when is_record(OfferId, 'OfferID') ->
+declineOffer(Handle, OfferId) when is_record(OfferId, 'OfferID') ->
     Filter = #'Filters'{},
-    nif_scheduler_declineOffer(mesos_pb:encode_msg(OfferId), mesos_pb:encode_msg(Filter)).
+    nif_scheduler_declineOffer(Handle, mesos_pb:encode_msg(OfferId), mesos_pb:encode_msg(Filter)).
 
-declineOffer(OfferId,Filter) when is_record(OfferId, 'OfferID'),
+declineOffer(Handle, OfferId,Filter) when is_record(OfferId, 'OfferID'),
                                             is_record(Filter, 'Filters') ->
-    nif_scheduler_declineOffer(mesos_pb:encode_msg(OfferId), mesos_pb:encode_msg(Filter)).
+    nif_scheduler_declineOffer(Handle, mesos_pb:encode_msg(OfferId), mesos_pb:encode_msg(Filter)).
+
+killTask(Handle, TaskId) when is_record(TaskId,'TaskID')->
+    nif_scheduler_killTask(Handle, mesos_pb:encode_msg(TaskId)).
+
+% the bulk calls return a status per item, in the order of the items. An item
+% may also be a binary already encoded with mesos_pb
+declineOffers(Handle, OfferIds) when is_list(OfferIds) ->
+    declineOffers(Handle, OfferIds, #'Filters'{}).
 
-killTask(TaskId) when is_record(TaskId,'TaskID')->
-    nif_scheduler_killTask(mesos_pb:encode_msg(TaskId)).
+declineOffers(Handle, OfferIds, Filter) when is_list(OfferIds),
+                                             is_record(Filter, 'Filters') ->
+    on_thread(nif_scheduler_declineOffers(Handle, [encode_item(OfferId) || OfferId <- OfferIds], mesos_pb:encode_msg(Filter))).
 
-reviveOffers() ->
-    nif_scheduler_reviveOffers().
+killTasks(Handle, TaskIds) when is_list(TaskIds) ->
+    on_thread(nif_scheduler_killTasks(Handle, [encode_item(TaskId) || TaskId <- TaskIds])).
 
-sendFrameworkMessage(ExecutorId,SlaveId,Data) when    is_record(ExecutorId, 'ExecutorID'),
+reviveOffers(Handle) ->
+    nif_scheduler_reviveOffers(Handle).
+
+sendFrameworkMessage(Handle, ExecutorId,SlaveId,Data) when    is_record(ExecutorId, 'ExecutorID'),
                                                       is_record(SlaveId, 'SlaveID'),
-                                                      is_list(Data)->
-    nif_scheduler_sendFrameworkMessage(mesos_pb:encode_msg(ExecutorId), mesos_pb:encode_msg(SlaveId), Data).
+                                                      (is_list(Data) orelse is_binary(Data))->
+    nif_scheduler_sendFrameworkMessage(Handle, mesos_pb:encode_msg(ExecutorId), mesos_pb:encode_msg(SlaveId), Data).
 
-requestResources(Requests) when is_list(Requests) ->
+requestResources(Handle, Requests) when is_list(Requests) ->
     EncodedRequests = encode_array(Requests, []),
-    nif_scheduler_requestResources(EncodedRequests).
+    nif_scheduler_requestResources(Handle, EncodedRequests).
 
-reconcileTasks(TaskStatuss) when is_list(TaskStatuss)->
+reconcileTasks(Handle, TaskStatuss) when is_list(TaskStatuss)->
     EncodedTaskStatus = encode_array(TaskStatuss, []),
-    nif_scheduler_reconcileTasks(EncodedTaskStatus).
+    nif_scheduler_reconcileTasks(Handle, EncodedTaskStatus).
 
-launchTasks(OfferId, TaskInfos ) when is_record(OfferId, 'OfferID'), 
-                                        is_list(TaskInfos) ->
-    EncodedTaskInfos = encode_array(TaskInfos, []),
-    Filter = #'Filters'{},
-    nif_scheduler_launchTasks(mesos_pb:encode_msg(OfferId), EncodedTaskInfos, mesos_pb:encode_msg(Filter)).
+launchTasks(Handle, OfferId, TaskInfos ) when is_list(TaskInfos) ->
+    launchTasks(Handle, OfferId, TaskInfos, #'Filters'{}).
+
+launchTasks(Handle, OfferId, TaskInfos, Filter ) when is_list(TaskInfos) ->
+    nif_scheduler_launchTasks(Handle, OfferId, TaskInfos, Filter).
+
+destroy(Handle)->
+    on_thread(nif_scheduler_destroy(Handle)).
+
+acknowledgeStatusUpdate(Handle, TaskStatus) when is_record(TaskStatus, 'TaskStatus') ->
+    nif_scheduler_acknowledgeStatusUpdate(Handle, mesos_pb:encode_msg(TaskStatus)).
+
+% Ack is the handle sent with a status update when acknowledgements are explicit
+ack(_Handle, undefined) ->
+    {ok, driver_running};
+ack(Handle, Ack) ->
+    nif_scheduler_ack(Handle, Ack).
+
+% an undefined Ack is answered {ok, driver_running} in its place, as ack/2 does
+ackMany(Handle, Acks) when is_list(Acks) ->
+    on_thread(nif_scheduler_ackMany(Handle, Acks)).
+
+acknowledgeStatusUpdates(Handle, TaskStatuses) when is_list(TaskStatuses) ->
+    on_thread(nif_scheduler_acknowledgeStatusUpdates(Handle, [encode_item(TaskStatus) || TaskStatus <- TaskStatuses])).
+
+setBatchOffers(Handle, Enabled) when is_boolean(Enabled) ->
+    nif_scheduler_setBatchOffers(Handle, bool_to_int(Enabled)).
+
+envStats() ->
+    nif_scheduler_envStats().
+
+% latency histograms of the callbacks and driver calls of every scheduler in the vm
+stats() ->
+    nif_scheduler_stats().
+
+observe(Message, Nanos) when is_atom(Message), is_integer(Nanos), Nanos >= 0 ->
+    nif_scheduler_observe(Message, Nanos).
+
+setMessageFormat(Handle, Type, Format) when is_atom(Type) ->
+    nif_scheduler_setMessageFormat(Handle, Type, format_to_int(Format)).
+
+setCoalesceStatusUpdates(Handle, Enabled) when is_boolean(Enabled) ->
+    nif_scheduler_setCoalesceStatusUpdates(Handle, bool_to_int(Enabled)).
+
+% returns {TaskStatuses, More} with up to Max of the updates held while coalescing
+takeStatusUpdates(Handle, Max) when is_integer(Max), Max > 0 ->
+    nif_scheduler_takeStatusUpdates(Handle, Max).
 
-launchTasks(OfferId, TaskInfos, Filter ) when is_record(OfferId, 'OfferID'), 
-                                              is_list(TaskInfos),
-                                              is_record(Filter, 'Filters') ->
-    EncodedTaskInfos = encode_array(TaskInfos, []),
-    nif_scheduler_launchTasks(mesos_pb:encode_msg(OfferId), EncodedTaskInfos, mesos_pb:encode_msg(Filter)).
+taskState(Handle, TaskId) ->
+    nif_scheduler_taskState(Handle, TaskId).
 
-destroy()->
-    nif_scheduler_destroy().
+taskStats(Handle) ->
+    nif_scheduler_taskStats(Handle).
 
-acknowledgeStatusUpdate(TaskStatus) when is_record(TaskStatus, 'TaskStatus') ->
-    nif_scheduler_acknowledgeStatusUpdate(mesos_pb:encode_msg(TaskStatus)).
+% TaskStatuses are passed as they are, [] asks for implicit reconciliation
+reconcile(Handle, TaskStatuses) when is_list(TaskStatuses) ->
+    on_thread(nif_scheduler_reconcile(Handle, TaskStatuses)).
+
+setReconcileOptions(Handle, Options) when is_list(Options) ->
+    nif_scheduler_setReconcileOptions(Handle, Options).
+
+cancelReconcile(Handle) ->
+    nif_scheduler_cancelReconcile(Handle).
+
+reconcileStats(Handle) ->
+    nif_scheduler_reconcileStats(Handle).
+
+% Options is a proplist of {window, N}, {max_queue, N}, {offers, queue | coalesce | decline},
+% {framework_messages, queue | drop} and {refuse_seconds, Seconds} for the offers declined.
+% The owner starts with window credits and must grant more as it handles messages.
+setFlowControl(Handle, Options) when is_list(Options) ->
+    nif_scheduler_setFlowControl(Handle, Options).
+
+grant(Handle, Credits) when is_integer(Credits), Credits > 0 ->
+    nif_scheduler_grant(Handle, Credits).
+
+flowControlStats(Handle) ->
+    nif_scheduler_flowControlStats(Handle).
+
+% counts kept by the fake driver selected by a fake:// master location,
+% {error, not_fake_driver} for a scheduler connected to mesos
+fakeDriverStats(Handle) ->
+    nif_scheduler_fakeDriverStats(Handle).
+
+% Options is a proplist of {flush_millis, N}, {max_frame, Bytes}, {compress, boolean()}
+% and {compress_min, Bytes}. Framework messages are then sent packed into frames, and
+% frames received are unpacked, so the executors must use the channel too.
+setMessageChannel(Handle, Options) when is_list(Options) ->
+    nif_scheduler_setMessageChannel(Handle, Options).
+
+messageChannelStats(Handle) ->
+    nif_scheduler_messageChannelStats(Handle).
+
+% Workers is a list of pids. Status updates are then sent to one of them by task id,
+% offers, rescinded offers and slaveLost by slave id, and framework messages and
+% executorLost by executor id, always the same pid for the same id. [] sends every
+% callback to the owner again.
+setDispatch(Handle, Workers) when is_list(Workers) ->
+    nif_scheduler_setDispatch(Handle, Workers).
+
+dispatchStats(Handle) ->
+    nif_scheduler_dispatchStats(Handle).
+
+setOfferIndex(Handle, Enabled) when is_boolean(Enabled) ->
+    nif_scheduler_setOfferIndex(Handle, bool_to_int(Enabled)).
+
+% Query is a proplist of {cpus, N}, {mem, N}, {disk, N}, {hostname, Host},
+% distinct_hosts and {limit, N}, offers are returned in their message format
+findOffers(Handle, Query) when is_list(Query) ->
+    nif_scheduler_findOffers(Handle, Query).
+
+% Filter is an #offer_filter{} or undefined to let every offer through
+setOfferFilter(Handle, Filter) when is_record(Filter, offer_filter);
+                                    Filter =:= undefined ->
+    nif_scheduler_setOfferFilter(Handle, Filter).
+
+offerFilterStats(Handle) ->
+    nif_scheduler_offerFilterStats(Handle).
+
+% queues a launchTasks, declineOffer, killTask, acknowledgeStatusUpdate,
+% reconcileTasks or frameworkMessage command tuple for the driver worker thread, returns {ok, Id}
+% once queued. A failed driver call is sent to the caller as {command_failed, Id, Status}.
+cast(Handle, Command) when is_tuple(Command) ->
+    nif_scheduler_cast(Handle, Command).
+
+decode(Bin, Type, Format) when is_binary(Bin), is_atom(Type) ->
+    nif_scheduler_decode(Bin, Type, format_to_int(Format)).
 
 % nif functions
 nif_scheduler_init(_, _, _, _, _)->
     not_loaded(?LINE).
 nif_scheduler_init(_, _, _, _)->
     not_loaded(?LINE).
-nif_scheduler_start() ->
+nif_scheduler_start(_) ->
+    not_loaded(?LINE).
+nif_scheduler_join(_) ->
     not_loaded(?LINE).
-nif_scheduler_join() ->
+nif_scheduler_joinAsync(_) ->
     not_loaded(?LINE).
-nif_scheduler_abort() ->
+nif_scheduler_abort(_) ->
     not_loaded(?LINE).
-nif_scheduler_stop(_) ->
+nif_scheduler_stop(_, _) ->
     not_loaded(?LINE).
-nif_scheduler_acceptOffers(_, _, _)->
+nif_scheduler_acceptOffers(_, _, _, _)->
     not_loaded(?LINE).
-nif_scheduler_declineOffer(_,_)->
+nif_scheduler_declineOffer(_,_,_)->
     not_loaded(?LINE).
-nif_scheduler_killTask(_) ->
+nif_scheduler_killTask(_,_) ->
     not_loaded(?LINE).
-nif_scheduler_reviveOffers() ->
+nif_scheduler_reviveOffers(_) ->
     not_loaded(?LINE).
-nif_scheduler_sendFrameworkMessage(_,_,_) ->
+nif_scheduler_sendFrameworkMessage(_,_,_,_) ->
     not_loaded(?LINE).
-nif_scheduler_requestResources(_) ->
+nif_scheduler_requestResources(_,_) ->
     not_loaded(?LINE).
-nif_scheduler_reconcileTasks(_) ->
+nif_scheduler_reconcileTasks(_,_) ->
     not_loaded(?LINE).
-nif_scheduler_launchTasks(_,_,_) ->
+nif_scheduler_launchTasks(_,_,_,_) ->
     not_loaded(?LINE).
-nif_scheduler_destroy() ->
+nif_scheduler_destroy(_) ->
     not_loaded(?LINE).
-nif_scheduler_acknowledgeStatusUpdate(_) ->
+nif_scheduler_acknowledgeStatusUpdate(_,_) ->
+    not_loaded(?LINE).
+nif_scheduler_setBatchOffers(_,_) ->
+    not_loaded(?LINE).
+nif_scheduler_envStats() ->
+    not_loaded(?LINE).
+nif_scheduler_stats() ->
+    not_loaded(?LINE).
+nif_scheduler_observe(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_setMessageFormat(_, _, _) ->
+    not_loaded(?LINE).
+nif_scheduler_setCoalesceStatusUpdates(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_takeStatusUpdates(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_taskState(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_taskStats(_) ->
+    not_loaded(?LINE).
+nif_scheduler_reconcile(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_setReconcileOptions(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_cancelReconcile(_) ->
+    not_loaded(?LINE).
+nif_scheduler_reconcileStats(_) ->
+    not_loaded(?LINE).
+nif_scheduler_setFlowControl(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_grant(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_flowControlStats(_) ->
+    not_loaded(?LINE).
+nif_scheduler_fakeDriverStats(_) ->
+    not_loaded(?LINE).
+nif_scheduler_setMessageChannel(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_messageChannelStats(_) ->
+    not_loaded(?LINE).
+nif_scheduler_setDispatch(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_dispatchStats(_) ->
+    not_loaded(?LINE).
+nif_scheduler_setOfferIndex(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_findOffers(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_setOfferFilter(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_offerFilterStats(_) ->
+    not_loaded(?LINE).
+nif_scheduler_ack(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_ackMany(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_cast(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_declineOffers(_, _, _) ->
+    not_loaded(?LINE).
+nif_scheduler_killTasks(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_acknowledgeStatusUpdates(_, _) ->
+    not_loaded(?LINE).
+nif_scheduler_decode(_, _, _) ->
     not_loaded(?LINE).
 
 init() ->
@@ -182,6 +410,20 @@ not_loaded(Line) ->
 bool_to_int(true) -> 1;
 bool_to_int(false) -> 0.
 
+format_to_int(binary) -> 0;
+format_to_int(record) -> 1;
+format_to_int(map) -> 2.
+
 encode_array([], Acc) -> Acc;
 encode_array([H|T], Acc) -> 
     encode_array(T, [mesos_pb:encode_msg(H) | Acc]).
+
+encode_item(Bin) when is_binary(Bin) -> Bin;
+encode_item(Record) -> mesos_pb:encode_msg(Record).
+
+% without dirty schedulers the nifs that can block run on a thread of their own
+% and return {nif_thread, Ref}, their result is sent to the caller as {Ref, Result}
+on_thread({nif_thread, Ref}) ->
+    receive {Ref, Result} -> Result end;
+on_thread(Result) ->
+    Result.
@@ -24,15 +24,21 @@
 %api
 -export([
         start/2,
+        start/3,
         start_link/2,
+        start_link/3,
         join/0,
+        joinAsync/0,
         abort/0,
         stop/1,
         acceptOffers/2,
         acceptOffers/3,
         declineOffer/1,
         declineOffer/2,
+        declineOffers/1,
+        declineOffers/2,
         killTask/1,
+        killTasks/1,
         reviveOffers/0,
         sendFrameworkMessage/3,
         requestResources/1,
@@ -40,7 +46,35 @@
         launchTasks/2,
         launchTasks/3,
         destroy/0,
-        acknowledgeStatusUpdate/1]).
+        acknowledgeStatusUpdate/1,
+        acknowledgeStatusUpdates/1,
+        ack/1,
+        ack_many/1,
+        launchTasksAsync/2,
+        launchTasksAsync/3,
+        declineOfferAsync/1,
+        declineOfferAsync/2,
+        killTaskAsync/1,
+        acknowledgeStatusUpdateAsync/1,
+        reconcileTasksAsync/1,
+        broadcastFrameworkMessage/2,
+        envStats/0,
+        flowControlStats/0,
+        fakeDriverStats/0,
+        messageChannelStats/0,
+        dispatchStats/0,
+        stats/0,
+        setOfferFilter/1,
+        offerFilterStats/0,
+        findOffers/1,
+        taskState/1,
+        taskStats/0,
+        reconcile/1,
+        setReconcileOptions/1,
+        cancelReconcile/0,
+        reconcileStats/0,
+        attach/1,
+        detach/0]).
 
 %gen server
 -export([init/1, handle_call/3, handle_info/2, terminate/2, handle_cast/2,
@@ -63,15 +97,23 @@
 
 -callback disconnected( State :: any()) -> {ok, State :: any()}.
 
--callback resourceOffers( Offer :: #'Offer'{}, State :: any()) -> {ok, State :: any()}.
+% called once per offer or, with the batch_offers option, once per offer cycle
+-callback resourceOffers( Offer :: #'Offer'{} | [#'Offer'{}], State :: any()) -> {ok, State :: any()}.
 
 -callback offerRescinded( OfferID :: #'OfferID'{}, State :: any()) -> {ok, State :: any()}.
 
 -callback statusUpdate( TaskStatus :: #'TaskStatus'{},State :: any()) -> {ok, State :: any()}.
 
+% with explicit acknowledgements a handler may export statusUpdate(TaskStatus, Ack, State)
+% instead, and pass Ack to ack/1 or ack_many/1.
+% With the coalesce_status_updates option a handler may also export
+% statusUpdates(TaskStatuses, State) to be given each batch in one call.
+% With the workers option a handler may export init_worker(Index, State) -> {ok, State}
+% to give each worker process its own state, each starts with a copy of State otherwise
+
 -callback frameworkMessage( ExecutorId :: #'ExecutorID'{},
                         SlaveId :: #'SlaveID'{},
-                        Message :: string(),
+                        Message :: binary(),
                         State :: any()) -> {ok, State :: any()}.
 
 -callback slaveLost( SlaveId :: #'SlaveID'{},State :: any()) -> {ok, State :: any()}.
@@ -84,36 +126,105 @@
 
 %% -----------------------------------------------------------------------------------------
 
+-type message_format() :: binary | record | map.
+
+-type scheduler_option() :: {name, atom() | undefined} |
+                            {batch_offers, boolean()} |
+                            {offer_filter, #offer_filter{}} |
+                            {offer_index, boolean()} |
+                            {coalesce_status_updates, boolean()} |
+                            {reconcile, reconcile_options()} |
+                            {flow_control, flow_control_options()} |
+                            {message_channel, message_channel_options()} |
+                            {handler_stats, boolean()} |
+                            {workers, non_neg_integer()} |
+                            {message_formats, [{MessageType :: atom(), message_format()}]}.
+
+-type reconcile_options() :: [{page_size | max_attempts, non_neg_integer()} |
+                              {rate | backoff | max_backoff, number()}].
+
+-type flow_control_options() :: [{window | max_queue, non_neg_integer()} |
+                                 {offers, queue | coalesce | decline} |
+                                 {framework_messages, queue | drop} |
+                                 {refuse_seconds, number()}].
+
+-type message_channel_options() :: [{flush_millis | max_frame | compress_min, non_neg_integer()} |
+                                    {compress, boolean()}].
+
+-export_type([scheduler_option/0, message_format/0, reconcile_options/0, flow_control_options/0,
+              message_channel_options/0]).
+
+%% -----------------------------------------------------------------------------------------
+
 -record(state, {
     handler_module,   %% Handler callback module
     handler_state %% Handler state
 }).
 
+%% the driver a process talks to, kept in the process dictionary of the scheduler
+%% and of any process that has attached to it
+-record(instance, {
+    handle,  %% nif handle
+    name,    %% registered name or undefined
+    pid,     %% scheduler process
+    workers = [] %% processes started by the workers option
+}).
+
+-define(INSTANCE, {?MODULE, instance}).
+
+% {GrantEvery, Used} while flow control is on, see consumed/0
+-define(FLOW, {?MODULE, flow}).
+
+% true when the handler_stats option is set
+-define(HANDLER_STATS, {?MODULE, handler_stats}).
+
+% credits the nif starts with unless the flow_control option says otherwise
+-define(FLOW_WINDOW, 1000).
+
+% coalesced status updates taken from the nif at a time
+-define(STATUS_UPDATE_BATCH, 1000).
+
 %% -----------------------------------------------------------------------------------------
 
 -spec start( Module :: atom(), Args :: term()) ->
     {ok, Server :: pid()} | {error, Reason :: term()}.
 start(Module, Args) ->
-    gen_server:start(?MODULE, {Module, Args}, []).
+    start(Module, Args, []).
+
+-spec start( Module :: atom(), Args :: term(), Options :: [scheduler_option()]) ->
+    {ok, Server :: pid()} | {error, Reason :: term()}.
+start(Module, Args, Options) when is_list(Options) ->
+    gen_server:start(?MODULE, {Module, Args, Options}, []).
 
 %% -----------------------------------------------------------------------------------------
 
 -spec start_link( Module :: atom(), Args :: term()) ->
     {ok, Server :: pid()} | {error, Reason :: term()}.
 start_link(Module, Args ) ->
-    gen_server:start_link(?MODULE, {Module, Args}, []).
+    start_link(Module, Args, []).
+
+-spec start_link( Module :: atom(), Args :: term(), Options :: [scheduler_option()]) ->
+    {ok, Server :: pid()} | {error, Reason :: term()}.
+start_link(Module, Args, Options) when is_list(Options) ->
+    gen_server:start_link(?MODULE, {Module, Args, Options}, []).
 
 %% -----------------------------------------------------------------------------------------
 
 -spec join() -> {ok, driver_running } | { error, scheduler_not_inited} | {error, driver_state()}.
 join() ->
-    nif_scheduler:join().
+    nif_scheduler:join(handle()).
+
+% as join/0 but returns at once, the result is sent to the caller as {Ref, Result}
+% when the driver stops
+-spec joinAsync() -> {ok, Ref :: reference()} | {error, scheduler_not_inited} | {error, thread_not_started}.
+joinAsync() ->
+    nif_scheduler:joinAsync(handle()).
 
 %% -----------------------------------------------------------------------------------------
 
 -spec abort() -> {ok, driver_aborted } | { state_error, scheduler_not_inited} | {error, driver_state()}.
 abort() ->
-    nif_scheduler:abort().
+    nif_scheduler:abort(handle()).
 
 %% -----------------------------------------------------------------------------------------
 
@@ -121,23 +232,24 @@ abort() ->
 stop(Failover) when is_integer(Failover), 
                                 Failover > -1, 
                                 Failover < 2 ->
-     nif_scheduler:stop(Failover).
+     nif_scheduler:stop(handle(), Failover).
 
 %% -----------------------------------------------------------------------------------------
 
--spec acceptOffers( OfferIDs :: list(#'OfferID'{}),
-                    Operations :: list(#'Offer.Operation'{})) -> 
+-spec acceptOffers( OfferIDs :: list(#'OfferID'{} | map()),
+                    Operations :: list(#'Offer.Operation'{} | map())) -> 
                       {ok, driver_running } 
                     | {error, scheduler_not_inited} 
                     | {error, {invalid_or_corrupted_parameter, offerid_array}}
                     | {error, {invalid_or_corrupted_parameter, operations_array}}
+                    | {error, {invalid_or_corrupted_parameter, filters}}
                     | {error, driver_state()}.
 acceptOffers(OfferIDs, Operations) ->
-  nif_scheduler:acceptOffers(OfferIDs, Operations).
+  nif_scheduler:acceptOffers(handle(), OfferIDs, Operations).
 
--spec acceptOffers( OfferIDs :: list(#'OfferID'{}),
-                    Operations :: list(#'Offer.Operation'{}),
-                    Filters :: #'Filters'{}) ->  
+-spec acceptOffers( OfferIDs :: list(#'OfferID'{} | map()),
+                    Operations :: list(#'Offer.Operation'{} | map()),
+                    Filters :: #'Filters'{} | map()) ->  
                       {ok, driver_running } 
                     | {error, scheduler_not_inited} 
                     | {error, {invalid_or_corrupted_parameter, offerid_array}}
@@ -145,7 +257,7 @@ acceptOffers(OfferIDs, Operations) ->
                     | {error, {invalid_or_corrupted_parameter, filters}}
                     | {error, driver_state()}.
 acceptOffers(OfferIDs, Operations, Filters) ->
-  nif_scheduler:acceptOffers(OfferIDs, Operations, Filters).
+  nif_scheduler:acceptOffers(handle(), OfferIDs, Operations, Filters).
 
 %% -----------------------------------------------------------------------------------------
 
@@ -156,7 +268,7 @@ acceptOffers(OfferIDs, Operations, Filters) ->
                     | {error, driver_state()}.
 
 declineOffer(OfferId) when is_record(OfferId, 'OfferID') ->
-    nif_scheduler:declineOffer(OfferId).
+    nif_scheduler:declineOffer(handle(), OfferId).
 
 -spec declineOffer( OfferId :: #'OfferID'{},
                     Filter :: #'Filters'{}) ->
@@ -168,7 +280,28 @@ declineOffer(OfferId) when is_record(OfferId, 'OfferID') ->
 
 declineOffer(OfferId,Filter) when is_record(OfferId, 'OfferID'),
                                   is_record(Filter, 'Filters') ->
-    nif_scheduler:declineOffer(OfferId, Filter).                               
+    nif_scheduler:declineOffer(handle(), OfferId, Filter).                               
+
+%% -----------------------------------------------------------------------------------------
+
+% declineOffers/1,2, killTasks/1 and acknowledgeStatusUpdates/1 make one driver call
+% per item in a single nif call and return the status of each, in order. An item
+% may be a binary already encoded with mesos_pb, one that cannot be decoded is
+% answered {error, driver_aborted}.
+
+-type bulk_result() :: [{ok, driver_running} | {error, driver_state()}]
+                     | {error, scheduler_not_inited}
+                     | {error, {invalid_or_corrupted_parameter, atom()}}.
+
+-spec declineOffers( OfferIds :: [ #'OfferID'{} | binary() ]) -> bulk_result().
+declineOffers(OfferIds) when is_list(OfferIds) ->
+    nif_scheduler:declineOffers(handle(), OfferIds).
+
+-spec declineOffers( OfferIds :: [ #'OfferID'{} | binary() ], 
+                     Filter :: #'Filters'{}) -> bulk_result().
+declineOffers(OfferIds, Filter) when is_list(OfferIds),
+                                     is_record(Filter, 'Filters') ->
+    nif_scheduler:declineOffers(handle(), OfferIds, Filter).
 
 %% -----------------------------------------------------------------------------------------
 
@@ -179,20 +312,24 @@ declineOffer(OfferId,Filter) when is_record(OfferId, 'OfferID'),
                     | {error, driver_state()}.
 
 killTask(TaskId) when is_record(TaskId,'TaskID') ->
-    nif_scheduler:killTask(TaskId).
+    nif_scheduler:killTask(handle(), TaskId).
+
+-spec killTasks( TaskIds :: [ #'TaskID'{} | binary() ]) -> bulk_result().
+killTasks(TaskIds) when is_list(TaskIds) ->
+    nif_scheduler:killTasks(handle(), TaskIds).
 
 %% -----------------------------------------------------------------------------------------
 
 -spec reviveOffers() -> {ok, driver_aborted } | { error, scheduler_not_inited} | {error, driver_state()}.
 
 reviveOffers()->
-    nif_scheduler:reviveOffers().
+    nif_scheduler:reviveOffers(handle()).
 
 %% -----------------------------------------------------------------------------------------
 
 -spec sendFrameworkMessage( ExecutorId :: #'ExecutorID'{},
                             SlaveId :: #'SlaveID'{},
-                            Data ::string()) -> 
+                            Data :: iodata()) -> 
                               {ok, driver_running }
                             | {error, scheduler_not_inited} 
                             | {error, {invalid_or_corrupted_parameter, executor_id}}
@@ -202,8 +339,8 @@ reviveOffers()->
 
 sendFrameworkMessage(ExecutorId,SlaveId,Data) when is_record(ExecutorId, 'ExecutorID'),
                                                    is_record(SlaveId, 'SlaveID'),
-                                                   is_list(Data)->
-    nif_scheduler:sendFrameworkMessage(ExecutorId,SlaveId,Data).
+                                                   (is_list(Data) orelse is_binary(Data))->
+    nif_scheduler:sendFrameworkMessage(handle(), ExecutorId,SlaveId,Data).
 
 %% -----------------------------------------------------------------------------------------
 
@@ -214,7 +351,7 @@ sendFrameworkMessage(ExecutorId,SlaveId,Data) when is_record(ExecutorId, 'Execut
                     | {error, driver_state()}.
 
 requestResources(Requests) when is_list(Requests) ->
-    nif_scheduler:requestResources(Requests).
+    nif_scheduler:requestResources(handle(), Requests).
 
 %% -----------------------------------------------------------------------------------------
 
@@ -225,25 +362,25 @@ requestResources(Requests) when is_list(Requests) ->
                     | {error, driver_state()}.
 
 reconcileTasks(TaskStatus)when is_list(TaskStatus)->
-    nif_scheduler:reconcileTasks(TaskStatus).
+    nif_scheduler:reconcileTasks(handle(), TaskStatus).
 
 %% -----------------------------------------------------------------------------------------
 
--spec launchTasks(  OfferId :: #'OfferID'{}, 
-                    TaskInfos :: [ #'TaskInfo'{}]) ->
+-spec launchTasks(  OfferId :: #'OfferID'{} | map(), 
+                    TaskInfos :: [ #'TaskInfo'{} | map()]) ->
                       {ok, driver_running } 
                     | {error, scheduler_not_inited} 
                     | {error, {invalid_or_corrupted_parameter, offer_id}}
                     | {error, {invalid_or_corrupted_parameter, task_info_array}}
+                    | {error, {invalid_or_corrupted_parameter, filters}}
                     | {error, driver_state()}.
 
-launchTasks(OfferId, TaskInfos) when is_record(OfferId, 'OfferID'), 
-                                     is_list(TaskInfos) ->
-    nif_scheduler:launchTasks(OfferId, TaskInfos).
+launchTasks(OfferId, TaskInfos) when is_list(TaskInfos) ->
+    nif_scheduler:launchTasks(handle(), OfferId, TaskInfos).
 
--spec launchTasks(  OfferId :: #'OfferID'{}, 
-                    TaskInfos :: [ #'TaskInfo'{}],
-                    Filter :: #'Filters'{}) ->
+-spec launchTasks(  OfferId :: #'OfferID'{} | map(), 
+                    TaskInfos :: [ #'TaskInfo'{} | map()],
+                    Filter :: #'Filters'{} | map()) ->
                       {ok, driver_running }
                     | {error, scheduler_not_inited} 
                     | {error, {invalid_or_corrupted_parameter, offer_id}}
@@ -251,20 +388,20 @@ launchTasks(OfferId, TaskInfos) when is_record(OfferId, 'OfferID'),
                     | {error, {invalid_or_corrupted_parameter, filters}}
                     | {error, driver_state()}.
 
-launchTasks(OfferId, TaskInfos, Filter) when is_record(OfferId, 'OfferID'), 
-                                             is_list(TaskInfos),
-                                             is_record(Filter, 'Filters') ->
-    nif_scheduler:launchTasks(OfferId, TaskInfos, Filter).
+launchTasks(OfferId, TaskInfos, Filter) when is_list(TaskInfos) ->
+    nif_scheduler:launchTasks(handle(), OfferId, TaskInfos, Filter).
 
 %% -----------------------------------------------------------------------------------------
 
 -spec destroy() -> ok | {error, scheduler_not_inited}.
 destroy() ->
-    Response = nif_scheduler:destroy(),
+    #instance{handle = Handle, name = Name, pid = Pid, workers = Workers} = instance(),
+    Response = nif_scheduler:destroy(Handle),
+    ok = mesos_workers:stop(Workers),
 
-    case whereis(?MODULE) of
-        undefined  -> ok;
-        _ -> unregister(?MODULE)
+    case Name =/= undefined andalso whereis(Name) of
+        Pid when is_pid(Pid) -> unregister(Name);
+        _ -> ok
     end,
 
     Response.
@@ -277,7 +414,231 @@ destroy() ->
                                 | {error, {invalid_or_corrupted_parameter, task_status}}
                                 | {error, driver_state()}. 
 acknowledgeStatusUpdate( TaskStatus ) when is_record(TaskStatus, 'TaskStatus') ->
-    nif_scheduler:acknowledgeStatusUpdate(TaskStatus).
+    nif_scheduler:acknowledgeStatusUpdate(handle(), TaskStatus).
+
+% acknowledges the update an ack handle was sent with, without the TaskStatus
+% being encoded again. The handle of an update that needs no acknowledgement
+% is undefined.
+-spec ack(Ack :: reference() | undefined) ->
+                                 {ok, driver_running }
+                                | {error, scheduler_not_inited} 
+                                | {error, {invalid_or_corrupted_parameter, ack}}
+                                | {error, driver_state()}. 
+ack(Ack) ->
+    nif_scheduler:ack(handle(), Ack).
+
+-spec ack_many(Acks :: [reference() | undefined]) -> bulk_result().
+ack_many(Acks) when is_list(Acks) ->
+    nif_scheduler:ackMany(handle(), Acks).
+
+-spec acknowledgeStatusUpdates(TaskStatuses :: [ #'TaskStatus'{} | binary() ]) -> bulk_result().
+acknowledgeStatusUpdates(TaskStatuses) when is_list(TaskStatuses) ->
+    nif_scheduler:acknowledgeStatusUpdates(handle(), TaskStatuses).
+
+%% -----------------------------------------------------------------------------------------
+
+% The *Async calls queue the command for a driver worker thread and return
+% {ok, Id} without waiting for libmesos. Queued declines of offers from the
+% same slave are sent to the master together. If the driver call fails the
+% calling process is sent {command_failed, Id, driver_state()}.
+
+-type async_result() :: {ok, Id :: pos_integer()}
+                      | {error, scheduler_not_inited}
+                      | {error, queue_full}
+                      | {error, thread_not_started}
+                      | {error, {invalid_or_corrupted_parameter, atom()}}.
+
+-spec launchTasksAsync(OfferId :: #'OfferID'{} | map(), 
+                       TaskInfos :: [ #'TaskInfo'{} | map()]) -> async_result().
+launchTasksAsync(OfferId, TaskInfos) ->
+    launchTasksAsync(OfferId, TaskInfos, #'Filters'{}).
+
+-spec launchTasksAsync(OfferId :: #'OfferID'{} | map(), 
+                       TaskInfos :: [ #'TaskInfo'{} | map()],
+                       Filter :: #'Filters'{} | map()) -> async_result().
+launchTasksAsync(OfferId, TaskInfos, Filter) when is_list(TaskInfos) ->
+    nif_scheduler:cast(handle(), {launchTasks, OfferId, TaskInfos, Filter}).
+
+-spec declineOfferAsync(OfferId :: #'OfferID'{} | map()) -> async_result().
+declineOfferAsync(OfferId) ->
+    declineOfferAsync(OfferId, #'Filters'{}).
+
+-spec declineOfferAsync(OfferId :: #'OfferID'{} | map(), 
+                        Filter :: #'Filters'{} | map()) -> async_result().
+declineOfferAsync(OfferId, Filter) ->
+    nif_scheduler:cast(handle(), {declineOffer, OfferId, Filter}).
+
+-spec killTaskAsync(TaskId :: #'TaskID'{} | map()) -> async_result().
+killTaskAsync(TaskId) ->
+    nif_scheduler:cast(handle(), {killTask, TaskId}).
+
+-spec acknowledgeStatusUpdateAsync(TaskStatus :: #'TaskStatus'{} | map()) -> async_result().
+acknowledgeStatusUpdateAsync(TaskStatus) ->
+    nif_scheduler:cast(handle(), {acknowledgeStatusUpdate, TaskStatus}).
+
+-spec reconcileTasksAsync(TaskStatus :: [ #'TaskStatus'{} | map()]) -> async_result().
+reconcileTasksAsync(TaskStatus) when is_list(TaskStatus) ->
+    nif_scheduler:cast(handle(), {reconcileTasks, TaskStatus}).
+
+% sends Data to each executor in Targets, or with all to every executor the nif
+% knows to be running: those named by launched tasks, status updates or framework
+% messages, and not since lost. Data is copied once and the driver calls are made
+% by the worker thread, a failure of any is reported once for the whole broadcast.
+-spec broadcastFrameworkMessage(Targets :: all | [{#'ExecutorID'{} | map(), #'SlaveID'{} | map()}],
+                                Data :: iodata()) -> async_result().
+broadcastFrameworkMessage(Targets, Data) when Targets =:= all; is_list(Targets) ->
+    nif_scheduler:cast(handle(), {frameworkMessage, Targets, Data}).
+
+%% -----------------------------------------------------------------------------------------
+
+% offers failing Filter are declined in the nif with Filter's refuse_seconds,
+% undefined lets every offer through again
+-spec setOfferFilter(Filter :: #offer_filter{} | undefined) -> 
+                      ok 
+                    | {error, scheduler_not_inited}
+                    | {error, {invalid_or_corrupted_parameter, offer_filter}}.
+setOfferFilter(Filter) ->
+    nif_scheduler:setOfferFilter(handle(), Filter).
+
+-spec offerFilterStats() -> [{passed | declined | declined_cpus | declined_mem | declined_disk | declined_attributes, 
+                              non_neg_integer()}] | {error, scheduler_not_inited}.
+offerFilterStats() ->
+    nif_scheduler:offerFilterStats(handle()).
+
+%% -----------------------------------------------------------------------------------------
+
+% searches the offers held by the framework, smallest first, when the scheduler
+% was started with {offer_index, true}. Offers used, declined or rescinded are
+% no longer found.
+-type offer_query() :: [{cpus | mem | disk, number()} |
+                        {hostname, string() | binary()} |
+                        {limit, non_neg_integer()} |
+                        distinct_hosts].
+
+-spec findOffers(Query :: offer_query()) -> 
+                      {ok, [#'Offer'{} | map()]}
+                    | {error, scheduler_not_inited}
+                    | {error, {invalid_or_corrupted_parameter, query}}.
+findOffers(Query) when is_list(Query) ->
+    case nif_scheduler:findOffers(handle(), Query) of
+        {ok, Offers} -> {ok, [decode(Offer, 'Offer') || Offer <- Offers]};
+        Error -> Error
+    end.
+
+%% -----------------------------------------------------------------------------------------
+
+% the latest state the scheduler has seen for a task
+-spec taskState(TaskId :: #'TaskID'{} | map()) ->
+                      {ok, {State :: atom(), Timestamp :: float(), SlaveId :: string(), Healthy :: boolean() | undefined}}
+                    | {error, not_found}
+                    | {error, scheduler_not_inited}
+                    | {error, {invalid_or_corrupted_parameter, task_id}}.
+taskState(TaskId) ->
+    nif_scheduler:taskState(handle(), TaskId).
+
+-spec taskStats() -> [{tasks | held | delivered | duplicates | superseded, non_neg_integer()}] 
+                   | {error, scheduler_not_inited}.
+taskStats() ->
+    nif_scheduler:taskStats(handle()).
+
+%% -----------------------------------------------------------------------------------------
+
+% reconciles TaskStatuses in the background, sending them to the master in pages
+% at the rate set by setReconcileOptions/1 and again, with exponential backoff,
+% until a status update arrives for each task. [] asks for implicit reconciliation.
+-spec reconcile(TaskStatuses :: [#'TaskStatus'{} | map()]) ->
+                      ok
+                    | {error, scheduler_not_inited}
+                    | {error, thread_not_started}
+                    | {error, {invalid_or_corrupted_parameter, task_status_array}}.
+reconcile(TaskStatuses) when is_list(TaskStatuses) ->
+    nif_scheduler:reconcile(handle(), TaskStatuses).
+
+% page_size tasks per reconcileTasks call (1000), rate pages a second (1),
+% backoff seconds before a task is first sent again (10), max_backoff seconds
+% it doubles up to (600) and max_attempts before a task is given up on (0, never)
+-spec setReconcileOptions(Options :: reconcile_options()) ->
+                      ok
+                    | {error, scheduler_not_inited}
+                    | {error, {invalid_or_corrupted_parameter, options}}.
+setReconcileOptions(Options) when is_list(Options) ->
+    nif_scheduler:setReconcileOptions(handle(), Options).
+
+-spec cancelReconcile() -> ok | {error, scheduler_not_inited}.
+cancelReconcile() ->
+    nif_scheduler:cancelReconcile(handle()).
+
+-spec reconcileStats() -> [{outstanding | pages | sent | retried | confirmed | abandoned | implicit, 
+                            non_neg_integer()}] | {error, scheduler_not_inited}.
+reconcileStats() ->
+    nif_scheduler:reconcileStats(handle()).
+
+%% -----------------------------------------------------------------------------------------
+
+% memory held by the environments used to deliver callback messages
+-spec envStats() -> [{envs | envs_allocated | messages | bytes | peak_bytes, non_neg_integer()}].
+envStats() ->
+    nif_scheduler:envStats().
+
+% messages held back by the flow_control option
+-spec flowControlStats() -> [{enabled, boolean()} |
+                             {window | credits | depth | high_water | queued | overflowed | 
+                              dropped | declined | coalesced, non_neg_integer()}]
+                          | {error, scheduler_not_inited}.
+flowControlStats() ->
+    nif_scheduler:flowControlStats(handle()).
+
+% what the fake driver selected by a fake:// master location has sent and been asked to do
+-spec fakeDriverStats() -> [{offered | outstanding | launched | accepted | declined | invalid_offers |
+                             killed | acknowledged | reconciled | revived | requests |
+                             status_updates | messages_sent | messages_received, non_neg_integer()}]
+                         | {error, scheduler_not_inited | not_fake_driver}.
+fakeDriverStats() ->
+    nif_scheduler:fakeDriverStats(handle()).
+
+% frames sent to each executor by the message_channel option, keyed by
+% {ExecutorIdValue, SlaveIdValue}, and frames received
+-spec messageChannelStats() -> [{enabled, boolean()} |
+                                {frames_received | messages_unpacked | corrupt_frames, non_neg_integer()} |
+                                {destinations, [{{binary(), binary()},
+                                                 [{messages | frames | bytes | wire_bytes |
+                                                   size_flushes | failed | pending, non_neg_integer()}]}]}]
+                             | {error, scheduler_not_inited}.
+messageChannelStats() ->
+    nif_scheduler:messageChannelStats(handle()).
+
+% callbacks sent to each process started by the workers option
+-spec dispatchStats() -> [{workers, non_neg_integer()} | {routed, [non_neg_integer()]}]
+                       | {error, scheduler_not_inited}.
+dispatchStats() ->
+    nif_scheduler:dispatchStats(handle()).
+
+% latency of each callback and driver call made by schedulers in the vm, and with the
+% handler_stats option of each message handled, in microseconds. Bytes
+% are those encoded into callback messages or passed to the driver.
+-spec stats() -> [{Name :: atom(), [{count | bytes | mean | max | p50 | p90 | p99 | p999, non_neg_integer()}]}].
+stats() ->
+    nif_scheduler:stats().
+
+%% -----------------------------------------------------------------------------------------
+
+% the functions in this module act on the scheduler started by the calling process,
+% or on the one registered as 'scheduler'. attach/1 points them at another scheduler
+% until detach/0 is called.
+-spec attach(Server :: pid() | atom()) -> ok | {error, scheduler_not_inited}.
+attach(Server) ->
+    case server_instance(Server) of
+        #instance{handle = undefined} -> {error, scheduler_not_inited};
+        Instance -> 
+            put(?INSTANCE, Instance),
+            ok
+    end.
+
+% undoes attach/1
+-spec detach() -> ok.
+detach() ->
+    erase(?INSTANCE),
+    ok.
 
 %% -----------------------------------------------------------------------------------------
 %% -----------------------------------------------------------------------------------------
@@ -286,49 +647,33 @@ acknowledgeStatusUpdate( TaskStatus ) when is_record(TaskStatus, 'TaskStatus') -
 %% -----------------------------------------------------------------------------------------
 %% -----------------------------------------------------------------------------------------
 %% -----------------------------------------------------------------------------------------
-init({Module, Args}) ->
+init({Module, Args, Options}) ->
     
-     case whereis(?MODULE) of
+     Name = proplists:get_value(name, Options, ?MODULE),
+     % so that a worker that fails stops the driver in terminate/2
+     process_flag(trap_exit, true),
+
+     case whereis_name(Name) of
         undefined ->
-            register(?MODULE, self()),
+            register_name(Name),
             case Module:init(Args) of
              {FrameworkInfo, MasterLocation, ImplicitAcknowledgements, State} when is_record(FrameworkInfo, 'FrameworkInfo'), 
                                                                                 is_list(MasterLocation),
                                                                                 is_boolean(ImplicitAcknowledgements) ->
                                                  
-                    ok = nif_scheduler:init(self(), FrameworkInfo, MasterLocation, ImplicitAcknowledgements), 
-                    {ok,driver_running} = nif_scheduler:start(),                                    
-                    {ok, #state{
-                                handler_module = Module,
-                                handler_state = State
-                            }};
+                    init_result(start_driver(nif_scheduler:init(self(), FrameworkInfo, MasterLocation, ImplicitAcknowledgements), Name, Options, Module, State), Module, State);
              {FrameworkInfo, MasterLocation, State} when is_record(FrameworkInfo, 'FrameworkInfo'), 
                                                          is_list(MasterLocation) ->
-                    ok = nif_scheduler:init(self(), FrameworkInfo, MasterLocation, true), 
-                    {ok,driver_running} = nif_scheduler:start(),                                    
-                    {ok, #state{
-                                handler_module = Module,
-                                handler_state = State
-                            }};
+                    init_result(start_driver(nif_scheduler:init(self(), FrameworkInfo, MasterLocation, true), Name, Options, Module, State), Module, State);
              {FrameworkInfo, MasterLocation, ImplicitAcknowledgements, Credential, State} when is_record(FrameworkInfo, 'FrameworkInfo'), 
                                                                 is_list(MasterLocation),
                                                                 is_boolean(ImplicitAcknowledgements),
                                                                 is_record(Credential, 'Credential') ->
-                    ok = nif_scheduler:init(self(), FrameworkInfo, MasterLocation, ImplicitAcknowledgements, Credential),
-                    {ok,driver_running} = nif_scheduler:start(),  
-                    {ok, #state{
-                                handler_module = Module,
-                                handler_state = State
-                            }};
+                    init_result(start_driver(nif_scheduler:init(self(), FrameworkInfo, MasterLocation, ImplicitAcknowledgements, Credential), Name, Options, Module, State), Module, State);
              {FrameworkInfo, MasterLocation, Credential, State} when is_record(FrameworkInfo, 'FrameworkInfo'), 
                                                                 is_record(Credential, 'Credential'),
                                                                 is_list(MasterLocation) ->
-                    ok = nif_scheduler:init(self(), FrameworkInfo, MasterLocation, true, Credential),
-                    {ok,driver_running} = nif_scheduler:start(),  
-                    {ok, #state{
-                                handler_module = Module,
-                                handler_state = State
-                            }};
+                    init_result(start_driver(nif_scheduler:init(self(), FrameworkInfo, MasterLocation, true, Credential), Name, Options, Module, State), Module, State);
              Else ->  
                 Error = {bad_return_value, Else},   
                 {stop, Error}                                           
@@ -337,67 +682,108 @@ init({Module, Args}) ->
             {stop, {already_started,Pid}} 
     end.
 
+handle_call(instance, _From, State) ->
+    {reply, get(?INSTANCE), State};
+
 handle_call(_Request, _From, State) ->
     {reply, ok, State}.
 
 handle_cast(_Msg, State) ->
   {noreply, State}.
 
-handle_info({registered , FrameworkIdBin, MasterInfoBin }, #state{ handler_module = Module, handler_state = HandlerState }) ->
+% an *Async call made from a callback failed in the driver, these are sent
+% outside flow control
+handle_info({command_failed, Id, Status}, State) ->
+    error_logger:warning_msg("scheduler command ~p failed: ~p~n", [Id, Status]),
+    {noreply, State};
+
+% a worker, or any other process linked to the scheduler, that fails stops the
+% scheduler and with it the driver, as the link did before exits were trapped
+handle_info({'EXIT', _, normal}, State) ->
+    {noreply, State};
+handle_info({'EXIT', _, Reason}, State) ->
+    {stop, Reason, State};
+
+handle_info(Info, State) ->
+    Started = started(),
+    Reply = handle_message(Info, State),
+    ok = handled(Info, Started),
+    ok = consumed(),
+    Reply.
+
+handle_message({registered , FrameworkIdBin, MasterInfoBin }, #state{ handler_module = Module, handler_state = HandlerState }) ->
     
-    FrameworkId = mesos_pb:decode_msg(FrameworkIdBin, 'FrameworkID'),
-    MasterInfo = mesos_pb:decode_msg(MasterInfoBin, 'MasterInfo'),
-    MasterInfo2 = MasterInfo#'MasterInfo'{ip = int_to_ip(MasterInfo#'MasterInfo'.ip)},
+    FrameworkId = decode(FrameworkIdBin, 'FrameworkID'),
+    MasterInfo = decode(MasterInfoBin, 'MasterInfo'),
+    MasterInfo2 = master_info_ip(MasterInfo),
 
     {ok, State1} = Module:registered(FrameworkId, MasterInfo2, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({resourceOffers, OfferBin}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+handle_message({resourceOffers, OfferBins}, #state{ handler_module = Module, handler_state = HandlerState }) when is_list(OfferBins) ->
+
+    Offers = [decode(OfferBin, 'Offer') || OfferBin <- OfferBins],
+    {ok, State1} = Module:resourceOffers(Offers, HandlerState),
+    {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-    Offer = mesos_pb:decode_msg(OfferBin, 'Offer'),
+handle_message({resourceOffers, OfferBin}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+
+    Offer = decode(OfferBin, 'Offer'),
     {ok, State1} = Module:resourceOffers(Offer, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({reregistered, MasterInfoBin}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+handle_message({reregistered, MasterInfoBin}, #state{ handler_module = Module, handler_state = HandlerState }) ->
 
-    MasterInfo = mesos_pb:decode_msg(MasterInfoBin, 'MasterInfo'),
-    MasterInfo2 = MasterInfo#'MasterInfo'{ip = int_to_ip(MasterInfo#'MasterInfo'.ip)},
+    MasterInfo = decode(MasterInfoBin, 'MasterInfo'),
+    MasterInfo2 = master_info_ip(MasterInfo),
     {ok, State1} = Module:reregistered(MasterInfo2, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({disconnected}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+handle_message({disconnected}, #state{ handler_module = Module, handler_state = HandlerState }) ->
 
     {ok, State1} = Module:disconnected(HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({offerRescinded, OfferIdBin}, #state{ handler_module = Module, handler_state = HandlerState }) ->
-    OfferId = mesos_pb:decode_msg(OfferIdBin, 'OfferID'),
+handle_message({offerRescinded, OfferIdBin}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+    OfferId = decode(OfferIdBin, 'OfferID'),
     {ok, State1} = Module:offerRescinded(OfferId, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({statusUpdate, TaskStatusBin}, #state{ handler_module = Module, handler_state = HandlerState }) ->
-    TaskStatus = mesos_pb:decode_msg(TaskStatusBin, 'TaskStatus'),
+handle_message({statusUpdate, TaskStatusBin}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+    TaskStatus = decode(TaskStatusBin, 'TaskStatus'),
     {ok, State1} = Module:statusUpdate(TaskStatus, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({frameworkMessage, ExecutorIdBin, SlaveIdBin, Message}, #state{ handler_module = Module, handler_state = HandlerState }) ->
-    ExecutorId = mesos_pb:decode_msg(ExecutorIdBin, 'ExecutorID'),
-    SlaveId = mesos_pb:decode_msg(SlaveIdBin, 'SlaveID'),
+handle_message({statusUpdate, TaskStatusBin, Ack}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+    TaskStatus = decode(TaskStatusBin, 'TaskStatus'),
+    {ok, State1} = case erlang:function_exported(Module, statusUpdate, 3) of
+        true -> Module:statusUpdate(TaskStatus, Ack, HandlerState);
+        false -> Module:statusUpdate(TaskStatus, HandlerState)
+    end,
+    {noreply, #state{ handler_module = Module, handler_state = State1 }};
+
+handle_message({statusUpdatesPending}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+    State1 = take_status_updates(handle(), Module, HandlerState),
+    {noreply, #state{ handler_module = Module, handler_state = State1 }};
+
+handle_message({frameworkMessage, ExecutorIdBin, SlaveIdBin, Message}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+    ExecutorId = decode(ExecutorIdBin, 'ExecutorID'),
+    SlaveId = decode(SlaveIdBin, 'SlaveID'),
     {ok, State1} = Module:frameworkMessage(ExecutorId, SlaveId, Message, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({slaveLost, SlaveIdBin}, #state{ handler_module = Module, handler_state = HandlerState }) ->
-    SlaveId = mesos_pb:decode_msg(SlaveIdBin, 'SlaveID'),
+handle_message({slaveLost, SlaveIdBin}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+    SlaveId = decode(SlaveIdBin, 'SlaveID'),
     {ok, State1} = Module:slaveLost(SlaveId, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({executorLost, ExecutorIdBin, SlaveIdBin, Status}, #state{ handler_module = Module, handler_state = HandlerState }) ->
-    ExecutorId = mesos_pb:decode_msg(ExecutorIdBin, 'ExecutorID'),
-    SlaveId = mesos_pb:decode_msg(SlaveIdBin, 'SlaveID'),
+handle_message({executorLost, ExecutorIdBin, SlaveIdBin, Status}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+    ExecutorId = decode(ExecutorIdBin, 'ExecutorID'),
+    SlaveId = decode(SlaveIdBin, 'SlaveID'),
     {ok, State1} = Module:executorLost(ExecutorId, SlaveId, Status, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }};
 
-handle_info({error, Message}, #state{ handler_module = Module, handler_state = HandlerState }) ->
+handle_message({error, Message}, #state{ handler_module = Module, handler_state = HandlerState }) ->
     {ok, State1} = Module:error(Message, HandlerState),
     {noreply, #state{ handler_module = Module, handler_state = State1 }}.
 
@@ -409,6 +795,165 @@ code_change(_, State, _) ->
   {ok, State}.
 
 % helpers
+init_result({ok, driver_running}, Module, State) ->
+    {ok, #state{
+                handler_module = Module,
+                handler_state = State
+            }};
+init_result({error, Reason}, _, _) ->
+    {stop, Reason}.
+
+% an option the nif refuses stops init, with the driver destroyed
+start_driver({ok, Handle}, Name, Options, Module, State) ->
+    put(?INSTANCE, #instance{handle = Handle, name = Name, pid = self()}),
+    case apply_options(Handle, Options) of
+        ok ->
+            ok = start_workers(Handle, proplists:get_value(workers, Options, 0), Module, State),
+            nif_scheduler:start(Handle);
+        Error ->
+            nif_scheduler:destroy(Handle),
+            Error
+    end;
+start_driver(Error, _, _, _, _) ->
+    Error.
+
+% the workers option starts Count processes, linked to the scheduler, that handle
+% the callbacks the nif routes to them by task, slave or executor id, so those for
+% one id are handled in order and those for different ids in parallel. Callbacks
+% without an id, and coalesced status updates, are still handled by the scheduler.
+start_workers(_, 0, _, _) ->
+    ok;
+start_workers(Handle, Count, Module, State) ->
+    Workers = mesos_workers:start(Count, ?FLOW, [?INSTANCE, ?HANDLER_STATS],
+                                  fun(Index) -> init_worker(Index, Module, State) end,
+                                  fun handle_info/2),
+    put(?INSTANCE, (get(?INSTANCE))#instance{workers = Workers}),
+    nif_scheduler:setDispatch(Handle, Workers).
+
+init_worker(Index, Module, State) ->
+    {ok, State1} = case erlang:function_exported(Module, init_worker, 2) of
+        true -> Module:init_worker(Index, State);
+        false -> {ok, State}
+    end,
+    #state{handler_module = Module, handler_state = State1}.
+
+apply_options(_, []) -> ok;
+apply_options(Handle, [{name, _} | Rest]) ->
+    apply_options(Handle, Rest);
+apply_options(Handle, [{batch_offers, Enabled} = Option | Rest]) when is_boolean(Enabled) ->
+    apply_option(nif_scheduler:setBatchOffers(Handle, Enabled), Handle, Option, Rest);
+apply_options(Handle, [{coalesce_status_updates, Enabled} = Option | Rest]) when is_boolean(Enabled) ->
+    apply_option(nif_scheduler:setCoalesceStatusUpdates(Handle, Enabled), Handle, Option, Rest);
+apply_options(Handle, [{offer_index, Enabled} = Option | Rest]) when is_boolean(Enabled) ->
+    apply_option(nif_scheduler:setOfferIndex(Handle, Enabled), Handle, Option, Rest);
+apply_options(Handle, [{reconcile, ReconcileOptions} = Option | Rest]) when is_list(ReconcileOptions) ->
+    apply_option(nif_scheduler:setReconcileOptions(Handle, ReconcileOptions), Handle, Option, Rest);
+apply_options(Handle, [{offer_filter, Filter} = Option | Rest]) when is_record(Filter, offer_filter);
+                                                                   Filter =:= undefined ->
+    apply_option(nif_scheduler:setOfferFilter(Handle, Filter), Handle, Option, Rest);
+apply_options(Handle, [{handler_stats, Enabled} | Rest]) when is_boolean(Enabled) ->
+    put(?HANDLER_STATS, Enabled),
+    apply_options(Handle, Rest);
+apply_options(Handle, [{workers, Count} | Rest]) when is_integer(Count), Count >= 0 ->
+    % started by start_driver once the options are applied
+    apply_options(Handle, Rest);
+apply_options(Handle, [{flow_control, FlowOptions} = Option | Rest]) when is_list(FlowOptions) ->
+    Window = proplists:get_value(window, FlowOptions, ?FLOW_WINDOW),
+    put(?FLOW, {max(1, Window div 2), 0}),
+    apply_option(nif_scheduler:setFlowControl(Handle, FlowOptions), Handle, Option, Rest);
+apply_options(Handle, [{message_channel, ChannelOptions} = Option | Rest]) when is_list(ChannelOptions) ->
+    apply_option(nif_scheduler:setMessageChannel(Handle, ChannelOptions), Handle, Option, Rest);
+apply_options(Handle, [{message_formats, Formats} = Option | Rest]) when is_list(Formats) ->
+    apply_option(set_message_formats(Handle, Formats), Handle, Option, Rest);
+apply_options(_, [Option | _]) ->
+    {error, {invalid_option, Option}}.
+
+% an option whose value the nif refuses is as invalid as an unknown one
+apply_option(ok, Handle, _, Rest) ->
+    apply_options(Handle, Rest);
+apply_option(_, _, Option, _) ->
+    {error, {invalid_option, Option}}.
+
+set_message_formats(_, []) ->
+    ok;
+set_message_formats(Handle, [{Type, Format} | Rest]) when is_atom(Type) ->
+    case lists:member(Format, [binary, record, map]) andalso nif_scheduler:setMessageFormat(Handle, Type, Format) of
+        ok -> set_message_formats(Handle, Rest);
+        _ -> error
+    end;
+set_message_formats(_, _) ->
+    error.
+
+% with the handler_stats option the time taken by each message is recorded in the nif
+started() ->
+    case get(?HANDLER_STATS) of
+        true -> os:timestamp();
+        _ -> undefined
+    end.
+
+handled(_, undefined) ->
+    ok;
+handled(Info, Started) ->
+    nif_scheduler:observe(element(1, Info), timer:now_diff(os:timestamp(), Started) * 1000).
+
+% each callback message uses a credit with flow control, see mesos_workers:consumed/2
+consumed() ->
+    mesos_workers:consumed(?FLOW, fun(Credits) -> nif_scheduler:grant(handle(), Credits) end).
+
+whereis_name(undefined) -> undefined;
+whereis_name(Name) -> whereis(Name).
+
+register_name(undefined) -> true;
+register_name(Name) -> register(Name, self()).
+
+handle() ->
+    #instance{handle = Handle} = instance(),
+    Handle.
+
+% delivers the coalesced status updates a batch at a time
+take_status_updates(Handle, Module, HandlerState) ->
+    {TaskStatusBins, More} = nif_scheduler:takeStatusUpdates(Handle, ?STATUS_UPDATE_BATCH),
+    TaskStatuses = [decode(TaskStatusBin, 'TaskStatus') || TaskStatusBin <- TaskStatusBins],
+
+    {ok, State1} = case erlang:function_exported(Module, statusUpdates, 2) of
+        true -> 
+            Module:statusUpdates(TaskStatuses, HandlerState);
+        false -> 
+            lists:foldl(fun(TaskStatus, {ok, State}) -> Module:statusUpdate(TaskStatus, State) end, 
+                        {ok, HandlerState}, TaskStatuses)
+    end,
+
+    case More of
+        true -> take_status_updates(Handle, Module, State1);
+        false -> State1
+    end.
+
+instance() ->
+    case get(?INSTANCE) of
+        undefined -> server_instance(?MODULE);
+        Instance -> Instance
+    end.
+
+% an instance without a handle makes the nif return scheduler_not_inited
+server_instance(Server) ->
+    try gen_server:call(Server, instance) of
+        #instance{} = Instance -> Instance;
+        _ -> #instance{}
+    catch
+        exit:_ -> #instance{}
+    end.
+
+% messages arrive as binaries unless a native format has been set for the type
+decode(Bin, Type) when is_binary(Bin) ->
+    mesos_pb:decode_msg(Bin, Type);
+decode(Msg, _Type) ->
+    Msg.
+
+master_info_ip(#'MasterInfo'{ip = Ip} = MasterInfo) ->
+    MasterInfo#'MasterInfo'{ip = int_to_ip(Ip)};
+master_info_ip(#{ip := Ip} = MasterInfo) ->
+    MasterInfo#{ip := int_to_ip(Ip)}.
+
 int_to_ip(Ip)-> {Ip bsr 24, (Ip band 16711680) bsr 16, (Ip band 65280) bsr 8, Ip band 255}.
 
 do_terminate() -> 
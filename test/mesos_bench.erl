@@ -0,0 +1,129 @@
+-module (mesos_bench).
+-include ("mesos_pb.hrl").
+
+-export ([run/0, run/1]).
+
+% times the erlang side of the serialization paths: encoding and decoding with
+% mesos_pb, decoding in the nif, and lists of messages passed to the nif through
+% the fake driver, which are parsed a slice at a time into a batch (requests) or
+% inspected into an array and parsed one at a time with deserialize<T> in
+% utils.hpp (declines).
+% bench/pb_bench times the c++ side alone.
+%
+% Results are printed as csv, in the same columns as pb_bench, so runs at two
+% commits can be compared. allocs_per_item is left empty.
+%
+%   name,items,bytes,iterations,ns_per_item,allocs_per_item
+
+run() ->
+    run(500).
+
+% each case is run with doubling iteration counts until it takes MinMillis
+run(MinMillis) when is_integer(MinMillis), MinMillis > 0 ->
+    io:format("name,items,bytes,iterations,ns_per_item,allocs_per_item~n"),
+
+    Messages = [{offer_50_resources, offer(50), 'Offer'},
+                {task_info_1k_data, task_info(1024), 'TaskInfo'},
+                {task_info_1m_data, task_info(1024 * 1024), 'TaskInfo'},
+                {task_status, task_status(), 'TaskStatus'}],
+
+    [bench_messages(Name, Message, Type, MinMillis) || {Name, Message, Type} <- Messages],
+    [bench_batches(Name, Message, Batch, MinMillis) || {Name, Message, _} <- Messages,
+                                                        Name =/= task_info_1m_data,
+                                                        Batch <- [1, 10, 100, 1000, 10000]],
+    bench_driver(MinMillis).
+
+bench_messages(Name, Message, Type, MinMillis) ->
+    Bin = mesos_pb:encode_msg(Message),
+    Bytes = byte_size(Bin),
+    bench("gpb_encode_", Name, 1, Bytes, fun() -> mesos_pb:encode_msg(Message) end, MinMillis),
+    bench("gpb_decode_", Name, 1, Bytes, fun() -> mesos_pb:decode_msg(Bin, Type) end, MinMillis),
+    bench("nif_decode_", Name, 1, Bytes, fun() -> {ok, _} = nif_scheduler:decode(Bin, Type, record) end, MinMillis).
+
+% as nif_scheduler:encode_array/2 does for requestResources and reconcileTasks
+bench_batches(Name, Message, Count, MinMillis) ->
+    Batch = lists:duplicate(Count, Message),
+    Bytes = byte_size(mesos_pb:encode_msg(Message)) * Count,
+    bench("gpb_encode_array_", Name, Count, Bytes, fun() -> [mesos_pb:encode_msg(M) || M <- Batch] end, MinMillis).
+
+% the whole call, from records to the driver, for lists that need no reply
+bench_driver(MinMillis) ->
+    FrameworkInfo = #'FrameworkInfo'{user = "", name = "mesos_bench"},
+    {ok, Handle} = nif_scheduler:init(self(), FrameworkInfo, "fake://?offer_rate=0", true),
+    {ok, driver_running} = nif_scheduler:start(Handle),
+
+    Request = #'Request'{slave_id = #'SlaveID'{value = "slave-1"}, resources = (offer(50))#'Offer'.resources},
+    RequestBytes = byte_size(mesos_pb:encode_msg(Request)),
+    OfferId = #'OfferID'{value = "20150924-000000-16777343-5050-1234-O123456"},
+    OfferIdBytes = byte_size(mesos_pb:encode_msg(OfferId)),
+
+    [begin
+        Requests = lists:duplicate(Count, Request),
+        OfferIds = lists:duplicate(Count, OfferId),
+        bench("nif_requestResources_", request_50_resources, Count, RequestBytes * Count,
+              fun() -> {ok, driver_running} = nif_scheduler:requestResources(Handle, Requests) end, MinMillis),
+        bench("nif_declineOffers_", offer_id, Count, OfferIdBytes * Count,
+              fun() -> nif_scheduler:declineOffers(Handle, OfferIds) end, MinMillis)
+     end || Count <- [1, 10, 100, 1000, 10000]],
+
+    nif_scheduler:stop(Handle, 0),
+    nif_scheduler:destroy(Handle),
+    flush().
+
+bench(Prefix, Name, Items, Bytes, Fun, MinMillis) ->
+    Fun(),
+    bench(Prefix, Name, Items, Bytes, Fun, MinMillis, 1).
+
+bench(Prefix, Name, Items, Bytes, Fun, MinMillis, Iterations) ->
+    {Micros, ok} = timer:tc(fun() -> repeat(Fun, Iterations) end),
+    case Micros >= MinMillis * 1000 of
+        true ->
+            NsPerItem = Micros * 1000 / (Iterations * Items),
+            io:format("~s~s,~p,~p,~p,~.1f,~n", [Prefix, Name, Items, Bytes, Iterations, NsPerItem]);
+        false ->
+            bench(Prefix, Name, Items, Bytes, Fun, MinMillis, Iterations * 2)
+    end.
+
+repeat(_, 0) -> ok;
+repeat(Fun, N) -> Fun(), repeat(Fun, N - 1).
+
+% the fake driver's registration and offers
+flush() ->
+    receive _ -> flush()
+    after 0 -> ok
+    end.
+
+% an offer from a slave with many custom resources, one in ten a set of port ranges
+offer(Resources) ->
+    #'Offer'{id = #'OfferID'{value = "20150924-000000-16777343-5050-1234-O123456"},
+             framework_id = #'FrameworkID'{value = "20150924-000000-16777343-5050-1234-0000"},
+             slave_id = #'SlaveID'{value = "20150924-000000-16777343-5050-1234-S42"},
+             hostname = "slave-42.rack-7.example.com",
+             resources = [resource(I) || I <- lists:seq(0, Resources - 1)],
+             attributes = [#'Attribute'{name = "attribute-" ++ integer_to_list(I), type = 'TEXT',
+                                        text = #'Value.Text'{value = "value-" ++ integer_to_list(I)}}
+                           || I <- lists:seq(0, 4)],
+             executor_ids = []}.
+
+resource(I) when I rem 10 =:= 0 ->
+    #'Resource'{name = "ports", type = 'RANGES', role = "*",
+                ranges = #'Value.Ranges'{range = [#'Value.Range'{'begin' = 31000 + J * 100, 'end' = 31049 + J * 100}
+                                                  || J <- lists:seq(0, 9)]}};
+resource(I) ->
+    scalar("resource-" ++ integer_to_list(I), I * 1.5).
+
+scalar(Name, Value) ->
+    #'Resource'{name = Name, type = 'SCALAR', scalar = #'Value.Scalar'{value = Value}, role = "*"}.
+
+task_info(DataSize) ->
+    #'TaskInfo'{name = "task-with-data",
+                task_id = #'TaskID'{value = "task-0123456789"},
+                slave_id = #'SlaveID'{value = "20150924-000000-16777343-5050-1234-S42"},
+                resources = [scalar("cpus", 0.5), scalar("mem", 512.0)],
+                command = #'CommandInfo'{value = "./run-task --with --some --arguments"},
+                data = binary:copy(<<"d">>, DataSize)}.
+
+task_status() ->
+    #'TaskStatus'{task_id = #'TaskID'{value = "task-0123456789"},
+                  state = 'TASK_RUNNING',
+                  slave_id = #'SlaveID'{value = "20150924-000000-16777343-5050-1234-S42"}}.
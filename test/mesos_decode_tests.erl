@@ -0,0 +1,65 @@
+-module (mesos_decode_tests).
+-include_lib("eunit/include/eunit.hrl").
+-include ("mesos_pb.hrl").
+-include ("mesos_erlang.hrl").
+
+-export ([bench/1]).
+
+% the nif decoder must produce exactly what mesos_pb does
+
+native_offer_record_matches_gpb_test() ->
+    Bin = mesos_pb:encode_msg(offer()),
+    {ok, Offer} = nif_scheduler:decode(Bin, 'Offer', record),
+    ?assertEqual(mesos_pb:decode_msg(Bin, 'Offer'), Offer).
+
+native_task_status_record_matches_gpb_test() ->
+    Bin = mesos_pb:encode_msg(task_status()),
+    {ok, TaskStatus} = nif_scheduler:decode(Bin, 'TaskStatus', record),
+    ?assertEqual(mesos_pb:decode_msg(Bin, 'TaskStatus'), TaskStatus).
+
+native_binary_format_returns_binary_test() ->
+    Bin = mesos_pb:encode_msg(offer()),
+    ?assertEqual({ok, Bin}, nif_scheduler:decode(Bin, 'Offer', binary)).
+
+native_decode_rejects_unknown_type_test() ->
+    Bin = mesos_pb:encode_msg(offer()),
+    ?assertMatch({error, _}, nif_scheduler:decode(Bin, 'NotAMesosType', record)).
+
+% times decoding N offers and task statuses with mesos_pb and the nif
+bench(N) ->
+    [bench(Name, Bin, Type, N) || {Name, Bin, Type} <- [{offer, mesos_pb:encode_msg(offer()), 'Offer'},
+                                                         {task_status, mesos_pb:encode_msg(task_status()), 'TaskStatus'}]],
+    ok.
+
+bench(Name, Bin, Type, N) ->
+    Gpb = time(fun() -> mesos_pb:decode_msg(Bin, Type) end, N),
+    Record = time(fun() -> {ok, _} = nif_scheduler:decode(Bin, Type, record) end, N),
+    io:format("~p x ~p (~p bytes): mesos_pb ~p us, nif record ~p us~n", [Name, N, byte_size(Bin), Gpb, Record]).
+
+time(Fun, N) ->
+    {Micros, ok} = timer:tc(fun() -> repeat(Fun, N) end),
+    Micros.
+
+repeat(_, 0) -> ok;
+repeat(Fun, N) -> Fun(), repeat(Fun, N - 1).
+
+offer() ->
+    #'Offer'{id = #'OfferID'{value = "offer-1"},
+             framework_id = #'FrameworkID'{value = "framework-1"},
+             slave_id = #'SlaveID'{value = "slave-1"},
+             hostname = "host.example.com",
+             resources = [#'Resource'{name = "cpus", type = 'SCALAR', scalar = #'Value.Scalar'{value = 4.0}, role = "*"},
+                          #'Resource'{name = "mem", type = 'SCALAR', scalar = #'Value.Scalar'{value = 2048.0}, role = "*"},
+                          #'Resource'{name = "ports", type = 'RANGES', role = "*",
+                                      ranges = #'Value.Ranges'{range = [#'Value.Range'{'begin' = 31000, 'end' = 32000}]}}],
+             attributes = [#'Attribute'{name = "rack", type = 'TEXT', text = #'Value.Text'{value = "r1"}}],
+             executor_ids = []}.
+
+task_status() ->
+    #'TaskStatus'{task_id = #'TaskID'{value = "task-1"},
+                  state = 'TASK_RUNNING',
+                  message = "running",
+                  source = 'SOURCE_EXECUTOR',
+                  slave_id = #'SlaveID'{value = "slave-1"},
+                  timestamp = 1444900000.5,
+                  uuid = <<1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16>>}.
@@ -0,0 +1,563 @@
+-module (mesos_fake_driver_tests).
+-include_lib("eunit/include/eunit.hrl").
+-include ("mesos_pb.hrl").
+-include ("mesos_erlang.hrl").
+
+-behaviour (scheduler).
+
+-export ([bench/1]).
+
+-export ([init/1, registered/3, reregistered/2, disconnected/1, resourceOffers/2, offerRescinded/2,
+          statusUpdate/2, statusUpdate/3, frameworkMessage/4, slaveLost/2, executorLost/4, error/2]).
+
+% these tests run the scheduler against the fake driver in the nif, so need no mesos master.
+% This module is the scheduler's handler, its state is {TestPid, OfferAction}, an action
+% of {hold, OfferAction} first holds the handler in registered, see held_start/3
+-define (FAKE_MASTER, "fake://?offer_rate=2000&offers_per_cycle=10&max_outstanding=100").
+
+declined_offers_are_recorded_by_the_fake_driver_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), ?FAKE_MASTER, true, decline}),
+
+    wait_for(offer, 50),
+    Stats = scheduler:fakeDriverStats(),
+    ?assert(proplists:get_value(declined, Stats) >= 50),
+    ?assertEqual(0, proplists:get_value(invalid_offers, Stats)),
+
+    stop().
+
+launched_tasks_are_sent_status_updates_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), ?FAKE_MASTER, true, launch}),
+
+    wait_for({status, 'TASK_RUNNING'}, 10),
+    wait_for({status, 'TASK_FINISHED'}, 10),
+    ?assert(proplists:get_value(launched, scheduler:fakeDriverStats()) >= 10),
+
+    stop().
+
+explicit_acknowledgements_reach_the_fake_driver_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), ?FAKE_MASTER, false, launch}),
+
+    wait_for(acked, 20),
+    ?assert(proplists:get_value(acknowledged, scheduler:fakeDriverStats()) >= 20),
+
+    stop().
+
+unanswered_offers_are_made_again_once_revived_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0&offers_per_cycle=5", true, keep}),
+
+    wait_for(offer, 5),
+    timer:sleep(50),
+    ?assertEqual(5, proplists:get_value(offered, scheduler:fakeDriverStats())),
+
+    {ok, driver_running} = scheduler:reviveOffers(),
+    wait_for(offer, 5),
+    ?assertEqual(10, proplists:get_value(offered, scheduler:fakeDriverStats())),
+
+    stop().
+
+% long enough that the nif converts it over many time slices
+long_lists_are_sent_to_the_driver_in_one_call_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0", true, keep}),
+
+    Status = #'TaskStatus'{task_id = #'TaskID'{value = "task-1"}, state = 'TASK_RUNNING',
+                           slave_id = #'SlaveID'{value = "slave-1"}},
+    {ok, driver_running} = scheduler:reconcileTasks(lists:duplicate(100000, Status)),
+    ?assertEqual(1, proplists:get_value(reconciled, scheduler:fakeDriverStats())),
+
+    Task = #'TaskInfo'{name = "task", task_id = #'TaskID'{value = "task-1"},
+                       slave_id = #'SlaveID'{value = "slave-1"}, resources = []},
+    ?assertMatch({error, _}, scheduler:launchTasks(#'OfferID'{value = "offer-1"},
+                                                   lists:duplicate(10000, Task) ++ [not_a_task])),
+    ?assertEqual(0, proplists:get_value(launched, scheduler:fakeDriverStats())),
+
+    stop().
+
+framework_messages_are_binaries_both_ways_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0&message_rate=100&message_size=4096", true, keep}),
+
+    Message = receive {message, M} -> M after 5000 -> erlang:error(timeout) end,
+    ?assertEqual(4096, byte_size(Message)),
+
+    ExecutorId = #'ExecutorID'{value = "executor-1"},
+    SlaveId = #'SlaveID'{value = "slave-1"},
+    {ok, driver_running} = scheduler:sendFrameworkMessage(ExecutorId, SlaveId, binary:copy(<<0, 255>>, 64 * 1024)),
+    {ok, driver_running} = scheduler:sendFrameworkMessage(ExecutorId, SlaveId, [<<"header">>, $:, "body"]),
+    ?assertEqual(2, proplists:get_value(messages_received, scheduler:fakeDriverStats())),
+
+    stop().
+
+% the fake executor sends every frame back, so the messages are unpacked again
+framed_messages_arrive_unpacked_and_in_order_test() ->
+    Channel = [{flush_millis, 5}, {compress, true}, {compress_min, 64}],
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0&echo_messages=1", true, keep},
+                              [{message_channel, Channel}]),
+
+    ExecutorId = #'ExecutorID'{value = "executor-1"},
+    SlaveId = #'SlaveID'{value = "slave-1"},
+    Messages = [list_to_binary(lists:duplicate(I, $m)) || I <- lists:seq(1, 200)],
+    [{ok, driver_running} = scheduler:sendFrameworkMessage(ExecutorId, SlaveId, M) || M <- Messages],
+
+    ?assertEqual(Messages, [receive {message, M} -> M after 5000 -> erlang:error(timeout) end || _ <- Messages]),
+
+    Stats = scheduler:messageChannelStats(),
+    [{{<<"executor-1">>, <<"slave-1">>}, Destination}] = proplists:get_value(destinations, Stats),
+    Frames = proplists:get_value(frames, Destination),
+    ?assertEqual(200, proplists:get_value(messages, Destination)),
+    ?assert(Frames < 200),
+    ?assert(proplists:get_value(wire_bytes, Destination) < proplists:get_value(bytes, Destination)),
+    ?assertEqual(Frames, proplists:get_value(frames_received, Stats)),
+    ?assertEqual(Frames, proplists:get_value(messages_received, scheduler:fakeDriverStats())),
+
+    stop().
+
+% the echoes make the executors known to the nif, so all reaches them again
+broadcast_framework_messages_reach_every_executor_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0&echo_messages=1", true, keep}),
+
+    Targets = [{#'ExecutorID'{value = "executor-" ++ integer_to_list(I)}, #'SlaveID'{value = "slave-1"}}
+               || I <- lists:seq(1, 3)],
+    {ok, _} = scheduler:broadcastFrameworkMessage(Targets, [<<"to">>, $:, "each"]),
+    wait_for({message, <<"to:each">>}, 3),
+
+    {ok, _} = scheduler:broadcastFrameworkMessage(all, <<"to-all">>),
+    wait_for({message, <<"to-all">>}, 3),
+    ?assertEqual(6, proplists:get_value(messages_received, scheduler:fakeDriverStats())),
+
+    ?assertMatch({error, _}, scheduler:broadcastFrameworkMessage([not_a_target], <<"data">>)),
+
+    stop().
+
+broadcast_framework_messages_go_through_the_channel_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0&echo_messages=1", true, keep},
+                              [{message_channel, [{flush_millis, 5}]}]),
+
+    Targets = [{#'ExecutorID'{value = "executor-" ++ integer_to_list(I)}, #'SlaveID'{value = "slave-1"}}
+               || I <- lists:seq(1, 3)],
+    {ok, _} = scheduler:broadcastFrameworkMessage(Targets, <<"framed">>),
+    wait_for({message, <<"framed">>}, 3),
+    ?assertEqual(3, length(proplists:get_value(destinations, scheduler:messageChannelStats()))),
+
+    stop().
+
+join_async_answers_once_the_driver_stops_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0", true, keep}),
+
+    {ok, Ref} = scheduler:joinAsync(),
+    ?assertEqual(nothing, receive {Ref, _} -> joined after 50 -> nothing end),
+    {ok, driver_stopped} = scheduler:stop(0),
+    ?assertEqual({error, driver_stopped}, receive {Ref, Result} -> Result after 5000 -> erlang:error(timeout) end),
+
+    ok = scheduler:destroy(),
+    flush().
+
+% destroy aborts the driver and waits for the join, which must not hold it off
+destroy_ends_a_pending_join_async_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0", true, keep}),
+
+    {ok, Ref} = scheduler:joinAsync(),
+    ok = scheduler:destroy(),
+    ?assertEqual({error, driver_aborted}, receive {Ref, Result} -> Result after 5000 -> erlang:error(timeout) end),
+    flush().
+
+% <<255>> is a truncated varint, which no message decodes from
+bulk_calls_answer_each_item_in_order_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0&offers_per_cycle=2", true, keep}),
+
+    wait_for(offer, 2),
+    Corrupt = <<255>>,
+    ?assertEqual([{ok, driver_running}, {error, driver_aborted}, {ok, driver_running}],
+                 scheduler:declineOffers([#'OfferID'{value = "fake-offer-0"}, Corrupt,
+                                          mesos_pb:encode_msg(#'OfferID'{value = "fake-offer-1"})])),
+    ?assertEqual([{ok, driver_running}, {error, driver_aborted}],
+                 scheduler:killTasks([#'TaskID'{value = "task-1"}, Corrupt])),
+    Status = #'TaskStatus'{task_id = #'TaskID'{value = "task-1"}, state = 'TASK_RUNNING', uuid = <<"uuid-1">>},
+    ?assertEqual([{error, driver_aborted}, {ok, driver_running}, {ok, driver_running}],
+                 scheduler:acknowledgeStatusUpdates([Corrupt, Status, Status])),
+
+    Stats = scheduler:fakeDriverStats(),
+    ?assertEqual(2, proplists:get_value(declined, Stats)),
+    ?assertEqual(0, proplists:get_value(outstanding, Stats)),
+    ?assertEqual(0, proplists:get_value(invalid_offers, Stats)),
+    ?assertEqual(1, proplists:get_value(killed, Stats)),
+    ?assertEqual(2, proplists:get_value(acknowledged, Stats)),
+
+    stop().
+
+% undefined is answered in its place, so the results line up with the acks
+ack_many_answers_each_ack_in_order_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0&offers_per_cycle=2&finish_tasks=0", false, collect_acks}),
+
+    [Ack1, Ack2] = [receive {ack, Ack} -> Ack after 5000 -> erlang:error(timeout) end || _ <- [1, 2]],
+    ?assertEqual([{ok, driver_running}, {ok, driver_running}, {ok, driver_running}],
+                 scheduler:ack_many([Ack1, undefined, Ack2])),
+    ?assertEqual(2, proplists:get_value(acknowledged, scheduler:fakeDriverStats())),
+
+    {ok, driver_stopped} = scheduler:stop(0),
+    ?assertEqual([{error, driver_stopped}, {ok, driver_running}, {error, driver_stopped}],
+                 scheduler:ack_many([Ack1, undefined, Ack2])),
+
+    ok = scheduler:destroy(),
+    flush().
+
+% the offers are all made before the first decline starts the command queue
+queued_declines_of_one_slave_are_merged_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0&offers_per_cycle=20&slaves=1", true, decline_async},
+                              [{batch_offers, true}]),
+
+    wait_for({offers, 20}, 1),
+    Stats = wait_for_stat(fun scheduler:fakeDriverStats/0, outstanding, 0),
+    ?assertEqual(0, proplists:get_value(invalid_offers, Stats)),
+    ?assert(proplists:get_value(accepted, Stats) >= 1),
+    ?assert(proplists:get_value(accepted, Stats) + proplists:get_value(declined, Stats) < 20),
+
+    stop().
+
+% the fake driver's offers have 8192 mem and one attribute, attribute-0 of value-0
+offers_failing_the_filter_are_declined_in_the_nif_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0&offers_per_cycle=5&attributes=1", true, keep},
+                              [{offer_filter, #offer_filter{min_mem = 16384}}]),
+
+    wait_for_stat(fun scheduler:offerFilterStats/0, declined_mem, 5),
+    wait_for_stat(fun scheduler:fakeDriverStats/0, declined, 5),
+    ?assertEqual(nothing, receive offer -> offer after 0 -> nothing end),
+
+    ok = scheduler:setOfferFilter(#offer_filter{min_cpus = 2, attributes = [{"attribute-0", "value-0"}]}),
+    {ok, driver_running} = scheduler:reviveOffers(),
+    wait_for(offer, 5),
+    Stats = scheduler:offerFilterStats(),
+    ?assertEqual(5, proplists:get_value(passed, Stats)),
+    ?assertEqual(5, proplists:get_value(declined, Stats)),
+
+    ok = scheduler:setOfferFilter(#offer_filter{attributes = ["attribute-1"]}),
+    {ok, driver_running} = scheduler:reviveOffers(),
+    wait_for_stat(fun scheduler:offerFilterStats/0, declined_attributes, 5),
+    ?assertEqual(nothing, receive offer -> offer after 0 -> nothing end),
+
+    stop().
+
+% offer N of the fake driver is fake-offer-N, from fake-host-(N rem slaves) with 4 cpus
+held_offers_are_found_in_the_index_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0&offers_per_cycle=6&slaves=3", true, keep},
+                              [{offer_index, true}]),
+
+    wait_for(offer, 6),
+    ?assertMatch({ok, [_, _, _, _, _, _]}, scheduler:findOffers([{cpus, 2}, {mem, 1024}])),
+    ?assertMatch({ok, []}, scheduler:findOffers([{cpus, 8}])),
+    ?assertMatch({ok, [_, _]}, scheduler:findOffers([{limit, 2}])),
+    {ok, Distinct} = scheduler:findOffers([distinct_hosts]),
+    ?assertEqual(["fake-host-0", "fake-host-1", "fake-host-2"],
+                 lists:sort([Host || #'Offer'{hostname = Host} <- Distinct])),
+
+    {ok, OnHost} = scheduler:findOffers([{hostname, "fake-host-0"}]),
+    ?assertEqual(["fake-offer-0", "fake-offer-3"], lists:sort([Id || #'Offer'{id = #'OfferID'{value = Id}} <- OnHost])),
+
+    {ok, driver_running} = scheduler:declineOffer(#'OfferID'{value = "fake-offer-0"}),
+    ?assertMatch({ok, [#'Offer'{id = #'OfferID'{value = "fake-offer-3"}}]},
+                 scheduler:findOffers([{hostname, "fake-host-0"}])),
+
+    stop().
+
+% a TASK_RUNNING still held when its TASK_FINISHED arrives is replaced by it
+coalesced_status_updates_deliver_the_latest_state_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0&offers_per_cycle=10", true, launch},
+                              [{coalesce_status_updates, true}]),
+
+    wait_for({status, 'TASK_FINISHED'}, 10),
+    Stats = wait_for_stat(fun scheduler:taskStats/0, held, 0),
+    Superseded = proplists:get_value(superseded, Stats),
+    ?assertEqual(20, proplists:get_value(delivered, Stats) + Superseded),
+    ?assertEqual(10 - Superseded, count({status, 'TASK_RUNNING'})),
+    ?assertMatch({ok, {'TASK_FINISHED', _, "fake-slave-0", _}}, scheduler:taskState(#'TaskID'{value = "fake-offer-0"})),
+
+    stop().
+
+duplicate_status_updates_are_dropped_in_the_nif_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0&offers_per_cycle=10&duplicate_updates=1", false, launch}),
+
+    wait_for({status, 'TASK_FINISHED'}, 10),
+    Stats = wait_for_stat(fun scheduler:taskStats/0, duplicates, 20),
+    ?assertEqual(20, proplists:get_value(delivered, Stats)),
+    ?assertEqual(10, count({status, 'TASK_RUNNING'})),
+    ?assertEqual(40, proplists:get_value(status_updates, scheduler:fakeDriverStats())),
+
+    stop().
+
+% the fake driver answers the reconciliation of a task it never launched with TASK_LOST
+reconciled_tasks_are_sent_in_pages_until_confirmed_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0", true, keep},
+                              [{reconcile, [{page_size, 10}, {rate, 1000}]}]),
+
+    ok = scheduler:reconcile(unknown_tasks(25)),
+    wait_for({status, 'TASK_LOST'}, 25),
+    % a page is counted once the driver call for it returns
+    Stats = wait_for_stat(fun scheduler:reconcileStats/0, pages, 3),
+    ?assertEqual(25, proplists:get_value(sent, Stats)),
+    ?assertEqual(25, proplists:get_value(confirmed, Stats)),
+    ?assertEqual(0, proplists:get_value(retried, Stats)),
+    ?assertEqual(0, proplists:get_value(outstanding, Stats)),
+    ?assertEqual(3, proplists:get_value(reconciled, scheduler:fakeDriverStats())),
+
+    ok = scheduler:reconcile([]),
+    wait_for_stat(fun scheduler:reconcileStats/0, implicit, 1),
+    ?assertEqual(4, proplists:get_value(reconciled, scheduler:fakeDriverStats())),
+
+    stop().
+
+% sent at 0, 10 and 30 ms and given up on at 70 ms, or later on a loaded host
+unanswered_reconciliation_backs_off_and_gives_up_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0&answer_reconciliation=0", true, keep},
+                              [{reconcile, [{page_size, 10}, {rate, 1000}, {backoff, 0.01},
+                                            {max_backoff, 0.02}, {max_attempts, 3}]}]),
+
+    ok = scheduler:reconcile(unknown_tasks(25)),
+    Stats = wait_for_stat(fun scheduler:reconcileStats/0, outstanding, 0),
+    ?assertEqual(75, proplists:get_value(sent, Stats)),
+    ?assertEqual(50, proplists:get_value(retried, Stats)),
+    ?assertEqual(25, proplists:get_value(abandoned, Stats)),
+    ?assertEqual(0, proplists:get_value(confirmed, Stats)),
+    ?assertEqual(0, proplists:get_value(outstanding, Stats)),
+    ?assertEqual(proplists:get_value(pages, Stats), proplists:get_value(reconciled, scheduler:fakeDriverStats())),
+
+    stop().
+
+% offers, the launches they lead to and the status updates are spread over the workers
+callbacks_are_routed_to_workers_by_id_test() ->
+    {ok, _} = scheduler:start(?MODULE, {self(), ?FAKE_MASTER, true, launch}, [{workers, 4}]),
+
+    wait_for({status, 'TASK_FINISHED'}, 20),
+    [{workers, 4}, {routed, Routed}] = scheduler:dispatchStats(),
+    ?assertEqual(4, length(Routed)),
+    ?assert(length([N || N <- Routed, N > 0]) > 1),
+    ?assert(lists:sum(Routed) >= 40),
+
+    stop().
+
+% the scheduler traps the exit of a worker that fails and stops with the driver
+failed_worker_stops_the_scheduler_test() ->
+    {ok, Pid} = scheduler:start(?MODULE, {self(), "fake://?offer_rate=0", true, keep}, [{workers, 2}]),
+    Ref = monitor(process, Pid),
+
+    {instance, _, _, Pid, [Worker, _]} = gen_server:call(Pid, instance),
+    exit(Worker, kill),
+    receive {'DOWN', Ref, process, Pid, killed} -> ok after 5000 -> erlang:error(timeout) end,
+    ?assertEqual(undefined, whereis(scheduler)),
+    ?assertEqual({error, scheduler_not_inited}, scheduler:fakeDriverStats()),
+
+    flush().
+
+% the handler holds on to the credit of registered, so one cycle of offers
+% meets flow control with none left
+queued_offers_past_max_queue_are_declined_test() ->
+    held_start("fake://?offer_rate=0&offers_per_cycle=5", keep,
+               [{flow_control, [{window, 1}, {max_queue, 3}, {offers, queue}]}]),
+
+    wait_for(offer, 3),
+    % handing back a credit per message handled leaves the window full again
+    Stats = wait_for_stat(fun scheduler:flowControlStats/0, credits, 1),
+    ?assertEqual(3, proplists:get_value(queued, Stats)),
+    ?assertEqual(2, proplists:get_value(declined, Stats)),
+    ?assertEqual(0, proplists:get_value(depth, Stats)),
+    wait_for_stat(fun scheduler:fakeDriverStats/0, declined, 2),
+    ?assertEqual(nothing, receive offer -> offer after 0 -> nothing end),
+
+    stop().
+
+offers_without_credit_are_declined_test() ->
+    held_start("fake://?offer_rate=0&offers_per_cycle=5", keep,
+               [{flow_control, [{window, 1}, {offers, decline}, {refuse_seconds, 30}]}]),
+
+    wait_for_stat(fun scheduler:flowControlStats/0, declined, 5),
+    wait_for_stat(fun scheduler:fakeDriverStats/0, declined, 5),
+    ?assertEqual(nothing, receive offer -> offer after 0 -> nothing end),
+
+    stop().
+
+% without batch_offers the coalesced offers still arrive one at a time
+coalesced_offers_are_bounded_by_max_queue_test() ->
+    held_start("fake://?offer_rate=0&offers_per_cycle=5", keep,
+               [{flow_control, [{window, 1}, {max_queue, 3}, {offers, coalesce}]}]),
+
+    wait_for(offer, 3),
+    Stats = wait_for_stat(fun scheduler:flowControlStats/0, credits, 1),
+    ?assertEqual(1, proplists:get_value(queued, Stats)),
+    ?assertEqual(3, proplists:get_value(coalesced, Stats)),
+    ?assertEqual(2, proplists:get_value(declined, Stats)),
+    wait_for_stat(fun scheduler:fakeDriverStats/0, declined, 2),
+    ?assertEqual(nothing, receive offer -> offer after 0 -> nothing end),
+
+    stop().
+
+coalesced_batches_of_offers_arrive_as_one_test() ->
+    held_start("fake://?offer_rate=1000&offers_per_cycle=5&max_outstanding=20", keep,
+               [{batch_offers, true}, {flow_control, [{window, 1}, {offers, coalesce}]}]),
+
+    wait_for({offers, 20}, 1),
+    ?assertEqual(20, proplists:get_value(coalesced, scheduler:flowControlStats())),
+
+    stop().
+
+framework_messages_past_max_queue_are_dropped_test() ->
+    held_start("fake://?offer_rate=0&message_rate=1000", keep,
+               [{flow_control, [{window, 1}, {max_queue, 0}, {framework_messages, drop}]}]),
+
+    ?assert(proplists:get_value(dropped, scheduler:flowControlStats()) > 0),
+
+    stop().
+
+invalid_fake_master_fails_init_test() ->
+    ?assertMatch({error, _}, scheduler:start(?MODULE, {self(), "fake://?no_such_key=1", true, decline})).
+
+invalid_options_fail_init_test() ->
+    Args = {self(), ?FAKE_MASTER, true, decline},
+    ?assertEqual({error, {invalid_option, {flow_control, [{window, 0}]}}},
+                 scheduler:start(?MODULE, Args, [{flow_control, [{window, 0}]}])),
+    ?assertEqual({error, {invalid_option, {offer_filter, not_a_filter}}},
+                 scheduler:start(?MODULE, Args, [{offer_filter, not_a_filter}])),
+    ?assertEqual({error, {invalid_option, {message_formats, [{offer, json}]}}},
+                 scheduler:start(?MODULE, Args, [{message_formats, [{offer, json}]}])),
+    ?assertEqual(undefined, whereis(scheduler)).
+
+% runs the scheduler for N offers, each declined as it is handled, and prints
+% the offers handled a second and the latency of the callback and the handler.
+% The histograms are shared by every scheduler in the vm, so run it in a fresh one
+bench(N) ->
+    Master = "fake://?offer_rate=1000000&offers_per_cycle=100&max_outstanding=10000",
+    {Micros, ok} = timer:tc(fun() ->
+                                {ok, _} = scheduler:start(?MODULE, {self(), Master, true, decline}, [{handler_stats, true}]),
+                                wait_for(offer, N)
+                            end),
+    Stats = scheduler:stats(),
+    stop(),
+
+    io:format("~p offers in ~p ms, ~p offers/sec~n", [N, Micros div 1000, N * 1000000 div max(1, Micros)]),
+    [io:format("~p: p50 ~p us, p99 ~p us~n", [Name, proplists:get_value(p50, Values), proplists:get_value(p99, Values)])
+        || {Name, Values} <- Stats, lists:member(Name, [scheduler_callback_resourceOffers,
+                                                          scheduler_handle_resourceOffers,
+                                                          scheduler_declineOffer])],
+    ok.
+
+% starts the scheduler with its handler blocked in registered, the callbacks
+% of the next 100 ms see no credit, then lets it go on with Action
+held_start(Master, Action, Options) ->
+    {ok, _} = scheduler:start(?MODULE, {self(), Master, true, {hold, Action}}, Options),
+    Scheduler = receive {holding, Pid} -> Pid after 5000 -> erlang:error(timeout) end,
+    timer:sleep(100),
+    Scheduler ! release,
+    ok.
+
+unknown_tasks(N) ->
+    [#'TaskStatus'{task_id = #'TaskID'{value = "task-" ++ integer_to_list(I)}, state = 'TASK_RUNNING'}
+        || I <- lists:seq(1, N)].
+
+stop() ->
+    {ok, driver_stopped} = scheduler:stop(0),
+    ok = scheduler:destroy(),
+    flush().
+
+wait_for(_, 0) -> ok;
+wait_for(Message, N) ->
+    receive
+        Message -> wait_for(Message, N - 1)
+    after 5000 ->
+        erlang:error({timeout, Message, N})
+    end.
+
+% the number of Message in the mailbox
+count(Message) ->
+    receive Message -> 1 + count(Message)
+    after 0 -> 0
+    end.
+
+% polls Stats, a stats function, until Key is Value and returns the stats it
+% last read, for counts kept by the nif's threads which may not be there yet
+wait_for_stat(Stats, Key, Value) ->
+    wait_for_stat(Stats, Key, Value, 1000).
+
+wait_for_stat(Stats, Key, Value, 0) ->
+    erlang:error({timeout, Key, Value, proplists:get_value(Key, Stats())});
+wait_for_stat(Stats, Key, Value, Polls) ->
+    Current = Stats(),
+    case proplists:get_value(Key, Current) of
+        Value -> Current;
+        _ ->
+            timer:sleep(5),
+            wait_for_stat(Stats, Key, Value, Polls - 1)
+    end.
+
+flush() ->
+    receive _ -> flush()
+    after 0 -> ok
+    end.
+
+% scheduler callbacks
+
+init({Parent, Master, ImplicitAcknowledgements, Action}) ->
+    {#'FrameworkInfo'{user = "", name = "Erlang Fake Driver Tests"}, Master, ImplicitAcknowledgements, {Parent, Action}}.
+
+registered(_FrameworkID, _MasterInfo, {Parent, {hold, Action}}) ->
+    Parent ! {holding, self()},
+    receive release -> ok end,
+    {ok, {Parent, Action}};
+registered(_FrameworkID, _MasterInfo, State) ->
+    {ok, State}.
+
+reregistered(_MasterInfo, State) ->
+    {ok, State}.
+
+disconnected(State) ->
+    {ok, State}.
+
+resourceOffers(Offers, {Parent, decline_async} = State) when is_list(Offers) ->
+    [{ok, _} = scheduler:declineOfferAsync(OfferId) || #'Offer'{id = OfferId} <- Offers],
+    Parent ! {offers, length(Offers)},
+    {ok, State};
+resourceOffers(Offers, {Parent, _} = State) when is_list(Offers) ->
+    Parent ! {offers, length(Offers)},
+    {ok, State};
+resourceOffers(#'Offer'{id = OfferId}, {Parent, decline} = State) ->
+    {ok, driver_running} = scheduler:declineOffer(OfferId),
+    Parent ! offer,
+    {ok, State};
+resourceOffers(#'Offer'{id = OfferId, slave_id = SlaveId}, {Parent, Action} = State) when Action =:= launch;
+                                                                                     Action =:= collect_acks ->
+    Task = #'TaskInfo'{name = "fake-task",
+                       task_id = #'TaskID'{value = OfferId#'OfferID'.value},
+                       slave_id = SlaveId,
+                       resources = []},
+    {ok, driver_running} = scheduler:launchTasks(OfferId, [Task]),
+    Parent ! offer,
+    {ok, State};
+resourceOffers(_Offer, {Parent, keep} = State) ->
+    Parent ! offer,
+    {ok, State}.
+
+offerRescinded(_OfferId, State) ->
+    {ok, State}.
+
+statusUpdate(#'TaskStatus'{state = TaskState}, {Parent, _} = State) ->
+    Parent ! {status, TaskState},
+    {ok, State}.
+
+% collect_acks leaves the acknowledgements to the test
+statusUpdate(#'TaskStatus'{state = TaskState}, Ack, {Parent, collect_acks} = State) ->
+    Parent ! {ack, Ack},
+    Parent ! {status, TaskState},
+    {ok, State};
+statusUpdate(#'TaskStatus'{state = TaskState}, Ack, {Parent, _} = State) ->
+    {ok, driver_running} = scheduler:ack(Ack),
+    Parent ! acked,
+    Parent ! {status, TaskState},
+    {ok, State}.
+
+frameworkMessage(_ExecutorId, _SlaveId, Message, {Parent, _} = State) when is_binary(Message) ->
+    Parent ! {message, Message},
+    {ok, State}.
+
+slaveLost(_SlaveId, State) ->
+    {ok, State}.
+
+executorLost(_ExecutorId, _SlaveId, _Status, State) ->
+    {ok, State}.
+
+error(_Message, State) ->
+    {ok, State}.
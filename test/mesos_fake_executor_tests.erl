@@ -0,0 +1,82 @@
+-module (mesos_fake_executor_tests).
+-include_lib("eunit/include/eunit.hrl").
+-include ("mesos_pb.hrl").
+
+-behaviour (executor).
+
+-export ([init/1, registered/4, reregistered/2, disconnected/1, launchTask/2, killTask/2,
+          frameworkMessage/2, shutdown/1, error/2]).
+
+% these tests run the executor against the fake driver in the nif, so need no slave.
+-define (FAKE_DRIVER, "fake://?launch_rate=0").
+
+status_updates_are_sent_in_one_call_test() ->
+    {ok, _} = executor:start(?MODULE, self(), [{driver, ?FAKE_DRIVER}]),
+
+    Updates = [status("task-" ++ integer_to_list(I), 'TASK_RUNNING') || I <- lists:seq(1, 100)],
+    ?assertEqual(lists:duplicate(100, {ok, driver_running}), executor:sendStatusUpdates(Updates)),
+    ?assertEqual(100, proplists:get_value(status_updates, executor:fakeDriverStats())),
+    ?assertMatch({error, _}, executor:sendStatusUpdates([not_a_status])),
+
+    stop().
+
+% the window is long enough that only terminal updates and destroy send anything
+superseded_updates_are_not_sent_test() ->
+    {ok, _} = executor:start(?MODULE, self(), [{driver, ?FAKE_DRIVER}, {status_update_window, 60000}]),
+
+    [{ok, driver_running}, {ok, driver_running}, {ok, driver_running}] =
+        executor:sendStatusUpdates([status("task-1", 'TASK_STARTING'),
+                                    status("task-1", 'TASK_RUNNING'),
+                                    status("task-2", 'TASK_RUNNING')]),
+    ?assertEqual(0, proplists:get_value(status_updates, executor:fakeDriverStats())),
+
+    {ok, driver_running} = executor:sendStatusUpdate(status("task-1", 'TASK_FINISHED')),
+    ?assertEqual(1, proplists:get_value(status_updates, executor:fakeDriverStats())),
+
+    Stats = executor:statusUpdateStats(),
+    ?assertEqual(2, proplists:get_value(superseded, Stats)),
+    ?assertEqual(1, proplists:get_value(terminal, Stats)),
+    ?assertEqual(1, proplists:get_value(pending, Stats)),
+
+    stop().
+
+invalid_options_fail_init_test() ->
+    ?assertEqual({error, {invalid_option, {flow_control, [{offers, sometimes}]}}},
+                 executor:start(?MODULE, self(), [{driver, ?FAKE_DRIVER}, {flow_control, [{offers, sometimes}]}])),
+    ?assertEqual(undefined, whereis(executor)).
+
+stop() ->
+    executor:stop(),
+    ok = executor:destroy().
+
+status(TaskId, State) ->
+    #'TaskStatus'{task_id = #'TaskID'{value = TaskId}, state = State}.
+
+% executor callbacks
+
+init(Parent) ->
+    {ok, Parent}.
+
+registered(_ExecutorInfo, _FrameworkInfo, _SlaveInfo, State) ->
+    {ok, State}.
+
+reregistered(_SlaveInfo, State) ->
+    {ok, State}.
+
+disconnected(State) ->
+    {ok, State}.
+
+launchTask(_TaskInfo, State) ->
+    {ok, State}.
+
+killTask(_TaskId, State) ->
+    {ok, State}.
+
+frameworkMessage(_Message, State) ->
+    {ok, State}.
+
+shutdown(State) ->
+    {ok, State}.
+
+error(_Message, State) ->
+    {ok, State}.
@@ -82,3 +82,28 @@ crash_in_scheduler_closes_nif_connections_gracefully_test()->
     ok = scheduler:destroy(),
     
     meck:unload(test_framework).
+
+two_schedulers_can_share_a_node_test()->
+
+    meck:new(test_framework, [non_strict]), 
+
+    FrameworkInfo = #'FrameworkInfo'{user="", name="Erlang Test Framework"},
+
+    meck:expect(test_framework, init , fun(_) -> { FrameworkInfo, ?MASTER_LOCATION, []} end),
+    meck:expect(test_framework, registered , fun(_FrameworkID, _MasterInfo, State) -> {ok,State} end),
+    meck:expect(test_framework, resourceOffers , fun(_Offer, State) -> {ok,State} end),
+
+    {ok, _} = scheduler:start_link( test_framework, ?MASTER_LOCATION, [{name, scheduler_one}]),
+    {ok, Two} = scheduler:start_link( test_framework, ?MASTER_LOCATION, [{name, undefined}]),
+
+    ok = scheduler:attach(scheduler_one),
+    {ok, driver_stopped} = scheduler:stop(0),
+    ok = scheduler:destroy(),
+    undefined = whereis(scheduler_one),
+
+    ok = scheduler:attach(Two),
+    {ok, driver_stopped} = scheduler:stop(0),
+    ok = scheduler:destroy(),
+    ok = scheduler:detach(),
+
+    meck:unload(test_framework).